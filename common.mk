@@ -57,10 +57,10 @@ $(BIN):$(LINK_OBJ)
 
 ifeq ($(BUILD_SO), true)
 # gcc -o generates a shared object (.so) file
-	$(CC) -fPIC -shared -o $@.so $^
+	$(CC) -fPIC -shared -o $@.so $^ $(LDLIBS)
 else
 # gcc -o generates an executable file
-	$(CC) -o $@ $^
+	$(CC) -o $@ $^ $(LDLIBS)
 endif
 
 #----------------------------------------------------------------1end-------------------
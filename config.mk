@@ -2,9 +2,12 @@ export BUILD_ROOT = $(shell pwd)
 
 export INCLUDE_PATH = $(BUILD_ROOT)/include
 
-BUILD_DIR = $(BUILD_ROOT)/mitsubishi_cnc_m70_ezsocket_net/
+BUILD_DIR = $(BUILD_ROOT)/mitsubishi_cnc_m70_ezsocket_net/ $(BUILD_ROOT)/tools/
 
 export DEBUG = true
 
 export BUILD_SO = false 
 
+# Worker threads of the fleet poller
+export LDLIBS = -lpthread
+
@@ -10,8 +10,14 @@
 #include <errno.h>
 #endif
 
-// Last error information
-static m70_error_info_t g_last_error = {0};
+#ifdef _MSC_VER
+#define M70_THREAD_LOCAL __declspec(thread)
+#else
+#define M70_THREAD_LOCAL __thread
+#endif
+
+// Last error information, one per thread so concurrent connections do not overwrite each other
+static M70_THREAD_LOCAL m70_error_info_t g_last_error = {0};
 
 // Error code description table
 static const struct {
@@ -77,8 +83,16 @@ const m70_error_info_t* m70_error_get_last(void) {
     return &g_last_error;
 }
 
-// Set error information
-void m70_error_set(m70_error_code_ex_e code, const char* file, int line, const char* func, const char* message, ...) {
+// Get last error information of a connection
+const m70_error_info_t* m70_error_get_conn_last(const m70_conn_t* conn) {
+    return conn ? &conn->last_error : NULL;
+}
+
+// Fill the calling thread's error information
+static void error_record(m70_error_code_ex_e code, const char* file, int line, const char* func, const char* message, va_list args) {
+    // Read before anything else can change it
+    int system_error_code = get_system_error_code();
+
     // Clear previous error information
     memset(&g_last_error, 0, sizeof(m70_error_info_t));
     
@@ -86,7 +100,7 @@ void m70_error_set(m70_error_code_ex_e code, const char* file, int line, const c
     g_last_error.error_code = code;
     
     // Set system error code
-    g_last_error.system_error_code = get_system_error_code();
+    g_last_error.system_error_code = system_error_code;
     
     // Set file name, line number and function name
     if (file) {
@@ -99,12 +113,11 @@ void m70_error_set(m70_error_code_ex_e code, const char* file, int line, const c
     
     // Format error message
     if (message) {
-        va_list args;
-        va_start(args, message);
         vsnprintf(g_last_error.message, sizeof(g_last_error.message) - 1, message, args);
-        va_end(args);
     }
-    
+}
+
+static void error_log_last(void) {
     // Log error message
     m70_log_error("[ERROR] %s (Code: %d, SysCode: %d) at %s:%d in %s()", 
                  g_last_error.message, 
@@ -115,6 +128,27 @@ void m70_error_set(m70_error_code_ex_e code, const char* file, int line, const c
                  g_last_error.function);
 }
 
+// Set error information
+void m70_error_set(m70_error_code_ex_e code, const char* file, int line, const char* func, const char* message, ...) {
+    va_list args;
+    va_start(args, message);
+    error_record(code, file, line, func, message, args);
+    va_end(args);
+    error_log_last();
+}
+
+// Set error information and keep a copy on the connection
+void m70_error_set_conn(m70_conn_t* conn, m70_error_code_ex_e code, const char* file, int line, const char* func, const char* message, ...) {
+    va_list args;
+    va_start(args, message);
+    error_record(code, file, line, func, message, args);
+    va_end(args);
+    if (conn) {
+        conn->last_error = g_last_error;
+    }
+    error_log_last();
+}
+
 // Get description information corresponding to error code
 const char* m70_error_get_description(m70_error_code_ex_e code) {
     for (size_t i = 0; i < sizeof(g_error_descriptions) / sizeof(g_error_descriptions[0]); i++) {
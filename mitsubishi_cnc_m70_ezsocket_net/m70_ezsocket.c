@@ -3,6 +3,8 @@
 #include "m70_ezsocket_private.h"
 #include "m70_error.h"
 #include "m70_log.h"
+#include "m70_subscribe.h"
+#include "m70_stats.h"
 
 #include "socket.h"
 #include <string.h>
@@ -32,6 +34,10 @@ bool m70_cnc_connect(const char* ip_addr, int port, m70_nc_type_e type, m70_conn
 		return false;
 	}
 
+	// Connecting again starts from scratch, subscriptions and statistics of the previous session
+	// are released
+	m70_unsubscribe_all(conn);
+	m70_stats_disable(conn);
 	memset((void*)conn, 0, sizeof(m70_conn_t));
 	bool result = giop_connect(ip_addr, type, port, conn);
 	
@@ -39,17 +45,39 @@ bool m70_cnc_connect(const char* ip_addr, int port, m70_nc_type_e type, m70_conn
 		M70_LOG_INFO("Successfully connected to CNC device: %s:%d, Socket=%d", ip_addr, port, conn->socket);
 	} else {
 		M70_LOG_ERROR("Failed to connect to CNC device: %s:%d", ip_addr, port);
-		M70_ERROR_SET(M70_ERROR_CODE_EX_CONN_FAILED, "Failed to connect to CNC device: %s:%d", ip_addr, port);
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CONN_FAILED, "Failed to connect to CNC device: %s:%d", ip_addr, port);
 	}
 	
 	return result;
 }
 
+bool m70_cnc_reconnect(const char* ip_addr, int port, m70_nc_type_e type, m70_conn_t* conn)
+{
+	if (ip_addr == NULL || port <= 0 || conn == NULL) {
+		M70_ERROR_SET(M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid connection parameters: IP=%s, Port=%d",
+				  ip_addr ? ip_addr : "NULL", port);
+		return false;
+	}
+
+	// Settings, subscriptions and statistics stay, giop_connect resets only the protocol state
+	M70_LOG_INFO("Reconnecting to CNC device: %s:%d", ip_addr, port);
+	bool result = giop_connect(ip_addr, type, port, conn);
+	if (!result)
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CONN_FAILED, "Failed to reconnect to CNC device: %s:%d", ip_addr, port);
+	return result;
+}
+
 void m70_cnc_disconnect(m70_conn_t* conn)
 {
+	// Subscriptions and statistics go away with the connection, even one that already dropped
+	if (conn != NULL) {
+		m70_unsubscribe_all(conn);
+		m70_stats_disable(conn);
+	}
+
 	if (!check_conn_is_valid(conn)) {
 		M70_LOG_WARNING("Attempting to disconnect an invalid connection");
-		M70_ERROR_SET(M70_ERROR_CODE_EX_CONN_INVALID, "Attempting to disconnect an invalid connection");
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CONN_INVALID, "Attempting to disconnect an invalid connection");
 		return;
 	}
 
@@ -58,13 +86,123 @@ void m70_cnc_disconnect(m70_conn_t* conn)
 	M70_LOG_DEBUG("CNC device connection has been disconnected");
 }
 
+void m70_cnc_set_pipeline_depth(m70_conn_t* conn, int depth)
+{
+	if (conn == NULL)
+		return;
+
+	if (depth < 1)
+		depth = 1;
+	if (depth > M70_MAX_PIPELINE_DEPTH)
+		depth = M70_MAX_PIPELINE_DEPTH;
+	conn->pipeline_depth = depth;
+	M70_LOG_DEBUG("Pipeline depth set to %d", depth);
+}
+
+void m70_cnc_invalidate_metadata(m70_conn_t* conn)
+{
+	if (conn == NULL)
+		return;
+
+	memset((void*)&conn->meta, 0, sizeof(conn->meta));
+	M70_LOG_DEBUG("Machine metadata cache cleared");
+}
+
+void m70_cnc_set_override_method_ttl(m70_conn_t* conn, uint32 ttl_ms)
+{
+	if (conn == NULL)
+		return;
+
+	conn->override_method.ttl_ms = ttl_ms > 0 ? ttl_ms : M70_DEFAULT_OVERRIDE_METHOD_TTL;
+	memset((void*)conn->override_method.read_tick, 0, sizeof(conn->override_method.read_tick));
+	M70_LOG_DEBUG("Override method revalidation interval set to %u ms", conn->override_method.ttl_ms);
+}
+
+m70_error_code_e m70_cnc_read_batch(m70_conn_t* conn, m70_batch_item_t* items, int count)
+{
+	m70_error_code_e ret = M70_ERROR_CODE_FAILED;
+	if (!check_conn_is_valid(conn) || items == NULL || count <= 0)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid batch read parameters");
+		return ret;
+	}
+	int i = 0;
+	for (i = 0; i < count; i++)
+	{
+		// A string slot has no size of its own, the reply would be copied without a bound
+		if (items[i].data_type == T_STR && items[i].value_size <= 0)
+		{
+			M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Batch item %d reads a string without value_size", i);
+			return ret;
+		}
+	}
+
+	M70_LOG_DEBUG("Reading batch of %d items", count);
+
+	// Each chunk is encoded into one buffer and written with a single send
+	mel_request_t requests[M70_MAX_PIPELINE_DEPTH];
+	int failed = 0;
+	int offset = 0;
+	for (offset = 0; offset < count; offset += M70_MAX_PIPELINE_DEPTH)
+	{
+		int chunk = count - offset;
+		if (chunk > M70_MAX_PIPELINE_DEPTH)
+			chunk = M70_MAX_PIPELINE_DEPTH;
+
+		memset((void*)requests, 0, sizeof(requests));
+		for (i = 0; i < chunk; i++)
+		{
+			m70_batch_item_t* item = &items[offset + i];
+			requests[i].op = MEL_OP_GET_DATA;
+			requests[i].section = item->section;
+			requests[i].sub_section = item->sub_section;
+			requests[i].system_no = item->system_no;
+			requests[i].axis_flag = item->axis_flag;
+			requests[i].data_type = item->data_type;
+			requests[i].out = item->value;
+			requests[i].out_size = item->value_size;
+		}
+
+		long code = melPipelineRequests(conn, requests, chunk, chunk);
+		for (i = 0; i < chunk; i++)
+		{
+			m70_batch_item_t* item = &items[offset + i];
+			if (requests[i].code == 0)
+			{
+				item->data_type = requests[i].data_type;
+				item->result = M70_ERROR_CODE_OK;
+			}
+			else
+			{
+				item->result = code == -1 ? M70_ERROR_CODE_SOCKET_FAILED : M70_ERROR_CODE_FAILED;
+				failed++;
+			}
+		}
+
+		if (code == -1)
+		{
+			for (i = offset + chunk; i < count; i++)
+				items[i].result = M70_ERROR_CODE_SOCKET_FAILED;
+			M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CONN_CLOSED, "Connection lost during batch read");
+			return M70_ERROR_CODE_SOCKET_FAILED;
+		}
+	}
+
+	if (failed == 0)
+		ret = M70_ERROR_CODE_OK;
+	else
+		M70_LOG_WARNING("Batch read finished with %d of %d items failed", failed, count);
+
+	return ret;
+}
+
 m70_error_code_e m70_cnc_read_status(m70_conn_t* conn, short system_no, m70_device_status_e* status, m70_run_mode_e* mode, m70_run_status_e* run_status)
 {
 	M70_LOG_DEBUG("Reading CNC status, System No: %d", system_no);
 	
 	m70_error_code_e ret = M70_ERROR_CODE_FAILED;
 	if (!check_conn_is_valid(conn)) {
-		M70_ERROR_SET(M70_ERROR_CODE_EX_CONN_INVALID, "Invalid connection");
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CONN_INVALID, "Invalid connection");
 		M70_LOG_ERROR("Failed to read CNC status: Invalid connection");
 		return ret;
 	}
@@ -78,29 +216,20 @@ m70_error_code_e m70_cnc_read_status(m70_conn_t* conn, short system_no, m70_devi
 	if (0 == melGetData(conn, 35, 11, system_no, 0, &data_type, &temp_mode))
 	{
 		*mode = (m70_run_mode_e)temp_mode;
-		*status = IDLE;
 		M70_LOG_DEBUG("CNC running mode: %d", temp_mode);
-		
+
+		// The automatic operation flag only matters in memory and DNC operation
+		bool auto_running = false;
 		if (temp_mode == MEM || temp_mode == DNC)
 		{
 			long auto_status = 0;
 			data_type = T_DLONG;
 			if (0 == melGetData(conn, 35, 20, system_no, 0, &data_type, &auto_status))
-			{
-				if (auto_status == 1) {
-					*status = RUN;
-					M70_LOG_DEBUG("CNC device status: Running");
-				}
-			}
+				auto_running = auto_status == 1;
 			else {
 				M70_LOG_WARNING("Failed to get automatic status");
 			}
 		}
-		else if (temp_mode >= LNK && temp_mode <= LIN)
-		{
-			*status = DEBUG;
-			M70_LOG_DEBUG("CNC device status: Debugging");
-		}
 
 		short temp_status = 0;
 		data_type = T_SHORT;
@@ -108,28 +237,46 @@ m70_error_code_e m70_cnc_read_status(m70_conn_t* conn, short system_no, m70_devi
 		{
 			*run_status = (m70_run_status_e)temp_status;
 			M70_LOG_DEBUG("CNC running status: %d", temp_status);
-			
-			if (temp_status == EMG) {
-				*status = STOP;
-				M70_LOG_WARNING("CNC device is in emergency stop state");
-			}
 		}
 		else {
 			M70_LOG_WARNING("Failed to get running status");
 		}
 
+		*status = m70_cnc_decode_status(*mode, auto_running, *run_status);
+		if (*status == STOP)
+			M70_LOG_WARNING("CNC device is in emergency stop state");
+
 		ret = M70_ERROR_CODE_OK;
 		M70_LOG_INFO("Successfully read CNC status: system_no=%d, status=%d, mode=%d, run_status=%d", 
 				 system_no, *status, *mode, *run_status);
 	}
 	else {
-		M70_ERROR_SET(M70_ERROR_CODE_EX_CNC_NOT_READY, "Failed to read CNC mode");
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_NOT_READY, "Failed to read CNC mode");
 		M70_LOG_ERROR("Failed to read CNC status: Unable to get running mode");
 	}
 
 	return ret;
 }
 
+// Device status from the running mode (35/11), automatic operation flag (35/20) and run status (35/10)
+m70_device_status_e m70_cnc_decode_status(m70_run_mode_e mode, bool auto_running, m70_run_status_e run_status)
+{
+	m70_device_status_e status = IDLE;
+	if (mode == MEM || mode == DNC)
+	{
+		if (auto_running)
+			status = RUN;
+	}
+	else if (mode >= LNK && mode <= LIN)
+	{
+		status = DEBUG;
+	}
+
+	if (run_status == EMG)
+		status = STOP;
+	return status;
+}
+
 m70_error_code_e m70_cnc_read_counter(m70_conn_t* conn, short system_no, uint32* counter)
 {
 	m70_error_code_e ret = M70_ERROR_CODE_FAILED;
@@ -150,11 +297,20 @@ static m70_error_code_e read_data_count(m70_conn_t* conn, uint32* count, int par
 	if (!check_conn_is_valid(conn))
 		return ret;
 
+	uint32 flag = M70_META_DATA_COUNT << param;
+	if (conn->meta.valid & flag)
+	{
+		*count = conn->meta.data_count[param];
+		return M70_ERROR_CODE_OK;
+	}
+
 	byte axis_count = 0;
 	m70_data_type_e data_type = T_CHAR;
 	if (0 == melGetData(conn, 2, param, 0, 0, &data_type, &axis_count))
 	{
 		*count = (short)axis_count;
+		conn->meta.data_count[param] = *count;
+		conn->meta.valid |= flag;
 		ret = M70_ERROR_CODE_OK;
 	}
 
@@ -192,6 +348,12 @@ m70_error_code_e m70_cnc_read_nc_type(m70_conn_t* conn, m70_nc_machine_type_e* t
 	if (!check_conn_is_valid(conn))
 		return ret;
 
+	if (conn->meta.valid & M70_META_MACHINE_TYPE)
+	{
+		*type = conn->meta.machine_type;
+		return M70_ERROR_CODE_OK;
+	}
+
 	*type = MACHINE_TYPE_MC;
 	byte temp = 0;
 	m70_data_type_e data_type = T_CHAR;
@@ -200,60 +362,64 @@ m70_error_code_e m70_cnc_read_nc_type(m70_conn_t* conn, m70_nc_machine_type_e* t
 		if (1 == (short)temp)
 			*type = MACHINE_TYPE_Lathe;
 
+		conn->meta.machine_type = *type;
+		conn->meta.valid |= M70_META_MACHINE_TYPE;
 		ret = M70_ERROR_CODE_OK;
 	}
 
 	return ret;
 }
 
-m70_error_code_e m70_cnc_read_nc_version(m70_conn_t* conn, char* version)
+// Reads a version string once per connection and serves it from the metadata cache afterwards
+static m70_error_code_e read_cached_version(m70_conn_t* conn, int section, int sub_section, uint32 flag, char* cache, char* version)
 {
 	m70_error_code_e ret = M70_ERROR_CODE_FAILED;
 	if (!check_conn_is_valid(conn) || version == NULL)
 		return ret;
 
+	if (conn->meta.valid & flag)
+	{
+		strcpy(version, cache);
+		return M70_ERROR_CODE_OK;
+	}
+
 	T_string data = { 0 };
 	m70_data_type_e data_type = T_STR;
-	if (0 == melGetData(conn, 67, 1, 0, 0, &data_type, &data))
+	if (0 == melGetData(conn, section, sub_section, 0, 0, &data_type, &data))
 	{
-		strncpy(version, data.text, data.msg_length);
+		// The whole text is kept, callers see what an uncached read returns
+		int length = data.msg_length;
+		if (length < 0 || length > (int)sizeof(data.text))
+			length = sizeof(data.text);
+		memset(cache, 0, M70_META_VERSION_SIZE);
+		strncpy(cache, data.text, length);
+		conn->meta.valid |= flag;
+		strcpy(version, cache);
 		ret = M70_ERROR_CODE_OK;
 	}
 
 	return ret;
 }
 
-m70_error_code_e m70_cnc_read_nc_name_version(m70_conn_t* conn, char* version)
+m70_error_code_e m70_cnc_read_nc_version(m70_conn_t* conn, char* version)
 {
-	m70_error_code_e ret = M70_ERROR_CODE_FAILED;
-	if (!check_conn_is_valid(conn) || version == NULL)
-		return ret;
+	if (conn == NULL)
+		return M70_ERROR_CODE_FAILED;
+	return read_cached_version(conn, 67, 1, M70_META_NC_VERSION, conn->meta.nc_version, version);
+}
 
-	T_string data = { 0 };
-	m70_data_type_e data_type = T_STR;
-	if (0 == melGetData(conn, 68, 1, 0, 0, &data_type, &data))
-	{
-		strncpy(version, data.text, data.msg_length);
-		ret = M70_ERROR_CODE_OK;
-	}
-	return ret;
+m70_error_code_e m70_cnc_read_nc_name_version(m70_conn_t* conn, char* version)
+{
+	if (conn == NULL)
+		return M70_ERROR_CODE_FAILED;
+	return read_cached_version(conn, 68, 1, M70_META_NC_NAME_VERSION, conn->meta.nc_name_version, version);
 }
 
 m70_error_code_e m70_cnc_read_plc_version(m70_conn_t* conn, char* version)
 {
-	m70_error_code_e ret = M70_ERROR_CODE_FAILED;
-	if (!check_conn_is_valid(conn) || version == NULL)
-		return ret;
-
-	T_string data = { 0 };
-	m70_data_type_e data_type = T_STR;
-	if (0 == melGetData(conn, 67, 2, 0, 0, &data_type, &data))
-	{
-		strncpy(version, data.text, data.msg_length);
-		ret = M70_ERROR_CODE_OK;
-	}
-
-	return ret;
+	if (conn == NULL)
+		return M70_ERROR_CODE_FAILED;
+	return read_cached_version(conn, 67, 2, M70_META_PLC_VERSION, conn->meta.plc_version, version);
 }
 
 m70_error_code_e m70_cnc_read_main_program_name(m70_conn_t* conn, short system_no, program_name_type_e type, char* prog)
@@ -476,13 +642,9 @@ m70_error_code_e m70_cnc_read_svo_load(m70_conn_t* conn, short system_no, short*
 	return ret;
 }
 
-m70_error_code_e m70_cnc_read_axis_position(m70_conn_t* conn, short system_no, double* pos, uint32 axis_index, position_type_e type)
+// Sub-section of section 37 holding the given position counter
+int get_position_sub_section(position_type_e type)
 {
-	m70_error_code_e ret = M70_ERROR_CODE_FAILED;
-	if (!check_conn_is_valid(conn))
-		return ret;
-
-	*pos = 0.0;
 	int pos_type = 2;
 	switch (type)
 	{
@@ -511,7 +673,17 @@ m70_error_code_e m70_cnc_read_axis_position(m70_conn_t* conn, short system_no, d
 		pos_type = 2;
 		break;
 	}
+	return pos_type;
+}
+
+m70_error_code_e m70_cnc_read_axis_position(m70_conn_t* conn, short system_no, double* pos, uint32 axis_index, position_type_e type)
+{
+	m70_error_code_e ret = M70_ERROR_CODE_FAILED;
+	if (!check_conn_is_valid(conn))
+		return ret;
 
+	*pos = 0.0;
+	int pos_type = get_position_sub_section(type);
 	uint32 axis_flag = get_axis_real_no(axis_index);
 	get_data_value data = { 0 };
 	m70_data_type_e data_type = T_FLOATBIN;
@@ -527,18 +699,65 @@ m70_error_code_e m70_cnc_read_axis_position(m70_conn_t* conn, short system_no, d
 	return ret;
 }
 
+// Axis bit mask covering axes 1..axis_count
+static uint32 get_axis_mask(int axis_count)
+{
+	uint32 mask = 0;
+	int i = 0;
+	for (i = 1; i <= axis_count; i++)
+		mask |= get_axis_real_no(i);
+	return mask;
+}
+
+// Multi-axis replies hold FLOATBIN records in axis order, or plain doubles
+static void decode_axis_records(const float_bin_data* records, m70_data_type_e data_type, double* pos, int count)
+{
+	int i = 0;
+	for (i = 0; i < count; i++)
+	{
+		if (data_type == T_FLOATBIN)
+			pos[i] = records[i].data;
+		else
+			pos[i] = ((const double*)records)[i];
+	}
+}
+
 m70_error_code_e m70_cnc_read_all_axis_position(m70_conn_t* conn, short system_no, double* pos, int* pos_count, position_type_e type)
 {
 	m70_error_code_e ret = M70_ERROR_CODE_FAILED;
 	if (!check_conn_is_valid(conn))
 		return ret;
 
-	byte data = 0;
-	m70_data_type_e data_type = T_CHAR;
-	if (0 == melGetData(conn, 2, 2, 0, 0, &data_type, &data))
+	uint32 data = 0;
+	if (M70_ERROR_CODE_OK == m70_cnc_read_nc_axis_count(conn, &data))
 	{
-		*pos_count = data;
 		int num = data;
+		if (num > M70_MAX_AXIS_COUNT)
+			num = M70_MAX_AXIS_COUNT;
+		*pos_count = num;
+		if (num == 1)
+			return m70_cnc_read_axis_position(conn, system_no, pos, 1, type);
+
+		// All axes in one request, the reply carries one FLOATBIN record per axis bit
+		float_bin_data records[M70_MAX_AXIS_COUNT];
+		mel_request_t request;
+		memset((void*)records, 0, sizeof(records));
+		memset((void*)&request, 0, sizeof(request));
+		request.op = MEL_OP_GET_DATA;
+		request.section = 37;
+		request.sub_section = get_position_sub_section(type);
+		request.system_no = system_no;
+		request.axis_flag = get_axis_mask(num);
+		request.data_type = T_FLOATBIN;
+		request.out = records;
+		request.out_size = sizeof(records);
+		if (0 == melPipelineRequests(conn, &request, 1, 1) && request.code == 0)
+		{
+			decode_axis_records(records, request.data_type, pos, num);
+			return M70_ERROR_CODE_OK;
+		}
+
+		M70_LOG_WARNING("Multi-axis position read failed, falling back to per-axis reads");
 		for (int i = 1; i <= num; i++)
 		{
 			double temp = 0;
@@ -557,26 +776,45 @@ m70_error_code_e m70_cnc_read_axis_name(m70_conn_t* conn, short system_no, char*
 	if (!check_conn_is_valid(conn))
 		return ret;
 
-	byte data = 0;
+	bool cacheable = system_no >= 1 && system_no <= M70_MAX_SYSTEM_COUNT;
+	uint32 flag = cacheable ? M70_META_AXIS_NAMES << (system_no - 1) : 0;
+	if (cacheable && (conn->meta.valid & flag))
+	{
+		*axis_count = conn->meta.axis_name_count[system_no - 1];
+		strcpy(names, conn->meta.axis_names[system_no - 1]);
+		return M70_ERROR_CODE_OK;
+	}
+
+	uint32 data = 0;
 	int i = 0;
 	m70_data_type_e data_type = T_CHAR;
-	if (0 == melGetData(conn, 2, 2, 0, 0, &data_type, &data))
+	if (M70_ERROR_CODE_OK == m70_cnc_read_nc_axis_count(conn, &data))
 	{
 		*axis_count = data;
 		size_t num = 0;
-		for (i = 1; i <= data; i++)
+		bool complete = true;
+		for (i = 1; i <= (int)data; i++)
 		{
 			T_string temp = { 0 };
 			data_type = T_STR;
-			melGetData(conn, 127, 1, system_no, get_axis_real_no(i), &data_type, &temp);
+			if (0 != melGetData(conn, 127, 1, system_no, get_axis_real_no(i), &data_type, &temp))
+				complete = false;
 			strcpy(names + num, temp.text);
 			num += strlen(temp.text);
-			if (i < data)
+			if (i < (int)data)
 			{
 				strcat(names + num, ",");
 				num++;
 			}
 		}
+
+		// A name that failed to read must not stick for the life of the connection
+		if (cacheable && complete && num < M70_META_TEXT_SIZE)
+		{
+			conn->meta.axis_name_count[system_no - 1] = *axis_count;
+			strcpy(conn->meta.axis_names[system_no - 1], names);
+			conn->meta.valid |= flag;
+		}
 		ret = M70_ERROR_CODE_OK;
 	}
 
@@ -602,6 +840,74 @@ m70_error_code_e m70_cnc_read_spindle_speed(m70_conn_t* conn, short system_no, u
 	return ret;
 }
 
+// Spindle override code bits (Y1888...) to percent
+static short decode_spindle_override_code(byte code)
+{
+	switch (code)
+	{
+	case 0x7:
+		return 50;
+	case 0x3:
+		return 60;
+	case 0x2:
+		return 70;
+	case 0x6:
+		return 80;
+	case 0x4:
+		return 90;
+	case 0x1:
+		return 110;
+	case 0x5:
+		return 120;
+	case 0x0:
+	default:
+		return 100;
+	}
+}
+
+// Cutting feed override code bits (YC60...) to percent
+static short decode_feed_override_code(byte code)
+{
+	return (0x0F - (short)(code & 0x0F)) * 10;
+}
+
+// Looks up a cached override setting method, false when it is missing or older than the TTL
+static bool get_cached_override_method(m70_conn_t* conn, int kind, short system_no, byte* method)
+{
+	if (system_no < 1 || system_no > M70_MAX_SYSTEM_COUNT)
+		return false;
+
+	uint64 tick = conn->override_method.read_tick[kind][system_no - 1];
+	if (tick == 0 || get_tick_count_ms() - tick >= conn->override_method.ttl_ms)
+		return false;
+
+	*method = conn->override_method.method[kind][system_no - 1];
+	return true;
+}
+
+static void set_cached_override_method(m70_conn_t* conn, int kind, short system_no, byte method)
+{
+	if (system_no < 1 || system_no > M70_MAX_SYSTEM_COUNT)
+		return;
+
+	conn->override_method.method[kind][system_no - 1] = method;
+	conn->override_method.read_tick[kind][system_no - 1] = get_tick_count_ms();
+}
+
+// Reads an override setting-method bit unless a fresh one is cached
+static bool read_override_method(m70_conn_t* conn, int kind, short system_no, int sub_section, byte* method)
+{
+	if (get_cached_override_method(conn, kind, system_no, method))
+		return true;
+
+	m70_data_type_e data_type = T_CHAR;
+	if (0 != melGetData(conn, 53, sub_section, 0, 0, &data_type, method))
+		return false;
+
+	set_cached_override_method(conn, kind, system_no, *method);
+	return true;
+}
+
 m70_error_code_e m70_cnc_read_spindle_override(m70_conn_t* conn, short system_no, short* spindle_override)
 {
 	m70_error_code_e ret = M70_ERROR_CODE_FAILED;
@@ -613,7 +919,7 @@ m70_error_code_e m70_cnc_read_spindle_override(m70_conn_t* conn, short system_no
 	int subSection = 16287 + 96 * (system_no - 1);
 	byte bType = 0;
 	m70_data_type_e data_type = T_CHAR;
-	if (0 == melGetData(conn, 53, subSection, 0, 0, &data_type, &bType)) // Y188F
+	if (read_override_method(conn, M70_OVERRIDE_SPINDLE, system_no, subSection, &bType)) // Y188F
 	{
 		if (bType == 0)
 		{
@@ -621,44 +927,17 @@ m70_error_code_e m70_cnc_read_spindle_override(m70_conn_t* conn, short system_no
 			// Y1888 SP11 主轴倍率 代码1 第1主轴 {(6个主轴） 相差 96} 第二轴 Y18E8
 			if (0 == melGetData(conn, 54, 16280 + 96 * (system_no - 1), 0, 0, &data_type, &bType)) // Y1888
 			{
-				switch (bType)
-				{
-				case 0x7:
-					temp = 50;
-					break;
-				case 0x3:
-					temp = 60;
-					break;
-				case 0x2:
-					temp = 70;
-					break;
-				case 0x6:
-					temp = 80;
-					break;
-				case 0x4:
-					temp = 90;
-					break;
-				case 0x1:
-					temp = 110;
-					break;
-				case 0x5:
-					temp = 120;
-					break;
-				case 0x0:
-				default:
-					temp = 100;
-					break;
-				}
+				temp = decode_spindle_override_code(bType);
 				ret = M70_ERROR_CODE_OK;
 			}
 		}
 		else
 		{ // R7008 S command override First spindle {(6 spindles) difference 50} Second axis R7058
-			short ret = 0;
+			short value = 0;
 			data_type = T_SHORT;
-			if (0 == melGetData(conn, 55, 107008 + 50 * (system_no - 1), 0, 0, &data_type, &ret)) // R7008
+			if (0 == melGetData(conn, 55, 107008 + 50 * (system_no - 1), 0, 0, &data_type, &value)) // R7008
 			{
-				temp = ret;
+				temp = value;
 				ret = M70_ERROR_CODE_OK;
 			}
 		}
@@ -747,7 +1026,7 @@ m70_error_code_e m70_cnc_read_feed_override(m70_conn_t* conn, short system_no, s
 	// YC67 Cutting feed override value setting method First system {(4 systems) difference 320} Second axis YDA7
 	byte bType = 0;
 	m70_data_type_e data_type = T_CHAR;
-	if (0 == melGetData(conn, 53, 13175 + 320 * (system_no - 1), 0, 0, &data_type, &bType)) // YC67
+	if (read_override_method(conn, M70_OVERRIDE_FEED, system_no, 13175 + 320 * (system_no - 1), &bType)) // YC67
 	{
 		if (bType == 0)
 		{
@@ -755,17 +1034,17 @@ m70_error_code_e m70_cnc_read_feed_override(m70_conn_t* conn, short system_no, s
 			// YC60 Cutting feed override code 1 First system {(4 systems) difference 320} Second axis YDA0
 			if (0 == melGetData(conn, 54, 13168 + 320 * (system_no - 1), 0, 0, &data_type, &bType)) // YC60
 			{
-				temp_override = (0x0F - (short)(bType & 0x0F)) * 10;
+				temp_override = decode_feed_override_code(bType);
 				ret = M70_ERROR_CODE_OK;
 			}
 		}
 		else
 		{ // R2500 第1切削进给倍率 第1系统 {(4个系统） 相差 200} 第二轴 R2700
-			short ret = 0;
+			short value = 0;
 			data_type = T_SHORT;
-			if (0 == melGetData(conn, 55, 102500 + 200 * (system_no - 1), 0, 0, &data_type, &ret)) // R2500
+			if (0 == melGetData(conn, 55, 102500 + 200 * (system_no - 1), 0, 0, &data_type, &value)) // R2500
 			{
-				temp_override = ret;
+				temp_override = value;
 				ret = M70_ERROR_CODE_OK;
 			}
 		}
@@ -913,6 +1192,167 @@ m70_error_code_e m70_cnc_read_system_datetime(m70_conn_t* conn, uint32* date, ui
 	return ret;
 }
 
+static int add_get_data_request(mel_request_t* requests, int* count, int section, int sub_section, int system_no, int axis_flag, m70_data_type_e data_type, void* out)
+{
+	int index = (*count)++;
+	memset((void*)&requests[index], 0, sizeof(mel_request_t));
+	requests[index].op = MEL_OP_GET_DATA;
+	requests[index].section = section;
+	requests[index].sub_section = sub_section;
+	requests[index].system_no = system_no;
+	requests[index].axis_flag = axis_flag;
+	requests[index].data_type = data_type;
+	requests[index].out = out;
+	return index;
+}
+
+m70_error_code_e m70_cnc_read_snapshot(m70_conn_t* conn, short system_no, position_type_e pos_type, m70_snapshot_t* snapshot)
+{
+	m70_error_code_e ret = M70_ERROR_CODE_FAILED;
+	if (!check_conn_is_valid(conn) || snapshot == NULL)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CONN_INVALID, "Invalid connection");
+		return ret;
+	}
+
+	memset((void*)snapshot, 0, sizeof(*snapshot));
+	snapshot->status = OFFLINE;
+
+	uint32 axis_count = 0;
+	if (M70_ERROR_CODE_OK != m70_cnc_read_nc_axis_count(conn, &axis_count))
+	{
+		M70_LOG_WARNING("Snapshot: failed to read axis count, positions skipped");
+		axis_count = 0;
+	}
+	if (axis_count > M70_MAX_AXIS_COUNT)
+		axis_count = M70_MAX_AXIS_COUNT;
+
+	short mode = 0;
+	short run_status = 0;
+	short tool_no = 0;
+	int64 auto_status = 0;
+	int64 sequence_no = 0;
+	int64 spindle_speed = 0;
+	int64 spindle_load = 0;
+	T_string program = { 0 };
+	byte sp_method = 0, sp_code = 0, feed_method = 0, feed_code = 0;
+	short sp_value = 0, feed_value = 0;
+	float_bin_data feed = { 0 };
+	float_bin_data positions[M70_MAX_AXIS_COUNT];
+	alarm_string alarm;
+	memset((void*)positions, 0, sizeof(positions));
+	memset((void*)&alarm, 0, sizeof(alarm));
+
+	mel_request_t requests[17];
+	int count = 0;
+	int i_mode = add_get_data_request(requests, &count, 35, 11, system_no, 0, T_SHORT, &mode);
+	int i_auto = add_get_data_request(requests, &count, 35, 20, system_no, 0, T_DLONG, &auto_status);
+	int i_run = add_get_data_request(requests, &count, 35, 10, system_no, 0, T_SHORT, &run_status);
+	int i_prog = add_get_data_request(requests, &count, 45, 101, system_no, 0, T_STR, &program);
+	requests[i_prog].out_size = sizeof(program);
+	int i_seq = add_get_data_request(requests, &count, 45, 102, system_no, 0, T_DLONG, &sequence_no);
+	int i_tool = add_get_data_request(requests, &count, 55, 100536, system_no, 0, T_SHORT, &tool_no);
+	// With a fresh cached setting method only the selected override device is read,
+	// otherwise the method bit and both devices go out and the bit picks the one to use
+	int i_sp_method = -1, i_sp_code = -1, i_sp_value = -1;
+	bool sp_cached = get_cached_override_method(conn, M70_OVERRIDE_SPINDLE, system_no, &sp_method);
+	if (!sp_cached)
+		i_sp_method = add_get_data_request(requests, &count, 53, 16287 + 96 * (system_no - 1), 0, 0, T_CHAR, &sp_method); // Y188F
+	if (!sp_cached || sp_method == 0)
+		i_sp_code = add_get_data_request(requests, &count, 54, 16280 + 96 * (system_no - 1), 0, 0, T_UCHAR, &sp_code); // Y1888
+	if (!sp_cached || sp_method != 0)
+		i_sp_value = add_get_data_request(requests, &count, 55, 107008 + 50 * (system_no - 1), 0, 0, T_SHORT, &sp_value); // R7008
+	int i_feed_method = -1, i_feed_code = -1, i_feed_value = -1;
+	bool feed_cached = get_cached_override_method(conn, M70_OVERRIDE_FEED, system_no, &feed_method);
+	if (!feed_cached)
+		i_feed_method = add_get_data_request(requests, &count, 53, 13175 + 320 * (system_no - 1), 0, 0, T_CHAR, &feed_method); // YC67
+	if (!feed_cached || feed_method == 0)
+		i_feed_code = add_get_data_request(requests, &count, 54, 13168 + 320 * (system_no - 1), 0, 0, T_CHAR, &feed_code); // YC60
+	if (!feed_cached || feed_method != 0)
+		i_feed_value = add_get_data_request(requests, &count, 55, 102500 + 200 * (system_no - 1), 0, 0, T_SHORT, &feed_value); // R2500
+	int i_feed = add_get_data_request(requests, &count, 33, 1, system_no, 0, T_FLOATBIN, &feed);
+	int i_sp_speed = add_get_data_request(requests, &count, 34, 1, system_no, get_axis_real_no(1), T_DLONG, &spindle_speed);
+	int i_sp_load = add_get_data_request(requests, &count, 63, 4, system_no, get_axis_real_no(1), T_DLONG, &spindle_load);
+	int i_pos = -1;
+	if (axis_count > 0)
+	{
+		i_pos = add_get_data_request(requests, &count, 37, get_position_sub_section(pos_type), system_no, get_axis_mask(axis_count), T_FLOATBIN, positions);
+		requests[i_pos].out_size = sizeof(positions);
+	}
+
+	int i_alarm = count++;
+	memset((void*)&requests[i_alarm], 0, sizeof(mel_request_t));
+	requests[i_alarm].op = MEL_OP_GET_ALARM_MSG;
+	requests[i_alarm].system_no = system_no;
+	requests[i_alarm].count = 1;
+	requests[i_alarm].msg_type = M_ALM_ALL_ALARM;
+	requests[i_alarm].out = &alarm;
+	requests[i_alarm].out_size = sizeof(alarm);
+
+	uint64 start = get_current_time_ms();
+	long code = melPipelineRequests(conn, requests, count, count);
+	snapshot->timestamp = get_current_time_ms();
+	snapshot->sample_time_ms = (uint32)(snapshot->timestamp - start);
+	if (code != 0 || requests[i_mode].code != 0)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_NOT_READY, "Failed to read CNC snapshot");
+		M70_LOG_ERROR("Failed to read CNC snapshot: Unable to get running mode");
+		return code == -1 ? M70_ERROR_CODE_SOCKET_FAILED : ret;
+	}
+
+	snapshot->mode = (m70_run_mode_e)mode;
+	if (requests[i_run].code == 0)
+		snapshot->run_status = (m70_run_status_e)run_status;
+	snapshot->status = m70_cnc_decode_status(snapshot->mode, requests[i_auto].code == 0 && auto_status == 1, snapshot->run_status);
+
+	if (requests[i_prog].code == 0)
+	{
+		int length = program.msg_length;
+		if (length < 0 || length >= (int)sizeof(snapshot->program_no))
+			length = sizeof(snapshot->program_no) - 1;
+		strncpy(snapshot->program_no, program.text, length);
+	}
+	if (requests[i_seq].code == 0)
+		snapshot->sequence_no = (uint32)sequence_no;
+	if (requests[i_tool].code == 0)
+		snapshot->tool_no = tool_no;
+
+	if (i_sp_method >= 0 && requests[i_sp_method].code == 0)
+		set_cached_override_method(conn, M70_OVERRIDE_SPINDLE, system_no, sp_method);
+	if (sp_cached || requests[i_sp_method].code == 0)
+	{
+		if (sp_method == 0 && requests[i_sp_code].code == 0)
+			snapshot->spindle_override = decode_spindle_override_code(sp_code);
+		else if (sp_method != 0 && requests[i_sp_value].code == 0)
+			snapshot->spindle_override = sp_value;
+	}
+	if (i_feed_method >= 0 && requests[i_feed_method].code == 0)
+		set_cached_override_method(conn, M70_OVERRIDE_FEED, system_no, feed_method);
+	if (feed_cached || requests[i_feed_method].code == 0)
+	{
+		if (feed_method == 0 && requests[i_feed_code].code == 0)
+			snapshot->feed_override = decode_feed_override_code(feed_code);
+		else if (feed_method != 0 && requests[i_feed_value].code == 0)
+			snapshot->feed_override = feed_value;
+	}
+
+	if (requests[i_feed].code == 0)
+		snapshot->feed_speed = feed.data;
+	if (requests[i_sp_speed].code == 0)
+		snapshot->spindle_speed = (uint32)spindle_speed;
+	if (requests[i_sp_load].code == 0)
+		snapshot->spindle_load = (int32)spindle_load;
+
+	snapshot->axis_count = axis_count;
+	if (i_pos >= 0 && requests[i_pos].code == 0)
+		decode_axis_records(positions, requests[i_pos].data_type, snapshot->axis_position, axis_count);
+
+	if (requests[i_alarm].code == 0 && alarm.alarm_length > 0)
+		snapshot->alarm = true;
+
+	M70_LOG_DEBUG("Snapshot of system %d read with %d requests in %u ms", system_no, count, snapshot->sample_time_ms);
+	return M70_ERROR_CODE_OK;
+}
 
 uint32 get_axis_real_no(uint32 axis_index)
 {
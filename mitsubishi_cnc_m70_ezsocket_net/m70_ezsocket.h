@@ -3,11 +3,21 @@
 
 #include "typedef.h"
 
+// conn must be zeroed before its first connect. Connecting it again drops its subscriptions,
+// releases its statistics and resets every setting.
 bool m70_cnc_connect(const char* ip_addr, int port, m70_nc_type_e type, m70_conn_t* conn);
+// Opens a new socket for conn and keeps its settings, subscriptions and statistics
+bool m70_cnc_reconnect(const char* ip_addr, int port, m70_nc_type_e type, m70_conn_t* conn);
 void m70_cnc_disconnect(m70_conn_t* conn);
+void m70_cnc_set_pipeline_depth(m70_conn_t* conn, int depth);
+void m70_cnc_invalidate_metadata(m70_conn_t* conn);
+void m70_cnc_set_override_method_ttl(m70_conn_t* conn, uint32 ttl_ms);
 
 // read
+m70_error_code_e m70_cnc_read_batch(m70_conn_t* conn, m70_batch_item_t* items, int count);
+m70_error_code_e m70_cnc_read_snapshot(m70_conn_t* conn, short system_no, position_type_e pos_type, m70_snapshot_t* snapshot);
 m70_error_code_e m70_cnc_read_status(m70_conn_t* conn, short system_no, m70_device_status_e* status, m70_run_mode_e* mode, m70_run_status_e* run_status);
+m70_device_status_e m70_cnc_decode_status(m70_run_mode_e mode, bool auto_running, m70_run_status_e run_status);
 m70_error_code_e m70_cnc_read_counter(m70_conn_t* conn, short system_no, uint32* status);
 m70_error_code_e m70_cnc_read_system_count(m70_conn_t* conn, uint32* count);
 m70_error_code_e m70_cnc_read_nc_axis_count(m70_conn_t* conn, uint32* count);
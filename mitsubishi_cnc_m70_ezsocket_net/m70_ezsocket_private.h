@@ -3,6 +3,7 @@
 #include "typedef.h"
 
 uint32 get_axis_real_no(uint32 axis_index);
+int get_position_sub_section(position_type_e type);
 
 typedef enum tag_giop_msg_types
 {
@@ -0,0 +1,340 @@
+#include "m70_fleet.h"
+#include "m70_ezsocket.h"
+#include "m70_giop.h"
+#include "m70_thread.h"
+#include "m70_log.h"
+#include "m70_error.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define M70_FLEET_IDLE_WAIT 20 // Milliseconds an idle worker or the dispatcher sleeps between checks
+
+typedef struct m70_fleet_job
+{
+	m70_fleet_machine_t config;
+	m70_conn_t conn;
+	int home;		   // Worker whose deque receives this machine
+	bool busy;		   // Queued or being polled, guarded by fleet->state_lock
+	uint64 next_due;   // get_tick_count_ms of the next poll
+} m70_fleet_job_t;
+
+// Ring of machine indices; the owner takes the oldest, thieves take the newest
+typedef struct m70_fleet_deque
+{
+	m70_mutex_t lock;
+	int* items;
+	int capacity;
+	int head;
+	int count;
+} m70_fleet_deque_t;
+
+typedef struct m70_fleet_worker
+{
+	m70_fleet_t* fleet;
+	int index;
+	m70_thread_t thread;
+	m70_fleet_deque_t deque;
+} m70_fleet_worker_t;
+
+struct m70_fleet
+{
+	m70_fleet_job_t* jobs;
+	int job_count;
+	m70_fleet_worker_t* workers;
+	int worker_count;
+
+	m70_thread_t dispatcher;
+	bool running;
+	volatile int32 stop;
+
+	m70_mutex_t state_lock; // busy/next_due of every job
+	m70_mutex_t wake_lock;
+	m70_cond_t wake; // Signalled when jobs are queued
+
+	volatile int32 polls;
+	volatile int32 failures;
+	volatile int32 steals;
+};
+
+static void deque_push(m70_fleet_deque_t* deque, int item)
+{
+	m70_mutex_lock(&deque->lock);
+	deque->items[(deque->head + deque->count) % deque->capacity] = item;
+	deque->count++;
+	m70_mutex_unlock(&deque->lock);
+}
+
+static int deque_pop_oldest(m70_fleet_deque_t* deque)
+{
+	int item = -1;
+	m70_mutex_lock(&deque->lock);
+	if (deque->count > 0)
+	{
+		item = deque->items[deque->head];
+		deque->head = (deque->head + 1) % deque->capacity;
+		deque->count--;
+	}
+	m70_mutex_unlock(&deque->lock);
+	return item;
+}
+
+static int deque_steal_newest(m70_fleet_deque_t* deque)
+{
+	int item = -1;
+	m70_mutex_lock(&deque->lock);
+	if (deque->count > 0)
+	{
+		deque->count--;
+		item = deque->items[(deque->head + deque->count) % deque->capacity];
+	}
+	m70_mutex_unlock(&deque->lock);
+	return item;
+}
+
+static void fleet_poll_machine(m70_fleet_t* fleet, int index)
+{
+	m70_fleet_job_t* job = &fleet->jobs[index];
+	m70_fleet_machine_t* config = &job->config;
+	uint64 start = get_tick_count_ms();
+	m70_error_code_e result = M70_ERROR_CODE_SOCKET_FAILED;
+
+	if (!check_conn_is_valid(&job->conn))
+		m70_cnc_reconnect(config->ip, config->port, config->type, &job->conn);
+
+	if (check_conn_is_valid(&job->conn))
+	{
+		result = config->plan != NULL ? config->plan(&job->conn, config->user_data) : M70_ERROR_CODE_OK;
+		if (!check_conn_is_valid(&job->conn))
+			result = M70_ERROR_CODE_SOCKET_FAILED;
+	}
+
+	uint64 end = get_tick_count_ms();
+	m70_atomic_add(&fleet->polls, 1);
+	if (result != M70_ERROR_CODE_OK)
+		m70_atomic_add(&fleet->failures, 1);
+	if (config->on_complete != NULL)
+		config->on_complete(index, result, (uint32)(end - start), config->user_data);
+
+	// A lost connection is retried after the reconnect interval, not on the next tick
+	uint64 next_due = start + config->interval_ms;
+	if (result == M70_ERROR_CODE_SOCKET_FAILED)
+	{
+		if (job->conn.socket > 0)
+			giop_disconnect(&job->conn);
+		if (config->interval_ms < M70_FLEET_RECONNECT_INTERVAL)
+			next_due = end + M70_FLEET_RECONNECT_INTERVAL;
+	}
+
+	m70_mutex_lock(&fleet->state_lock);
+	job->next_due = next_due;
+	job->busy = false;
+	m70_mutex_unlock(&fleet->state_lock);
+}
+
+static void fleet_worker_main(void* arg)
+{
+	m70_fleet_worker_t* worker = (m70_fleet_worker_t*)arg;
+	m70_fleet_t* fleet = worker->fleet;
+	while (!m70_atomic_load(&fleet->stop))
+	{
+		int index = deque_pop_oldest(&worker->deque);
+		int i = 0;
+		for (i = 1; index < 0 && i < fleet->worker_count; i++)
+		{
+			index = deque_steal_newest(&fleet->workers[(worker->index + i) % fleet->worker_count].deque);
+			if (index >= 0)
+				m70_atomic_add(&fleet->steals, 1);
+		}
+
+		if (index >= 0)
+		{
+			fleet_poll_machine(fleet, index);
+			continue;
+		}
+
+		m70_mutex_lock(&fleet->wake_lock);
+		if (!m70_atomic_load(&fleet->stop))
+			m70_cond_wait(&fleet->wake, &fleet->wake_lock, M70_FLEET_IDLE_WAIT);
+		m70_mutex_unlock(&fleet->wake_lock);
+	}
+}
+
+// Queues every idle machine whose poll is due on its home worker
+static void fleet_dispatcher_main(void* arg)
+{
+	m70_fleet_t* fleet = (m70_fleet_t*)arg;
+	while (!m70_atomic_load(&fleet->stop))
+	{
+		uint64 now = get_tick_count_ms();
+		int queued = 0;
+		int i = 0;
+		for (i = 0; i < fleet->job_count; i++)
+		{
+			m70_fleet_job_t* job = &fleet->jobs[i];
+			m70_mutex_lock(&fleet->state_lock);
+			bool due = !job->busy && job->next_due <= now;
+			if (due)
+				job->busy = true;
+			m70_mutex_unlock(&fleet->state_lock);
+
+			if (due)
+			{
+				deque_push(&fleet->workers[job->home].deque, i);
+				queued++;
+			}
+		}
+
+		m70_mutex_lock(&fleet->wake_lock);
+		if (queued > 0)
+			m70_cond_broadcast(&fleet->wake);
+		if (!m70_atomic_load(&fleet->stop))
+			m70_cond_wait(&fleet->wake, &fleet->wake_lock, M70_FLEET_IDLE_WAIT);
+		m70_mutex_unlock(&fleet->wake_lock);
+	}
+}
+
+m70_fleet_t* m70_fleet_create(const m70_fleet_machine_t* machines, int count, int worker_count)
+{
+	if (machines == NULL || count <= 0 || worker_count <= 0)
+	{
+		M70_ERROR_SET(M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid fleet parameters: count=%d, workers=%d", count, worker_count);
+		return NULL;
+	}
+	if (worker_count > M70_FLEET_MAX_WORKERS)
+		worker_count = M70_FLEET_MAX_WORKERS;
+
+	m70_fleet_t* fleet = (m70_fleet_t*)calloc(1, sizeof(m70_fleet_t));
+	if (fleet == NULL)
+		return NULL;
+
+	fleet->jobs = (m70_fleet_job_t*)calloc(count, sizeof(m70_fleet_job_t));
+	fleet->workers = (m70_fleet_worker_t*)calloc(worker_count, sizeof(m70_fleet_worker_t));
+	if (fleet->jobs == NULL || fleet->workers == NULL)
+	{
+		M70_ERROR_SET(M70_ERROR_CODE_EX_SYS_OUT_OF_MEMORY, "Failed to allocate fleet of %d machines", count);
+		free(fleet->jobs);
+		free(fleet->workers);
+		free(fleet);
+		return NULL;
+	}
+
+	fleet->job_count = count;
+	fleet->worker_count = worker_count;
+	int i = 0;
+	for (i = 0; i < count; i++)
+	{
+		fleet->jobs[i].config = machines[i];
+		fleet->jobs[i].conn.socket = -1;
+		fleet->jobs[i].home = i % worker_count;
+	}
+
+	// Each machine is queued at most once, so a deque never holds more than count items
+	for (i = 0; i < worker_count; i++)
+	{
+		m70_fleet_worker_t* worker = &fleet->workers[i];
+		worker->fleet = fleet;
+		worker->index = i;
+		worker->deque.capacity = count;
+		worker->deque.items = (int*)calloc(count, sizeof(int));
+		m70_mutex_init(&worker->deque.lock);
+	}
+
+	m70_mutex_init(&fleet->state_lock);
+	m70_mutex_init(&fleet->wake_lock);
+	m70_cond_init(&fleet->wake);
+	M70_LOG_INFO("Fleet created: %d machines, %d workers", count, worker_count);
+	return fleet;
+}
+
+bool m70_fleet_start(m70_fleet_t* fleet)
+{
+	if (fleet == NULL || fleet->running)
+		return false;
+
+	m70_atomic_store(&fleet->stop, 0);
+	int i = 0;
+	for (i = 0; i < fleet->worker_count; i++)
+	{
+		if (fleet->workers[i].deque.items == NULL || !m70_thread_create(&fleet->workers[i].thread, fleet_worker_main, &fleet->workers[i]))
+		{
+			M70_ERROR_SET(M70_ERROR_CODE_EX_SYS_RESOURCE_LIMIT, "Failed to start fleet worker %d", i);
+			m70_atomic_store(&fleet->stop, 1);
+			while (--i >= 0)
+				m70_thread_join(fleet->workers[i].thread);
+			return false;
+		}
+	}
+
+	if (!m70_thread_create(&fleet->dispatcher, fleet_dispatcher_main, fleet))
+	{
+		M70_ERROR_SET(M70_ERROR_CODE_EX_SYS_RESOURCE_LIMIT, "Failed to start fleet dispatcher");
+		m70_atomic_store(&fleet->stop, 1);
+		for (i = 0; i < fleet->worker_count; i++)
+			m70_thread_join(fleet->workers[i].thread);
+		return false;
+	}
+
+	fleet->running = true;
+	return true;
+}
+
+// Waits for the polls in progress; a machine blocked in a socket timeout delays this by up to that timeout
+void m70_fleet_stop(m70_fleet_t* fleet)
+{
+	if (fleet == NULL || !fleet->running)
+		return;
+
+	m70_atomic_store(&fleet->stop, 1);
+	m70_mutex_lock(&fleet->wake_lock);
+	m70_cond_broadcast(&fleet->wake);
+	m70_mutex_unlock(&fleet->wake_lock);
+
+	m70_thread_join(fleet->dispatcher);
+	int i = 0;
+	for (i = 0; i < fleet->worker_count; i++)
+		m70_thread_join(fleet->workers[i].thread);
+
+	// Jobs left in the deques were never started
+	for (i = 0; i < fleet->worker_count; i++)
+		fleet->workers[i].deque.count = 0;
+	for (i = 0; i < fleet->job_count; i++)
+		fleet->jobs[i].busy = false;
+	fleet->running = false;
+}
+
+void m70_fleet_destroy(m70_fleet_t* fleet)
+{
+	if (fleet == NULL)
+		return;
+
+	m70_fleet_stop(fleet);
+	int i = 0;
+	for (i = 0; i < fleet->job_count; i++)
+	{
+		if (check_conn_is_valid(&fleet->jobs[i].conn))
+			m70_cnc_disconnect(&fleet->jobs[i].conn);
+	}
+	for (i = 0; i < fleet->worker_count; i++)
+	{
+		m70_mutex_destroy(&fleet->workers[i].deque.lock);
+		free(fleet->workers[i].deque.items);
+	}
+
+	m70_cond_destroy(&fleet->wake);
+	m70_mutex_destroy(&fleet->wake_lock);
+	m70_mutex_destroy(&fleet->state_lock);
+	free(fleet->workers);
+	free(fleet->jobs);
+	free(fleet);
+}
+
+void m70_fleet_get_stats(m70_fleet_t* fleet, m70_fleet_stats_t* stats)
+{
+	if (fleet == NULL || stats == NULL)
+		return;
+
+	stats->polls = (uint32)m70_atomic_load(&fleet->polls);
+	stats->failures = (uint32)m70_atomic_load(&fleet->failures);
+	stats->steals = (uint32)m70_atomic_load(&fleet->steals);
+}
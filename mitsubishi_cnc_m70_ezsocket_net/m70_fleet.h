@@ -0,0 +1,47 @@
+#ifndef __H_M70_FLEET_H__
+#define __H_M70_FLEET_H__
+
+// Polls many CNC machines on a fixed-size worker pool. Every worker owns a deque of
+// machine jobs and steals from its neighbours when it runs dry, so a controller stuck
+// in a socket timeout only ever holds one worker.
+
+#include "typedef.h"
+
+#define M70_FLEET_MAX_WORKERS 64
+#define M70_FLEET_RECONNECT_INTERVAL 5000 // Milliseconds between connection attempts to a failing machine
+
+typedef struct m70_fleet m70_fleet_t;
+
+// Poll plan of one machine, runs on a worker with a connected conn (m70_cnc_read_* calls).
+// The conn is reconnected with m70_cnc_reconnect, settings, subscriptions and statistics made
+// by the plan survive a lost connection.
+typedef m70_error_code_e (*m70_fleet_plan_fn)(m70_conn_t* conn, void* user_data);
+
+// Called on the worker thread after every poll of a machine
+typedef void (*m70_fleet_callback)(int machine, m70_error_code_e result, uint32 elapsed_ms, void* user_data);
+
+typedef struct _tag_m70_fleet_machine
+{
+	char ip[64];
+	int port;
+	m70_nc_type_e type;
+	uint32 interval_ms; // Poll period, 0 = as often as possible
+	m70_fleet_plan_fn plan;
+	m70_fleet_callback on_complete;
+	void* user_data;
+} m70_fleet_machine_t;
+
+typedef struct _tag_m70_fleet_stats
+{
+	uint32 polls;	 // Finished polls
+	uint32 failures; // Polls that did not return M70_ERROR_CODE_OK
+	uint32 steals;	 // Jobs taken from another worker's deque
+} m70_fleet_stats_t;
+
+m70_fleet_t* m70_fleet_create(const m70_fleet_machine_t* machines, int count, int worker_count);
+bool m70_fleet_start(m70_fleet_t* fleet);
+void m70_fleet_stop(m70_fleet_t* fleet);
+void m70_fleet_destroy(m70_fleet_t* fleet);
+void m70_fleet_get_stats(m70_fleet_t* fleet, m70_fleet_stats_t* stats);
+
+#endif // __H_M70_FLEET_H__
@@ -0,0 +1,733 @@
+#include "m70_fs.h"
+#include "m70_ezsocket.h"
+#include "m70_giop.h"
+#include "m70_log.h"
+#include "m70_error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#pragma warning(disable : 4996)
+#else
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+void m70_cnc_set_transfer_chunk_size(m70_conn_t* conn, int size)
+{
+	if (conn == NULL)
+		return;
+
+	if (size < 1)
+		size = 0;
+	if (size > M70_FS_MAX_CHUNK)
+		size = M70_FS_MAX_CHUNK;
+	conn->fs_chunk_size = size;
+	M70_LOG_DEBUG("Transfer chunk size set to %d", size);
+}
+
+// The size set on the connection, else TRANS_SIZE as reported by the controller, else the default
+static int fs_chunk_size(m70_conn_t* conn)
+{
+	if (conn->fs_chunk_size > 0)
+		return (int)conn->fs_chunk_size;
+
+	if (!(conn->meta.valid & M70_META_TRANS_SIZE))
+	{
+		int size = 0;
+		if (m70_cnc_read_program_file_info(conn, 1, TRANS_SIZE, &size) != M70_ERROR_CODE_OK)
+			size = 0;
+		conn->meta.trans_size = size < M70_FS_MAX_CHUNK ? size : M70_FS_MAX_CHUNK;
+		conn->meta.valid |= M70_META_TRANS_SIZE;
+		M70_LOG_DEBUG("Controller transfer size %d", size);
+	}
+	return conn->meta.trans_size > 0 ? conn->meta.trans_size : M70_FS_DEFAULT_CHUNK;
+}
+
+int m70_cnc_get_transfer_chunk_size(m70_conn_t* conn)
+{
+	if (!check_conn_is_valid(conn))
+		return M70_FS_DEFAULT_CHUNK;
+	return fs_chunk_size(conn);
+}
+
+static int fs_depth(m70_conn_t* conn)
+{
+	int depth = (int)conn->pipeline_depth;
+	if (depth < 1)
+		depth = 1;
+	if (depth > M70_MAX_PIPELINE_DEPTH)
+		depth = M70_MAX_PIPELINE_DEPTH;
+	return depth;
+}
+
+// Requests, their chunk buffers and the pipeline of one transfer
+typedef struct _tag_fs_window
+{
+	int depth;
+	int chunk;
+	mel_request_t* requests;
+	byte* buffers;
+	mel_pipeline_t* pipe;
+} fs_window_t;
+
+static void fs_window_free(fs_window_t* window)
+{
+	free(window->requests);
+	free(window->buffers);
+	free(window->pipe);
+}
+
+// Transfers to or from memory point the requests into it and need no chunk buffers
+static bool fs_window_alloc(m70_conn_t* conn, fs_window_t* window, bool buffered)
+{
+	window->chunk = fs_chunk_size(conn);
+	window->depth = fs_depth(conn);
+	window->requests = (mel_request_t*)calloc(window->depth, sizeof(mel_request_t));
+	window->buffers = buffered ? (byte*)malloc((size_t)window->depth * window->chunk) : NULL;
+	window->pipe = (mel_pipeline_t*)malloc(sizeof(mel_pipeline_t));
+	if (window->requests == NULL || (buffered && window->buffers == NULL) || window->pipe == NULL)
+	{
+		fs_window_free(window);
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_SYS_OUT_OF_MEMORY, "No memory for %d transfer buffers", window->depth);
+		return false;
+	}
+	mel_pipeline_init(window->pipe, conn, window->depth);
+	return true;
+}
+
+static m70_error_code_e fs_open_failed(m70_conn_t* conn, const char* remote_path, long code)
+{
+	if (code == -1)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CONN_CLOSED, "Connection lost opening %s", remote_path);
+		return M70_ERROR_CODE_SOCKET_FAILED;
+	}
+	M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_NOT_FOUND, "Cannot open %s, code 0x%lX", remote_path, code);
+	return M70_ERROR_CODE_FAILED;
+}
+
+static void fs_finish_stats(m70_transfer_stats_t* stats, uint64 start)
+{
+	stats->elapsed_ms = (uint32)(get_tick_count_ms() - start);
+	stats->bytes_per_sec = stats->elapsed_ms > 0 ? stats->bytes * 1000.0 / stats->elapsed_ms : 0;
+}
+
+// Points the read at the next chunk of target, then at the probe once target is covered.
+// Returns false when the probe is already out and nothing is left to read.
+static bool fs_next_target(mel_request_t* request, byte* target, uint64 target_size, int chunk, uint64* offset, bool* probing, byte* probe)
+{
+	if (*offset < target_size)
+	{
+		uint64 remaining = target_size - *offset;
+		request->count = remaining < (uint64)chunk ? (int)remaining : chunk;
+		request->out = target + *offset;
+		*offset += request->count;
+	}
+	else if (!*probing)
+	{
+		request->count = 1;
+		request->out = probe;
+		*probing = true;
+	}
+	else
+		return false;
+	request->out_size = request->count;
+	return true;
+}
+
+// Streams the file to sink, or with target set reads it straight into target. Reads into
+// target stop at target_size; one more byte is then asked for to tell a longer file apart,
+// which fails the download and sets *larger when given.
+static m70_error_code_e fs_download(m70_conn_t* conn, const char* remote_path, m70_fs_sink_fn sink, void* user,
+									byte* target, uint64 target_size, m70_transfer_stats_t* stats, bool* larger)
+{
+	if (larger != NULL)
+		*larger = false;
+	m70_transfer_stats_t transfer;
+	memset((void*)&transfer, 0, sizeof(transfer));
+	if (stats != NULL)
+		*stats = transfer;
+
+	if (!check_conn_is_valid(conn) || remote_path == NULL || remote_path[0] == '\0' || (sink == NULL && target == NULL))
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid download parameters");
+		return M70_ERROR_CODE_FAILED;
+	}
+
+	fs_window_t window;
+	if (!fs_window_alloc(conn, &window, target == NULL))
+		return M70_ERROR_CODE_FAILED;
+
+	M70_LOG_DEBUG("Downloading %s, %d byte chunks, %d in flight", remote_path, window.chunk, window.depth);
+	uint64 start = get_tick_count_ms();
+	long fd = 0;
+	long code = melFsOpenFile(conn, remote_path, M_FSOPEN_RDONLY, &fd);
+	if (code != 0)
+	{
+		fs_window_free(&window);
+		return fs_open_failed(conn, remote_path, code);
+	}
+
+	// Every read continues where the previous one stopped, so replies come back in file order.
+	// A short read is the end of the file; reads still in flight then return nothing.
+	m70_error_code_e ret = M70_ERROR_CODE_OK;
+	bool more = true;
+	mel_pipeline_t* pipe = window.pipe;
+	uint64 offset = 0; // Of the next read into target
+	bool probing = false;
+	byte probe = 0;
+	int i = 0;
+	for (i = 0; i < window.depth; i++)
+	{
+		mel_request_t* request = &window.requests[i];
+		request->op = MEL_OP_FS_READ_FILE;
+		request->fd = fd;
+		if (target == NULL)
+		{
+			request->count = window.chunk;
+			request->out = window.buffers + (size_t)i * window.chunk;
+			request->out_size = window.chunk;
+		}
+		else if (!fs_next_target(request, target, target_size, window.chunk, &offset, &probing, &probe))
+			break;
+		if (!mel_pipeline_submit(pipe, request))
+			break;
+		transfer.requests++;
+	}
+
+	while (pipe->inflight_count > 0)
+	{
+		mel_request_t* request = mel_pipeline_complete(pipe);
+		if (request == NULL)
+		{
+			mel_pipeline_abort(pipe);
+			ret = M70_ERROR_CODE_SOCKET_FAILED;
+			M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CONN_CLOSED, "Connection lost downloading %s", remote_path);
+			break;
+		}
+
+		if (request->code != 0)
+		{
+			if (ret == M70_ERROR_CODE_OK)
+				M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_IO_ERROR, "Read of %s failed, code 0x%lX", remote_path, request->code);
+			ret = M70_ERROR_CODE_FAILED;
+			more = false;
+			continue;
+		}
+
+		if (!more)
+			continue;
+		if (target != NULL && request->out == &probe)
+		{
+			if (request->out_length > 0)
+			{
+				M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_IO_ERROR, "%s is larger than %llu bytes", remote_path, target_size);
+				ret = M70_ERROR_CODE_FAILED;
+				if (larger != NULL)
+					*larger = true;
+			}
+			more = false;
+			continue;
+		}
+		if (target == NULL && request->out_length > 0 && !sink((const byte*)request->out, request->out_length, user))
+		{
+			M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_IO_ERROR, "Download of %s stopped by the sink", remote_path);
+			ret = M70_ERROR_CODE_FAILED;
+			more = false;
+			continue;
+		}
+		transfer.bytes += request->out_length;
+		if (request->out_length < request->count)
+		{
+			more = false;
+			continue;
+		}
+
+		request->out_length = 0;
+		if (target != NULL && !fs_next_target(request, target, target_size, window.chunk, &offset, &probing, &probe))
+			continue;
+		if (!mel_pipeline_submit(pipe, request))
+			more = false;
+		else
+			transfer.requests++;
+	}
+
+	if (check_conn_is_valid(conn))
+		melFsCloseFile(conn, fd);
+
+	fs_finish_stats(&transfer, start);
+	if (stats != NULL)
+		*stats = transfer;
+	if (ret == M70_ERROR_CODE_OK)
+		M70_LOG_INFO("Downloaded %s: %llu bytes in %u ms, %.0f bytes/s", remote_path, transfer.bytes, transfer.elapsed_ms, transfer.bytes_per_sec);
+
+	fs_window_free(&window);
+	return ret;
+}
+
+m70_error_code_e m70_cnc_download_program(m70_conn_t* conn, const char* remote_path, m70_fs_sink_fn sink, void* user, m70_transfer_stats_t* stats)
+{
+	if (sink == NULL)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid download sink");
+		return M70_ERROR_CODE_FAILED;
+	}
+	return fs_download(conn, remote_path, sink, user, NULL, 0, stats, NULL);
+}
+
+m70_error_code_e m70_cnc_download_program_to_memory(m70_conn_t* conn, const char* remote_path, void* buffer, uint64 size, uint64* length, m70_transfer_stats_t* stats)
+{
+	if (length != NULL)
+		*length = 0;
+	if (buffer == NULL && size > 0)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid download buffer");
+		return M70_ERROR_CODE_FAILED;
+	}
+
+	// Any target will do for an empty buffer, only the probe read is sent
+	byte empty = 0;
+	m70_transfer_stats_t transfer;
+	m70_error_code_e ret = fs_download(conn, remote_path, NULL, NULL, buffer != NULL ? (byte*)buffer : &empty, size, &transfer, NULL);
+	if (length != NULL)
+		*length = transfer.bytes;
+	if (stats != NULL)
+		*stats = transfer;
+	return ret;
+}
+
+static bool fs_fd_sink(const byte* data, int length, void* user)
+{
+	int fd = *(int*)user;
+	while (length > 0)
+	{
+#ifdef _WIN32
+		int written = _write(fd, data, length);
+#else
+		int written = (int)write(fd, data, length);
+		if (written < 0 && errno == EINTR)
+			continue;
+#endif
+		if (written <= 0)
+			return false;
+		data += written;
+		length -= written;
+	}
+	return true;
+}
+
+m70_error_code_e m70_cnc_download_program_to_fd(m70_conn_t* conn, const char* remote_path, int fd, m70_transfer_stats_t* stats)
+{
+	if (fd < 0)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid download descriptor %d", fd);
+		return M70_ERROR_CODE_FAILED;
+	}
+	return m70_cnc_download_program(conn, remote_path, fs_fd_sink, &fd, stats);
+}
+
+// Writes what source produces, or with data set sends data itself chunk by chunk
+static m70_error_code_e fs_upload(m70_conn_t* conn, const char* remote_path, m70_fs_source_fn source, void* user,
+								  const byte* data, uint64 size, m70_transfer_stats_t* stats)
+{
+	m70_transfer_stats_t transfer;
+	memset((void*)&transfer, 0, sizeof(transfer));
+	if (stats != NULL)
+		*stats = transfer;
+
+	if (!check_conn_is_valid(conn) || remote_path == NULL || remote_path[0] == '\0' || (source == NULL && data == NULL))
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid upload parameters");
+		return M70_ERROR_CODE_FAILED;
+	}
+
+	fs_window_t window;
+	if (!fs_window_alloc(conn, &window, data == NULL))
+		return M70_ERROR_CODE_FAILED;
+
+	M70_LOG_DEBUG("Uploading %s, %d byte chunks, %d in flight", remote_path, window.chunk, window.depth);
+	uint64 start = get_tick_count_ms();
+	long fd = 0;
+	long code = melFsCreateFile(conn, remote_path, 0, &fd);
+	if (code != 0)
+	{
+		fs_window_free(&window);
+		return fs_open_failed(conn, remote_path, code);
+	}
+
+	// Writes land at the file position in the order they were sent, so a window of
+	// them can be in flight. Each slot is refilled from the source when its reply is in.
+	m70_error_code_e ret = M70_ERROR_CODE_OK;
+	bool more = true;
+	mel_pipeline_t* pipe = window.pipe;
+	uint64 offset = 0; // Of the next write from data
+	int free_count = window.depth;
+	mel_request_t* free_slots[M70_MAX_PIPELINE_DEPTH];
+	int i = 0;
+	for (i = 0; i < window.depth; i++)
+	{
+		free_slots[i] = &window.requests[window.depth - 1 - i];
+		free_slots[i]->op = MEL_OP_FS_WRITE_FILE;
+		free_slots[i]->fd = fd;
+		if (data == NULL)
+			free_slots[i]->in = window.buffers + (size_t)(window.depth - 1 - i) * window.chunk;
+	}
+
+	while (true)
+	{
+		while (more && free_count > 0)
+		{
+			mel_request_t* request = free_slots[free_count - 1];
+			int length = 0;
+			if (data == NULL)
+				length = source((byte*)request->in, window.chunk, user);
+			else
+			{
+				uint64 remaining = size - offset;
+				length = remaining < (uint64)window.chunk ? (int)remaining : window.chunk;
+				request->in = data + offset;
+				offset += length;
+			}
+			if (length <= 0)
+			{
+				if (length < 0)
+				{
+					M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_IO_ERROR, "Upload source of %s failed", remote_path);
+					ret = M70_ERROR_CODE_FAILED;
+				}
+				more = false;
+				break;
+			}
+			if (length > window.chunk)
+				length = window.chunk;
+
+			request->count = length;
+			request->out_length = 0;
+			if (!mel_pipeline_submit(pipe, request))
+			{
+				more = false;
+				break;
+			}
+			free_count--;
+			transfer.requests++;
+		}
+
+		if (pipe->inflight_count == 0)
+			break;
+
+		mel_request_t* request = mel_pipeline_complete(pipe);
+		if (request == NULL)
+		{
+			mel_pipeline_abort(pipe);
+			ret = M70_ERROR_CODE_SOCKET_FAILED;
+			M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CONN_CLOSED, "Connection lost uploading %s", remote_path);
+			break;
+		}
+
+		free_slots[free_count++] = request;
+		if (request->code != 0 || request->out_length != request->count)
+		{
+			if (ret == M70_ERROR_CODE_OK)
+				M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_IO_ERROR, "Write of %s failed, code 0x%lX, %d of %d bytes",
+								   remote_path, request->code, request->out_length, request->count);
+			ret = M70_ERROR_CODE_FAILED;
+			more = false;
+			continue;
+		}
+		transfer.bytes += request->out_length;
+	}
+
+	if (!check_conn_is_valid(conn))
+		ret = M70_ERROR_CODE_SOCKET_FAILED;
+	else if (melFsCloseFile(conn, fd) != 0 && ret == M70_ERROR_CODE_OK)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_IO_ERROR, "Cannot close %s", remote_path);
+		ret = M70_ERROR_CODE_FAILED;
+	}
+
+	fs_finish_stats(&transfer, start);
+	if (stats != NULL)
+		*stats = transfer;
+	if (ret == M70_ERROR_CODE_OK)
+		M70_LOG_INFO("Uploaded %s: %llu bytes in %u ms, %.0f bytes/s", remote_path, transfer.bytes, transfer.elapsed_ms, transfer.bytes_per_sec);
+
+	fs_window_free(&window);
+	return ret;
+}
+
+m70_error_code_e m70_cnc_upload_program(m70_conn_t* conn, const char* remote_path, m70_fs_source_fn source, void* user, m70_transfer_stats_t* stats)
+{
+	if (source == NULL)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid upload source");
+		return M70_ERROR_CODE_FAILED;
+	}
+	return fs_upload(conn, remote_path, source, user, NULL, 0, stats);
+}
+
+m70_error_code_e m70_cnc_upload_program_from_memory(m70_conn_t* conn, const char* remote_path, const void* data, uint64 size, m70_transfer_stats_t* stats)
+{
+	if (data == NULL && size > 0)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid upload buffer");
+		return M70_ERROR_CODE_FAILED;
+	}
+	return fs_upload(conn, remote_path, NULL, NULL, data != NULL ? (const byte*)data : (const byte*)"", size, stats);
+}
+
+// Fills the whole chunk unless the file ends, so every write but the last is full size
+static int fs_fd_source(byte* buffer, int size, void* user)
+{
+	int fd = *(int*)user;
+	int total = 0;
+	while (total < size)
+	{
+#ifdef _WIN32
+		int count = _read(fd, buffer + total, size - total);
+#else
+		int count = (int)read(fd, buffer + total, size - total);
+		if (count < 0 && errno == EINTR)
+			continue;
+#endif
+		if (count < 0)
+			return -1;
+		if (count == 0)
+			break;
+		total += count;
+	}
+	return total;
+}
+
+m70_error_code_e m70_cnc_upload_program_from_fd(m70_conn_t* conn, const char* remote_path, int fd, m70_transfer_stats_t* stats)
+{
+	if (fd < 0)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid upload descriptor %d", fd);
+		return M70_ERROR_CODE_FAILED;
+	}
+	return m70_cnc_upload_program(conn, remote_path, fs_fd_source, &fd, stats);
+}
+
+// A local file mapped into memory
+typedef struct _tag_fs_mapping
+{
+	byte* data;
+	uint64 size;
+#ifdef _WIN32
+	HANDLE handle;
+#endif
+} fs_mapping_t;
+
+static int fs_open_local(const char* path, bool writable)
+{
+#ifdef _WIN32
+	return _open(path, writable ? _O_RDWR | _O_CREAT | _O_TRUNC | _O_BINARY : _O_RDONLY | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+	return open(path, writable ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+#endif
+}
+
+static void fs_close_local(int fd)
+{
+#ifdef _WIN32
+	_close(fd);
+#else
+	close(fd);
+#endif
+}
+
+// Moves the finished download over the target, which may exist
+static bool fs_replace_local(const char* from, const char* to)
+{
+#ifdef _WIN32
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+static bool fs_local_size(int fd, uint64* size)
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_fstat64(fd, &info) != 0)
+		return false;
+#else
+	struct stat info;
+	if (fstat(fd, &info) != 0)
+		return false;
+#endif
+	*size = (uint64)info.st_size;
+	return true;
+}
+
+static bool fs_resize_local(int fd, uint64 size)
+{
+#ifdef _WIN32
+	return _chsize_s(fd, (__int64)size) == 0;
+#else
+	return ftruncate(fd, (off_t)size) == 0;
+#endif
+}
+
+// Fails for an empty file or one that does not fit the address space, callers then stream it
+static bool fs_map(int fd, uint64 size, bool writable, fs_mapping_t* map)
+{
+	memset((void*)map, 0, sizeof(*map));
+	if (size == 0 || size != (uint64)(size_t)size)
+		return false;
+#ifdef _WIN32
+	HANDLE file = (HANDLE)_get_osfhandle(fd);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	map->handle = CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, (DWORD)(size >> 32), (DWORD)size, NULL);
+	if (map->handle == NULL)
+		return false;
+	map->data = (byte*)MapViewOfFile(map->handle, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, (SIZE_T)size);
+	if (map->data == NULL)
+	{
+		CloseHandle(map->handle);
+		return false;
+	}
+#else
+	void* data = mmap(NULL, (size_t)size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED)
+		return false;
+	madvise(data, (size_t)size, MADV_SEQUENTIAL); // Every chunk is touched once, front to back
+	map->data = (byte*)data;
+#endif
+	map->size = size;
+	return true;
+}
+
+static void fs_unmap(fs_mapping_t* map)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(map->data);
+	CloseHandle(map->handle);
+#else
+	munmap(map->data, (size_t)map->size);
+#endif
+}
+
+m70_error_code_e m70_cnc_download_program_to_file(m70_conn_t* conn, const char* remote_path, const char* local_path, m70_transfer_stats_t* stats)
+{
+	if (stats != NULL)
+		memset((void*)stats, 0, sizeof(*stats));
+	if (!check_conn_is_valid(conn) || remote_path == NULL || remote_path[0] == '\0' || local_path == NULL || local_path[0] == '\0')
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid download parameters");
+		return M70_ERROR_CODE_FAILED;
+	}
+
+	// The remote size tells how much to map; a file that cannot be stat'ed cannot be opened either
+	file_FS_stat info;
+	memset((void*)&info, 0, sizeof(info));
+	long code = melFSStatFile(conn, remote_path, &info);
+	if (code != 0)
+		return fs_open_failed(conn, remote_path, code);
+
+	// The download goes to a side file that replaces local_path only once it is complete, so a
+	// failed transfer leaves an existing local file as it was
+	size_t path_length = strlen(local_path);
+	char* part_path = (char*)malloc(path_length + sizeof(M70_FS_PART_SUFFIX));
+	if (part_path == NULL)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_SYS_OUT_OF_MEMORY, "No memory for downloading %s", remote_path);
+		return M70_ERROR_CODE_FAILED;
+	}
+	memcpy(part_path, local_path, path_length);
+	memcpy(part_path + path_length, M70_FS_PART_SUFFIX, sizeof(M70_FS_PART_SUFFIX));
+
+	int fd = fs_open_local(part_path, true);
+	if (fd < 0)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_ACCESS_DENIED, "Cannot create %s", part_path);
+		free(part_path);
+		return M70_ERROR_CODE_FAILED;
+	}
+
+	m70_error_code_e ret = M70_ERROR_CODE_OK;
+	bool larger = false;
+	fs_mapping_t map;
+	bool mapped = fs_resize_local(fd, info.file_size) && fs_map(fd, info.file_size, true, &map);
+	if (mapped)
+	{
+		m70_transfer_stats_t transfer;
+		ret = fs_download(conn, remote_path, NULL, NULL, map.data, map.size, &transfer, &larger);
+		fs_unmap(&map);
+		if (stats != NULL)
+			*stats = transfer;
+		// The file may have shrunk since it was looked up
+		if (!larger && transfer.bytes < map.size && !fs_resize_local(fd, transfer.bytes) && ret == M70_ERROR_CODE_OK)
+		{
+			M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_IO_ERROR, "Cannot truncate %s", part_path);
+			ret = M70_ERROR_CODE_FAILED;
+		}
+	}
+
+	// A file that grew since it was looked up no longer fits the mapping and is streamed instead.
+	// Nothing was written through fd, its offset is still at the start.
+	if (larger)
+	{
+		M70_LOG_DEBUG("%s grew past %llu bytes, streaming it", remote_path, (uint64)info.file_size);
+		if (fs_resize_local(fd, 0))
+			ret = m70_cnc_download_program_to_fd(conn, remote_path, fd, stats);
+		else
+			M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_IO_ERROR, "Cannot truncate %s", part_path);
+	}
+	else if (!mapped)
+		ret = m70_cnc_download_program_to_fd(conn, remote_path, fd, stats);
+
+	fs_close_local(fd);
+	if (ret == M70_ERROR_CODE_OK && !fs_replace_local(part_path, local_path))
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_ACCESS_DENIED, "Cannot replace %s", local_path);
+		ret = M70_ERROR_CODE_FAILED;
+	}
+	if (ret != M70_ERROR_CODE_OK)
+		remove(part_path);
+	free(part_path);
+	return ret;
+}
+
+m70_error_code_e m70_cnc_upload_program_from_file(m70_conn_t* conn, const char* remote_path, const char* local_path, m70_transfer_stats_t* stats)
+{
+	if (local_path == NULL)
+	{
+		if (stats != NULL)
+			memset((void*)stats, 0, sizeof(*stats));
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid upload parameters");
+		return M70_ERROR_CODE_FAILED;
+	}
+
+	int fd = fs_open_local(local_path, false);
+	if (fd < 0)
+	{
+		if (stats != NULL)
+			memset((void*)stats, 0, sizeof(*stats));
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_NOT_FOUND, "Cannot open %s", local_path);
+		return M70_ERROR_CODE_FAILED;
+	}
+
+	m70_error_code_e ret = M70_ERROR_CODE_OK;
+	uint64 size = 0;
+	fs_mapping_t map;
+	if (fs_local_size(fd, &size) && fs_map(fd, size, false, &map))
+	{
+		ret = m70_cnc_upload_program_from_memory(conn, remote_path, map.data, map.size, stats);
+		fs_unmap(&map);
+	}
+	else
+		ret = m70_cnc_upload_program_from_fd(conn, remote_path, fd, stats);
+
+	fs_close_local(fd);
+	return ret;
+}
@@ -0,0 +1,48 @@
+#ifndef __H_M70_FS_H__
+#define __H_M70_FS_H__
+
+// File transfers with the controller file system. Transfers keep up to the connection's
+// pipeline depth of read or write requests in flight and stream the data chunk by chunk,
+// so a file is never held in memory as a whole. Chunks are TRANS_SIZE bytes as reported
+// by the controller unless m70_cnc_set_transfer_chunk_size says otherwise.
+// Transfers to and from memory send and receive each chunk in place; the _file variants map the
+// local file for that and stream it through a descriptor when it cannot be mapped.
+
+#include "typedef.h"
+
+#define M70_FS_DEFAULT_CHUNK 4096 // Bytes per request when the controller does not report TRANS_SIZE
+#define M70_FS_MAX_CHUNK 65536
+#define M70_FS_PART_SUFFIX ".part" // Side file of a download to a local path until it is complete
+
+// Receives the file in order; returning false stops the transfer
+typedef bool (*m70_fs_sink_fn)(const byte* data, int length, void* user);
+
+// Fills buffer with the next bytes of the file, returns their count, 0 at the end or -1 on error
+typedef int (*m70_fs_source_fn)(byte* buffer, int size, void* user);
+
+typedef struct _tag_m70_transfer_stats
+{
+	uint64 bytes;		  // Payload moved
+	uint32 requests;	  // Read or write requests sent
+	uint32 elapsed_ms;	  // From open to close
+	double bytes_per_sec; // bytes over elapsed_ms
+} m70_transfer_stats_t;
+
+void m70_cnc_set_transfer_chunk_size(m70_conn_t* conn, int size); // size < 1 uses TRANS_SIZE again
+int m70_cnc_get_transfer_chunk_size(m70_conn_t* conn); // Asks the controller for TRANS_SIZE once
+
+// stats may be NULL
+m70_error_code_e m70_cnc_download_program(m70_conn_t* conn, const char* remote_path, m70_fs_sink_fn sink, void* user, m70_transfer_stats_t* stats);
+m70_error_code_e m70_cnc_download_program_to_fd(m70_conn_t* conn, const char* remote_path, int fd, m70_transfer_stats_t* stats);
+// Fails when the file is larger than size; length receives the bytes read
+m70_error_code_e m70_cnc_download_program_to_memory(m70_conn_t* conn, const char* remote_path, void* buffer, uint64 size, uint64* length, m70_transfer_stats_t* stats);
+// Writes local_path plus M70_FS_PART_SUFFIX and renames it over local_path once complete
+m70_error_code_e m70_cnc_download_program_to_file(m70_conn_t* conn, const char* remote_path, const char* local_path, m70_transfer_stats_t* stats);
+
+// Creates or truncates remote_path and writes the source into it
+m70_error_code_e m70_cnc_upload_program(m70_conn_t* conn, const char* remote_path, m70_fs_source_fn source, void* user, m70_transfer_stats_t* stats);
+m70_error_code_e m70_cnc_upload_program_from_fd(m70_conn_t* conn, const char* remote_path, int fd, m70_transfer_stats_t* stats);
+m70_error_code_e m70_cnc_upload_program_from_memory(m70_conn_t* conn, const char* remote_path, const void* data, uint64 size, m70_transfer_stats_t* stats);
+m70_error_code_e m70_cnc_upload_program_from_file(m70_conn_t* conn, const char* remote_path, const char* local_path, m70_transfer_stats_t* stats);
+
+#endif // __H_M70_FS_H__
@@ -0,0 +1,624 @@
+#include "m70_fs_sync.h"
+#include "m70_fs.h"
+#include "m70_giop.h"
+#include "m70_log.h"
+#include "m70_error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#pragma warning(disable : 4996)
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+#define M70_FS_SYNC_HASH_BLOCK 65536
+#define M70_FS_SYNC_FNV_OFFSET 0xcbf29ce484222325ULL
+#define M70_FS_SYNC_FNV_PRIME 0x100000001b3ULL
+
+typedef struct _tag_sync_file
+{
+	char name[M70_FS_NAME_SIZE];
+	uint64 size;
+	uint64 mtime; // YYYYMMDDhhmmss local time, as the controller reports its times
+} sync_file_t;
+
+typedef struct _tag_sync_list
+{
+	sync_file_t* files;
+	int count;
+	int capacity;
+} sync_list_t;
+
+// One file of a batch; the pipeline hands back &request so it must stay the first member
+typedef struct _tag_sync_slot
+{
+	mel_request_t request;
+	char path[M70_FS_PATH_SIZE];
+	byte* data; // Whole file, one chunk at most
+	int length;
+	long fd;
+	bool ok;
+} sync_slot_t;
+
+typedef struct _tag_sync_state
+{
+	m70_conn_t* conn;
+	m70_fs_sync_result_t* result;
+	mel_pipeline_t* pipe;
+	sync_slot_t* slots;
+	int depth;
+	int chunk;
+	int pending;		 // Slots of the batch being filled
+	sync_list_t touched; // Controller files sent or removed, their index entries are refreshed after
+} sync_state_t;
+
+static bool sync_list_add(sync_list_t* list, const char* name, uint64 size, uint64 mtime)
+{
+	if (strlen(name) >= M70_FS_NAME_SIZE)
+	{
+		M70_LOG_WARNING("Skipping %s, the name is too long", name);
+		return true;
+	}
+	if (list->count == list->capacity)
+	{
+		int capacity = list->capacity > 0 ? list->capacity * 2 : 64;
+		sync_file_t* files = (sync_file_t*)realloc(list->files, sizeof(sync_file_t) * capacity);
+		if (files == NULL)
+			return false;
+		list->files = files;
+		list->capacity = capacity;
+	}
+
+	sync_file_t* file = &list->files[list->count++];
+	strcpy(file->name, name);
+	file->size = size;
+	file->mtime = mtime;
+	return true;
+}
+
+static void sync_touch(sync_state_t* state, const char* name)
+{
+	if (!sync_list_add(&state->touched, name, 0, 0))
+		M70_LOG_WARNING("Index entry of %s may be stale, no memory to track it", name);
+}
+
+// Syncs run on fleet workers too, so the reentrant variants are used
+static uint64 sync_local_time(time_t t)
+{
+	struct tm tm;
+#ifdef _WIN32
+	if (localtime_s(&tm, &t) != 0)
+		return 0;
+#else
+	if (localtime_r(&t, &tm) == NULL)
+		return 0;
+#endif
+	return (((((tm.tm_year + 1900) * 100ULL + tm.tm_mon + 1) * 100 + tm.tm_mday) * 100 + tm.tm_hour) * 100 + tm.tm_min) * 100 + tm.tm_sec;
+}
+
+// Regular files directly inside dir
+static bool sync_list_local(const char* dir, sync_list_t* list)
+{
+	bool ok = true;
+#ifdef _WIN32
+	char pattern[M70_FS_PATH_SIZE * 2];
+	snprintf(pattern, sizeof(pattern), "%s\\*", dir);
+	struct _finddata64_t data;
+	intptr_t find = _findfirst64(pattern, &data);
+	if (find == -1)
+		return false;
+	do
+	{
+		if (!(data.attrib & _A_SUBDIR))
+			ok = sync_list_add(list, data.name, (uint64)data.size, sync_local_time((time_t)data.time_write));
+	} while (ok && _findnext64(find, &data) == 0);
+	_findclose(find);
+#else
+	DIR* handle = opendir(dir);
+	if (handle == NULL)
+		return false;
+	struct dirent* entry = NULL;
+	while (ok && (entry = readdir(handle)) != NULL)
+	{
+		char path[M70_FS_PATH_SIZE * 2];
+		struct stat info;
+		snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+		if (stat(path, &info) != 0 || !S_ISREG(info.st_mode))
+			continue;
+		ok = sync_list_add(list, entry->d_name, (uint64)info.st_size, sync_local_time(info.st_mtime));
+	}
+	closedir(handle);
+#endif
+	return ok;
+}
+
+static void sync_hash(uint64* hash, const byte* data, int length)
+{
+	int i = 0;
+	for (i = 0; i < length; i++)
+	{
+		*hash ^= data[i];
+		*hash *= M70_FS_SYNC_FNV_PRIME;
+	}
+}
+
+static bool sync_hash_sink(const byte* data, int length, void* user)
+{
+	sync_hash((uint64*)user, data, length);
+	return true;
+}
+
+static int sync_open_local(const char* path)
+{
+#ifdef _WIN32
+	return _open(path, _O_RDONLY | _O_BINARY);
+#else
+	return open(path, O_RDONLY);
+#endif
+}
+
+static void sync_close_local(int fd)
+{
+#ifdef _WIN32
+	_close(fd);
+#else
+	close(fd);
+#endif
+}
+
+// Reads up to size bytes, returns the count or -1
+static int sync_read_local(int fd, byte* buffer, int size)
+{
+	int total = 0;
+	while (total < size)
+	{
+#ifdef _WIN32
+		int count = _read(fd, buffer + total, size - total);
+#else
+		int count = (int)read(fd, buffer + total, size - total);
+		if (count < 0 && errno == EINTR)
+			continue;
+#endif
+		if (count < 0)
+			return -1;
+		if (count == 0)
+			break;
+		total += count;
+	}
+	return total;
+}
+
+static bool sync_hash_local(const char* path, uint64* hash)
+{
+	int fd = sync_open_local(path);
+	if (fd < 0)
+		return false;
+	byte* buffer = (byte*)malloc(M70_FS_SYNC_HASH_BLOCK);
+	int count = -1;
+	while (buffer != NULL && (count = sync_read_local(fd, buffer, M70_FS_SYNC_HASH_BLOCK)) > 0)
+		sync_hash(hash, buffer, count);
+	free(buffer);
+	sync_close_local(fd);
+	return count == 0;
+}
+
+// Sends the requests of the given slots together and waits for all replies. Returns false
+// when the connection is lost; results are in each request's code.
+static bool sync_run(sync_state_t* state, sync_slot_t** slots, int count)
+{
+	int i = 0;
+	for (i = 0; i < count; i++)
+	{
+		if (!mel_pipeline_submit(state->pipe, &slots[i]->request))
+		{
+			mel_pipeline_abort(state->pipe);
+			return false;
+		}
+	}
+	while (state->pipe->inflight_count > 0)
+	{
+		if (mel_pipeline_complete(state->pipe) == NULL)
+		{
+			mel_pipeline_abort(state->pipe);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void sync_slot_failed(sync_state_t* state, sync_slot_t* slot, const char* what)
+{
+	M70_CONN_ERROR_SET(state->conn, M70_ERROR_CODE_EX_FILE_IO_ERROR, "%s %s failed, code 0x%lX", what, slot->path, slot->request.code);
+	slot->ok = false;
+	state->result->failed++;
+}
+
+// Creates, writes and closes the batched files, one round trip for each step
+static m70_error_code_e sync_flush_batch(sync_state_t* state)
+{
+	sync_slot_t* active[M70_MAX_PIPELINE_DEPTH];
+	int count = 0;
+	int i = 0;
+	for (i = 0; i < state->pending; i++)
+	{
+		sync_slot_t* slot = &state->slots[i];
+		if (!slot->ok)
+			continue;
+		memset((void*)&slot->request, 0, sizeof(slot->request));
+		slot->request.op = MEL_OP_FS_CREATE_FILE;
+		slot->request.in = slot->path;
+		active[count++] = slot;
+	}
+	int pending = state->pending;
+	state->pending = 0;
+	if (!sync_run(state, active, count))
+		return M70_ERROR_CODE_SOCKET_FAILED;
+
+	count = 0;
+	for (i = 0; i < pending; i++)
+	{
+		sync_slot_t* slot = &state->slots[i];
+		if (!slot->ok)
+			continue;
+		if (slot->request.code != 0)
+		{
+			sync_slot_failed(state, slot, "Creating");
+			continue;
+		}
+		slot->fd = slot->request.fd;
+		if (slot->length == 0)
+			continue;
+		memset((void*)&slot->request, 0, sizeof(slot->request));
+		slot->request.op = MEL_OP_FS_WRITE_FILE;
+		slot->request.fd = slot->fd;
+		slot->request.in = slot->data;
+		slot->request.count = slot->length;
+		active[count++] = slot;
+	}
+	if (!sync_run(state, active, count))
+		return M70_ERROR_CODE_SOCKET_FAILED;
+
+	// Every created file is closed, also the ones whose write failed
+	count = 0;
+	for (i = 0; i < pending; i++)
+	{
+		sync_slot_t* slot = &state->slots[i];
+		if (!slot->ok)
+			continue;
+		if (slot->length > 0 && (slot->request.code != 0 || slot->request.out_length != slot->length))
+		{
+			sync_slot_failed(state, slot, "Writing");
+			slot->ok = true; // Still needs its close, counted as failed already
+			slot->length = -1;
+		}
+		memset((void*)&slot->request, 0, sizeof(slot->request));
+		slot->request.op = MEL_OP_FS_CLOSE_FILE;
+		slot->request.fd = slot->fd;
+		active[count++] = slot;
+	}
+	if (!sync_run(state, active, count))
+		return M70_ERROR_CODE_SOCKET_FAILED;
+
+	for (i = 0; i < count; i++)
+	{
+		sync_slot_t* slot = active[i];
+		if (slot->length < 0)
+			continue;
+		if (slot->request.code != 0)
+		{
+			sync_slot_failed(state, slot, "Closing");
+			continue;
+		}
+		state->result->uploaded++;
+		state->result->bytes += slot->length;
+	}
+	return M70_ERROR_CODE_OK;
+}
+
+// Queues a file of at most one chunk, the batch goes out once every slot is taken
+static m70_error_code_e sync_queue_small(sync_state_t* state, const char* remote_path, const char* local_path, uint64 size)
+{
+	sync_slot_t* slot = &state->slots[state->pending++];
+	strcpy(slot->path, remote_path);
+	slot->fd = 0;
+	slot->ok = false;
+
+	int fd = sync_open_local(local_path);
+	slot->length = fd >= 0 ? sync_read_local(fd, slot->data, state->chunk) : -1;
+	if (fd >= 0)
+		sync_close_local(fd);
+	// A file that grew past the chunk since it was listed would go out cut short
+	if (slot->length < 0 || (uint64)slot->length != size)
+	{
+		M70_CONN_ERROR_SET(state->conn, M70_ERROR_CODE_EX_FILE_IO_ERROR, "Cannot read %s or it changed", local_path);
+		state->result->failed++;
+	}
+	else
+		slot->ok = true;
+
+	if (state->pending == state->depth)
+		return sync_flush_batch(state);
+	return M70_ERROR_CODE_OK;
+}
+
+static m70_error_code_e sync_remove_extra(sync_state_t* state, const m70_fs_dir_t* dir, const sync_list_t* local)
+{
+	sync_slot_t* active[M70_MAX_PIPELINE_DEPTH];
+	int count = 0;
+	int i = 0;
+	for (i = 0; i <= dir->count; i++)
+	{
+		if (i < dir->count)
+		{
+			const m70_fs_entry_t* entry = &dir->entries[i];
+			bool found = false;
+			int j = 0;
+			for (j = 0; !found && j < local->count; j++)
+				found = strcmp(local->files[j].name, entry->name) == 0;
+			if (entry->is_dir || found)
+				continue;
+
+			// A cut path would remove another file
+			sync_slot_t* slot = &state->slots[count];
+			if (snprintf(slot->path, sizeof(slot->path), "%s%s", dir->path, entry->name) >= (int)sizeof(slot->path))
+			{
+				M70_CONN_ERROR_SET(state->conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Remote path for %s is too long", entry->name);
+				state->result->failed++;
+				continue;
+			}
+			sync_touch(state, entry->name);
+			memset((void*)&slot->request, 0, sizeof(slot->request));
+			slot->request.op = MEL_OP_FS_REMOVE_FILE;
+			slot->request.in = slot->path;
+			active[count++] = slot;
+			if (count < state->depth)
+				continue;
+		}
+		if (count == 0)
+			continue;
+
+		if (!sync_run(state, active, count))
+			return M70_ERROR_CODE_SOCKET_FAILED;
+		int j = 0;
+		for (j = 0; j < count; j++)
+		{
+			if (active[j]->request.code != 0)
+				sync_slot_failed(state, active[j], "Removing");
+			else
+				state->result->removed++;
+		}
+		count = 0;
+	}
+	return M70_ERROR_CODE_OK;
+}
+
+static const m70_fs_entry_t* sync_find_entry(const m70_fs_dir_t* dir, const char* name)
+{
+	int i = 0;
+	for (i = 0; i < dir->count; i++)
+	{
+		if (strcmp(dir->entries[i].name, name) == 0)
+			return &dir->entries[i];
+	}
+	return NULL;
+}
+
+// Whether the local file has to be sent; *lost is set when the connection went away while hashing
+static bool sync_changed(sync_state_t* state, const sync_file_t* file, const m70_fs_entry_t* entry,
+						 const char* remote_path, const char* local_path, bool compare_content, bool* lost)
+{
+	*lost = false;
+	if (entry == NULL || entry->size != file->size)
+		return true;
+	if (!compare_content)
+		return file->mtime > entry->mtime;
+
+	state->result->hashed++;
+	uint64 local_hash = M70_FS_SYNC_FNV_OFFSET;
+	uint64 remote_hash = M70_FS_SYNC_FNV_OFFSET;
+	if (!sync_hash_local(local_path, &local_hash))
+		return true;
+	m70_error_code_e ret = m70_cnc_download_program(state->conn, remote_path, sync_hash_sink, &remote_hash, NULL);
+	*lost = ret == M70_ERROR_CODE_SOCKET_FAILED;
+	return ret != M70_ERROR_CODE_OK || local_hash != remote_hash;
+}
+
+static m70_error_code_e sync_files(sync_state_t* state, const char* local_dir, const m70_fs_dir_t* dir, const sync_list_t* local, bool compare_content)
+{
+	m70_fs_sync_result_t* result = state->result;
+	int i = 0;
+	for (i = 0; i < local->count; i++)
+	{
+		const sync_file_t* file = &local->files[i];
+		char remote_path[M70_FS_PATH_SIZE];
+		char local_path[M70_FS_PATH_SIZE * 2];
+		result->checked++;
+		snprintf(local_path, sizeof(local_path), "%s/%s", local_dir, file->name);
+		if (snprintf(remote_path, sizeof(remote_path), "%s%s", dir->path, file->name) >= (int)sizeof(remote_path))
+		{
+			M70_CONN_ERROR_SET(state->conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Remote path for %s is too long", file->name);
+			result->failed++;
+			continue;
+		}
+
+		const m70_fs_entry_t* entry = sync_find_entry(dir, file->name);
+		if (entry != NULL && entry->is_dir)
+		{
+			M70_CONN_ERROR_SET(state->conn, M70_ERROR_CODE_EX_FILE_ACCESS_DENIED, "%s is a directory on the controller", remote_path);
+			result->failed++;
+			continue;
+		}
+
+		bool lost = false;
+		bool changed = sync_changed(state, file, entry, remote_path, local_path, compare_content, &lost);
+		if (lost)
+			return M70_ERROR_CODE_SOCKET_FAILED;
+		if (!changed)
+		{
+			result->skipped++;
+			continue;
+		}
+		sync_touch(state, file->name);
+
+		m70_error_code_e ret = M70_ERROR_CODE_OK;
+		if (file->size <= (uint64)state->chunk)
+			ret = sync_queue_small(state, remote_path, local_path, file->size);
+		else
+		{
+			m70_transfer_stats_t stats;
+			ret = m70_cnc_upload_program_from_file(state->conn, remote_path, local_path, &stats);
+			if (ret == M70_ERROR_CODE_OK)
+			{
+				result->uploaded++;
+				result->bytes += stats.bytes;
+			}
+			else if (ret != M70_ERROR_CODE_SOCKET_FAILED)
+			{
+				result->failed++;
+				ret = M70_ERROR_CODE_OK;
+			}
+		}
+		if (ret != M70_ERROR_CODE_OK)
+			return ret;
+	}
+	return state->pending > 0 ? sync_flush_batch(state) : M70_ERROR_CODE_OK;
+}
+
+// A rewrite leaves the directory time alone, so the caller's index would keep the old size and
+// time of every file sent and offer it again next time; the files sent or removed are stat'ed
+static m70_error_code_e sync_update_tree(sync_state_t* state, m70_fs_tree_t* tree, const char* dir_path)
+{
+	if (state->touched.count == 0)
+		return M70_ERROR_CODE_OK;
+	const char** names = (const char**)malloc(sizeof(const char*) * state->touched.count);
+	if (names == NULL)
+	{
+		M70_CONN_ERROR_SET(state->conn, M70_ERROR_CODE_EX_SYS_OUT_OF_MEMORY, "No memory for updating the index of %s", dir_path);
+		return M70_ERROR_CODE_FAILED;
+	}
+	int i = 0;
+	for (i = 0; i < state->touched.count; i++)
+		names[i] = state->touched.files[i].name;
+
+	char path[M70_FS_PATH_SIZE];
+	strcpy(path, dir_path);
+	m70_error_code_e ret = m70_fs_tree_update_files(state->conn, tree, path, names, state->touched.count);
+	free(names);
+	return ret;
+}
+
+m70_error_code_e m70_cnc_sync_programs(m70_conn_t* conn, const char* local_dir, const char* remote_dir,
+									   const m70_fs_sync_options_t* options, m70_fs_sync_result_t* result)
+{
+	m70_fs_sync_result_t summary;
+	memset((void*)&summary, 0, sizeof(summary));
+	if (result != NULL)
+		*result = summary;
+	m70_fs_sync_options_t settings;
+	memset((void*)&settings, 0, sizeof(settings));
+	if (options != NULL)
+		settings = *options;
+
+	if (!check_conn_is_valid(conn) || local_dir == NULL || local_dir[0] == '\0' || remote_dir == NULL || remote_dir[0] == '\0')
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid sync parameters");
+		return M70_ERROR_CODE_FAILED;
+	}
+
+	uint64 start = get_tick_count_ms();
+	sync_list_t local;
+	memset((void*)&local, 0, sizeof(local));
+	if (!sync_list_local(local_dir, &local))
+	{
+		free(local.files);
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_NOT_FOUND, "Cannot list local folder %s", local_dir);
+		return M70_ERROR_CODE_FAILED;
+	}
+
+	// The controller side comes from the index, which only lists directories that changed.
+	// Without one only remote_dir is listed, its subfolders are not synchronized.
+	m70_fs_tree_t* tree = settings.tree;
+	m70_error_code_e ret = M70_ERROR_CODE_OK;
+	if (tree != NULL)
+		ret = m70_fs_tree_refresh(conn, tree);
+	else if ((tree = m70_fs_tree_create(remote_dir)) == NULL)
+		ret = M70_ERROR_CODE_FAILED;
+	else
+	{
+		tree->root_only = true;
+		ret = m70_fs_tree_build(conn, tree);
+	}
+
+	const m70_fs_dir_t* dir = ret == M70_ERROR_CODE_OK ? m70_fs_tree_find_dir(tree, remote_dir) : NULL;
+	if (ret == M70_ERROR_CODE_OK && dir == NULL)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_NOT_FOUND, "%s is not in the index", remote_dir);
+		ret = M70_ERROR_CODE_FAILED;
+	}
+
+	sync_state_t state;
+	memset((void*)&state, 0, sizeof(state));
+	state.conn = conn;
+	state.result = &summary;
+	state.chunk = m70_cnc_get_transfer_chunk_size(conn);
+	state.depth = (int)conn->pipeline_depth;
+	if (state.depth < 1)
+		state.depth = 1;
+	if (state.depth > M70_MAX_PIPELINE_DEPTH)
+		state.depth = M70_MAX_PIPELINE_DEPTH;
+	byte* buffers = NULL;
+	if (ret == M70_ERROR_CODE_OK)
+	{
+		state.slots = (sync_slot_t*)calloc(state.depth, sizeof(sync_slot_t));
+		state.pipe = (mel_pipeline_t*)malloc(sizeof(mel_pipeline_t));
+		buffers = (byte*)malloc((size_t)state.depth * state.chunk);
+		if (state.slots == NULL || state.pipe == NULL || buffers == NULL)
+		{
+			M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_SYS_OUT_OF_MEMORY, "No memory for syncing %s", remote_dir);
+			ret = M70_ERROR_CODE_FAILED;
+		}
+	}
+
+	if (ret == M70_ERROR_CODE_OK)
+	{
+		int i = 0;
+		for (i = 0; i < state.depth; i++)
+			state.slots[i].data = buffers + (size_t)i * state.chunk;
+		mel_pipeline_init(state.pipe, conn, state.depth);
+
+		ret = sync_files(&state, local_dir, dir, &local, settings.compare_content);
+		if (ret == M70_ERROR_CODE_OK && settings.delete_extra)
+			ret = sync_remove_extra(&state, dir, &local);
+		if (ret != M70_ERROR_CODE_SOCKET_FAILED && tree == settings.tree)
+		{
+			m70_error_code_e update = sync_update_tree(&state, tree, dir->path);
+			if (ret == M70_ERROR_CODE_OK)
+				ret = update;
+		}
+		if (ret == M70_ERROR_CODE_OK && summary.failed > 0)
+			ret = M70_ERROR_CODE_FAILED;
+	}
+
+	free(state.slots);
+	free(state.pipe);
+	free(buffers);
+	free(state.touched.files);
+	free(local.files);
+	if (tree != settings.tree)
+		m70_fs_tree_destroy(tree);
+
+	summary.elapsed_ms = (uint32)(get_tick_count_ms() - start);
+	if (result != NULL)
+		*result = summary;
+	M70_LOG_INFO("Synced %s to %s: %u checked, %u uploaded, %u skipped, %u removed, %u failed, %llu bytes in %u ms", local_dir, remote_dir,
+				 summary.checked, summary.uploaded, summary.skipped, summary.removed, summary.failed, summary.bytes, summary.elapsed_ms);
+	return ret;
+}
@@ -0,0 +1,40 @@
+#ifndef __H_M70_FS_SYNC_H__
+#define __H_M70_FS_SYNC_H__
+
+// Pushes a local program folder to a controller directory and sends only what changed. A file
+// goes out when the controller lacks it, its size differs, or the local copy is newer. With
+// compare_content, files of equal size are hashed on both sides and times are ignored.
+// Files that fit in one transfer chunk go out in batches: creates, writes and closes for up
+// to the pipeline depth of files share a round trip each. Larger files stream on their own.
+// Subfolders are not synchronized, the controller offers no call to create directories.
+
+#include "typedef.h"
+#include "m70_fs_tree.h"
+
+typedef struct _tag_m70_fs_sync_options
+{
+	bool compare_content; // Hash files of equal size instead of comparing their times
+	bool delete_extra;	  // Remove controller files that the local folder does not have
+	m70_fs_tree_t* tree;  // Cached index holding the controller directory, refreshed instead of
+						  // walked again and updated for the files sent or removed; NULL lists
+						  // remote_dir alone into a temporary one
+} m70_fs_sync_options_t;
+
+typedef struct _tag_m70_fs_sync_result
+{
+	uint32 checked;	 // Local files compared
+	uint32 uploaded; // Sent because they changed
+	uint32 skipped;	 // Unchanged
+	uint32 hashed;	 // Compared by content
+	uint32 removed;	 // Deleted by delete_extra
+	uint32 failed;	 // Could not be compared, sent or removed
+	uint64 bytes;	 // Payload sent
+	uint32 elapsed_ms;
+} m70_fs_sync_result_t;
+
+// options and result may be NULL. Returns M70_ERROR_CODE_FAILED when any file failed; the rest
+// is still synchronized.
+m70_error_code_e m70_cnc_sync_programs(m70_conn_t* conn, const char* local_dir, const char* remote_dir,
+									   const m70_fs_sync_options_t* options, m70_fs_sync_result_t* result);
+
+#endif // __H_M70_FS_SYNC_H__
@@ -0,0 +1,665 @@
+#include "m70_fs_tree.h"
+#include "m70_giop.h"
+#include "m70_log.h"
+#include "m70_error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#pragma warning(disable : 4996)
+#endif
+
+#define M70_FS_TREE_ENTRY_SIZE 512 // Longest directory entry text kept
+
+// One request of the pipeline; the pipeline hands back &request so it must stay the first member
+typedef struct _tag_tree_slot
+{
+	mel_request_t request;
+	file_FS_stat stat;
+	char text[M70_FS_TREE_ENTRY_SIZE + 1]; // Stat path or directory entry
+	int dir;							   // Index of the directory being stat'ed
+} tree_slot_t;
+
+typedef struct _tag_tree_walk
+{
+	m70_conn_t* conn;
+	m70_fs_tree_t* tree;
+	int depth;
+	tree_slot_t* slots;
+	mel_pipeline_t* pipe;
+} tree_walk_t;
+
+static uint64 fs_time(uint32 year, uint32 month, uint32 day, uint32 hour, uint32 minute, uint32 second)
+{
+	return ((((year * 100ULL + month) * 100 + day) * 100 + hour) * 100 + minute) * 100 + second;
+}
+
+static void tree_clear_dir(m70_fs_dir_t* dir)
+{
+	free(dir->entries);
+	dir->entries = NULL;
+	dir->count = 0;
+	dir->capacity = 0;
+}
+
+static int tree_add_dir(m70_fs_tree_t* tree, const char* path)
+{
+	if (strlen(path) >= M70_FS_PATH_SIZE)
+		return -1;
+	if (tree->count == tree->capacity)
+	{
+		int capacity = tree->capacity > 0 ? tree->capacity * 2 : 8;
+		m70_fs_dir_t* dirs = (m70_fs_dir_t*)realloc(tree->dirs, sizeof(m70_fs_dir_t) * capacity);
+		if (dirs == NULL)
+			return -1;
+		tree->dirs = dirs;
+		tree->capacity = capacity;
+	}
+
+	m70_fs_dir_t* dir = &tree->dirs[tree->count];
+	memset((void*)dir, 0, sizeof(*dir));
+	strcpy(dir->path, path);
+	dir->check = true;
+	dir->stale = true;
+	return tree->count++;
+}
+
+// Drops every directory whose path starts with prefix; the ones kept stay in order
+static void tree_remove_dirs(m70_fs_tree_t* tree, const char* prefix)
+{
+	char copy[M70_FS_PATH_SIZE];
+	strncpy(copy, prefix, sizeof(copy) - 1);
+	copy[sizeof(copy) - 1] = '\0';
+	size_t length = strlen(copy);
+
+	int kept = 0;
+	int i = 0;
+	for (i = 0; i < tree->count; i++)
+	{
+		if (strncmp(tree->dirs[i].path, copy, length) == 0)
+		{
+			tree_clear_dir(&tree->dirs[i]);
+			continue;
+		}
+		tree->dirs[kept++] = tree->dirs[i];
+	}
+	tree->count = kept;
+}
+
+static int tree_find_index(const m70_fs_tree_t* tree, const char* path)
+{
+	int i = 0;
+	for (i = 0; i < tree->count; i++)
+	{
+		if (strcmp(tree->dirs[i].path, path) == 0)
+			return i;
+	}
+	return -1;
+}
+
+// Directory entries carry the name only; anything after a tab is ignored
+static bool tree_parse_name(char* text, int length, m70_fs_entry_t* entry)
+{
+	text[length] = '\0';
+	char* end = strpbrk(text, "\t\r\n");
+	if (end != NULL)
+		*end = '\0';
+	if (text[0] == '\0' || strcmp(text, ".") == 0 || strcmp(text, "..") == 0 || strlen(text) >= M70_FS_NAME_SIZE)
+		return false;
+
+	memset((void*)entry, 0, sizeof(*entry));
+	strcpy(entry->name, text);
+	return true;
+}
+
+static void tree_fill_entry(m70_fs_entry_t* entry, const file_FS_stat* stat)
+{
+	entry->is_dir = (stat->mode & M70_FS_MODE_DIRECTORY) != 0;
+	entry->size = entry->is_dir ? 0 : stat->file_size;
+	entry->mtime = fs_time(1950 + stat->year, stat->month, stat->day, stat->hour, stat->minute, stat->second);
+}
+
+static m70_error_code_e tree_connection_lost(tree_walk_t* walk, const char* path)
+{
+	mel_pipeline_abort(walk->pipe);
+	M70_CONN_ERROR_SET(walk->conn, M70_ERROR_CODE_EX_CONN_CLOSED, "Connection lost indexing %s", path);
+	return M70_ERROR_CODE_SOCKET_FAILED;
+}
+
+// Stats the directories marked check. A directory whose time moved, or that cannot be stat'ed
+// at all, is marked stale so that it gets listed again.
+static m70_error_code_e tree_stat_dirs(tree_walk_t* walk)
+{
+	m70_fs_tree_t* tree = walk->tree;
+	tree_slot_t* free_slots[M70_MAX_PIPELINE_DEPTH];
+	int free_count = 0;
+	int i = 0;
+	for (i = 0; i < walk->depth; i++)
+		free_slots[free_count++] = &walk->slots[i];
+
+	int next = 0;
+	while (true)
+	{
+		while (free_count > 0 && next < tree->count)
+		{
+			m70_fs_dir_t* dir = &tree->dirs[next++];
+			if (!dir->check)
+				continue;
+
+			tree_slot_t* slot = free_slots[--free_count];
+			slot->dir = next - 1;
+			strcpy(slot->text, dir->path);
+			size_t length = strlen(slot->text);
+			if (length > 1 && slot->text[length - 1] == '\\')
+				slot->text[length - 1] = '\0';
+
+			memset((void*)&slot->request, 0, sizeof(slot->request));
+			slot->request.op = MEL_OP_FS_STAT_FILE;
+			slot->request.in = slot->text;
+			slot->request.out = &slot->stat;
+			slot->request.out_size = sizeof(slot->stat);
+			if (!mel_pipeline_submit(walk->pipe, &slot->request))
+				return tree_connection_lost(walk, dir->path);
+			tree->requests++;
+		}
+
+		if (walk->pipe->inflight_count == 0)
+			return M70_ERROR_CODE_OK;
+
+		mel_request_t* request = mel_pipeline_complete(walk->pipe);
+		if (request == NULL)
+			return tree_connection_lost(walk, tree->dirs[0].path);
+
+		tree_slot_t* slot = (tree_slot_t*)request;
+		m70_fs_dir_t* dir = &tree->dirs[slot->dir];
+		uint64 mtime = 0;
+		if (request->code == 0)
+			mtime = fs_time(1950 + slot->stat.year, slot->stat.month, slot->stat.day, slot->stat.hour, slot->stat.minute, slot->stat.second);
+		if (request->code != 0 || mtime != dir->mtime)
+			dir->stale = true;
+		dir->mtime = mtime;
+		dir->check = false;
+		free_slots[free_count++] = slot;
+	}
+}
+
+static bool tree_append_entry(m70_fs_dir_t* dir, const m70_fs_entry_t* entry)
+{
+	if (dir->count == dir->capacity)
+	{
+		int capacity = dir->capacity > 0 ? dir->capacity * 2 : 16;
+		m70_fs_entry_t* entries = (m70_fs_entry_t*)realloc(dir->entries, sizeof(m70_fs_entry_t) * capacity);
+		if (entries == NULL)
+			return false;
+		dir->entries = entries;
+		dir->capacity = capacity;
+	}
+	dir->entries[dir->count++] = *entry;
+	return true;
+}
+
+static bool tree_has_subdir(const m70_fs_dir_t* dir, const char* name)
+{
+	int i = 0;
+	for (i = 0; i < dir->count; i++)
+	{
+		if (dir->entries[i].is_dir && strcmp(dir->entries[i].name, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+// Stats every entry of a fresh listing in one pipelined window. Entries that vanished since
+// the listing are dropped.
+static m70_error_code_e tree_stat_entries(tree_walk_t* walk, const char* path, m70_fs_dir_t* listing)
+{
+	tree_slot_t* free_slots[M70_MAX_PIPELINE_DEPTH];
+	int free_count = 0;
+	int i = 0;
+	for (i = 0; i < walk->depth; i++)
+		free_slots[free_count++] = &walk->slots[i];
+
+	int next = 0;
+	while (true)
+	{
+		while (free_count > 0 && next < listing->count)
+		{
+			tree_slot_t* slot = free_slots[--free_count];
+			slot->dir = next;
+			snprintf(slot->text, sizeof(slot->text), "%s%s", path, listing->entries[next++].name);
+
+			memset((void*)&slot->request, 0, sizeof(slot->request));
+			slot->request.op = MEL_OP_FS_STAT_FILE;
+			slot->request.in = slot->text;
+			slot->request.out = &slot->stat;
+			slot->request.out_size = sizeof(slot->stat);
+			if (!mel_pipeline_submit(walk->pipe, &slot->request))
+				return tree_connection_lost(walk, path);
+			walk->tree->requests++;
+		}
+
+		if (walk->pipe->inflight_count == 0)
+			break;
+
+		mel_request_t* request = mel_pipeline_complete(walk->pipe);
+		if (request == NULL)
+			return tree_connection_lost(walk, path);
+
+		tree_slot_t* slot = (tree_slot_t*)request;
+		m70_fs_entry_t* entry = &listing->entries[slot->dir];
+		if (request->code == 0)
+			tree_fill_entry(entry, &slot->stat);
+		else
+			entry->name[0] = '\0';
+		free_slots[free_count++] = slot;
+	}
+
+	int kept = 0;
+	for (i = 0; i < listing->count; i++)
+	{
+		if (listing->entries[i].name[0] != '\0')
+			listing->entries[kept++] = listing->entries[i];
+	}
+	listing->count = kept;
+	return M70_ERROR_CODE_OK;
+}
+
+// Reads the directory at index anew. Subdirectories that disappeared are dropped with everything
+// below them, new ones are added to be stat'ed and listed. gone is set when it cannot be opened.
+static m70_error_code_e tree_list_dir(tree_walk_t* walk, int index, bool* gone)
+{
+	m70_fs_tree_t* tree = walk->tree;
+	char path[M70_FS_PATH_SIZE];
+	strcpy(path, tree->dirs[index].path);
+	*gone = false;
+
+	long fd = 0;
+	long code = melFsOpenDirectory(walk->conn, path, &fd);
+	tree->requests++;
+	if (code == -1 || !check_conn_is_valid(walk->conn))
+		return tree_connection_lost(walk, path);
+	if (code != 0)
+	{
+		*gone = true;
+		return M70_ERROR_CODE_OK;
+	}
+
+	// Reads continue at the directory position like file reads, so a window of them can be in
+	// flight. The first empty reply is the end of the listing; the ones after it are empty too.
+	m70_error_code_e ret = M70_ERROR_CODE_OK;
+	m70_fs_dir_t listing;
+	memset((void*)&listing, 0, sizeof(listing));
+	bool more = true;
+	int i = 0;
+	for (i = 0; i < walk->depth; i++)
+	{
+		tree_slot_t* slot = &walk->slots[i];
+		memset((void*)&slot->request, 0, sizeof(slot->request));
+		slot->request.op = MEL_OP_FS_READ_DIR;
+		slot->request.fd = fd;
+		slot->request.out = slot->text;
+		slot->request.out_size = M70_FS_TREE_ENTRY_SIZE;
+		if (!mel_pipeline_submit(walk->pipe, &slot->request))
+			break;
+		tree->requests++;
+	}
+
+	while (walk->pipe->inflight_count > 0)
+	{
+		mel_request_t* request = mel_pipeline_complete(walk->pipe);
+		if (request == NULL)
+		{
+			tree_clear_dir(&listing);
+			return tree_connection_lost(walk, path);
+		}
+		if (!more)
+			continue;
+
+		if (request->code != 0)
+		{
+			M70_CONN_ERROR_SET(walk->conn, M70_ERROR_CODE_EX_FILE_IO_ERROR, "Reading directory %s failed, code 0x%lX", path, request->code);
+			ret = M70_ERROR_CODE_FAILED;
+			more = false;
+			continue;
+		}
+		if (request->out_length == 0)
+		{
+			more = false;
+			continue;
+		}
+
+		m70_fs_entry_t entry;
+		if (tree_parse_name((char*)request->out, request->out_length, &entry) && !tree_append_entry(&listing, &entry))
+		{
+			M70_CONN_ERROR_SET(walk->conn, M70_ERROR_CODE_EX_SYS_OUT_OF_MEMORY, "No memory for the entries of %s", path);
+			ret = M70_ERROR_CODE_FAILED;
+			more = false;
+			continue;
+		}
+
+		request->out_length = 0;
+		if (!mel_pipeline_submit(walk->pipe, request))
+			more = false;
+		else
+			tree->requests++;
+	}
+
+	if (!check_conn_is_valid(walk->conn))
+	{
+		tree_clear_dir(&listing);
+		return tree_connection_lost(walk, path);
+	}
+	melFsCloseDirectory(walk->conn, fd);
+	tree->requests++;
+	if (ret == M70_ERROR_CODE_OK)
+		ret = tree_stat_entries(walk, path, &listing);
+	if (ret != M70_ERROR_CODE_OK)
+	{
+		tree_clear_dir(&listing);
+		return ret;
+	}
+
+	m70_fs_dir_t* dir = &tree->dirs[index];
+	m70_fs_dir_t old = *dir;
+	dir->entries = listing.entries;
+	dir->count = listing.count;
+	dir->capacity = listing.capacity;
+	dir->stale = false;
+	tree->listed++;
+
+	// A subdirectory whose path does not fit M70_FS_PATH_SIZE never joins the index; a cut path
+	// would name another directory
+	char child[M70_FS_PATH_SIZE];
+	for (i = 0; i < old.count; i++)
+	{
+		if (old.entries[i].is_dir && !tree_has_subdir(&tree->dirs[index], old.entries[i].name) &&
+			snprintf(child, sizeof(child), "%s%s\\", path, old.entries[i].name) < (int)sizeof(child))
+			tree_remove_dirs(tree, child);
+	}
+	tree_clear_dir(&old);
+
+	for (i = 0; i < tree->dirs[index].count; i++)
+	{
+		const m70_fs_entry_t* entry = &tree->dirs[index].entries[i];
+		if (!entry->is_dir || tree->root_only)
+			continue;
+		if (snprintf(child, sizeof(child), "%s%s\\", path, entry->name) >= (int)sizeof(child))
+		{
+			M70_LOG_WARNING("Directory %s%s left out of the index, its path is too long", path, entry->name);
+			continue;
+		}
+		if (tree_find_index(tree, child) < 0 && tree_add_dir(tree, child) < 0)
+			M70_LOG_WARNING("Directory %s left out of the index", child);
+	}
+	return M70_ERROR_CODE_OK;
+}
+
+static bool tree_walk_init(tree_walk_t* walk, m70_conn_t* conn, m70_fs_tree_t* tree)
+{
+	walk->conn = conn;
+	walk->tree = tree;
+	walk->depth = (int)conn->pipeline_depth;
+	if (walk->depth < 1)
+		walk->depth = 1;
+	if (walk->depth > M70_MAX_PIPELINE_DEPTH)
+		walk->depth = M70_MAX_PIPELINE_DEPTH;
+	walk->slots = (tree_slot_t*)calloc(walk->depth, sizeof(tree_slot_t));
+	walk->pipe = (mel_pipeline_t*)malloc(sizeof(mel_pipeline_t));
+	if (walk->slots == NULL || walk->pipe == NULL)
+	{
+		free(walk->slots);
+		free(walk->pipe);
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_SYS_OUT_OF_MEMORY, "No memory for indexing %s", tree->dirs[0].path);
+		return false;
+	}
+	mel_pipeline_init(walk->pipe, conn, walk->depth);
+	return true;
+}
+
+// Stats and lists level by level until no directory is left to check or list
+static m70_error_code_e tree_walk(m70_conn_t* conn, m70_fs_tree_t* tree)
+{
+	tree->listed = 0;
+	tree->requests = 0;
+	if (!check_conn_is_valid(conn))
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid connection for indexing");
+		return M70_ERROR_CODE_FAILED;
+	}
+
+	tree_walk_t walk;
+	if (!tree_walk_init(&walk, conn, tree))
+		return M70_ERROR_CODE_FAILED;
+
+	uint64 start = get_tick_count_ms();
+	m70_error_code_e ret = M70_ERROR_CODE_OK;
+	bool pending = true;
+	while (ret == M70_ERROR_CODE_OK && pending)
+	{
+		ret = tree_stat_dirs(&walk);
+		pending = false;
+		int i = 0;
+		for (i = 0; ret == M70_ERROR_CODE_OK && i < tree->count; i++)
+		{
+			// Directories found by this round are stat'ed before they are listed
+			if (tree->dirs[i].check)
+			{
+				pending = true;
+				continue;
+			}
+			if (!tree->dirs[i].stale)
+				continue;
+
+			bool gone = false;
+			ret = tree_list_dir(&walk, i, &gone);
+			if (ret != M70_ERROR_CODE_OK || !gone)
+				continue;
+			if (i == 0)
+			{
+				// The index is emptied but keeps its root for the next attempt
+				char root[M70_FS_PATH_SIZE];
+				strcpy(root, tree->dirs[0].path);
+				tree_remove_dirs(tree, "");
+				tree_add_dir(tree, root);
+				M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_NOT_FOUND, "Cannot open directory %s", root);
+				ret = M70_ERROR_CODE_FAILED;
+				break;
+			}
+			tree_remove_dirs(tree, tree->dirs[i].path);
+			i--;
+		}
+	}
+
+	free(walk.slots);
+	free(walk.pipe);
+	if (ret == M70_ERROR_CODE_OK)
+		M70_LOG_DEBUG("Indexed %s: %d directories, %u listed, %u requests in %llu ms", tree->dirs[0].path, tree->count, tree->listed,
+					  tree->requests, get_tick_count_ms() - start);
+	return ret;
+}
+
+m70_fs_tree_t* m70_fs_tree_create(const char* root)
+{
+	if (root == NULL || root[0] == '\0' || strlen(root) + 2 > M70_FS_PATH_SIZE)
+	{
+		M70_ERROR_SET(M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid tree root");
+		return NULL;
+	}
+
+	m70_fs_tree_t* tree = (m70_fs_tree_t*)calloc(1, sizeof(m70_fs_tree_t));
+	if (tree == NULL)
+	{
+		M70_ERROR_SET(M70_ERROR_CODE_EX_SYS_OUT_OF_MEMORY, "No memory for the tree of %s", root);
+		return NULL;
+	}
+
+	char path[M70_FS_PATH_SIZE];
+	strcpy(path, root);
+	if (path[strlen(path) - 1] != '\\')
+		strcat(path, "\\");
+	if (tree_add_dir(tree, path) < 0)
+	{
+		free(tree);
+		M70_ERROR_SET(M70_ERROR_CODE_EX_SYS_OUT_OF_MEMORY, "No memory for the tree of %s", root);
+		return NULL;
+	}
+	return tree;
+}
+
+void m70_fs_tree_destroy(m70_fs_tree_t* tree)
+{
+	if (tree == NULL)
+		return;
+	int i = 0;
+	for (i = 0; i < tree->count; i++)
+		tree_clear_dir(&tree->dirs[i]);
+	free(tree->dirs);
+	free(tree);
+}
+
+m70_error_code_e m70_fs_tree_build(m70_conn_t* conn, m70_fs_tree_t* tree)
+{
+	if (tree == NULL)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid tree");
+		return M70_ERROR_CODE_FAILED;
+	}
+
+	// Everything below the root goes, the root itself is listed again
+	while (tree->count > 1)
+		tree_remove_dirs(tree, tree->dirs[tree->count - 1].path);
+	tree->dirs[0].mtime = 0;
+	tree->dirs[0].check = true;
+	tree->dirs[0].stale = true;
+	return tree_walk(conn, tree);
+}
+
+m70_error_code_e m70_fs_tree_refresh(m70_conn_t* conn, m70_fs_tree_t* tree)
+{
+	if (tree == NULL)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid tree");
+		return M70_ERROR_CODE_FAILED;
+	}
+
+	int i = 0;
+	for (i = 0; i < tree->count; i++)
+		tree->dirs[i].check = true;
+	return tree_walk(conn, tree);
+}
+
+m70_error_code_e m70_fs_tree_update_files(m70_conn_t* conn, m70_fs_tree_t* tree, const char* dir_path, const char* const* names, int count)
+{
+	if (!check_conn_is_valid(conn) || tree == NULL || dir_path == NULL || (names == NULL && count > 0))
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid tree update parameters");
+		return M70_ERROR_CODE_FAILED;
+	}
+	const m70_fs_dir_t* found = m70_fs_tree_find_dir(tree, dir_path);
+	if (found == NULL)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_FILE_NOT_FOUND, "%s is not in the index", dir_path);
+		return M70_ERROR_CODE_FAILED;
+	}
+	m70_fs_dir_t* dir = &tree->dirs[found - tree->dirs];
+	if (count <= 0)
+		return M70_ERROR_CODE_OK;
+
+	m70_fs_dir_t listing;
+	memset((void*)&listing, 0, sizeof(listing));
+	int i = 0;
+	for (i = 0; i < count; i++)
+	{
+		m70_fs_entry_t entry;
+		memset((void*)&entry, 0, sizeof(entry));
+		if (strlen(names[i]) >= M70_FS_NAME_SIZE)
+			continue;
+		strcpy(entry.name, names[i]);
+		if (!tree_append_entry(&listing, &entry))
+		{
+			tree_clear_dir(&listing);
+			M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_SYS_OUT_OF_MEMORY, "No memory for updating %s", dir->path);
+			return M70_ERROR_CODE_FAILED;
+		}
+	}
+
+	tree_walk_t walk;
+	if (!tree_walk_init(&walk, conn, tree))
+	{
+		tree_clear_dir(&listing);
+		return M70_ERROR_CODE_FAILED;
+	}
+	tree->requests = 0;
+	m70_error_code_e ret = tree_stat_entries(&walk, dir->path, &listing);
+	free(walk.slots);
+	free(walk.pipe);
+
+	// Files that were stat'ed replace or join their entries, the ones that are gone leave
+	int j = 0;
+	for (i = 0; ret == M70_ERROR_CODE_OK && i < count; i++)
+	{
+		const m70_fs_entry_t* update = NULL;
+		for (j = 0; update == NULL && j < listing.count; j++)
+		{
+			if (strcmp(listing.entries[j].name, names[i]) == 0)
+				update = &listing.entries[j];
+		}
+		for (j = 0; j < dir->count && strcmp(dir->entries[j].name, names[i]) != 0; j++)
+			;
+		if (update != NULL && j < dir->count)
+			dir->entries[j] = *update;
+		else if (update != NULL && !tree_append_entry(dir, update))
+		{
+			M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_SYS_OUT_OF_MEMORY, "No memory for updating %s", dir->path);
+			ret = M70_ERROR_CODE_FAILED;
+		}
+		else if (update == NULL && j < dir->count)
+		{
+			memmove(&dir->entries[j], &dir->entries[j + 1], sizeof(m70_fs_entry_t) * (dir->count - j - 1));
+			dir->count--;
+		}
+	}
+	tree_clear_dir(&listing);
+	return ret;
+}
+
+const m70_fs_dir_t* m70_fs_tree_find_dir(const m70_fs_tree_t* tree, const char* path)
+{
+	if (tree == NULL || path == NULL || path[0] == '\0' || strlen(path) + 2 > M70_FS_PATH_SIZE)
+		return NULL;
+
+	char key[M70_FS_PATH_SIZE];
+	strcpy(key, path);
+	if (key[strlen(key) - 1] != '\\')
+		strcat(key, "\\");
+	int index = tree_find_index(tree, key);
+	return index >= 0 ? &tree->dirs[index] : NULL;
+}
+
+const m70_fs_entry_t* m70_fs_tree_find(const m70_fs_tree_t* tree, const char* path)
+{
+	if (tree == NULL || path == NULL || strlen(path) >= M70_FS_PATH_SIZE)
+		return NULL;
+
+	char parent[M70_FS_PATH_SIZE];
+	strcpy(parent, path);
+	size_t length = strlen(parent);
+	if (length > 0 && parent[length - 1] == '\\')
+		parent[--length] = '\0';
+	char* name = strrchr(parent, '\\');
+	if (name == NULL)
+		return NULL;
+	*name++ = '\0';
+
+	const m70_fs_dir_t* dir = m70_fs_tree_find_dir(tree, parent);
+	if (dir == NULL)
+		return NULL;
+	int i = 0;
+	for (i = 0; i < dir->count; i++)
+	{
+		if (strcmp(dir->entries[i].name, name) == 0)
+			return &dir->entries[i];
+	}
+	return NULL;
+}
@@ -0,0 +1,61 @@
+#ifndef __H_M70_FS_TREE_H__
+#define __H_M70_FS_TREE_H__
+
+// Cached index of a directory tree on the controller. m70_fs_tree_build lists every directory
+// below the root. m70_fs_tree_refresh stats the cached directories and lists only the ones whose
+// modification time changed, plus directories that appeared since. A listing gives the names;
+// sizes, times and the directory flag come from a stat of each entry. Stats and directory reads
+// are pipelined. A file rewritten in place leaves its directory time alone, so only a build
+// picks that up, or m70_fs_tree_update_files from the code that rewrote it.
+
+#include "typedef.h"
+
+#define M70_FS_NAME_SIZE 128
+#define M70_FS_PATH_SIZE 256
+#define M70_FS_MODE_DIRECTORY 0x10 // file_FS_stat.mode bit of a directory
+
+typedef struct _tag_m70_fs_entry
+{
+	char name[M70_FS_NAME_SIZE];
+	bool is_dir;
+	uint32 size;  // 0 for directories
+	uint64 mtime; // YYYYMMDDhhmmss from mochaFSStatFile
+} m70_fs_entry_t;
+
+typedef struct _tag_m70_fs_dir
+{
+	char path[M70_FS_PATH_SIZE]; // Ends with a backslash
+	uint64 mtime;				 // YYYYMMDDhhmmss from mochaFSStatFile
+	m70_fs_entry_t* entries;
+	int count;
+	int capacity;
+	bool check; // Stat pending in the running build or refresh
+	bool stale; // Listing pending in the running build or refresh
+} m70_fs_dir_t;
+
+typedef struct _tag_m70_fs_tree
+{
+	m70_fs_dir_t* dirs; // The root first, every directory after its parent
+	int count;
+	int capacity;
+	bool root_only;	 // List the root alone, its subdirectories stay plain entries
+	uint32 listed;	 // Directories listed by the last build or refresh
+	uint32 requests; // Round trips of the last build or refresh
+} m70_fs_tree_t;
+
+// root is a directory such as "M01:\PRG\USER", the trailing backslash is optional
+m70_fs_tree_t* m70_fs_tree_create(const char* root);
+void m70_fs_tree_destroy(m70_fs_tree_t* tree);
+
+m70_error_code_e m70_fs_tree_build(m70_conn_t* conn, m70_fs_tree_t* tree);
+m70_error_code_e m70_fs_tree_refresh(m70_conn_t* conn, m70_fs_tree_t* tree);
+
+// Stats the named files of a cached directory in one pipelined batch after the caller changed
+// them; their entries are replaced or added, and those of files that no longer exist dropped
+m70_error_code_e m70_fs_tree_update_files(m70_conn_t* conn, m70_fs_tree_t* tree, const char* dir_path, const char* const* names, int count);
+
+// Paths are full controller paths; NULL when the tree does not hold them
+const m70_fs_dir_t* m70_fs_tree_find_dir(const m70_fs_tree_t* tree, const char* path);
+const m70_fs_entry_t* m70_fs_tree_find(const m70_fs_tree_t* tree, const char* path);
+
+#endif // __H_M70_FS_TREE_H__
@@ -1,8 +1,10 @@
+﻿#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include "m70_giop.h"
+#include "m70_stats.h"
 #include "socket.h"
 
 #ifdef _WIN32
@@ -44,11 +46,6 @@
 #define T_FLOATBIN 0x6
 #define T_CLCTDATA 0x100
 
-// open mode
-#define M_FSOPEN_RDONLY 0x0000
-#define M_FSOPEN_WRONLY 0x0001
-#define M_FSOPEN_RDWR 0x0002
-
 const char op_command_get_data[] = "mochaGetData";
 const char op_command_set_data[] = "mochaSetData";
 const char op_command_get_alarm_msg[] = "mochaGetCurrentAlarmMsgFirst";
@@ -65,6 +62,13 @@ const char op_command_fs_close_dir[] = "mochaFSCloseDirectory";
 const char op_command_fs_read_dir[] = "mochaFSReadDirectory";
 const char op_command_cancel_modal2[] = "mochaCancelModal2";
 
+// Fixed part of a pack followed by caller-owned bytes, sent without a staging copy or trailing padding
+static int giop_send_pack(m70_conn_t* conn, const void* pack, int pack_length, const void* payload, int payload_length)
+{
+	socket_iovec_t iov[2] = {{pack, pack_length}, {payload, payload_length}};
+	return socket_send_iov(conn->socket, iov, payload_length > 0 ? 2 : 1);
+}
+
 int get_data_type_length(int datatype)
 {
 	int len = T_CHAR_SIZE;
@@ -83,6 +87,103 @@ int get_data_type_length(int datatype)
 	return len;
 }
 
+// Pull bytes from the socket until at least 'need' unread bytes are buffered.
+// Every recv asks for all free space, so one call normally brings in a whole frame.
+static int giop_fill_buffer(m70_conn_t* conn, int need)
+{
+	m70_recv_buffer_t* rb = &conn->recv_buffer;
+	int buffered = rb->end - rb->start;
+	if (need > M70_RECV_BUFFER_SIZE)
+		need = M70_RECV_BUFFER_SIZE;
+	if (buffered >= need)
+		return buffered;
+
+	if (rb->start > 0)
+	{
+		memmove(rb->data, rb->data + rb->start, buffered);
+		rb->start = 0;
+		rb->end = buffered;
+	}
+
+	while (rb->end < need)
+	{
+		int count = socket_recv_data_one_loop(conn->socket, rb->data + rb->end, M70_RECV_BUFFER_SIZE - rb->end);
+		if (count <= 0)
+		{
+			// 0 is EOF, -1 is socket exception
+			conn->connected = false;
+			return -1;
+		}
+		rb->end += count;
+	}
+	return rb->end;
+}
+
+int giop_recv_data(m70_conn_t* conn, void* ptr, int nbytes)
+{
+	if (conn == NULL || ptr == NULL || nbytes <= 0)
+		return 0;
+
+	m70_recv_buffer_t* rb = &conn->recv_buffer;
+	byte* dst = (byte*)ptr;
+	int total = 0;
+	while (total < nbytes)
+	{
+		int buffered = rb->end - rb->start;
+		int left = nbytes - total;
+		if (buffered == 0)
+		{
+			// Large payloads bypass the buffer and land in the caller memory directly
+			if (left >= M70_RECV_BUFFER_SIZE)
+			{
+				if (socket_recv_data(conn->socket, dst + total, left) != left)
+				{
+					conn->connected = false;
+					return -1;
+				}
+				return nbytes;
+			}
+			if (giop_fill_buffer(conn, left) < 0)
+				return -1;
+			continue;
+		}
+
+		int count = buffered < left ? buffered : left;
+		memcpy(dst + total, rb->data + rb->start, count);
+		rb->start += count;
+		total += count;
+	}
+	return total;
+}
+
+static int giop_skip_data(m70_conn_t* conn, int nbytes)
+{
+	m70_recv_buffer_t* rb = &conn->recv_buffer;
+	int total = 0;
+	while (total < nbytes)
+	{
+		int buffered = rb->end - rb->start;
+		int left = nbytes - total;
+		if (buffered == 0)
+		{
+			if (giop_fill_buffer(conn, left) < 0)
+				return -1;
+			continue;
+		}
+
+		int count = buffered < left ? buffered : left;
+		rb->start += count;
+		total += count;
+	}
+	return total;
+}
+
+static void giop_reset_buffer(m70_conn_t* conn)
+{
+	conn->recv_buffer.start = 0;
+	conn->recv_buffer.end = 0;
+}
+
 long receive_error_data_response(m70_conn_t* conn, int* remain_length)
 {
 	if (!check_conn_is_valid(conn))
@@ -90,10 +191,11 @@ long receive_error_data_response(m70_conn_t* conn, int* remain_length)
 
 	int exceptionLen = 0;
 	int code = 0;
-	*remain_length -= socket_recv_data_one_loop(conn->socket, &exceptionLen, 4);
+	*remain_length -= giop_recv_data(conn, &exceptionLen, 4);
 	*remain_length -= receive_remain_info_response(conn, &exceptionLen);
 	mel_error_code errorPack;
-	*remain_length -= socket_recv_data_one_loop(conn->socket, &errorPack, sizeof(errorPack));
+	memset((void*)&errorPack, 0, sizeof(errorPack));
+	*remain_length -= giop_recv_data(conn, &errorPack, sizeof(errorPack));
 	code = errorPack.error_code;
 	return code;
 }
@@ -104,13 +206,12 @@ long receive_remain_info_response(m70_conn_t* conn, int* remain_length)
 		return -1;
 
 	long sum = 0;
-	long rl = 0;
-	while (*remain_length > 0)
+	if (*remain_length > 0)
 	{
-		char ch = 0;
-		rl = socket_recv_data_one_loop(conn->socket, &ch, 1);
-		sum += rl;
-		*remain_length -= rl;
+		sum = giop_skip_data(conn, *remain_length);
+		if (sum < 0)
+			return -1;
+		*remain_length -= sum;
 	}
 	return sum;
 }
@@ -135,7 +236,8 @@ bool is_mutiple_axis(int axis_flag)
 	return isMutiple;
 }
 
-int receive_get_data_response(m70_conn_t* conn, int len, m70_data_type_e* data_type, int axis_flag, void* data)
+// data_size bounds the copy into data, 0 leaves it unchecked
+int receive_get_data_response(m70_conn_t* conn, int len, m70_data_type_e* data_type, int axis_flag, void* data, int data_size)
 {
 	if (!check_conn_is_valid(conn))
 		return 0;
@@ -148,7 +250,9 @@ int receive_get_data_response(m70_conn_t* conn, int len, m70_data_type_e* data_t
 	{
 		get_data_float_bin_response_header rsp;
 		headLen = sizeof(rsp);
-		readLen = socket_recv_data_one_loop(conn->socket, &rsp, headLen);
+		if (len < headLen)
+			return 0; // Not a multi-axis reply, the caller skips the frame
+		readLen = giop_recv_data(conn, &rsp, headLen);
 		dataLen = rsp.data_length - 8;
 		*data_type = rsp.data_type;
 	}
@@ -156,14 +260,22 @@ int receive_get_data_response(m70_conn_t* conn, int len, m70_data_type_e* data_t
 	{
 		get_data_response_header rsp;
 		headLen = sizeof(rsp);
-		readLen = socket_recv_data_one_loop(conn->socket, &rsp, headLen);
+		readLen = giop_recv_data(conn, &rsp, headLen);
 		dataLen = rsp.data_length;
 		*data_type = rsp.data_type;
 	}
 
-	if (len > headLen)
+	if (readLen != headLen)
+		return readLen;
+
+	// Never read past the end of the frame or the caller buffer
+	if (dataLen > len - headLen)
+		dataLen = len - headLen;
+	if (data_size > 0 && dataLen > data_size)
+		dataLen = data_size;
+	if (dataLen > 0)
 	{
-		readLen += socket_recv_data_one_loop(conn->socket, data, dataLen);
+		readLen += giop_recv_data(conn, data, dataLen);
 	}
 	return readLen;
 }
@@ -174,22 +286,36 @@ int receive_data_response(m70_conn_t* conn, int len, int data_type, void* data)
 		return 0;
 
 	// Bit,Word,DWord,String
-	return socket_recv_data_one_loop(conn->socket, data, len);
+	return giop_recv_data(conn, data, len);
 }
 
-bool giop_connect(const char* ip, int type, int port, m70_conn_t* conn)
+// Protocol state for a fresh socket; closes the previous one
+void giop_init_conn(m70_conn_t* conn, int type)
 {
-	if (ip == NULL || strlen(ip) <= 0 || port <= 0 || conn == NULL)
-		return false;
-
 	conn->nc_type = (m70_nc_type_e)type;
 	conn->little_endian = true;
 	srand((uint32)time(NULL));
 	conn->request_id = rand() % 0xFFFF;
+	if (conn->pipeline_depth == 0)
+		conn->pipeline_depth = M70_DEFAULT_PIPELINE_DEPTH;
 
 	if (conn->socket > 0)
 		giop_disconnect(conn);
 
+	giop_reset_buffer(conn);
+	memset((void*)&conn->meta, 0, sizeof(conn->meta));
+	memset((void*)&conn->last_error, 0, sizeof(conn->last_error));
+	memset((void*)conn->override_method.read_tick, 0, sizeof(conn->override_method.read_tick));
+	if (conn->override_method.ttl_ms == 0)
+		conn->override_method.ttl_ms = M70_DEFAULT_OVERRIDE_METHOD_TTL;
+}
+
+bool giop_connect(const char* ip, int type, int port, m70_conn_t* conn)
+{
+	if (ip == NULL || strlen(ip) <= 0 || port <= 0 || conn == NULL)
+		return false;
+
+	giop_init_conn(conn, type);
 	conn->socket = socket_open_tcp_client_socket((char*)ip, port);
 	if (conn->socket > 0)
 	{
@@ -207,6 +333,77 @@ void giop_disconnect(m70_conn_t* conn)
 	socket_close_tcp_socket(conn->socket);
 	conn->socket = -1;
 	conn->connected = false;
+	giop_reset_buffer(conn);
+}
+
+int build_get_data_pack(m70_conn_t* conn, get_data_pack* pack, int section, int sub_section, int system_no, int axis_flag, m70_data_type_e data_type)
+{
+	giop_header giop;
+	build_giop_header(conn, &giop);
+
+	request_pack_header request;
+	build_request_pack_header(conn, &request, 0x0D);
+
+	memset((void*)pack, 0, sizeof(*pack));
+	giop.data_length = sizeof(*pack) - sizeof(giop);
+
+	pack->giop = giop;
+	pack->request = request;
+	strncpy(pack->op, op_command_get_data, sizeof(pack->op));
+	pack->op[sizeof(pack->op) - 1] = '\0';
+
+	pack->principal = HtoNl(conn->little_endian, 0x00);
+
+	pack->section = section;
+	pack->sub_section = sub_section;
+	pack->system_no = system_no;
+	pack->axis_no = axis_flag; // SET_AXIS_NO(axis_no));
+	pack->u2 = 0x00;
+	pack->data_type = data_type;
+	return sizeof(*pack);
+}
+
+int build_alarm_info_pack(m70_conn_t* conn, alarm_info_pack* pack, int system_no, int msg_count, int msg_type)
+{
+	giop_header giop;
+	build_giop_header(conn, &giop);
+
+	request_pack_header request;
+	build_request_pack_header(conn, &request, 0x1D);
+
+	memset((void*)pack, 0, sizeof(*pack));
+	giop.data_length = sizeof(*pack) - sizeof(giop);
+
+	pack->giop = giop;
+	pack->request = request;
+	strncpy(pack->op, op_command_get_alarm_msg, sizeof(pack->op));
+	pack->op[sizeof(pack->op) - 1] = '\0';
+	pack->principal = HtoNl(conn->little_endian, 0x00);
+	pack->system_no = system_no;
+	pack->msg_count = msg_count;
+	pack->msg_type = msg_type;
+	return sizeof(*pack);
+}
+
+int build_prog_block_pack(m70_conn_t* conn, prog_block_pack* pack, int system_no, int row_count)
+{
+	giop_header giop;
+	build_giop_header(conn, &giop);
+
+	request_pack_header request;
+	build_request_pack_header(conn, &request, 0x1D);
+
+	memset((void*)pack, 0, sizeof(*pack));
+	giop.data_length = sizeof(*pack) - sizeof(giop);
+
+	pack->giop = giop;
+	pack->request = request;
+	strncpy(pack->op, op_command_get_prog_block, sizeof(pack->op));
+	pack->op[sizeof(pack->op) - 1] = '\0';
+	pack->principal = HtoNl(conn->little_endian, 0x00000000);
+	pack->system_no = system_no;
+	pack->row_count = row_count;
+	return sizeof(*pack);
 }
 
 long melGetData(m70_conn_t* conn, int section, int sub_section, int system_no, int axis_flag, m70_data_type_e* int_out_data_type, void* out_data_value)
@@ -217,42 +414,87 @@ long melGetData(m70_conn_t* conn, int section, int sub_section, int system_no, i
 
 	if (conn->connected)
 	{
-		giop_header giop;
-		build_giop_header(conn, &giop);
-
-		request_pack_header request;
-		build_request_pack_header(conn, &request, 0x0D);
-
 		get_data_pack pack;
-		memset((void*)&pack, 0, sizeof(pack));
-		giop.data_length = sizeof(pack) - sizeof(giop);
-
-		pack.giop = giop;
-		pack.request = request;
-		strncpy(pack.op, op_command_get_data, sizeof(pack.op));
-		pack.op[sizeof(pack.op) - 1] = '\0';
-
-		pack.principal = HtoNl(conn->little_endian, 0x00);
-
-		pack.section = section;
-		pack.sub_section = sub_section;
-		pack.system_no = system_no;
-		pack.axis_no = axis_flag; // SET_AXIS_NO(axis_no));
-		pack.u2 = 0x00;
-		pack.data_type = *int_out_data_type;
+		build_get_data_pack(conn, &pack, section, sub_section, system_no, axis_flag, *int_out_data_type);
 
+		uint64 start = m70_stats_begin(conn);
 		socket_send_data(conn->socket, &pack, sizeof(pack));
+		giop_header giop;
 		memset((void*)&giop, 0, sizeof(giop));
 		int msg_length = 0;
 		code = mel_receive_response(conn, &giop, &msg_length);
+		m70_stats_end(conn, M70_STATS_OP_GET_DATA, start, code);
 		if (code == 0)
 		{
-			msg_length -= receive_get_data_response(conn, msg_length, int_out_data_type, axis_flag, out_data_value);
+			msg_length -= receive_get_data_response(conn, msg_length, int_out_data_type, axis_flag, out_data_value, 0);
 		}
 		receive_remain_info_response(conn, &msg_length);
 	}
 	return code;
 }
+// Returns the number of bytes to send, the pack is only filled up to the data of data_type
+int build_set_data_pack(m70_conn_t* conn, set_data_pack* pack, int section, int sub_section, int system_no, int axis_flag, m70_data_type_e data_type, void* data)
+{
+	giop_header giop;
+	build_giop_header(conn, &giop);
+
+	request_pack_header request;
+	build_request_pack_header(conn, &request, 0x0D);
+
+	memset((void*)pack, 0, sizeof(*pack));
+
+	pack->giop = giop;
+	pack->request = request;
+	strncpy(pack->op, op_command_set_data, sizeof(pack->op));
+	pack->op[sizeof(pack->op) - 1] = '\0';
+	pack->principal = HtoNl(conn->little_endian, 0x00000000);
+
+	pack->section = section;
+	pack->sub_section = sub_section;
+	pack->system_no = system_no;
+	pack->axis_no = axis_flag; // SET_AXIS_NO(axis_no));
+	pack->u2 = 0x00000000;
+	pack->data_type = data_type;
+	pack->byte_numbers = get_data_type_length(data_type);
+
+	if (T_CHAR == data_type)
+	{
+		pack->data.u_byte = *(byte*)data;
+	}
+	if (T_SHORT == data_type)
+	{
+		pack->data.u_word = *(ushort*)data;
+	}
+	else if ((T_LONG == data_type) || (T_DLONG == data_type))
+	{
+		pack->data.u_dword = *(uint32*)data;
+	}
+	else if (T_DOUBLE == data_type)
+	{
+		pack->data.u.f = *(uint32*)data;
+		pack->data.u.d = *((uint32*)data + 1);
+	}
+	else if (T_FLOATBIN == data_type)
+	{
+		pack->data.u3.int_data_nos = *(ushort*)data;
+		pack->data.u3.dec_data_nos = *((ushort*)data + 1);
+		pack->data.u3.option = *((uint32*)data + 1);
+		pack->data.u3.data = *((double*)data + 1);
+	}
+	else if (T_STR == data_type)
+	{
+		T_string* temp = (T_string*)data;
+		if (temp->msg_length >= 512)
+			temp->msg_length = 512;
+
+		pack->data.u_str.msg_size = temp->msg_length;
+		strncpy(pack->data.u_str.text, temp->text, temp->msg_length);
+		pack->byte_numbers = 4 + temp->msg_length; // Length + content
+	}
+	pack->giop.data_length = 48 + sizeof(request) + pack->byte_numbers;
+	return pack->giop.data_length + sizeof(giop);
+}
+
 long melSetData(m70_conn_t* conn, int section, int sub_section, int system_no, int axis_flag, m70_data_type_e data_type, void* data)
 {
 	long code = 1;
@@ -261,70 +503,16 @@ long melSetData(m70_conn_t* conn, int section, int sub_section, int system_no, i
 
 	if (conn->connected)
 	{
-		giop_header giop;
-		build_giop_header(conn, &giop);
-
-		request_pack_header request;
-		build_request_pack_header(conn, &request, 0x0D);
-
 		set_data_pack pack;
-		memset((void*)&pack, 0, sizeof(pack));
+		int send_length = build_set_data_pack(conn, &pack, section, sub_section, system_no, axis_flag, data_type, data);
 
-		pack.giop = giop;
-		pack.request = request;
-		strncpy(pack.op, op_command_set_data, sizeof(pack.op));
-		pack.op[sizeof(pack.op) - 1] = '\0';
-		pack.principal = HtoNl(conn->little_endian, 0x00000000);
-
-		pack.section = section;
-		pack.sub_section = sub_section;
-		pack.system_no = system_no;
-		pack.axis_no = axis_flag; // SET_AXIS_NO(axis_no));
-		pack.u2 = 0x00000000;
-		pack.data_type = data_type;
-		pack.byte_numbers = get_data_type_length(data_type);
-
-		if (T_CHAR == data_type)
-		{
-			pack.data.u_byte = *(byte*)data;
-		}
-		if (T_SHORT == data_type)
-		{
-			pack.data.u_word = *(ushort*)data;
-		}
-		else if ((T_LONG == data_type) || (T_DLONG == data_type))
-		{
-			pack.data.u_dword = *(uint32*)data;
-		}
-		else if (T_DOUBLE == data_type)
-		{
-			pack.data.u.f = *(uint32*)data;
-			pack.data.u.d = *((uint32*)data + 1);
-		}
-		else if (T_FLOATBIN == data_type)
-		{
-			pack.data.u3.int_data_nos = *(ushort*)data;
-			pack.data.u3.dec_data_nos = *((ushort*)data + 1);
-			pack.data.u3.option = *((uint32*)data + 1);
-			pack.data.u3.data = *((double*)data + 1);
-		}
-		else if (T_STR == data_type)
-		{
-			T_string* temp = (T_string*)data;
-			if (temp->msg_length >= 512)
-				temp->msg_length = 512;
-
-			pack.data.u_str.msg_size = temp->msg_length;
-			strncpy(pack.data.u_str.text, temp->text, temp->msg_length);
-			pack.byte_numbers = 4 + temp->msg_length; // Length + content
-		}
-		pack.giop.data_length = 48 + sizeof(request) + pack.byte_numbers;
-
-		int send_length = pack.giop.data_length + sizeof(giop);
+		uint64 start = m70_stats_begin(conn);
 		socket_send_data(conn->socket, &pack, send_length);
+		giop_header giop;
 		memset((void*)&giop, 0, sizeof(giop));
 		int msg_length = 0;
 		code = mel_receive_response(conn, &giop, &msg_length);
+		m70_stats_end(conn, M70_STATS_OP_SET_DATA, start, code);
 		receive_remain_info_response(conn, &msg_length);
 	}
 	return code;
@@ -337,29 +525,16 @@ long melGetCurrentAlarmMsg(m70_conn_t* conn, int system_no, int msg_count, int m
 
 	if (conn->connected)
 	{
-		giop_header giop;
-		build_giop_header(conn, &giop);
-
-		request_pack_header request;
-		build_request_pack_header(conn, &request, 0x1D);
-
 		alarm_info_pack pack;
-		memset((void*)&pack, 0, sizeof(pack));
-		giop.data_length = sizeof(pack) - sizeof(giop);
-
-		pack.giop = giop;
-		pack.request = request;
-		strncpy(pack.op, op_command_get_alarm_msg, sizeof(pack.op));
-		pack.op[sizeof(pack.op) - 1] = '\0';
-		pack.principal = HtoNl(conn->little_endian, 0x00);
-		pack.system_no = system_no;
-		pack.msg_count = msg_count;
-		pack.msg_type = msg_type;
+		build_alarm_info_pack(conn, &pack, system_no, msg_count, msg_type);
 
+		uint64 start = m70_stats_begin(conn);
 		socket_send_data(conn->socket, &pack, sizeof(pack));
+		giop_header giop;
 		memset((void*)&giop, 0, sizeof(giop));
 		int msg_length = 0;
 		code = mel_receive_response(conn, &giop, &msg_length);
+		m70_stats_end(conn, M70_STATS_OP_ALARM_MSG, start, code);
 		if (code == 0)
 		{
 			msg_length -= receive_data_response(conn, msg_length, (int)T_STR, msg);
@@ -376,28 +551,16 @@ long melGetCurrentPrgBlock(m70_conn_t* conn, int system_no, int row_count, void*
 
 	if (conn->connected)
 	{
-		giop_header giop;
-		build_giop_header(conn, &giop);
-
-		request_pack_header request;
-		build_request_pack_header(conn, &request, 0x1D);
-
 		prog_block_pack pack;
-		memset((void*)&pack, 0, sizeof(pack));
-		giop.data_length = sizeof(pack) - sizeof(giop);
-
-		pack.giop = giop;
-		pack.request = request;
-		strncpy(pack.op, op_command_get_prog_block, sizeof(pack.op));
-		pack.op[sizeof(pack.op) - 1] = '\0';
-		pack.principal = HtoNl(conn->little_endian, 0x00000000);
-		pack.system_no = system_no;
-		pack.row_count = row_count;
+		build_prog_block_pack(conn, &pack, system_no, row_count);
 
+		uint64 start = m70_stats_begin(conn);
 		socket_send_data(conn->socket, &pack, sizeof(pack));
+		giop_header giop;
 		memset((void*)&giop, 0, sizeof(giop));
 		int msg_length = 0;
 		code = mel_receive_response(conn, &giop, &msg_length);
+		m70_stats_end(conn, M70_STATS_OP_PRG_BLOCK, start, code);
 		if (code == 0)
 		{
 			msg_length -= receive_data_response(conn, msg_length, (int)T_STR, msg);
@@ -407,6 +570,348 @@ long melGetCurrentPrgBlock(m70_conn_t* conn, int system_no, int row_count, void*
 	return code;
 }
 
+void mel_pipeline_init(mel_pipeline_t* pipe, m70_conn_t* conn, int depth)
+{
+	memset((void*)pipe, 0, sizeof(*pipe));
+	pipe->conn = conn;
+	if (depth <= 0)
+		depth = 1;
+	if (depth > M70_MAX_PIPELINE_DEPTH)
+		depth = M70_MAX_PIPELINE_DEPTH;
+	pipe->depth = depth;
+}
+
+int mel_pipeline_request_size(const mel_request_t* request)
+{
+	switch (request->op)
+	{
+	case MEL_OP_FS_WRITE_FILE:
+		return -1;
+
+	case MEL_OP_FS_STAT_FILE:
+	case MEL_OP_FS_CREATE_FILE:
+	case MEL_OP_FS_REMOVE_FILE:
+		if (request->in == NULL)
+			return -1;
+		return MEL_PIPELINE_MAX_PACK + (int)strlen((const char*)request->in);
+
+	default:
+		return MEL_PIPELINE_MAX_PACK;
+	}
+}
+
+bool mel_pipeline_flush(mel_pipeline_t* pipe)
+{
+	if (pipe->send_length == 0)
+		return true;
+
+	int length = pipe->send_length;
+	pipe->send_length = 0;
+	if (socket_send_data(pipe->conn->socket, pipe->send_buffer, length) != length)
+	{
+		pipe->conn->connected = false;
+		return false;
+	}
+	return true;
+}
+
+// Encodes the request into the send buffer; it goes out with the next flush
+bool mel_pipeline_submit(mel_pipeline_t* pipe, mel_request_t* request)
+{
+	m70_conn_t* conn = pipe->conn;
+	request->code = -1;
+	if (!check_conn_is_valid(conn) || pipe->inflight_count >= pipe->depth)
+		return false;
+	if (request->op != MEL_OP_FS_WRITE_FILE && mel_pipeline_request_size(request) < 0)
+		return false;
+
+	int length = 0;
+	union
+	{
+		giop_header giop;
+		get_data_pack get_data;
+		alarm_info_pack alarm;
+		prog_block_pack prog_block;
+		FS_read_file_pack fs_read;
+		FS_stat_file_pack fs_stat;
+		FS_read_directory_pack fs_read_dir;
+		FS_create_file_pack fs_create;
+		FS_close_file_pack fs_close;
+		FS_remove_pack fs_remove;
+	} pack;
+	const void* tail = NULL; // Sent right after the pack
+	int tail_length = 0;
+
+	switch (request->op)
+	{
+	case MEL_OP_GET_DATA:
+		length = build_get_data_pack(conn, &pack.get_data, request->section, request->sub_section, request->system_no, request->axis_flag, request->data_type);
+		request->request_id = pack.get_data.request.request_id;
+		break;
+
+	case MEL_OP_GET_ALARM_MSG:
+		length = build_alarm_info_pack(conn, &pack.alarm, request->system_no, request->count, request->msg_type);
+		request->request_id = pack.alarm.request.request_id;
+		break;
+
+	case MEL_OP_GET_PRG_BLOCK:
+		length = build_prog_block_pack(conn, &pack.prog_block, request->system_no, request->count);
+		request->request_id = pack.prog_block.request.request_id;
+		break;
+
+	case MEL_OP_FS_READ_FILE:
+		length = build_fs_read_file_pack(conn, &pack.fs_read, request->fd, request->count);
+		request->request_id = pack.fs_read.request.request_id;
+		break;
+
+	case MEL_OP_FS_STAT_FILE:
+		tail = request->in;
+		tail_length = (int)strlen((const char*)request->in);
+		length = build_fs_stat_file_pack(conn, &pack.fs_stat, tail_length);
+		request->request_id = pack.fs_stat.request.request_id;
+		break;
+
+	case MEL_OP_FS_READ_DIR:
+		length = build_fs_read_dir_pack(conn, &pack.fs_read_dir, request->fd);
+		request->request_id = pack.fs_read_dir.request.request_id;
+		break;
+
+	case MEL_OP_FS_CREATE_FILE:
+		tail = request->in;
+		tail_length = (int)strlen((const char*)request->in);
+		length = build_fs_create_file_pack(conn, &pack.fs_create, 0, tail_length);
+		request->request_id = pack.fs_create.request.request_id;
+		break;
+
+	case MEL_OP_FS_CLOSE_FILE:
+		length = build_fs_close_file_pack(conn, &pack.fs_close, request->fd);
+		request->request_id = pack.fs_close.request.request_id;
+		break;
+
+	case MEL_OP_FS_REMOVE_FILE:
+		tail = request->in;
+		tail_length = (int)strlen((const char*)request->in);
+		length = build_fs_remove_file_pack(conn, &pack.fs_remove, tail_length);
+		request->request_id = pack.fs_remove.request.request_id;
+		break;
+
+	case MEL_OP_FS_WRITE_FILE:
+	{
+		// The payload is not copied into the send buffer; whatever is queued goes out first
+		FS_write_file_pack write_pack;
+		int header_length = build_fs_write_file_pack(conn, &write_pack, request->fd, request->count);
+		request->request_id = write_pack.request.request_id;
+		if (!mel_pipeline_flush(pipe) || giop_send_pack(conn, &write_pack, header_length, request->in, request->count) < 0)
+		{
+			conn->connected = false;
+			return false;
+		}
+		request->send_tick = m70_stats_begin(conn);
+		pipe->inflight[pipe->inflight_count++] = request;
+		return true;
+	}
+
+	default:
+		return false;
+	}
+
+	if (length + tail_length > (int)sizeof(pipe->send_buffer))
+		return false;
+	if (pipe->send_length + length + tail_length > (int)sizeof(pipe->send_buffer) && !mel_pipeline_flush(pipe))
+		return false;
+
+	memcpy(pipe->send_buffer + pipe->send_length, &pack, length);
+	pipe->send_length += length;
+	if (tail_length > 0)
+	{
+		memcpy(pipe->send_buffer + pipe->send_length, tail, tail_length);
+		pipe->send_length += tail_length;
+	}
+	request->send_tick = m70_stats_begin(conn);
+	pipe->inflight[pipe->inflight_count++] = request;
+	return true;
+}
+
+static m70_stats_op_e mel_stats_op(mel_op_e op)
+{
+	switch (op)
+	{
+	case MEL_OP_GET_ALARM_MSG:
+		return M70_STATS_OP_ALARM_MSG;
+	case MEL_OP_GET_PRG_BLOCK:
+		return M70_STATS_OP_PRG_BLOCK;
+	case MEL_OP_FS_READ_FILE:
+		return M70_STATS_OP_FS_READ;
+	case MEL_OP_FS_WRITE_FILE:
+		return M70_STATS_OP_FS_WRITE;
+	case MEL_OP_FS_STAT_FILE:
+		return M70_STATS_OP_FS_STAT;
+	case MEL_OP_FS_READ_DIR:
+		return M70_STATS_OP_FS_READ_DIR;
+	case MEL_OP_FS_CREATE_FILE:
+		return M70_STATS_OP_FS_CREATE;
+	case MEL_OP_FS_CLOSE_FILE:
+		return M70_STATS_OP_FS_CLOSE;
+	case MEL_OP_FS_REMOVE_FILE:
+		return M70_STATS_OP_FS_REMOVE;
+	default:
+		return M70_STATS_OP_GET_DATA;
+	}
+}
+
+static void mel_pipeline_decode(m70_conn_t* conn, mel_request_t* request, int* msg_length)
+{
+	switch (request->op)
+	{
+	case MEL_OP_GET_DATA:
+		*msg_length -= receive_get_data_response(conn, *msg_length, &request->data_type, request->axis_flag, request->out, request->out_size);
+		break;
+
+	case MEL_OP_GET_ALARM_MSG:
+	case MEL_OP_GET_PRG_BLOCK:
+	{
+		int length = *msg_length;
+		if (request->out_size > 0 && length > request->out_size)
+			length = request->out_size;
+		*msg_length -= receive_data_response(conn, length, (int)T_STR, request->out);
+		break;
+	}
+
+	case MEL_OP_FS_READ_FILE:
+	{
+		long size = request->count;
+		if (request->out_size > 0 && size > request->out_size)
+			size = request->out_size;
+		request->out_length = (int)receive_fs_read_file_response(conn, msg_length, request->out, size);
+		break;
+	}
+
+	case MEL_OP_FS_WRITE_FILE:
+		request->out_length = (int)receive_fs_write_file_response(conn, msg_length);
+		break;
+
+	case MEL_OP_FS_STAT_FILE:
+		*msg_length -= ReceiveFsStatData(conn, *msg_length, (file_FS_stat*)request->out);
+		break;
+
+	case MEL_OP_FS_READ_DIR:
+		request->out_length = receive_fs_read_dir_response(conn, msg_length, (char*)request->out, request->out_size);
+		break;
+
+	case MEL_OP_FS_CREATE_FILE:
+		request->fd = receive_fs_handle_response(conn, msg_length);
+		break;
+
+	default:
+		break;
+	}
+}
+
+// Consumes one frame and returns the in-flight request it answers, NULL for any other frame
+mel_request_t* mel_pipeline_receive(mel_pipeline_t* pipe)
+{
+	m70_conn_t* conn = pipe->conn;
+	giop_header giop;
+	memset((void*)&giop, 0, sizeof(giop));
+	int msg_length = 0;
+	uint32 request_id = 0;
+	bool parsed = false;
+	long code = mel_receive_reply(conn, &giop, &msg_length, &request_id, &parsed);
+	if (!check_conn_is_valid(conn))
+		return NULL;
+
+	// A reply too short for its header carries no request id and answers nobody
+	if (giop.msg_type != (byte)MSG_TYPES_Reply || !parsed)
+		return NULL;
+
+	int i = 0;
+	for (i = 0; i < pipe->inflight_count; i++)
+	{
+		if (pipe->inflight[i]->request_id == request_id)
+			break;
+	}
+
+	// Reply to a request nobody is waiting for any more (e.g. timed out earlier)
+	if (i == pipe->inflight_count)
+	{
+		receive_remain_info_response(conn, &msg_length);
+		return NULL;
+	}
+
+	mel_request_t* request = pipe->inflight[i];
+	for (; i < pipe->inflight_count - 1; i++)
+		pipe->inflight[i] = pipe->inflight[i + 1];
+	pipe->inflight_count--;
+
+	request->code = code;
+	m70_stats_end(conn, mel_stats_op(request->op), request->send_tick, code);
+	if (code == 0 && (request->out != NULL || request->op == MEL_OP_FS_WRITE_FILE || request->op == MEL_OP_FS_CREATE_FILE))
+		mel_pipeline_decode(conn, request, &msg_length);
+	receive_remain_info_response(conn, &msg_length);
+	return request;
+}
+
+mel_request_t* mel_pipeline_complete(mel_pipeline_t* pipe)
+{
+	m70_conn_t* conn = pipe->conn;
+	if (!mel_pipeline_flush(pipe))
+		return NULL;
+
+	while (pipe->inflight_count > 0 && check_conn_is_valid(conn))
+	{
+		mel_request_t* request = mel_pipeline_receive(pipe);
+		if (request != NULL)
+			return request;
+	}
+
+	return NULL;
+}
+
+void mel_pipeline_abort(mel_pipeline_t* pipe)
+{
+	int i = 0;
+	for (i = 0; i < pipe->inflight_count; i++)
+		pipe->inflight[i]->code = -1;
+	pipe->inflight_count = 0;
+	pipe->send_length = 0;
+}
+
+// depth <= 0 uses the connection's pipeline depth
+long melPipelineRequests(m70_conn_t* conn, mel_request_t* requests, int count, int depth)
+{
+	long code = -1;
+	if (!check_conn_is_valid(conn) || requests == NULL || count <= 0)
+		return code;
+
+	int i = 0;
+	for (i = 0; i < count; i++)
+		requests[i].code = -1;
+
+	mel_pipeline_t pipe;
+	mel_pipeline_init(&pipe, conn, depth > 0 ? depth : (int)conn->pipeline_depth);
+
+	int next = 0;
+	int done = 0;
+	while (done < count)
+	{
+		while (next < count && pipe.inflight_count < pipe.depth)
+		{
+			if (!mel_pipeline_submit(&pipe, &requests[next]))
+				break;
+			next++;
+		}
+
+		if (mel_pipeline_complete(&pipe) == NULL)
+		{
+			mel_pipeline_abort(&pipe);
+			return code;
+		}
+		done++;
+	}
+
+	return 0;
+}
+
 long melFsOpenFile(m70_conn_t* conn, const char* filename, long mode, long* fd)
 {
 	long code = 1;
@@ -425,37 +930,69 @@ long melFsOpenFile(m70_conn_t* conn, const char* filename, long mode, long* fd)
 		build_request_pack_header(conn, &request, 0x10);
 
 		FS_open_file_pack pack;
-		memset((void*)&pack, 0, sizeof(pack));
+		memset((void*)&pack, 0, offsetof(FS_open_file_pack, file_name));
 
 		strncpy(pack.op, op_command_fs_open_file, sizeof(pack.op));
 		pack.op[sizeof(pack.op) - 1] = '\0';
 		pack.principal = HtoNl(conn->little_endian, 0x00000000);
 		pack.mode = HtoNl(conn->little_endian, 0x00000000);
 		pack.flag = mode;
-		size_t fsize = strlen(filename);
+		int fsize = (int)strlen(filename);
 		pack.file_name_size = fsize;
-		memset(pack.file_name, 0, 256);
-		memcpy((void*)pack.file_name, filename, fsize);
 
-		giop.data_length = sizeof(pack) - sizeof(giop) - (sizeof(pack.file_name) - fsize);
+		giop.data_length = offsetof(FS_open_file_pack, file_name) - sizeof(giop) + fsize;
 		pack.giop = giop;
 		pack.request = request;
 
-		socket_send_data(conn->socket, &pack, sizeof(pack));
+		uint64 start = m70_stats_begin(conn);
+		giop_send_pack(conn, &pack, offsetof(FS_open_file_pack, file_name), filename, fsize);
 		memset((void*)&giop, 0, sizeof(giop));
 		int msg_length = 0;
 		code = mel_receive_response(conn, &giop, &msg_length);
+		m70_stats_end(conn, M70_STATS_OP_FS_OPEN, start, code);
 		if (code == 0)
-		{
-			long ret;
-			msg_length -= socket_recv_data_one_loop(conn->socket, &ret, sizeof(ret));
-			msg_length -= socket_recv_data_one_loop(conn->socket, fd, sizeof(uint32));
-		}
+			*fd = receive_fs_handle_response(conn, &msg_length);
 		receive_remain_info_response(conn, &msg_length);
 	}
 	return code;
 }
 
+int build_fs_read_file_pack(m70_conn_t* conn, FS_read_file_pack* pack, long fd, long need_read_size)
+{
+	giop_header giop;
+	build_giop_header(conn, &giop);
+
+	request_pack_header request;
+	build_request_pack_header(conn, &request, 0x10);
+
+	memset((void*)pack, 0, sizeof(*pack));
+	strncpy(pack->op, op_command_fs_read_file, sizeof(pack->op));
+	pack->op[sizeof(pack->op) - 1] = '\0';
+	pack->principal = HtoNl(conn->little_endian, 0x00000000);
+	pack->file_handle = fd;
+	pack->file_size = need_read_size;
+	giop.data_length = sizeof(*pack) - sizeof(giop);
+	pack->giop = giop;
+	pack->request = request;
+	return sizeof(*pack);
+}
+
+// Body of a successful read reply, returns the bytes stored in file_data
+long receive_fs_read_file_response(m70_conn_t* conn, int* msg_length, void* file_data, long need_read_size)
+{
+	uint32 ret = 0;
+	uint32 size = 0;
+	*msg_length -= giop_recv_data(conn, &ret, sizeof(ret));
+	*msg_length -= giop_recv_data(conn, &size, sizeof(size));
+	if (size > (uint32)need_read_size)
+		size = need_read_size;
+	if (size > (uint32)*msg_length)
+		size = *msg_length > 0 ? *msg_length : 0;
+	if (size > 0)
+		*msg_length -= receive_data_response(conn, size, 0, file_data);
+	return size;
+}
+
 long melFsReadFile(m70_conn_t* conn, long fd, void* file_data, long* read_size, long need_read_size)
 {
 	long code = 1;
@@ -467,42 +1004,47 @@ long melFsReadFile(m70_conn_t* conn, long fd, void* file_data, long* read_size,
 
 	if (conn->connected)
 	{
-		giop_header giop;
-		build_giop_header(conn, &giop);
-
-		request_pack_header request;
-		build_request_pack_header(conn, &request, 0x10);
-
 		FS_read_file_pack pack;
-		memset((void*)&pack, 0, sizeof(pack));
-		strncpy(pack.op, op_command_fs_read_file, sizeof(pack.op));
-		pack.op[sizeof(pack.op) - 1] = '\0';
-		pack.principal = HtoNl(conn->little_endian, 0x00000000);
-		pack.file_handle = fd;
-		pack.file_size = need_read_size;
-		giop.data_length = sizeof(pack) - sizeof(giop);
-		pack.giop = giop;
-		pack.request = request;
+		build_fs_read_file_pack(conn, &pack, fd, need_read_size);
 
+		uint64 start = m70_stats_begin(conn);
 		socket_send_data(conn->socket, &pack, sizeof(pack));
+		giop_header giop;
 		memset((void*)&giop, 0, sizeof(giop));
 		int msg_length = 0;
 		code = mel_receive_response(conn, &giop, &msg_length);
+		m70_stats_end(conn, M70_STATS_OP_FS_READ, start, code);
 		if (code == 0)
 		{
-			long ret = 0;
-			msg_length -= socket_recv_data_one_loop(conn->socket, &ret, sizeof(ret));
-			msg_length -= socket_recv_data_one_loop(conn->socket, read_size, sizeof(long));
-			if (*read_size)
-			{
-				msg_length -= receive_data_response(conn, *read_size, 0, file_data);
-			}
+			*read_size = receive_fs_read_file_response(conn, &msg_length, file_data, need_read_size);
 		}
 		receive_remain_info_response(conn, &msg_length);
 	}
 	return code;
 }
 
+int build_fs_close_file_pack(m70_conn_t* conn, FS_close_file_pack* pack, long fd)
+{
+	giop_header giop;
+	build_giop_header(conn, &giop);
+
+	request_pack_header request;
+	build_request_pack_header(conn, &request, 0x11);
+
+	memset((void*)pack, 0, sizeof(*pack));
+	strncpy(pack->op, op_command_fs_close_file, sizeof(pack->op));
+	pack->op[sizeof(pack->op) - 1] = '\0';
+
+	memcpy(pack->reserved, "\x0\x0\x0", sizeof(pack->reserved));
+	pack->principal = 0x00000000;
+	pack->file_handle = fd;
+
+	giop.data_length = sizeof(*pack) - sizeof(giop);
+	pack->giop = giop;
+	pack->request = request;
+	return sizeof(*pack);
+}
+
 long melFsCloseFile(m70_conn_t* conn, long fd)
 {
 	long code = 1;
@@ -511,40 +1053,55 @@ long melFsCloseFile(m70_conn_t* conn, long fd)
 
 	if (conn->connected)
 	{
-		giop_header giop;
-		build_giop_header(conn, &giop);
-
-		request_pack_header request;
-		build_request_pack_header(conn, &request, 0x11);
-
 		FS_close_file_pack pack;
-		memset((void*)&pack, 0, sizeof(pack));
-		strncpy(pack.op, op_command_fs_close_file, sizeof(pack.op));
-		pack.op[sizeof(pack.op) - 1] = '\0';
-
-		pack.giop = giop;
-		pack.request = request;
-		memcpy(pack.reserved, "\x0\x0\x0", sizeof(pack.reserved));
-		pack.principal = 0x00000000;
-		pack.file_handle = fd;
-
-		giop.data_length = sizeof(pack) - sizeof(giop);
-		pack.giop = giop;
-		pack.request = request;
-		giop.data_length = sizeof(pack) - sizeof(giop);
-
-		pack.giop = giop;
-		pack.request = request;
+		int length = build_fs_close_file_pack(conn, &pack, fd);
 
-		socket_send_data(conn->socket, &pack, sizeof(pack));
+		uint64 start = m70_stats_begin(conn);
+		socket_send_data(conn->socket, &pack, length);
+		giop_header giop;
 		memset((void*)&giop, 0, sizeof(giop));
 		int msg_length = 0;
 		code = mel_receive_response(conn, &giop, &msg_length);
+		m70_stats_end(conn, M70_STATS_OP_FS_CLOSE, start, code);
 		receive_remain_info_response(conn, &msg_length);
 	}
 	return code;
 }
 
+// Fills the pack up to file_name and returns that length; the name of name_length bytes follows it
+int build_fs_create_file_pack(m70_conn_t* conn, FS_create_file_pack* pack, long mode, int name_length)
+{
+	giop_header giop;
+	build_giop_header(conn, &giop);
+
+	request_pack_header request;
+	build_request_pack_header(conn, &request, 0x12);
+
+	memset((void*)pack, 0, offsetof(FS_create_file_pack, file_name));
+	strncpy(pack->op, op_command_fs_create_file, sizeof(pack->op));
+	pack->op[sizeof(pack->op) - 1] = '\0';
+
+	memcpy(pack->reserved, "\x00\x00", sizeof(pack->reserved));
+	pack->principal = 0x00000000;
+	pack->mode = mode;
+	pack->file_name_size = name_length;
+
+	giop.data_length = offsetof(FS_create_file_pack, file_name) - sizeof(giop) + name_length;
+	pack->giop = giop;
+	pack->request = request;
+	return offsetof(FS_create_file_pack, file_name);
+}
+
+// Body of a successful open or create reply, returns the file handle
+long receive_fs_handle_response(m70_conn_t* conn, int* msg_length)
+{
+	uint32 ret = 0;
+	uint32 handle = 0;
+	*msg_length -= giop_recv_data(conn, &ret, sizeof(ret));
+	*msg_length -= giop_recv_data(conn, &handle, sizeof(handle));
+	return handle;
+}
+
 long melFsCreateFile(m70_conn_t* conn, const char* filename, long mode, long* fd)
 {
 	long code = 1;
@@ -556,47 +1113,47 @@ long melFsCreateFile(m70_conn_t* conn, const char* filename, long mode, long* fd
 
 	if (conn->connected)
 	{
-		giop_header giop;
-		build_giop_header(conn, &giop);
-
-		request_pack_header request;
-		build_request_pack_header(conn, &request, 0x12);
-
 		FS_create_file_pack pack;
-		memset((void*)&pack, 0, sizeof(pack));
-		strncpy(pack.op, op_command_fs_create_file, sizeof(pack.op));
-		pack.op[sizeof(pack.op) - 1] = '\0';
-
-		pack.giop = giop;
-		pack.request = request;
-		memcpy(pack.reserved, "\x00\x00", sizeof(pack.reserved));
-		pack.principal = 0x00000000;
-		size_t fsize = strlen(filename);
-
-		pack.mode = mode;
-		pack.file_name_size = fsize;
-		memcpy(pack.file_name, filename, fsize);
+		int fsize = (int)strlen(filename);
+		int header_length = build_fs_create_file_pack(conn, &pack, mode, fsize);
 
-		giop.data_length = sizeof(pack) - sizeof(giop) - (sizeof(pack.file_name) - fsize);
-
-		pack.giop = giop;
-		pack.request = request;
-
-		socket_send_data(conn->socket, &pack, sizeof(pack));
+		uint64 start = m70_stats_begin(conn);
+		giop_send_pack(conn, &pack, header_length, filename, fsize);
+		giop_header giop;
 		memset((void*)&giop, 0, sizeof(giop));
 		int msg_length = 0;
 		code = mel_receive_response(conn, &giop, &msg_length);
+		m70_stats_end(conn, M70_STATS_OP_FS_CREATE, start, code);
 		if (code == 0)
-		{
-			long ret = 0;
-			msg_length -= socket_recv_data_one_loop(conn->socket, &ret, sizeof(uint32));
-			msg_length -= socket_recv_data_one_loop(conn->socket, fd, sizeof(uint32));
-		}
+			*fd = receive_fs_handle_response(conn, &msg_length);
 		receive_remain_info_response(conn, &msg_length);
 	}
 	return code;
 }
 
+// Fills the pack up to file_name and returns that length; the name of name_length bytes follows it
+int build_fs_remove_file_pack(m70_conn_t* conn, FS_remove_pack* pack, int name_length)
+{
+	giop_header giop;
+	build_giop_header(conn, &giop);
+
+	request_pack_header request;
+	build_request_pack_header(conn, &request, 0x12);
+
+	memset((void*)pack, 0, offsetof(FS_remove_pack, file_name));
+	strncpy(pack->op, op_command_fs_remove_file, sizeof(pack->op));
+	pack->op[sizeof(pack->op) - 1] = '\0';
+
+	memcpy(pack->reserved, "\x0\x0", 2);
+	pack->principal = 0x00000000;
+	pack->fileLen = name_length;
+
+	giop.data_length = offsetof(FS_remove_pack, file_name) - sizeof(giop) + name_length;
+	pack->giop = giop;
+	pack->request = request;
+	return offsetof(FS_remove_pack, file_name);
+}
+
 long melRemoveFile(m70_conn_t* conn, const char* file_name)
 {
 	long code = 1;
@@ -605,36 +1162,56 @@ long melRemoveFile(m70_conn_t* conn, const char* file_name)
 
 	if (conn->connected)
 	{
-		giop_header giop;
-		build_giop_header(conn, &giop);
-
-		request_pack_header request;
-		build_request_pack_header(conn, &request, 0x12);
-
 		FS_remove_pack pack;
-		memset((void*)&pack, 0, sizeof(pack));
-		strncpy(pack.op, op_command_fs_remove_file, sizeof(pack.op));
-		pack.op[sizeof(pack.op) - 1] = '\0';
-
-		size_t fileLen = strlen(file_name);
-		memcpy(pack.reserved, "\x0\x0", 2);
-		pack.principal = 0x00000000;
-		pack.fileLen = fileLen;
-
-		memcpy(pack.file_name, file_name, fileLen);
-		giop.data_length = sizeof(pack) - sizeof(giop) - (sizeof(pack.file_name) - fileLen);
-		pack.giop = giop;
-		pack.request = request;
+		int fileLen = (int)strlen(file_name);
+		int header_length = build_fs_remove_file_pack(conn, &pack, fileLen);
 
-		socket_send_data(conn->socket, &pack, sizeof(pack));
+		uint64 start = m70_stats_begin(conn);
+		giop_send_pack(conn, &pack, header_length, file_name, fileLen);
+		giop_header giop;
 		memset((void*)&giop, 0, sizeof(giop));
 		int msg_length = 0;
 		code = mel_receive_response(conn, &giop, &msg_length);
+		m70_stats_end(conn, M70_STATS_OP_FS_REMOVE, start, code);
 		receive_remain_info_response(conn, &msg_length);
 	}
 	return code;
 }
 
+// Fills the pack up to file_data and returns that length; the payload is sent from the caller
+// buffer right after it, so write_size is not bounded by file_data
+int build_fs_write_file_pack(m70_conn_t* conn, FS_write_file_pack* pack, long fd, long write_size)
+{
+	giop_header giop;
+	build_giop_header(conn, &giop);
+
+	request_pack_header request;
+	build_request_pack_header(conn, &request, 0x11);
+
+	memset((void*)pack, 0, offsetof(FS_write_file_pack, file_data));
+	strncpy(pack->op, op_command_fs_write_file, sizeof(pack->op));
+	pack->op[sizeof(pack->op) - 1] = '\0';
+
+	pack->principal = HtoNl(conn->little_endian, 0x00000000);
+	pack->file_handle = fd;
+	pack->file_size = write_size;
+
+	giop.data_length = offsetof(FS_write_file_pack, file_data) - sizeof(giop) + write_size;
+	pack->giop = giop;
+	pack->request = request;
+	return offsetof(FS_write_file_pack, file_data);
+}
+
+// Body of a successful write reply, returns the bytes written
+long receive_fs_write_file_response(m70_conn_t* conn, int* msg_length)
+{
+	uint32 ret = 0;
+	uint32 size = 0;
+	*msg_length -= giop_recv_data(conn, &ret, sizeof(ret));
+	*msg_length -= giop_recv_data(conn, &size, sizeof(size));
+	return size;
+}
+
 long melFsWriteFile(m70_conn_t* conn, long fd, void* file_data, long write_size, long* real_write_size)
 {
 	long code = 1;
@@ -645,35 +1222,21 @@ long melFsWriteFile(m70_conn_t* conn, long fd, void* file_data, long write_size,
 		return code;
 	if (conn->connected)
 	{
-		giop_header giop;
-		build_giop_header(conn, &giop);
-
-		request_pack_header request;
-		build_request_pack_header(conn, &request, 0x11);
-
 		FS_write_file_pack pack;
-		memset((void*)&pack, 0, sizeof(pack));
-		strncpy(pack.op, op_command_fs_write_file, sizeof(pack.op));
-		pack.op[sizeof(pack.op) - 1] = '\0';
-
-		pack.principal = HtoNl(conn->little_endian, 0x00000000);
-		pack.file_handle = fd;
-		pack.file_size = write_size;
-		memcpy((void*)pack.file_data, file_data, write_size);
-
-		giop.data_length = sizeof(pack) - sizeof(giop) - (sizeof(pack.file_data) - write_size);
-		pack.giop = giop;
-		pack.request = request;
-		socket_send_data(conn->socket, &pack, giop.data_length + sizeof(giop));
+		int header_length = build_fs_write_file_pack(conn, &pack, fd, write_size);
+		uint64 start = m70_stats_begin(conn);
+		giop_send_pack(conn, &pack, header_length, file_data, write_size);
 
 		int msg_length = 0;
+		giop_header giop;
 		memset(&giop, 0, sizeof(giop));
 		code = mel_receive_response(conn, &giop, &msg_length);
+		m70_stats_end(conn, M70_STATS_OP_FS_WRITE, start, code);
 		if (code == 0)
 		{
-			long ret = 0;
-			msg_length -= socket_recv_data_one_loop(conn->socket, &ret, sizeof(ret));
-			msg_length -= socket_recv_data_one_loop(conn->socket, real_write_size, sizeof(real_write_size));
+			long size = receive_fs_write_file_response(conn, &msg_length);
+			if (real_write_size != NULL)
+				*real_write_size = size;
 		}
 		receive_remain_info_response(conn, &msg_length);
 	}
@@ -692,15 +1255,43 @@ int ReceiveFsStatData(m70_conn_t* conn, int len, file_FS_stat* stat)
 
 	FS_stat_file_response_header rsp;
 	headLen = sizeof(rsp);
-	readLen = socket_recv_data_one_loop(conn->socket, &rsp, headLen);
-	dataLen = rsp.data_length;
+	readLen = giop_recv_data(conn, &rsp, headLen);
+	if (readLen != headLen)
+		return readLen;
 
-	if (len > headLen)
+	dataLen = rsp.data_length;
+	if (dataLen > len - headLen)
+		dataLen = len - headLen;
+	if (dataLen > (int)sizeof(file_FS_stat))
+		dataLen = sizeof(file_FS_stat);
+	if (dataLen > 0)
 	{
-		readLen += socket_recv_data_one_loop(conn->socket, (void*)stat, dataLen);
+		readLen += giop_recv_data(conn, (void*)stat, dataLen);
 	}
 	return readLen;
 }
+// Fills the pack up to file_name and returns that length; the name of name_length bytes follows it
+int build_fs_stat_file_pack(m70_conn_t* conn, FS_stat_file_pack* pack, int name_length)
+{
+	giop_header giop;
+	build_giop_header(conn, &giop);
+
+	request_pack_header request;
+	build_request_pack_header(conn, &request, 0x10);
+
+	memset((void*)pack, 0, offsetof(FS_stat_file_pack, file_name));
+	strncpy(pack->op, op_command_fs_stat_file, sizeof(pack->op));
+	pack->op[sizeof(pack->op) - 1] = '\0';
+
+	pack->principal = 0x00000000;
+	pack->file_name_size = name_length;
+
+	giop.data_length = offsetof(FS_stat_file_pack, file_name) - sizeof(giop) + name_length;
+	pack->giop = giop;
+	pack->request = request;
+	return offsetof(FS_stat_file_pack, file_name);
+}
+
 long melFSStatFile(m70_conn_t* conn, const char* filename, file_FS_stat* stat)
 {
 	long code = 1;
@@ -711,30 +1302,17 @@ long melFSStatFile(m70_conn_t* conn, const char* filename, file_FS_stat* stat)
 		return code;
 	if (conn->connected)
 	{
-		giop_header giop;
-		build_giop_header(conn, &giop);
-
-		request_pack_header request;
-		build_request_pack_header(conn, &request, 0x10);
-
 		FS_stat_file_pack pack;
-		memset((void*)&pack, 0, sizeof(pack));
-		strncpy(pack.op, op_command_fs_stat_file, sizeof(pack.op));
-		pack.op[sizeof(pack.op) - 1] = '\0';
-
-		size_t fileLen = strlen(filename);
-		pack.principal = 0x00000000;
-		pack.file_name_size = fileLen;
-		memcpy(pack.file_name, filename, fileLen);
+		int fileLen = (int)strlen(filename);
+		int header_length = build_fs_stat_file_pack(conn, &pack, fileLen);
 
-		giop.data_length = sizeof(pack) - sizeof(giop) - (sizeof(pack.file_name) - fileLen);
-		pack.giop = giop;
-		pack.request = request;
-
-		socket_send_data(conn->socket, &pack, sizeof(pack));
+		uint64 start = m70_stats_begin(conn);
+		giop_send_pack(conn, &pack, header_length, filename, fileLen);
+		giop_header giop;
 		memset((void*)&giop, 0, sizeof(giop));
 		int msg_length = 0;
 		code = mel_receive_response(conn, &giop, &msg_length);
+		m70_stats_end(conn, M70_STATS_OP_FS_STAT, start, code);
 		if (code == 0)
 		{
 			msg_length -= ReceiveFsStatData(conn, msg_length, stat);
@@ -762,28 +1340,31 @@ long melFsOpenDirectory(m70_conn_t* conn, const char* filepath, long* fd)
 		build_request_pack_header(conn, &request, 0x15);
 
 		FS_open_directory_pack pack;
-		memset((void*)&pack, 0, sizeof(pack));
+		memset((void*)&pack, 0, offsetof(FS_open_directory_pack, path_name));
 		strncpy(pack.op, op_command_fs_open_dir, sizeof(pack.op));
 		pack.op[sizeof(pack.op) - 1] = '\0';
-		size_t fileLen = strlen(filepath);
+		int fileLen = (int)strlen(filepath);
 
 		pack.principal = 0x00000000;
 		pack.path_name_size = fileLen;
-		memcpy(pack.path_name, filepath, fileLen);
 
-		giop.data_length = sizeof(pack) - sizeof(giop) - (sizeof(pack.path_name) - fileLen);
+		giop.data_length = offsetof(FS_open_directory_pack, path_name) - sizeof(giop) + fileLen;
 		pack.giop = giop;
 		pack.request = request;
 
-		socket_send_data(conn->socket, &pack, sizeof(pack));
+		uint64 start = m70_stats_begin(conn);
+		giop_send_pack(conn, &pack, offsetof(FS_open_directory_pack, path_name), filepath, fileLen);
 		memset((void*)&giop, 0, sizeof(giop));
 		int msg_length = 0;
 		code = mel_receive_response(conn, &giop, &msg_length);
+		m70_stats_end(conn, M70_STATS_OP_FS_OPEN_DIR, start, code);
 		if (code == 0)
 		{
-			long ret = 0;
-			msg_length -= socket_recv_data_one_loop(conn->socket, &ret, sizeof(uint32));
-			msg_length -= socket_recv_data_one_loop(conn->socket, fd, sizeof(uint32));
+			uint32 ret = 0;
+			uint32 handle = 0;
+			msg_length -= giop_recv_data(conn, &ret, sizeof(ret));
+			msg_length -= giop_recv_data(conn, &handle, sizeof(handle));
+			*fd = handle;
 		}
 		receive_remain_info_response(conn, &msg_length);
 	}
@@ -814,15 +1395,61 @@ long melFsCloseDirectory(m70_conn_t* conn, long fd)
 		pack.giop = giop;
 		pack.request = request;
 
+		uint64 start = m70_stats_begin(conn);
 		socket_send_data(conn->socket, &pack, sizeof(pack));
 		memset((void*)&giop, 0, sizeof(giop));
 		int msg_length = 0;
 		code = mel_receive_response(conn, &giop, &msg_length);
+		m70_stats_end(conn, M70_STATS_OP_FS_CLOSE_DIR, start, code);
 		receive_remain_info_response(conn, &msg_length);
 	}
 	return code;
 }
 
+int build_fs_read_dir_pack(m70_conn_t* conn, FS_read_directory_pack* pack, long fd)
+{
+	giop_header giop;
+	build_giop_header(conn, &giop);
+
+	request_pack_header request;
+	build_request_pack_header(conn, &request, 0x15);
+
+	memset((void*)pack, 0, sizeof(*pack));
+	strncpy(pack->op, op_command_fs_read_dir, sizeof(pack->op));
+	pack->op[sizeof(pack->op) - 1] = '\0';
+
+	pack->principal = HtoNl(conn->little_endian, 0x00000000);
+	pack->file_handle = fd;
+	giop.data_length = sizeof(*pack) - sizeof(giop);
+	pack->giop = giop;
+	pack->request = request;
+	return sizeof(*pack);
+}
+
+// Body of a successful directory read: the next entry including its terminating zero,
+// truncated to entry_size unless that is 0. Returns its length, 0 past the last entry.
+int receive_fs_read_dir_response(m70_conn_t* conn, int* msg_length, char* entry, int entry_size)
+{
+	uint32 ret = 0;
+	uint32 datasize = 0;
+	*msg_length -= giop_recv_data(conn, &ret, sizeof(ret));
+	*msg_length -= giop_recv_data(conn, &datasize, sizeof(datasize));
+	if (datasize == 0)
+		return 0;
+
+	int32 size = 0;
+	*msg_length -= giop_recv_data(conn, &ret, sizeof(ret));
+	*msg_length -= giop_recv_data(conn, &size, sizeof(size));
+	if (size > *msg_length)
+		size = *msg_length;
+	if (entry_size > 0 && size > entry_size)
+		size = entry_size;
+	if (size <= 0)
+		return 0;
+	*msg_length -= receive_data_response(conn, size, 0, entry);
+	return size;
+}
+
 long melFsReadDirectory(m70_conn_t* conn, long fd, char* dirname)
 {
 	long code = 1;
@@ -834,44 +1461,21 @@ long melFsReadDirectory(m70_conn_t* conn, long fd, char* dirname)
 
 	if (conn->connected)
 	{
-		giop_header giop;
-		build_giop_header(conn, &giop);
-
-		request_pack_header request;
-		build_request_pack_header(conn, &request, 0x15);
-
 		FS_read_directory_pack pack;
-		memset((void*)&pack, 0, sizeof(pack));
-		strncpy(pack.op, op_command_fs_read_dir, sizeof(pack.op));
-		pack.op[sizeof(pack.op) - 1] = '\0';
-
-		pack.principal = HtoNl(conn->little_endian, 0x00000000);
-		pack.file_handle = fd;
-		giop.data_length = sizeof(pack) - sizeof(giop);
-		pack.giop = giop;
-		pack.request = request;
+		int length = build_fs_read_dir_pack(conn, &pack, fd);
 
-		socket_send_data(conn->socket, &pack, sizeof(pack));
+		uint64 start = m70_stats_begin(conn);
+		socket_send_data(conn->socket, &pack, length);
+		giop_header giop;
 		memset((void*)&giop, 0, sizeof(giop));
 		int msg_length = 0;
 		code = mel_receive_response(conn, &giop, &msg_length);
+		m70_stats_end(conn, M70_STATS_OP_FS_READ_DIR, start, code);
 		if (code == 0)
 		{
-			long ret = 0;
-			long datasize = 0;
-			msg_length -= socket_recv_data_one_loop(conn->socket, &ret, sizeof(ret));
-			msg_length -= socket_recv_data_one_loop(conn->socket, &datasize, sizeof(datasize));
-			if (datasize)
-			{
-				long size = 0;
-				msg_length -= socket_recv_data_one_loop(conn->socket, &ret, sizeof(ret));
-				msg_length -= socket_recv_data_one_loop(conn->socket, &size, sizeof(size));
-				if (size > 0)
-				{
-					msg_length -= receive_data_response(conn, size, 0, dirname);
-					dirname[size - 1] = '\n';
-				}
-			}
+			int size = receive_fs_read_dir_response(conn, &msg_length, dirname, 0);
+			if (size > 0)
+				dirname[size - 1] = '\n';
 		}
 		receive_remain_info_response(conn, &msg_length);
 	}
@@ -905,31 +1509,47 @@ long CancelModal2(m70_conn_t* conn)
 		pack.u2 = 0x000002AB;
 		pack.u3 = 0x00000000;
 
+		uint64 start = m70_stats_begin(conn);
 		socket_send_data(conn->socket, &pack, sizeof(pack));
 		memset((void*)&giop, 0, sizeof(giop));
 		int msg_length = 0;
 		code = mel_receive_response(conn, &giop, &msg_length);
+		m70_stats_end(conn, M70_STATS_OP_CANCEL_MODAL, start, code);
 		receive_remain_info_response(conn, &msg_length);
 	}
 	return code;
 }
 
 int mel_receive_response(m70_conn_t* conn, giop_header* giop, int* remain_length)
+{
+	return mel_receive_reply(conn, giop, remain_length, NULL, NULL);
+}
+
+int mel_receive_reply(m70_conn_t* conn, giop_header* giop, int* remain_length, uint32* request_id, bool* parsed)
 {
 	int ret_code = 0;
+	if (parsed != NULL)
+		*parsed = false;
 	if (giop == NULL || conn == NULL)
 		return -1;
 
 	int recv_count = sizeof(giop_header);
-	int count = socket_recv_data_one_loop(conn->socket, giop, recv_count);
+	int count = giop_recv_data(conn, giop, recv_count);
 	if (recv_count == count)
 	{
 		*remain_length = giop->data_length;
-		if (*remain_length >= recv_count && giop->msg_type == (byte)MSG_TYPES_Reply)
+		// Bring in the rest of the frame so the body is parsed from memory
+		if (giop_fill_buffer(conn, *remain_length) < 0)
+			count = -1;
+		else if (*remain_length >= (int)sizeof(response_pack_header) && giop->msg_type == (byte)MSG_TYPES_Reply)
 		{
 			response_pack_header rpp;
 			memset((void*)&rpp, 0, sizeof(response_pack_header));
-			*remain_length -= socket_recv_data_one_loop(conn->socket, &rpp, sizeof(rpp));
+			*remain_length -= giop_recv_data(conn, &rpp, sizeof(rpp));
+			if (request_id != NULL)
+				*request_id = rpp.request_id;
+			if (parsed != NULL)
+				*parsed = true;
 			ret_code = rpp.is_error;
 			if (ret_code != 0)
 				ret_code = receive_error_data_response(conn, remain_length);
@@ -971,7 +1591,8 @@ void build_request_pack_header(m70_conn_t* conn, request_pack_header* request, i
 		return;
 
 	request->sc_list = HtoNl(conn->little_endian, 0x00);
-	request->request_id = conn->request_id;
+	// Every request carries its own id so pipelined replies can be matched
+	request->request_id = conn->request_id++;
 	request->expected = 0x01;
 	memcpy(request->reserved, "\x0\x0\x0", 3);
 	request->object_key_length = HtoNl(conn->little_endian, 0x04);
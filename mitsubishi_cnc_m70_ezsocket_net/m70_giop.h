@@ -5,7 +5,60 @@
 #include "typedef.h"
 #include "m70_ezsocket_private.h"
 
+// open mode
+#define M_FSOPEN_RDONLY 0x0000
+#define M_FSOPEN_WRONLY 0x0001
+#define M_FSOPEN_RDWR 0x0002
+
+// Operations that can be kept in flight on one connection
+typedef enum tag_mel_op
+{
+	MEL_OP_GET_DATA = 0,
+	MEL_OP_GET_ALARM_MSG,
+	MEL_OP_GET_PRG_BLOCK,
+	MEL_OP_FS_READ_FILE, // Reads continue at the file position, so replies arrive in file order
+	MEL_OP_FS_WRITE_FILE, // Written straight from in, not through the send buffer
+	MEL_OP_FS_STAT_FILE,   // Path in in, file_FS_stat out
+	MEL_OP_FS_READ_DIR,	   // Next entry of the directory fd; an empty reply ends the listing
+	MEL_OP_FS_CREATE_FILE, // Path in in, the new handle is stored in fd
+	MEL_OP_FS_CLOSE_FILE,
+	MEL_OP_FS_REMOVE_FILE // Path in in
+} mel_op_e;
+
+typedef struct tag_mel_request
+{
+	mel_op_e op;
+	int section;			   // GET_DATA: main section
+	int sub_section;		   // GET_DATA: sub-section
+	int system_no;			   // System number
+	int axis_flag;			   // GET_DATA: axis bit mask
+	int count;				   // GET_ALARM_MSG: message count, GET_PRG_BLOCK: row count, FS_READ/WRITE_FILE: bytes
+	long fd;				   // FS_*: file handle, set by FS_CREATE_FILE
+	const void* in;			   // FS_WRITE_FILE: caller-owned payload of count bytes, other FS_*: path
+	int msg_type;			   // GET_ALARM_MSG: message type
+	m70_data_type_e data_type; // GET_DATA: requested type in, returned type out
+	void* out;				   // Caller-owned output buffer
+	int out_size;			   // Size of out, 0 = unchecked
+	int out_length;			   // FS_READ_FILE/READ_DIR: bytes stored in out, FS_WRITE_FILE: bytes written
+	long code;				   // Result, 0 on success, -1 when no reply arrived
+	uint32 request_id;		   // Assigned when the request is sent
+	uint64 send_tick;		   // m70_stats_begin at submit, 0 when statistics are off
+} mel_request_t;
+
+typedef struct tag_mel_pipeline
+{
+	m70_conn_t* conn;
+	int depth; // Maximum requests in flight
+	int inflight_count;
+	mel_request_t* inflight[M70_MAX_PIPELINE_DEPTH];
+	int send_length; // Encoded bytes not yet written
+	byte send_buffer[M70_SEND_BUFFER_SIZE];
+} mel_pipeline_t;
+
+#define MEL_PIPELINE_MAX_PACK 256 // Upper bound of one encoded pipelined request, without the path of path ops
+
 // Connection management
+void giop_init_conn(m70_conn_t* conn, int type);
 bool giop_connect(const char* ip, int type, int port, m70_conn_t* conn);
 void giop_disconnect(m70_conn_t* conn);
 bool check_conn_is_valid(m70_conn_t* conn);
@@ -32,13 +85,44 @@ long melFsOpenDirectory(m70_conn_t* conn, const char* filepath, long* fd);
 long melFsCloseDirectory(m70_conn_t* conn, long fd);
 long melFsReadDirectory(m70_conn_t* conn, long fd, char* directory_list);
 
+// Pipelined requests, replies are matched by request_id
+long melPipelineRequests(m70_conn_t* conn, mel_request_t* requests, int count, int depth);
+void mel_pipeline_init(mel_pipeline_t* pipe, m70_conn_t* conn, int depth);
+bool mel_pipeline_submit(mel_pipeline_t* pipe, mel_request_t* request);
+int mel_pipeline_request_size(const mel_request_t* request); // Send buffer bytes it needs at most, -1 when sent outside it
+bool mel_pipeline_flush(mel_pipeline_t* pipe);
+mel_request_t* mel_pipeline_receive(mel_pipeline_t* pipe);
+mel_request_t* mel_pipeline_complete(mel_pipeline_t* pipe);
+void mel_pipeline_abort(mel_pipeline_t* pipe);
+
 // Miscellaneous
 long CancelModal2(m70_conn_t* conn);
 long receive_remain_info_response(m70_conn_t* conn, int* len);
 
 // Internal utilities
+int get_data_type_length(int datatype);
+bool is_mutiple_axis(int axis_flag); // More than one bit set in axis_flag
+int giop_recv_data(m70_conn_t* conn, void* ptr, int nbytes);
 int mel_receive_response(m70_conn_t* conn, giop_header* giop, int* remain_length);
+int mel_receive_reply(m70_conn_t* conn, giop_header* giop, int* remain_length, uint32* request_id, bool* parsed); // parsed: the reply header was read
+int receive_get_data_response(m70_conn_t* conn, int len, m70_data_type_e* data_type, int axis_flag, void* data, int data_size);
 void build_giop_header(m70_conn_t* conn, giop_header* giop);
 void build_request_pack_header(m70_conn_t* conn, request_pack_header* request, int op_name_length);
+int build_get_data_pack(m70_conn_t* conn, get_data_pack* pack, int section, int sub_section, int system_no, int axis_flag, m70_data_type_e data_type);
+int build_set_data_pack(m70_conn_t* conn, set_data_pack* pack, int section, int sub_section, int system_no, int axis_flag, m70_data_type_e data_type, void* data);
+int build_alarm_info_pack(m70_conn_t* conn, alarm_info_pack* pack, int system_no, int msg_count, int msg_type);
+int build_prog_block_pack(m70_conn_t* conn, prog_block_pack* pack, int system_no, int row_count);
+int build_fs_read_file_pack(m70_conn_t* conn, FS_read_file_pack* pack, long fd, long need_read_size);
+long receive_fs_read_file_response(m70_conn_t* conn, int* msg_length, void* file_data, long need_read_size);
+int build_fs_write_file_pack(m70_conn_t* conn, FS_write_file_pack* pack, long fd, long write_size);
+long receive_fs_write_file_response(m70_conn_t* conn, int* msg_length);
+int build_fs_stat_file_pack(m70_conn_t* conn, FS_stat_file_pack* pack, int name_length);
+int ReceiveFsStatData(m70_conn_t* conn, int len, file_FS_stat* stat);
+int build_fs_create_file_pack(m70_conn_t* conn, FS_create_file_pack* pack, long mode, int name_length);
+long receive_fs_handle_response(m70_conn_t* conn, int* msg_length);
+int build_fs_close_file_pack(m70_conn_t* conn, FS_close_file_pack* pack, long fd);
+int build_fs_remove_file_pack(m70_conn_t* conn, FS_remove_pack* pack, int name_length);
+int build_fs_read_dir_pack(m70_conn_t* conn, FS_read_directory_pack* pack, long fd);
+int receive_fs_read_dir_response(m70_conn_t* conn, int* msg_length, char* entry, int entry_size);
 
 #endif // __H_M70_GIOP_H__
\ No newline at end of file
@@ -1,4 +1,6 @@
 ﻿#include "m70_log.h"
+#include "m70_thread.h"
+#include "utill.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,6 +18,11 @@
 #include <sys/time.h>
 #endif
 
+#define M70_LOG_MESSAGE_SIZE 1024   // Formatted message without prefix
+#define M70_LOG_ASYNC_BATCH 64      // Messages written by the writer thread between flushes
+#define M70_LOG_ASYNC_IDLE_WAIT 100 // Milliseconds the idle writer sleeps between checks
+#define M70_LOG_BINARY_MAX_SITES 1024 // Format strings tracked per binary file, power of two
+
 // Global configuration for log module
 static struct {
     bool initialized;                // Whether initialized
@@ -28,21 +35,75 @@ static struct {
     bool include_file_line;          // Whether to include file and line number
     unsigned int max_file_size;      // Maximum log file size (KB)
     unsigned int max_file_count;     // Maximum number of log files
-    unsigned int current_file_size;  // Current log file size (KB)
+    unsigned long long current_file_size;  // Current log file size (bytes)
+    m70_mutex_t output_lock;         // Serializes console and file writes
+    bool output_lock_ready;          // output_lock has been initialized
+    bool binary_mode;                // The file receives binary records
 } g_log_config = {
-    false,                  // Not initialized
-    M70_LOG_LEVEL_INFO,    // Default INFO level
-    M70_LOG_TARGET_CONSOLE,// Default console output
-    "",                    // Default log file path is empty
-    NULL,                  // Log file handle is NULL
-    true,                  // Default include timestamp
-    true,                  // Default include log level
-    false,                 // Default don't include file and line number
-    10240,                 // Default maximum file size 10MB
-    5,                     // Default maximum file count 5
-    0                      // Current file size 0KB
+    .initialized = false,                    // Not initialized
+    .level = M70_LOG_LEVEL_INFO,             // Default INFO level
+    .target = M70_LOG_TARGET_CONSOLE,        // Default console output
+    .log_file_path = "",                     // Default log file path is empty
+    .log_file = NULL,                        // Log file handle is NULL
+    .include_timestamp = true,               // Default include timestamp
+    .include_level = true,                   // Default include log level
+    .include_file_line = false,              // Default don't include file and line number
+    .max_file_size = 10240,                  // Default maximum file size 10MB
+    .max_file_count = 5,                     // Default maximum file count 5
+    .current_file_size = 0,                  // Current file size 0 bytes
+    .output_lock_ready = false,              // output_lock is created on first init
+    .binary_mode = false                     // Default text records
 };
 
+// One message waiting to be written; in the async queue sequence tells producers and the writer whose turn it is
+typedef struct {
+    volatile int32 sequence;
+    m70_log_level_e level;
+    uint64 time_ms;
+    const char* file;
+    int line;
+    const char* format;
+    int length;                          // Bytes of packed arguments in binary mode
+    char message[M70_LOG_MESSAGE_SIZE];  // Text, or packed arguments in binary mode
+} log_entry_t;
+
+// Bounded lock-free queue, many producers and the writer thread as single consumer
+static struct {
+    log_entry_t* cells;
+    uint32 mask;                     // Capacity - 1, capacity is a power of two
+    volatile int32 enqueue_pos;
+    volatile int32 dequeue_pos;      // Advanced by the writer only
+    volatile int32 dropped;          // Total messages dropped
+    int32 reported_drops;            // Drops already reported in the log
+    volatile int32 active;           // Messages go through the queue
+    volatile int32 producers;        // Threads between the active check and the end of their push
+    volatile int32 sleeping;         // The writer waits on wake
+    volatile int32 stop;
+    m70_thread_t writer;
+    m70_mutex_t wake_lock;
+    m70_cond_t wake;
+} g_log_queue;
+
+// Format strings already written to the current binary file, the slot index is the record id
+static struct {
+    const char* format;
+    const char* file;
+    int line;
+} g_log_sites[M70_LOG_BINARY_MAX_SITES];
+static int g_log_site_count;
+
+static bool log_async_start(unsigned int queue_size);
+static void log_async_stop(void);
+static void log_output_flush(void);
+static void log_binary_file_opened(void);
+
+m70_log_level_e m70_log_active_level = M70_LOG_LEVEL_OFF;
+
+// Keep the level seen by the macros in step with the configuration
+static void log_update_active_level(void) {
+    m70_log_active_level = g_log_config.initialized ? g_log_config.level : M70_LOG_LEVEL_OFF;
+}
+
 // Log level strings
 static const char* g_log_level_str[] = {
     "DEBUG",
@@ -52,13 +113,10 @@ static const char* g_log_level_str[] = {
     "FATAL"
 };
 
-// Get current time string
-static void get_current_time(char* buffer, size_t buffer_size) {
-    time_t now;
+// Get time string of a message
+static void get_time_string(time_t now, char* buffer, size_t buffer_size) {
     struct tm timeinfo;
     
-    time(&now);
-    
 #ifdef _WIN32
     localtime_s(&timeinfo, &now);
 #else
@@ -100,9 +158,14 @@ static bool ensure_log_directory(const char* file_path) {
     return true;  // No directory part, return success directly
 }
 
+// Binary records carry lengths, text mode on Windows would turn their '\n' bytes into "\r\n"
+static FILE* open_log_file(void) {
+    return fopen(g_log_config.log_file_path, g_log_config.binary_mode ? "ab" : "a");
+}
+
 // Log file rotation
 static void rotate_log_file_if_needed() {
-    if (!g_log_config.log_file || g_log_config.current_file_size < g_log_config.max_file_size) {
+    if (!g_log_config.log_file || g_log_config.current_file_size < (unsigned long long)g_log_config.max_file_size * 1024) {
         return;
     }
     
@@ -134,7 +197,8 @@ static void rotate_log_file_if_needed() {
     rename(base_path, new_path);
     
     // Reopen log file
-    g_log_config.log_file = fopen(g_log_config.log_file_path, "a");
+    g_log_config.log_file = open_log_file();
+    log_binary_file_opened();
 }
 
 // Log initialization
@@ -143,9 +207,15 @@ bool m70_log_init(const m70_log_config_t* config) {
         m70_log_shutdown();  // If already initialized, shut down first
     }
     
+    if (!g_log_config.output_lock_ready) {
+        m70_mutex_init(&g_log_config.output_lock);
+        g_log_config.output_lock_ready = true;
+    }
+
     if (!config) {
         // Use default configuration
         g_log_config.initialized = true;
+        log_update_active_level();
         return true;
     }
     
@@ -157,6 +227,7 @@ bool m70_log_init(const m70_log_config_t* config) {
     g_log_config.include_file_line = config->include_file_line;
     g_log_config.max_file_size = config->max_file_size;
     g_log_config.max_file_count = config->max_file_count;
+    g_log_config.binary_mode = config->binary_mode;
     
     // If file output is needed, open log file
     if (g_log_config.target & M70_LOG_TARGET_FILE) {
@@ -170,7 +241,7 @@ bool m70_log_init(const m70_log_config_t* config) {
             }
             
             // Open log file
-            g_log_config.log_file = fopen(g_log_config.log_file_path, "a");
+            g_log_config.log_file = open_log_file();
             if (!g_log_config.log_file) {
                 fprintf(stderr, "Failed to open log file: %s\n", g_log_config.log_file_path);
                 return false;
@@ -178,14 +249,20 @@ bool m70_log_init(const m70_log_config_t* config) {
             
             // Get current file size
             fseek(g_log_config.log_file, 0, SEEK_END);
-            g_log_config.current_file_size = ftell(g_log_config.log_file) / 1024;
+            g_log_config.current_file_size = ftell(g_log_config.log_file);
+            log_binary_file_opened();
         } else {
             fprintf(stderr, "Log file path is empty\n");
             return false;
         }
     }
     
+    if (config->async_mode && !log_async_start(config->queue_size)) {
+        return false;
+    }
+
     g_log_config.initialized = true;
+    log_update_active_level();
     
     // Output initialization log
     m70_log_info("Log system initialization completed, level: %s, target: %d", 
@@ -203,34 +280,75 @@ void m70_log_shutdown(void) {
     
     if (g_log_config.log_file) {
         m70_log_info("Log system shutdown");
+    }
+
+    // Writes everything still queued; other threads must have stopped logging
+    log_async_stop();
+
+    if (g_log_config.log_file) {
         fclose(g_log_config.log_file);
         g_log_config.log_file = NULL;
     }
     
     g_log_config.initialized = false;
+    log_update_active_level();
+}
+
+// Flush queued and buffered messages
+void m70_log_flush(void) {
+    while (m70_atomic_load(&g_log_queue.active) &&
+           m70_atomic_load(&g_log_queue.dequeue_pos) != m70_atomic_load(&g_log_queue.enqueue_pos)) {
+        m70_sleep_ms(1);
+    }
+
+    if (g_log_config.output_lock_ready) {
+        m70_mutex_lock(&g_log_config.output_lock);
+        log_output_flush();
+        m70_mutex_unlock(&g_log_config.output_lock);
+    }
+}
+
+unsigned int m70_log_get_dropped_count(void) {
+    return (unsigned int)m70_atomic_load(&g_log_queue.dropped);
 }
 
 // Set log level
 void m70_log_set_level(m70_log_level_e level) {
     if (level >= M70_LOG_LEVEL_DEBUG && level <= M70_LOG_LEVEL_OFF) {
         g_log_config.level = level;
+        log_update_active_level();
         if (g_log_config.initialized) {
             m70_log_info("Log level has been set to: %s", level < M70_LOG_LEVEL_OFF ? g_log_level_str[level] : "OFF");
         }
     }
 }
 
+// The writer thread may be using the file while the configuration changes
+static void log_lock_output(void) {
+    if (g_log_config.output_lock_ready) {
+        m70_mutex_lock(&g_log_config.output_lock);
+    }
+}
+
+static void log_unlock_output(void) {
+    if (g_log_config.output_lock_ready) {
+        m70_mutex_unlock(&g_log_config.output_lock);
+    }
+}
+
 // Set log output target
 void m70_log_set_target(m70_log_target_e target) {
+    log_lock_output();
     g_log_config.target = target;
     
     // If file output is needed but file is not open, try to open it
     if ((target & M70_LOG_TARGET_FILE) && !g_log_config.log_file && g_log_config.log_file_path[0] != '\0') {
-        g_log_config.log_file = fopen(g_log_config.log_file_path, "a");
+        g_log_config.log_file = open_log_file();
         if (g_log_config.log_file) {
             // Get current file size
             fseek(g_log_config.log_file, 0, SEEK_END);
-            g_log_config.current_file_size = ftell(g_log_config.log_file) / 1024;
+            g_log_config.current_file_size = ftell(g_log_config.log_file);
+            log_binary_file_opened();
         }
     }
     
@@ -239,6 +357,7 @@ void m70_log_set_target(m70_log_target_e target) {
         fclose(g_log_config.log_file);
         g_log_config.log_file = NULL;
     }
+    log_unlock_output();
     
     if (g_log_config.initialized) {
         m70_log_info("Log output target has been set to: %d", target);
@@ -251,6 +370,8 @@ bool m70_log_set_file(const char* file_path) {
         return false;
     }
     
+    log_lock_output();
+
     // Close current log file
     if (g_log_config.log_file) {
         fclose(g_log_config.log_file);
@@ -263,21 +384,25 @@ bool m70_log_set_file(const char* file_path) {
     // Ensure log directory exists
     if (!ensure_log_directory(g_log_config.log_file_path)) {
         fprintf(stderr, "Failed to create log directory for %s\n", g_log_config.log_file_path);
+        log_unlock_output();
         return false;
     }
     
     // If file output is needed, open new log file
     if (g_log_config.target & M70_LOG_TARGET_FILE) {
-        g_log_config.log_file = fopen(g_log_config.log_file_path, "a");
+        g_log_config.log_file = open_log_file();
         if (!g_log_config.log_file) {
             fprintf(stderr, "Failed to open log file: %s\n", g_log_config.log_file_path);
+            log_unlock_output();
             return false;
         }
         
         // Get current file size
         fseek(g_log_config.log_file, 0, SEEK_END);
-        g_log_config.current_file_size = ftell(g_log_config.log_file) / 1024;
+        g_log_config.current_file_size = ftell(g_log_config.log_file);
+        log_binary_file_opened();
     }
+    log_unlock_output();
     
     if (g_log_config.initialized) {
         m70_log_info("Log file has been set to: %s", g_log_config.log_file_path);
@@ -286,40 +411,33 @@ bool m70_log_set_file(const char* file_path) {
     return true;
 }
 
-// Internal log write function
-static void log_write(m70_log_level_e level, const char* file, int line, const char* format, va_list args) {
-    if (!g_log_config.initialized || level < g_log_config.level || level >= M70_LOG_LEVEL_OFF) {
-        return;
-    }
-    
+// Build the complete log line from its parts
+static void log_format_line(m70_log_level_e level, uint64 time_ms, const char* file, int line, const char* message, char* full_message, size_t size) {
     char time_str[32] = {0};
-    char message[1024] = {0};
-    char full_message[1280] = {0};
-    
-    // Format log message
-    vsnprintf(message, sizeof(message) - 1, format, args);
-    
-    // Get current time
+
+    // Get message time
     if (g_log_config.include_timestamp) {
-        get_current_time(time_str, sizeof(time_str));
+        get_time_string((time_t)(time_ms / 1000), time_str, sizeof(time_str));
     }
     
     // Build complete log message
     if (g_log_config.include_timestamp && g_log_config.include_level && g_log_config.include_file_line && file) {
-        snprintf(full_message, sizeof(full_message), "[%s] [%s] [%s:%d] %s\n", 
+        snprintf(full_message, size, "[%s] [%s] [%s:%d] %s\n", 
                 time_str, g_log_level_str[level], file, line, message);
     } else if (g_log_config.include_timestamp && g_log_config.include_level) {
-        snprintf(full_message, sizeof(full_message), "[%s] [%s] %s\n", 
+        snprintf(full_message, size, "[%s] [%s] %s\n", 
                 time_str, g_log_level_str[level], message);
     } else if (g_log_config.include_timestamp) {
-        snprintf(full_message, sizeof(full_message), "[%s] %s\n", time_str, message);
+        snprintf(full_message, size, "[%s] %s\n", time_str, message);
     } else if (g_log_config.include_level) {
-        snprintf(full_message, sizeof(full_message), "[%s] %s\n", g_log_level_str[level], message);
+        snprintf(full_message, size, "[%s] %s\n", g_log_level_str[level], message);
     } else {
-        snprintf(full_message, sizeof(full_message), "%s\n", message);
+        snprintf(full_message, size, "%s\n", message);
     }
-    
-    // Output to console
+}
+
+// Write one line to the console
+static void log_output_console(m70_log_level_e level, const char* full_message) {
     if (g_log_config.target & M70_LOG_TARGET_CONSOLE) {
 #ifdef _WIN32
         HANDLE console_handle = GetStdHandle(STD_OUTPUT_HANDLE);
@@ -380,6 +498,12 @@ static void log_write(m70_log_level_e level, const char* file, int line, const c
         }
 #endif
     }
+}
+
+// Write one line to the targets, the caller holds output_lock and flushes
+static void log_output(m70_log_level_e level, const char* full_message) {
+    // Output to console
+    log_output_console(level, full_message);
     
     // Output to file
     if ((g_log_config.target & M70_LOG_TARGET_FILE) && g_log_config.log_file) {
@@ -388,13 +512,610 @@ static void log_write(m70_log_level_e level, const char* file, int line, const c
         
         // Write log
         if (g_log_config.log_file) {
-            size_t written = fprintf(g_log_config.log_file, "%s", full_message);
-            fflush(g_log_config.log_file);
+            int written = fprintf(g_log_config.log_file, "%s", full_message);
             
             // Update current file size
-            g_log_config.current_file_size += written / 1024;
+            if (written > 0) {
+                g_log_config.current_file_size += written;
+            }
+        }
+    }
+}
+
+static void log_put_u16(unsigned char* p, uint32 v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void log_put_u32(unsigned char* p, uint32 v) {
+    log_put_u16(p, v);
+    log_put_u16(p + 2, v >> 16);
+}
+
+static void log_put_u64(unsigned char* p, uint64 v) {
+    log_put_u32(p, (uint32)v);
+    log_put_u32(p + 4, (uint32)(v >> 32));
+}
+
+static uint64 log_get_u64(const unsigned char* p, int bytes) {
+    uint64 v = 0;
+    while (bytes-- > 0) {
+        v = (v << 8) | p[bytes];
+    }
+    return v;
+}
+
+// Length modifier and conversion of one printf specification, spec points after '%'
+typedef struct {
+    const char* end;     // First character after the conversion
+    char flags[8];
+    int width_star;      // Width is taken from an argument
+    int precision_star;  // Precision is taken from an argument
+    int width;           // -1 when absent
+    int precision;       // -1 when absent
+    int longs;           // Count of 'l', 'j', 'z' and 't' style modifiers
+    int long_double;     // 'L' modifier
+    char conversion;
+} log_spec_t;
+
+static void log_parse_spec(const char* spec, log_spec_t* out) {
+    int n = 0;
+    memset(out, 0, sizeof(*out));
+    out->width = -1;
+    out->precision = -1;
+    while (*spec && strchr("-+ #0", *spec) && n < (int)sizeof(out->flags) - 1) {
+        out->flags[n++] = *spec++;
+    }
+    if (*spec == '*') {
+        out->width_star = 1;
+        spec++;
+    } else if (*spec >= '0' && *spec <= '9') {
+        out->width = (int)strtol(spec, (char**)&spec, 10);
+    }
+    if (*spec == '.') {
+        spec++;
+        if (*spec == '*') {
+            out->precision_star = 1;
+            spec++;
+        } else {
+            out->precision = (int)strtol(spec, (char**)&spec, 10);
+        }
+    }
+    while (*spec && strchr("hlLjzt", *spec)) {
+        if (*spec == 'l' || *spec == 'j' || *spec == 'z' || *spec == 't') {
+            out->longs++;
+        } else if (*spec == 'L') {
+            out->long_double = 1;
+        }
+        spec++;
+    }
+    out->conversion = *spec;
+    out->end = *spec ? spec + 1 : spec;
+}
+
+// Copy the raw arguments of format into out, returns the packed length; stops when out is full
+static int log_pack_args(const char* format, va_list args, unsigned char* out, int size) {
+    int pos = 0;
+    const char* p = format;
+    while ((p = strchr(p, '%')) != NULL) {
+        log_spec_t spec;
+        if (p[1] == '%') {
+            p += 2;
+            continue;
+        }
+        log_parse_spec(p + 1, &spec);
+        p = spec.end;
+
+        int stars = spec.width_star + spec.precision_star;
+        while (stars-- > 0) {
+            int v = va_arg(args, int);
+            if (pos + 5 > size) {
+                return pos;
+            }
+            out[pos] = 'i';
+            log_put_u32(out + pos + 1, (uint32)v);
+            pos += 5;
         }
+
+        switch (spec.conversion) {
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c': {
+                uint64 v = 0;
+                if (spec.longs >= 2) {
+                    v = (uint64)va_arg(args, long long);
+                } else if (spec.longs == 1) {
+                    v = (uint64)va_arg(args, long);
+                } else {
+                    v = (uint64)(uint32)va_arg(args, int);
+                }
+                int bytes = spec.longs > 0 ? 8 : 4;
+                if (pos + 1 + bytes > size) {
+                    return pos;
+                }
+                out[pos] = spec.longs > 0 ? 'l' : 'i';
+                if (bytes == 8) {
+                    log_put_u64(out + pos + 1, v);
+                } else {
+                    log_put_u32(out + pos + 1, (uint32)v);
+                }
+                pos += 1 + bytes;
+                break;
+            }
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                double v = spec.long_double ? (double)va_arg(args, long double) : va_arg(args, double);
+                uint64 bits = 0;
+                memcpy(&bits, &v, sizeof(bits));
+                if (pos + 9 > size) {
+                    return pos;
+                }
+                out[pos] = 'f';
+                log_put_u64(out + pos + 1, bits);
+                pos += 9;
+                break;
+            }
+            case 's': {
+                const char* v = va_arg(args, const char*);
+                if (v == NULL) {
+                    v = "(null)";
+                }
+                size_t len = strlen(v);
+                if (spec.precision >= 0 && len > (size_t)spec.precision) {
+                    len = spec.precision;
+                }
+                if (pos + 3 > size) {
+                    return pos;
+                }
+                if (len > (size_t)(size - pos - 3)) {
+                    len = size - pos - 3;
+                }
+                out[pos] = 's';
+                log_put_u16(out + pos + 1, (uint32)len);
+                memcpy(out + pos + 3, v, len);
+                pos += 3 + (int)len;
+                break;
+            }
+            case 'p': {
+                void* v = va_arg(args, void*);
+                if (pos + 9 > size) {
+                    return pos;
+                }
+                out[pos] = 'p';
+                log_put_u64(out + pos + 1, (uint64)(size_t)v);
+                pos += 9;
+                break;
+            }
+            case 'n':
+                (void)va_arg(args, void*);
+                break;
+            default:
+                return pos;  // Unknown conversion, later arguments cannot be located
+        }
+    }
+    return pos;
+}
+
+// Read the next packed argument, false when it is missing or of another kind
+static bool log_unpack_arg(const unsigned char* args, int length, int* pos, char tag, uint64* value, const char** text, int* text_length) {
+    int size = tag == 'i' ? 4 : (tag == 's' ? 2 : 8);
+    if (*pos + 1 + size > length || (char)args[*pos] != tag) {
+        return false;
+    }
+    *value = log_get_u64(args + *pos + 1, size);
+    *pos += 1 + size;
+    if (tag == 's') {
+        if (*pos + (int)*value > length) {
+            return false;
+        }
+        *text = (const char*)args + *pos;
+        *text_length = (int)*value;
+        *pos += (int)*value;
+    }
+    return true;
+}
+
+int m70_log_format_binary(const char* format, const unsigned char* args, int length, char* out, size_t size) {
+    size_t n = 0;
+    int pos = 0;
+    const char* p = format;
+    if (size == 0) {
+        return 0;
+    }
+
+    while (*p && n + 1 < size) {
+        if (*p != '%') {
+            out[n++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[n++] = '%';
+            p += 2;
+            continue;
+        }
+
+        log_spec_t spec;
+        log_parse_spec(p + 1, &spec);
+        p = spec.end;
+
+        uint64 value = 0;
+        const char* text = NULL;
+        int text_length = 0;
+        if (spec.width_star && log_unpack_arg(args, length, &pos, 'i', &value, &text, &text_length)) {
+            spec.width = (int)(int32)(uint32)value;
+        }
+        if (spec.precision_star && log_unpack_arg(args, length, &pos, 'i', &value, &text, &text_length)) {
+            spec.precision = (int)(int32)(uint32)value;
+        }
+
+        // Rebuild the specification with the modifiers that match the packed width
+        char fmt[32];
+        int f = snprintf(fmt, sizeof(fmt), "%%%s", spec.flags);
+        if (spec.width >= 0) {
+            f += snprintf(fmt + f, sizeof(fmt) - f, "%d", spec.width);
+        }
+        if (spec.precision >= 0) {
+            f += snprintf(fmt + f, sizeof(fmt) - f, ".%d", spec.precision);
+        }
+
+        int written = 0;
+        char c = spec.conversion;
+        if (c && strchr("diuxXoc", c)) {
+            bool wide = spec.longs > 0;
+            if (!log_unpack_arg(args, length, &pos, wide ? 'l' : 'i', &value, &text, &text_length)) {
+                written = snprintf(out + n, size - n, "?");
+            } else if (c == 'c') {
+                snprintf(fmt + f, sizeof(fmt) - f, "c");
+                written = snprintf(out + n, size - n, fmt, (int)value);
+            } else {
+                snprintf(fmt + f, sizeof(fmt) - f, "ll%c", c);
+                long long v = wide ? (long long)value : (c == 'd' || c == 'i' ? (long long)(int32)(uint32)value : (long long)(uint32)value);
+                written = snprintf(out + n, size - n, fmt, v);
+            }
+        } else if (c && strchr("fFeEgGaA", c)) {
+            double v = 0;
+            if (!log_unpack_arg(args, length, &pos, 'f', &value, &text, &text_length)) {
+                written = snprintf(out + n, size - n, "?");
+            } else {
+                memcpy(&v, &value, sizeof(v));
+                snprintf(fmt + f, sizeof(fmt) - f, "%c", c);
+                written = snprintf(out + n, size - n, fmt, v);
+            }
+        } else if (c == 's') {
+            if (!log_unpack_arg(args, length, &pos, 's', &value, &text, &text_length)) {
+                written = snprintf(out + n, size - n, "?");
+            } else {
+                // The packed string is already cut to the precision
+                f = snprintf(fmt, sizeof(fmt), "%%%s", spec.flags);
+                if (spec.width >= 0) {
+                    f += snprintf(fmt + f, sizeof(fmt) - f, "%d", spec.width);
+                }
+                snprintf(fmt + f, sizeof(fmt) - f, ".*s");
+                written = snprintf(out + n, size - n, fmt, text_length, text);
+            }
+        } else if (c == 'p') {
+            if (!log_unpack_arg(args, length, &pos, 'p', &value, &text, &text_length)) {
+                written = snprintf(out + n, size - n, "?");
+            } else {
+                written = snprintf(out + n, size - n, "0x%llx", (unsigned long long)value);
+            }
+        }
+
+        if (written > 0) {
+            n += (size_t)written < size - n ? (size_t)written : size - n - 1;
+        }
+    }
+
+    out[n] = '\0';
+    return (int)n;
+}
+
+static void log_write_record(unsigned char type, const unsigned char* payload, int length) {
+    unsigned char head[3];
+    head[0] = type;
+    log_put_u16(head + 1, (uint32)length);
+    fwrite(head, 1, sizeof(head), g_log_config.log_file);
+    fwrite(payload, 1, length, g_log_config.log_file);
+    g_log_config.current_file_size += sizeof(head) + length;
+}
+
+// A new or reopened binary file starts with a header and forgets the formats already written
+static void log_binary_file_opened(void) {
+    if (!g_log_config.binary_mode || !g_log_config.log_file) {
+        return;
+    }
+    memset(g_log_sites, 0, sizeof(g_log_sites));
+    g_log_site_count = 0;
+    log_write_record(M70_LOG_RECORD_HEADER, (const unsigned char*)M70_LOG_BINARY_MAGIC, (int)strlen(M70_LOG_BINARY_MAGIC));
+}
+
+// Returns the record id of the entry's call site, writing its format record the first time
+static uint32 log_binary_site_id(const log_entry_t* entry) {
+    uint32 mask = M70_LOG_BINARY_MAX_SITES - 1;
+    uint32 slot = ((uint32)((size_t)entry->format >> 2) ^ ((uint32)entry->line * 2654435761u)) & mask;
+    while (g_log_sites[slot].format != NULL) {
+        if (g_log_sites[slot].format == entry->format && g_log_sites[slot].file == entry->file && g_log_sites[slot].line == entry->line) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    // Keep probes short, a new header lets the decoder drop its table as well
+    if (g_log_site_count >= M70_LOG_BINARY_MAX_SITES * 3 / 4) {
+        log_binary_file_opened();
+        slot = ((uint32)((size_t)entry->format >> 2) ^ ((uint32)entry->line * 2654435761u)) & mask;
+    }
+    g_log_sites[slot].format = entry->format;
+    g_log_sites[slot].file = entry->file;
+    g_log_sites[slot].line = entry->line;
+    g_log_site_count++;
+
+    unsigned char payload[12 + 256 + M70_LOG_MESSAGE_SIZE];
+    const char* file = entry->file ? entry->file : "";
+    size_t file_length = strlen(file);
+    size_t format_length = strlen(entry->format);
+    if (file_length > 256) {
+        file += file_length - 256;
+        file_length = 256;
+    }
+    if (format_length > M70_LOG_MESSAGE_SIZE) {
+        format_length = M70_LOG_MESSAGE_SIZE;
+    }
+    log_put_u32(payload, slot);
+    log_put_u32(payload + 4, (uint32)entry->line);
+    log_put_u16(payload + 8, (uint32)file_length);
+    memcpy(payload + 10, file, file_length);
+    log_put_u16(payload + 10 + file_length, (uint32)format_length);
+    memcpy(payload + 12 + file_length, entry->format, format_length);
+    log_write_record(M70_LOG_RECORD_FORMAT, payload, (int)(12 + file_length + format_length));
+    return slot;
+}
+
+// Fill an entry from the caller's arguments: text, or the raw values in binary mode
+static void log_fill_entry(log_entry_t* entry, m70_log_level_e level, const char* file, int line, const char* format, va_list args) {
+    entry->level = level;
+    entry->time_ms = get_current_time_ms();
+    entry->file = file;
+    entry->line = line;
+    entry->format = format;
+    if (g_log_config.binary_mode) {
+        entry->length = log_pack_args(format, args, (unsigned char*)entry->message, sizeof(entry->message));
+    } else {
+        entry->length = 0;
+        vsnprintf(entry->message, sizeof(entry->message) - 1, format, args);
+    }
+}
+
+static void log_make_entry(log_entry_t* entry, m70_log_level_e level, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    log_fill_entry(entry, level, NULL, 0, format, args);
+    va_end(args);
+}
+
+// Write one entry to the targets, the caller holds output_lock and flushes
+static void log_output_entry(const log_entry_t* entry) {
+    char full_message[1280];
+    if (!g_log_config.binary_mode) {
+        log_format_line(entry->level, entry->time_ms, entry->file, entry->line, entry->message, full_message, sizeof(full_message));
+        log_output(entry->level, full_message);
+        return;
+    }
+
+    // The console still gets text
+    if (g_log_config.target & M70_LOG_TARGET_CONSOLE) {
+        char message[M70_LOG_MESSAGE_SIZE];
+        m70_log_format_binary(entry->format, (const unsigned char*)entry->message, entry->length, message, sizeof(message));
+        log_format_line(entry->level, entry->time_ms, entry->file, entry->line, message, full_message, sizeof(full_message));
+        log_output_console(entry->level, full_message);
+    }
+
+    if ((g_log_config.target & M70_LOG_TARGET_FILE) && g_log_config.log_file) {
+        rotate_log_file_if_needed();
+        if (g_log_config.log_file) {
+            unsigned char payload[13 + M70_LOG_MESSAGE_SIZE];
+            log_put_u32(payload, log_binary_site_id(entry));
+            log_put_u64(payload + 4, entry->time_ms);
+            payload[12] = (unsigned char)entry->level;
+            memcpy(payload + 13, entry->message, entry->length);
+            log_write_record(M70_LOG_RECORD_MESSAGE, payload, 13 + entry->length);
+        }
+    }
+}
+
+static void log_output_flush(void) {
+    if (g_log_config.target & M70_LOG_TARGET_CONSOLE) {
+        fflush(stdout);
+    }
+    if (g_log_config.log_file) {
+        fflush(g_log_config.log_file);
+    }
+}
+
+// Claim a cell, copy the message and publish it; false when the queue is full
+static bool log_queue_push(m70_log_level_e level, const char* file, int line, const char* format, va_list args) {
+    log_entry_t* cell = NULL;
+    int32 pos = m70_atomic_load(&g_log_queue.enqueue_pos);
+    for (;;) {
+        cell = &g_log_queue.cells[(uint32)pos & g_log_queue.mask];
+        int32 diff = (int32)((uint32)m70_atomic_load(&cell->sequence) - (uint32)pos);
+        if (diff == 0) {
+            if (m70_atomic_cas(&g_log_queue.enqueue_pos, pos, (int32)((uint32)pos + 1))) {
+                break;
+            }
+            pos = m70_atomic_load(&g_log_queue.enqueue_pos);
+        } else if (diff < 0) {
+            return false;  // The writer is a whole lap behind
+        } else {
+            pos = m70_atomic_load(&g_log_queue.enqueue_pos);
+        }
+    }
+
+    log_fill_entry(cell, level, file, line, format, args);
+    m70_atomic_store(&cell->sequence, (int32)((uint32)pos + 1));
+
+    // Wake the writer only when it sleeps, so producers rarely touch the lock
+    if (m70_atomic_load(&g_log_queue.sleeping)) {
+        m70_mutex_lock(&g_log_queue.wake_lock);
+        m70_cond_signal(&g_log_queue.wake);
+        m70_mutex_unlock(&g_log_queue.wake_lock);
+    }
+    return true;
+}
+
+// Single consumer, returns the next published cell or NULL when the queue is empty
+static log_entry_t* log_queue_peek(void) {
+    uint32 pos = (uint32)g_log_queue.dequeue_pos;
+    log_entry_t* cell = &g_log_queue.cells[pos & g_log_queue.mask];
+    int32 diff = (int32)((uint32)m70_atomic_load(&cell->sequence) - (pos + 1));
+    return diff == 0 ? cell : NULL;
+}
+
+static void log_queue_release(log_entry_t* cell) {
+    uint32 pos = (uint32)g_log_queue.dequeue_pos;
+    m70_atomic_store(&cell->sequence, (int32)(pos + g_log_queue.mask + 1));
+    m70_atomic_store(&g_log_queue.dequeue_pos, (int32)(pos + 1));
+}
+
+// Background writer: formats and writes queued messages in batches, flushing once per batch
+static void log_writer_main(void* arg) {
+    log_entry_t report;
+    (void)arg;
+
+    for (;;) {
+        int written = 0;
+        log_entry_t* cell = NULL;
+
+        m70_mutex_lock(&g_log_config.output_lock);
+        while (written < M70_LOG_ASYNC_BATCH && (cell = log_queue_peek()) != NULL) {
+            log_output_entry(cell);
+            log_queue_release(cell);
+            written++;
+        }
+
+        int32 dropped = m70_atomic_load(&g_log_queue.dropped);
+        if (dropped != g_log_queue.reported_drops) {
+            log_make_entry(&report, M70_LOG_LEVEL_WARNING, "%u log messages dropped, async queue full", (uint32)(dropped - g_log_queue.reported_drops));
+            g_log_queue.reported_drops = dropped;
+            log_output_entry(&report);
+            written++;
+        }
+
+        if (written > 0) {
+            log_output_flush();
+        }
+        m70_mutex_unlock(&g_log_config.output_lock);
+
+        if (written == M70_LOG_ASYNC_BATCH) {
+            continue;
+        }
+
+        // Sleep until a producer signals; the queue is re-checked after announcing it
+        m70_mutex_lock(&g_log_queue.wake_lock);
+        m70_atomic_store(&g_log_queue.sleeping, 1);
+        if (log_queue_peek() == NULL) {
+            if (m70_atomic_load(&g_log_queue.stop)) {
+                m70_atomic_store(&g_log_queue.sleeping, 0);
+                m70_mutex_unlock(&g_log_queue.wake_lock);
+                break;
+            }
+            m70_cond_wait(&g_log_queue.wake, &g_log_queue.wake_lock, M70_LOG_ASYNC_IDLE_WAIT);
+        }
+        m70_atomic_store(&g_log_queue.sleeping, 0);
+        m70_mutex_unlock(&g_log_queue.wake_lock);
+    }
+}
+
+static bool log_async_start(unsigned int queue_size) {
+    uint32 capacity = 2;
+    uint32 i = 0;
+
+    if (queue_size == 0) {
+        queue_size = M70_LOG_DEFAULT_QUEUE_SIZE;
+    }
+    while (capacity < queue_size && capacity < 0x40000000) {
+        capacity <<= 1;
+    }
+
+    g_log_queue.cells = (log_entry_t*)malloc(sizeof(log_entry_t) * capacity);
+    if (!g_log_queue.cells) {
+        fprintf(stderr, "Failed to allocate log queue of %u messages\n", capacity);
+        return false;
+    }
+    for (i = 0; i < capacity; i++) {
+        g_log_queue.cells[i].sequence = (int32)i;
+    }
+    g_log_queue.mask = capacity - 1;
+    g_log_queue.enqueue_pos = 0;
+    g_log_queue.dequeue_pos = 0;
+    g_log_queue.dropped = 0;
+    g_log_queue.reported_drops = 0;
+    g_log_queue.sleeping = 0;
+    g_log_queue.stop = 0;
+    m70_mutex_init(&g_log_queue.wake_lock);
+    m70_cond_init(&g_log_queue.wake);
+
+    if (!m70_thread_create(&g_log_queue.writer, log_writer_main, NULL)) {
+        fprintf(stderr, "Failed to start log writer thread\n");
+        m70_cond_destroy(&g_log_queue.wake);
+        m70_mutex_destroy(&g_log_queue.wake_lock);
+        free(g_log_queue.cells);
+        g_log_queue.cells = NULL;
+        return false;
+    }
+
+    m70_atomic_store(&g_log_queue.active, 1);
+    return true;
+}
+
+// Drains the queue and stops the writer; messages logged after this are written synchronously
+static void log_async_stop(void) {
+    if (!m70_atomic_load(&g_log_queue.active)) {
+        return;
+    }
+
+    // Producers that saw the queue active may still be writing their cells
+    m70_atomic_store(&g_log_queue.active, 0);
+    while (m70_atomic_load(&g_log_queue.producers) > 0) {
+        m70_sleep_ms(1);
+    }
+    m70_atomic_store(&g_log_queue.stop, 1);
+    m70_mutex_lock(&g_log_queue.wake_lock);
+    m70_cond_signal(&g_log_queue.wake);
+    m70_mutex_unlock(&g_log_queue.wake_lock);
+    m70_thread_join(g_log_queue.writer);
+
+    m70_cond_destroy(&g_log_queue.wake);
+    m70_mutex_destroy(&g_log_queue.wake_lock);
+    free(g_log_queue.cells);
+    g_log_queue.cells = NULL;
+}
+
+// Internal log write function
+static void log_write(m70_log_level_e level, const char* file, int line, const char* format, va_list args) {
+    if (!g_log_config.initialized || level < g_log_config.level || level >= M70_LOG_LEVEL_OFF) {
+        return;
+    }
+
+    // Async mode only copies the message, the writer thread does the rest
+    m70_atomic_add(&g_log_queue.producers, 1);
+    if (m70_atomic_load(&g_log_queue.active)) {
+        if (!log_queue_push(level, file, line, format, args)) {
+            m70_atomic_add(&g_log_queue.dropped, 1);
+        }
+        m70_atomic_add(&g_log_queue.producers, -1);
+        return;
+    }
+    m70_atomic_add(&g_log_queue.producers, -1);
+    
+    log_entry_t entry;
+    
+    // Format log message
+    log_fill_entry(&entry, level, file, line, format, args);
+
+    m70_mutex_lock(&g_log_config.output_lock);
+    log_output_entry(&entry);
+    if (g_log_config.log_file) {
+        fflush(g_log_config.log_file);
     }
+    m70_mutex_unlock(&g_log_config.output_lock);
 }
 
 // Log output function implementation
@@ -2,6 +2,7 @@
 #define __H_M70_LOG_H__
 
 #include <stdbool.h>
+#include <stddef.h>
 
 // Log level definition
 typedef enum _tag_m70_log_level
@@ -33,28 +34,62 @@ typedef struct _tag_m70_log_config
     bool include_file_line;           // Whether to include file and line number
     unsigned int max_file_size;       // Maximum log file size (KB)
     unsigned int max_file_count;      // Maximum number of log files
+    bool async_mode;                  // Write from a background thread instead of the caller
+    unsigned int queue_size;          // Async queue capacity in messages, 0 = default
+    bool binary_mode;                 // Write binary records to the file, see tools/m70_logdecode; formats must be literals
 } m70_log_config_t;
 
+#define M70_LOG_DEFAULT_QUEUE_SIZE 1024   // Async queue capacity, rounded up to a power of two
+
+// Binary log file layout. Each record is a type byte and a u16 payload length, then the
+// payload; all integers are little-endian. A header starts the file and after it every
+// format string is written once, the first time it is used, before the messages that refer to it.
+#define M70_LOG_BINARY_MAGIC "M70BLOG1"
+
+typedef enum _tag_m70_log_record
+{
+    M70_LOG_RECORD_HEADER = 0,   // Magic; earlier format records no longer apply
+    M70_LOG_RECORD_FORMAT = 1,   // u32 id, u32 line, u16 length + file, u16 length + format
+    M70_LOG_RECORD_MESSAGE = 2   // u32 id, u64 milliseconds since 1970, u8 level, packed arguments
+} m70_log_record_e;
+
+// Packed arguments, one tag byte each: 'i' i32, 'l' i64, 'f' double bits as u64, 'p' u64, 's' u16 length + bytes.
+// Renders them with their format string, returns the text length.
+int m70_log_format_binary(const char* format, const unsigned char* args, int length, char* out, size_t size);
+
 // Log initialization and configuration functions
 bool m70_log_init(const m70_log_config_t* config);
 void m70_log_shutdown(void);
 void m70_log_set_level(m70_log_level_e level);
 void m70_log_set_target(m70_log_target_e target);
 bool m70_log_set_file(const char* file_path);
+void m70_log_flush(void);                       // Waits until queued messages are written
+unsigned int m70_log_get_dropped_count(void);   // Messages dropped because the async queue was full
 
-// Log output functions
+// Log output functions. In binary mode the format must be a string literal: a call site is
+// keyed by the format's address, and the async writer reads the format after the call returned.
 void m70_log_debug(const char* format, ...);
 void m70_log_info(const char* format, ...);
 void m70_log_warning(const char* format, ...);
 void m70_log_error(const char* format, ...);
 void m70_log_fatal(const char* format, ...);
 
-// Log output macros with file and line number
-#define M70_LOG_DEBUG(format, ...) m70_log_debug_ex(__FILE__, __LINE__, format, ##__VA_ARGS__)
-#define M70_LOG_INFO(format, ...) m70_log_info_ex(__FILE__, __LINE__, format, ##__VA_ARGS__)
-#define M70_LOG_WARNING(format, ...) m70_log_warning_ex(__FILE__, __LINE__, format, ##__VA_ARGS__)
-#define M70_LOG_ERROR(format, ...) m70_log_error_ex(__FILE__, __LINE__, format, ##__VA_ARGS__)
-#define M70_LOG_FATAL(format, ...) m70_log_fatal_ex(__FILE__, __LINE__, format, ##__VA_ARGS__)
+// Lowest level the macros below compile in, e.g. -DM70_LOG_COMPILE_LEVEL=1 removes every DEBUG call
+#ifndef M70_LOG_COMPILE_LEVEL
+#define M70_LOG_COMPILE_LEVEL 0
+#endif
+
+// Lowest level currently written, M70_LOG_LEVEL_OFF while the log system is not initialized
+extern m70_log_level_e m70_log_active_level;
+
+#define M70_LOG_ENABLED(level) ((level) >= M70_LOG_COMPILE_LEVEL && (level) >= m70_log_active_level)
+
+// Log output macros with file and line number; arguments are not evaluated when the level is disabled
+#define M70_LOG_DEBUG(format, ...) do { if (M70_LOG_ENABLED(M70_LOG_LEVEL_DEBUG)) m70_log_debug_ex(__FILE__, __LINE__, format, ##__VA_ARGS__); } while (0)
+#define M70_LOG_INFO(format, ...) do { if (M70_LOG_ENABLED(M70_LOG_LEVEL_INFO)) m70_log_info_ex(__FILE__, __LINE__, format, ##__VA_ARGS__); } while (0)
+#define M70_LOG_WARNING(format, ...) do { if (M70_LOG_ENABLED(M70_LOG_LEVEL_WARNING)) m70_log_warning_ex(__FILE__, __LINE__, format, ##__VA_ARGS__); } while (0)
+#define M70_LOG_ERROR(format, ...) do { if (M70_LOG_ENABLED(M70_LOG_LEVEL_ERROR)) m70_log_error_ex(__FILE__, __LINE__, format, ##__VA_ARGS__); } while (0)
+#define M70_LOG_FATAL(format, ...) do { if (M70_LOG_ENABLED(M70_LOG_LEVEL_FATAL)) m70_log_fatal_ex(__FILE__, __LINE__, format, ##__VA_ARGS__); } while (0)
 
 // Log output functions with file and line number
 void m70_log_debug_ex(const char* file, int line, const char* format, ...);
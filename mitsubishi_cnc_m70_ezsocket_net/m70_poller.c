@@ -0,0 +1,506 @@
+#include "m70_poller.h"
+
+#ifdef __linux__
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "socket.h"
+#include "m70_log.h"
+#include "m70_error.h"
+
+#define M70_POLLER_MAX_EVENTS 64
+
+// Queued request, the pipeline hands back &request so it must stay the first member
+typedef struct m70_poller_request
+{
+	mel_request_t request;
+	m70_poller_callback callback;
+	void* user_data;
+	struct m70_poller_request* next;
+} m70_poller_request_t;
+
+struct m70_poller_conn
+{
+	m70_poller_t* poller;
+	m70_conn_t* conn;
+	m70_poller_state_e state;
+	bool removed; // Closed by the caller, freed by the next sweep
+	char ip[64];
+	int port;
+	m70_nc_type_e type;
+	void* user_data;
+
+	mel_pipeline_t pipe; // Encodes requests and tracks the ones in flight
+	int send_offset;	 // Bytes of pipe.send_buffer already written
+	bool want_write;	 // EPOLLOUT registered
+	m70_poller_request_t* pending_head;
+	m70_poller_request_t* pending_tail;
+	int pending_count;
+	uint64 last_activity; // get_tick_count_ms of the last progress
+};
+
+struct m70_poller
+{
+	int epoll_fd;
+	int timeout_ms;
+	int count;
+	int capacity;
+	m70_poller_conn_t** conns;
+};
+
+static int poller_complete(m70_poller_conn_t* pc, m70_poller_request_t* node, long code)
+{
+	node->request.code = code;
+	if (node->callback != NULL)
+		node->callback(pc, &node->request, node->user_data);
+	free(node);
+	return 1;
+}
+
+// Fails everything queued or in flight and closes the socket
+static int poller_fail(m70_poller_conn_t* pc, const char* reason)
+{
+	int done = 0;
+	if (pc->state != M70_POLLER_CLOSED)
+		M70_CONN_ERROR_SET(pc->conn, M70_ERROR_CODE_EX_CONN_CLOSED, "Poller: dropping %s:%d, %s", pc->ip, pc->port, reason);
+
+	if (pc->conn->socket > 0)
+	{
+		epoll_ctl(pc->poller->epoll_fd, EPOLL_CTL_DEL, pc->conn->socket, NULL);
+		giop_disconnect(pc->conn);
+	}
+	pc->conn->connected = false;
+	pc->state = M70_POLLER_CLOSED;
+	pc->want_write = false;
+	pc->send_offset = 0;
+
+	// Detach both lists first, callbacks may queue new requests
+	int inflight_count = pc->pipe.inflight_count;
+	mel_request_t* inflight[M70_MAX_PIPELINE_DEPTH];
+	memcpy(inflight, pc->pipe.inflight, sizeof(mel_request_t*) * inflight_count);
+	mel_pipeline_abort(&pc->pipe);
+	m70_poller_request_t* node = pc->pending_head;
+	pc->pending_head = pc->pending_tail = NULL;
+	pc->pending_count = 0;
+
+	int i = 0;
+	for (i = 0; i < inflight_count; i++)
+		done += poller_complete(pc, (m70_poller_request_t*)inflight[i], -1);
+	while (node != NULL)
+	{
+		m70_poller_request_t* next = node->next;
+		done += poller_complete(pc, node, -1);
+		node = next;
+	}
+	return done;
+}
+
+static bool poller_update_events(m70_poller_conn_t* pc, bool want_write)
+{
+	struct epoll_event ev;
+	memset((void*)&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+	ev.data.ptr = pc;
+	if (epoll_ctl(pc->poller->epoll_fd, EPOLL_CTL_MOD, pc->conn->socket, &ev) != 0)
+		return false;
+	pc->want_write = want_write;
+	return true;
+}
+
+// Moves queued requests into the pipeline while there is depth and buffer room
+static int poller_fill(m70_poller_conn_t* pc)
+{
+	int done = 0;
+	while (pc->pending_head != NULL && pc->pipe.inflight_count < pc->pipe.depth &&
+		pc->pipe.send_length + mel_pipeline_request_size(&pc->pending_head->request) <= (int)sizeof(pc->pipe.send_buffer))
+	{
+		m70_poller_request_t* node = pc->pending_head;
+		pc->pending_head = node->next;
+		if (pc->pending_head == NULL)
+			pc->pending_tail = NULL;
+		pc->pending_count--;
+		node->next = NULL;
+
+		if (pc->pipe.inflight_count == 0)
+			pc->last_activity = get_tick_count_ms();
+		if (!mel_pipeline_submit(&pc->pipe, &node->request))
+			done += poller_complete(pc, node, -1);
+	}
+	return done;
+}
+
+static int poller_write(m70_poller_conn_t* pc)
+{
+	while (pc->send_offset < pc->pipe.send_length)
+	{
+		int count = send(pc->conn->socket, pc->pipe.send_buffer + pc->send_offset, pc->pipe.send_length - pc->send_offset, MSG_NOSIGNAL);
+		socket_count_syscall(true);
+		if (count > 0)
+		{
+			pc->send_offset += count;
+			pc->last_activity = get_tick_count_ms();
+			continue;
+		}
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			if (!pc->want_write && !poller_update_events(pc, true))
+				return poller_fail(pc, "epoll update failed");
+			return 0;
+		}
+		return poller_fail(pc, strerror(errno));
+	}
+
+	pc->send_offset = 0;
+	pc->pipe.send_length = 0;
+	if (pc->want_write && !poller_update_events(pc, false))
+		return poller_fail(pc, "epoll update failed");
+	return 0;
+}
+
+// Drains the socket into the receive buffer and decodes every complete frame
+static int poller_read(m70_poller_conn_t* pc)
+{
+	m70_conn_t* conn = pc->conn;
+	m70_recv_buffer_t* rb = &conn->recv_buffer;
+	int done = 0;
+	bool drained = false;
+	while (!drained)
+	{
+		if (rb->start > 0)
+		{
+			memmove(rb->data, rb->data + rb->start, rb->end - rb->start);
+			rb->end -= rb->start;
+			rb->start = 0;
+		}
+
+		while (rb->end < M70_RECV_BUFFER_SIZE)
+		{
+			int count = recv(conn->socket, rb->data + rb->end, M70_RECV_BUFFER_SIZE - rb->end, 0);
+			socket_count_syscall(false);
+			if (count > 0)
+			{
+				rb->end += count;
+				pc->last_activity = get_tick_count_ms();
+				continue;
+			}
+			if (count < 0 && errno == EINTR)
+				continue;
+			if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			{
+				drained = true;
+				break;
+			}
+			return done + poller_fail(pc, count == 0 ? "closed by peer" : strerror(errno));
+		}
+
+		// The decoders only ever see whole frames, so they never touch the socket
+		while (rb->end - rb->start >= (int)sizeof(giop_header))
+		{
+			giop_header giop;
+			memcpy(&giop, rb->data + rb->start, sizeof(giop));
+			int frame_length = (int)sizeof(giop) + (int)giop.data_length;
+			if (memcmp(giop.magic_number, "GIOP", 4) != 0 || giop.data_length > M70_RECV_BUFFER_SIZE - sizeof(giop))
+				return done + poller_fail(pc, "malformed GIOP frame");
+			if (rb->end - rb->start < frame_length)
+				break;
+
+			mel_request_t* request = mel_pipeline_receive(&pc->pipe);
+			if (!check_conn_is_valid(conn))
+				return done + poller_fail(pc, "reply decoding failed");
+			if (request != NULL)
+				done += poller_complete(pc, (m70_poller_request_t*)request, request->code);
+			if (pc->state != M70_POLLER_READY)
+				return done;
+		}
+	}
+	return done;
+}
+
+static int poller_finish_connect(m70_poller_conn_t* pc)
+{
+	int error = 0;
+	socklen_t length = sizeof(error);
+	if (getsockopt(pc->conn->socket, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0)
+		return poller_fail(pc, error != 0 ? strerror(error) : "connect failed");
+
+	pc->state = M70_POLLER_READY;
+	pc->conn->connected = true;
+	pc->last_activity = get_tick_count_ms();
+	M70_LOG_INFO("Poller: connected to %s:%d, Socket=%d", pc->ip, pc->port, pc->conn->socket);
+	if (!poller_update_events(pc, false))
+		return poller_fail(pc, "epoll update failed");
+	return 0;
+}
+
+static bool poller_start_connect(m70_poller_conn_t* pc)
+{
+	giop_init_conn(pc->conn, pc->type);
+	mel_pipeline_init(&pc->pipe, pc->conn, (int)pc->conn->pipeline_depth);
+	pc->send_offset = 0;
+	pc->want_write = true;
+	pc->last_activity = get_tick_count_ms();
+
+	pc->conn->socket = socket_open_tcp_client_socket_async(pc->ip, (short)pc->port);
+	if (pc->conn->socket <= 0)
+	{
+		pc->conn->socket = -1;
+		pc->state = M70_POLLER_CLOSED;
+		return false;
+	}
+
+	struct epoll_event ev;
+	memset((void*)&ev, 0, sizeof(ev));
+	ev.events = EPOLLOUT;
+	ev.data.ptr = pc;
+	if (epoll_ctl(pc->poller->epoll_fd, EPOLL_CTL_ADD, pc->conn->socket, &ev) != 0)
+	{
+		M70_LOG_ERROR("Poller: epoll_ctl failed for %s:%d: %s", pc->ip, pc->port, strerror(errno));
+		giop_disconnect(pc->conn);
+		pc->state = M70_POLLER_CLOSED;
+		return false;
+	}
+
+	pc->state = M70_POLLER_CONNECTING;
+	return true;
+}
+
+m70_poller_t* m70_poller_create(int timeout_ms)
+{
+	m70_poller_t* poller = (m70_poller_t*)calloc(1, sizeof(m70_poller_t));
+	if (poller == NULL)
+		return NULL;
+
+	poller->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (poller->epoll_fd < 0)
+	{
+		M70_LOG_ERROR("Poller: epoll_create1 failed: %s", strerror(errno));
+		free(poller);
+		return NULL;
+	}
+	poller->timeout_ms = timeout_ms > 0 ? timeout_ms : M70_POLLER_DEFAULT_TIMEOUT;
+	return poller;
+}
+
+void m70_poller_destroy(m70_poller_t* poller)
+{
+	if (poller == NULL)
+		return;
+
+	int i = 0;
+	for (i = 0; i < poller->count; i++)
+	{
+		poller_fail(poller->conns[i], "poller destroyed");
+		free(poller->conns[i]);
+	}
+	free(poller->conns);
+	close(poller->epoll_fd);
+	free(poller);
+}
+
+m70_poller_conn_t* m70_poller_connect(m70_poller_t* poller, const char* ip, int port, m70_nc_type_e type, m70_conn_t* conn, void* user_data)
+{
+	if (poller == NULL || ip == NULL || strlen(ip) <= 0 || strlen(ip) >= 64 || port <= 0 || conn == NULL)
+	{
+		M70_ERROR_SET(M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid poller connection parameters");
+		return NULL;
+	}
+
+	if (poller->count == poller->capacity)
+	{
+		int capacity = poller->capacity > 0 ? poller->capacity * 2 : 16;
+		m70_poller_conn_t** conns = (m70_poller_conn_t**)realloc(poller->conns, sizeof(m70_poller_conn_t*) * capacity);
+		if (conns == NULL)
+			return NULL;
+		poller->conns = conns;
+		poller->capacity = capacity;
+	}
+
+	m70_poller_conn_t* pc = (m70_poller_conn_t*)calloc(1, sizeof(m70_poller_conn_t));
+	if (pc == NULL)
+		return NULL;
+
+	memset((void*)conn, 0, sizeof(m70_conn_t));
+	conn->socket = -1;
+	pc->poller = poller;
+	pc->conn = conn;
+	strcpy(pc->ip, ip);
+	pc->port = port;
+	pc->type = type;
+	pc->user_data = user_data;
+	poller->conns[poller->count++] = pc;
+
+	if (!poller_start_connect(pc))
+		M70_LOG_ERROR("Poller: failed to start connection to %s:%d", ip, port);
+	return pc;
+}
+
+bool m70_poller_reconnect(m70_poller_conn_t* pc)
+{
+	if (pc == NULL || pc->removed)
+		return false;
+
+	poller_fail(pc, "reconnecting");
+	return poller_start_connect(pc);
+}
+
+void m70_poller_close(m70_poller_conn_t* pc)
+{
+	if (pc == NULL || pc->removed)
+		return;
+
+	poller_fail(pc, "closed");
+	pc->removed = true;
+}
+
+bool m70_poller_submit(m70_poller_conn_t* pc, const mel_request_t* request, m70_poller_callback callback, void* user_data)
+{
+	if (pc == NULL || request == NULL || pc->removed || pc->state == M70_POLLER_CLOSED)
+		return false;
+	// A write goes out by itself with a blocking send, and a request larger than the buffer would
+	// need a blocking flush; only requests that fit the buffer written here can be queued
+	int size = mel_pipeline_request_size(request);
+	if (size < 0 || size > (int)sizeof(pc->pipe.send_buffer))
+	{
+		M70_ERROR_SET(M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Poller: request op %d cannot be queued", (int)request->op);
+		return false;
+	}
+	// A reply frame larger than the receive buffer is taken for a malformed one and fails the connection
+	if (request->op == MEL_OP_FS_READ_FILE && request->count > M70_POLLER_MAX_READ)
+	{
+		M70_ERROR_SET(M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Poller: file read of %d bytes exceeds %d", request->count, M70_POLLER_MAX_READ);
+		return false;
+	}
+
+	m70_poller_request_t* node = (m70_poller_request_t*)calloc(1, sizeof(m70_poller_request_t));
+	if (node == NULL)
+		return false;
+
+	node->request = *request;
+	node->request.code = -1;
+	node->callback = callback;
+	node->user_data = user_data;
+	if (pc->pending_tail != NULL)
+		pc->pending_tail->next = node;
+	else
+		pc->pending_head = node;
+	pc->pending_tail = node;
+	pc->pending_count++;
+	return true;
+}
+
+bool m70_poller_get_data(m70_poller_conn_t* pc, int section, int sub_section, int system_no, int axis_flag, m70_data_type_e data_type, void* out, int out_size, m70_poller_callback callback, void* user_data)
+{
+	mel_request_t request;
+	memset((void*)&request, 0, sizeof(request));
+	request.op = MEL_OP_GET_DATA;
+	request.section = section;
+	request.sub_section = sub_section;
+	request.system_no = system_no;
+	request.axis_flag = axis_flag;
+	request.data_type = data_type;
+	request.out = out;
+	request.out_size = out_size;
+	return m70_poller_submit(pc, &request, callback, user_data);
+}
+
+int m70_poller_run_once(m70_poller_t* poller, int timeout_ms)
+{
+	if (poller == NULL)
+		return -1;
+
+	int done = 0;
+	int i = 0;
+
+	// Requests queued since the last round go out before waiting
+	for (i = 0; i < poller->count; i++)
+	{
+		m70_poller_conn_t* pc = poller->conns[i];
+		if (pc->state == M70_POLLER_READY && pc->pending_head != NULL)
+		{
+			done += poller_fill(pc);
+			if (pc->state == M70_POLLER_READY)
+				done += poller_write(pc);
+		}
+	}
+
+	struct epoll_event events[M70_POLLER_MAX_EVENTS];
+	int count = epoll_wait(poller->epoll_fd, events, M70_POLLER_MAX_EVENTS, done > 0 ? 0 : timeout_ms);
+	if (count < 0 && errno != EINTR)
+	{
+		M70_LOG_ERROR("Poller: epoll_wait failed: %s", strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		m70_poller_conn_t* pc = (m70_poller_conn_t*)events[i].data.ptr;
+		uint32 flags = events[i].events;
+		if (pc->state == M70_POLLER_CONNECTING)
+		{
+			done += poller_finish_connect(pc);
+			continue;
+		}
+		if (pc->state != M70_POLLER_READY)
+			continue;
+
+		if (flags & (EPOLLIN | EPOLLERR | EPOLLHUP))
+			done += poller_read(pc);
+		if (pc->state == M70_POLLER_READY && (flags & EPOLLOUT))
+			done += poller_write(pc);
+	}
+
+	// Refill the pipelines freed by the replies, expire stalled connections, sweep closed entries
+	uint64 now = get_tick_count_ms();
+	int kept = 0;
+	for (i = 0; i < poller->count; i++)
+	{
+		m70_poller_conn_t* pc = poller->conns[i];
+		bool busy = pc->state == M70_POLLER_CONNECTING || (pc->state == M70_POLLER_READY && pc->pipe.inflight_count > 0);
+		if (busy && now > pc->last_activity && now - pc->last_activity >= (uint64)poller->timeout_ms)
+			done += poller_fail(pc, pc->state == M70_POLLER_CONNECTING ? "connect timed out" : "reply timed out");
+
+		if (pc->state == M70_POLLER_READY)
+		{
+			done += poller_fill(pc);
+			if (pc->state == M70_POLLER_READY)
+				done += poller_write(pc);
+		}
+
+		if (pc->removed)
+			free(pc);
+		else
+			poller->conns[kept++] = pc;
+	}
+	poller->count = kept;
+
+	return done;
+}
+
+m70_poller_state_e m70_poller_get_state(m70_poller_conn_t* pc)
+{
+	return pc != NULL ? pc->state : M70_POLLER_CLOSED;
+}
+
+m70_conn_t* m70_poller_get_conn(m70_poller_conn_t* pc)
+{
+	return pc != NULL ? pc->conn : NULL;
+}
+
+void* m70_poller_get_user_data(m70_poller_conn_t* pc)
+{
+	return pc != NULL ? pc->user_data : NULL;
+}
+
+int m70_poller_get_pending_count(m70_poller_conn_t* pc)
+{
+	return pc != NULL ? pc->pending_count + pc->pipe.inflight_count : 0;
+}
+
+#endif // __linux__
@@ -0,0 +1,57 @@
+#ifndef __H_M70_POLLER_H__
+#define __H_M70_POLLER_H__
+
+// Single-threaded event loop that drives many CNC connections at once (Linux epoll).
+// Requests are queued per connection, pipelined onto the socket and parsed with the
+// regular GIOP decoders once their whole reply frame is buffered.
+
+#ifdef __linux__
+
+#include "m70_giop.h"
+
+#define M70_POLLER_DEFAULT_TIMEOUT 5000 // Milliseconds without progress before a connection is dropped
+// Largest MEL_OP_FS_READ_FILE count: the reply frame, with its GIOP and reply headers and the
+// result and length words, has to fit the receive buffer
+#define M70_POLLER_MAX_READ ((int)(M70_RECV_BUFFER_SIZE - sizeof(giop_header) - sizeof(response_pack_header) - 2 * sizeof(uint32)))
+
+typedef enum _tag_m70_poller_state
+{
+	M70_POLLER_CLOSED = 0, // Not connected, queued requests fail
+	M70_POLLER_CONNECTING, // Non-blocking connect in progress
+	M70_POLLER_READY	   // Connected, requests are being sent
+} m70_poller_state_e;
+
+typedef struct m70_poller m70_poller_t;
+typedef struct m70_poller_conn m70_poller_conn_t;
+
+// Called from m70_poller_run_once for every finished request. request->code is 0 on success,
+// -1 when the connection was lost or timed out, otherwise the CNC error code.
+// The request is only valid during the call; new requests may be submitted from here.
+typedef void (*m70_poller_callback)(m70_poller_conn_t* pc, mel_request_t* request, void* user_data);
+
+m70_poller_t* m70_poller_create(int timeout_ms);
+void m70_poller_destroy(m70_poller_t* poller);
+
+// conn is caller-owned storage that must outlive the poller entry
+m70_poller_conn_t* m70_poller_connect(m70_poller_t* poller, const char* ip, int port, m70_nc_type_e type, m70_conn_t* conn, void* user_data);
+bool m70_poller_reconnect(m70_poller_conn_t* pc);
+void m70_poller_close(m70_poller_conn_t* pc);
+
+// The request is copied, its out buffer and path must stay valid until the callback ran.
+// MEL_OP_FS_WRITE_FILE is refused, it is sent with a blocking write outside the pipeline buffer,
+// and so is a path longer than the send buffer. A MEL_OP_FS_READ_FILE whose count exceeds
+// M70_POLLER_MAX_READ is refused too, its reply would not fit the receive buffer.
+bool m70_poller_submit(m70_poller_conn_t* pc, const mel_request_t* request, m70_poller_callback callback, void* user_data);
+bool m70_poller_get_data(m70_poller_conn_t* pc, int section, int sub_section, int system_no, int axis_flag, m70_data_type_e data_type, void* out, int out_size, m70_poller_callback callback, void* user_data);
+
+// Waits up to timeout_ms for socket events, returns the number of completed requests or -1
+int m70_poller_run_once(m70_poller_t* poller, int timeout_ms);
+
+m70_poller_state_e m70_poller_get_state(m70_poller_conn_t* pc);
+m70_conn_t* m70_poller_get_conn(m70_poller_conn_t* pc);
+void* m70_poller_get_user_data(m70_poller_conn_t* pc);
+int m70_poller_get_pending_count(m70_poller_conn_t* pc);
+
+#endif // __linux__
+
+#endif // __H_M70_POLLER_H__
@@ -0,0 +1,276 @@
+#include "m70_scheduler.h"
+#include "m70_ezsocket.h"
+#include "m70_giop.h"
+#include "m70_log.h"
+#include "m70_error.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define M70_SCHED_STATUS_ITEMS 3
+
+typedef struct m70_sched_entry
+{
+	m70_sched_item_t item;
+	byte* scratch; // The read lands here first and is compared with item.value
+	uint32 period_ms;
+	uint64 next_due;
+	bool valid;	  // item.value holds a successful read
+	bool changed; // Last read differed from the previous value
+	m70_error_code_e result;
+} m70_sched_entry_t;
+
+struct m70_scheduler
+{
+	m70_conn_t* conn;
+	short system_no;
+	m70_sched_entry_t* entries;
+	int count;
+	int capacity;
+	m70_batch_item_t* batch; // capacity + status items
+	int* batch_entry;		 // Entry index of each batch slot, -1 for status items
+
+	uint32 status_period_ms;
+	uint64 status_next_due;
+	short mode;
+	int64 auto_status;
+	short run_status;
+	m70_device_status_e status;
+	bool idle; // RST or OFFLINE, every item runs at its maximum period
+	uint32 read_count;
+};
+
+static void sched_set_batch_item(m70_batch_item_t* batch, int section, int sub_section, int system_no, int axis_flag, m70_data_type_e data_type, void* value, int value_size)
+{
+	memset((void*)batch, 0, sizeof(*batch));
+	batch->section = section;
+	batch->sub_section = sub_section;
+	batch->system_no = system_no;
+	batch->axis_flag = axis_flag;
+	batch->data_type = data_type;
+	batch->value = value;
+	batch->value_size = value_size;
+}
+
+m70_scheduler_t* m70_scheduler_create(m70_conn_t* conn, short system_no)
+{
+	if (conn == NULL)
+	{
+		M70_ERROR_SET(M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid scheduler connection");
+		return NULL;
+	}
+
+	m70_scheduler_t* sched = (m70_scheduler_t*)calloc(1, sizeof(m70_scheduler_t));
+	if (sched == NULL)
+		return NULL;
+
+	sched->conn = conn;
+	sched->system_no = system_no;
+	sched->status_period_ms = M70_SCHED_DEFAULT_STATUS_PERIOD;
+	sched->status = OFFLINE;
+	sched->idle = true;
+	return sched;
+}
+
+void m70_scheduler_destroy(m70_scheduler_t* sched)
+{
+	if (sched == NULL)
+		return;
+
+	int i = 0;
+	for (i = 0; i < sched->count; i++)
+		free(sched->entries[i].scratch);
+	free(sched->entries);
+	free(sched->batch);
+	free(sched->batch_entry);
+	free(sched);
+}
+
+void m70_scheduler_set_status_period(m70_scheduler_t* sched, uint32 period_ms)
+{
+	if (sched == NULL || period_ms == 0)
+		return;
+	sched->status_period_ms = period_ms;
+}
+
+int m70_scheduler_add(m70_scheduler_t* sched, const m70_sched_item_t* item)
+{
+	if (sched == NULL || item == NULL || item->value == NULL || item->value_size <= 0 || item->min_period_ms == 0)
+	{
+		M70_ERROR_SET(M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid scheduler item");
+		return -1;
+	}
+
+	if (sched->count == sched->capacity)
+	{
+		int capacity = sched->capacity > 0 ? sched->capacity * 2 : 16;
+		m70_sched_entry_t* entries = (m70_sched_entry_t*)realloc(sched->entries, sizeof(m70_sched_entry_t) * capacity);
+		if (entries == NULL)
+			return -1;
+		sched->entries = entries;
+
+		m70_batch_item_t* batch = (m70_batch_item_t*)realloc(sched->batch, sizeof(m70_batch_item_t) * (capacity + M70_SCHED_STATUS_ITEMS));
+		if (batch == NULL)
+			return -1;
+		sched->batch = batch;
+
+		int* batch_entry = (int*)realloc(sched->batch_entry, sizeof(int) * (capacity + M70_SCHED_STATUS_ITEMS));
+		if (batch_entry == NULL)
+			return -1;
+		sched->batch_entry = batch_entry;
+		sched->capacity = capacity;
+	}
+
+	m70_sched_entry_t* entry = &sched->entries[sched->count];
+	memset((void*)entry, 0, sizeof(*entry));
+	entry->item = *item;
+	if (entry->item.max_period_ms < entry->item.min_period_ms)
+		entry->item.max_period_ms = entry->item.min_period_ms;
+	entry->scratch = (byte*)calloc(1, item->value_size);
+	if (entry->scratch == NULL)
+		return -1;
+	entry->period_ms = entry->item.min_period_ms;
+	entry->result = M70_ERROR_CODE_FAILED;
+	return sched->count++;
+}
+
+// Next period of an item after a successful read
+static uint32 sched_next_period(m70_scheduler_t* sched, m70_sched_entry_t* entry)
+{
+	if (sched->idle)
+		return entry->item.max_period_ms;
+	if (entry->changed)
+		return entry->item.min_period_ms;
+
+	uint32 period = entry->period_ms * 2;
+	return period < entry->item.max_period_ms ? period : entry->item.max_period_ms;
+}
+
+int m70_scheduler_tick(m70_scheduler_t* sched, uint32* wait_ms)
+{
+	if (sched == NULL)
+		return -1;
+
+	uint64 now = get_tick_count_ms();
+	int count = 0;
+	bool status_due = now >= sched->status_next_due;
+	if (status_due)
+	{
+		sched_set_batch_item(&sched->batch[count], 35, 11, sched->system_no, 0, T_SHORT, &sched->mode, sizeof(sched->mode));
+		sched->batch_entry[count++] = -1;
+		sched_set_batch_item(&sched->batch[count], 35, 20, sched->system_no, 0, T_DLONG, &sched->auto_status, sizeof(sched->auto_status));
+		sched->batch_entry[count++] = -1;
+		sched_set_batch_item(&sched->batch[count], 35, 10, sched->system_no, 0, T_SHORT, &sched->run_status, sizeof(sched->run_status));
+		sched->batch_entry[count++] = -1;
+	}
+
+	int i = 0;
+	for (i = 0; i < sched->count; i++)
+	{
+		m70_sched_entry_t* entry = &sched->entries[i];
+		if (entry->next_due > now)
+			continue;
+
+		m70_sched_item_t* item = &entry->item;
+		sched_set_batch_item(&sched->batch[count], item->section, item->sub_section, item->system_no, item->axis_flag, item->data_type, entry->scratch, item->value_size);
+		sched->batch_entry[count++] = i;
+	}
+
+	if (count > 0)
+	{
+		m70_error_code_e ret = m70_cnc_read_batch(sched->conn, sched->batch, count);
+		sched->read_count += count;
+		if (ret == M70_ERROR_CODE_SOCKET_FAILED || !check_conn_is_valid(sched->conn))
+		{
+			sched->status = OFFLINE;
+			sched->idle = true;
+			return -1;
+		}
+
+		bool was_idle = sched->idle;
+		if (status_due)
+		{
+			sched->status_next_due = now + sched->status_period_ms;
+			if (sched->batch[0].result != M70_ERROR_CODE_OK)
+				sched->status = OFFLINE;
+			else
+				sched->status = m70_cnc_decode_status((m70_run_mode_e)sched->mode, sched->batch[1].result == M70_ERROR_CODE_OK && sched->auto_status == 1,
+					sched->batch[2].result == M70_ERROR_CODE_OK ? (m70_run_status_e)sched->run_status : RST);
+			sched->idle = sched->status == OFFLINE || sched->batch[2].result != M70_ERROR_CODE_OK || sched->run_status == RST;
+		}
+
+		for (i = 0; i < count; i++)
+		{
+			if (sched->batch_entry[i] < 0)
+				continue;
+
+			m70_sched_entry_t* entry = &sched->entries[sched->batch_entry[i]];
+			entry->result = sched->batch[i].result;
+			entry->changed = false;
+			if (entry->result == M70_ERROR_CODE_OK)
+			{
+				entry->changed = !entry->valid || memcmp(entry->scratch, entry->item.value, entry->item.value_size) != 0;
+				memcpy(entry->item.value, entry->scratch, entry->item.value_size);
+				entry->valid = true;
+				entry->period_ms = sched_next_period(sched, entry);
+			}
+			entry->next_due = now + entry->period_ms;
+		}
+
+		// Leaving RST/OFFLINE: everything is read again at its fastest rate
+		if (was_idle && !sched->idle)
+		{
+			M70_LOG_DEBUG("Scheduler: machine active again, resetting item periods");
+			for (i = 0; i < sched->count; i++)
+			{
+				sched->entries[i].period_ms = sched->entries[i].item.min_period_ms;
+				sched->entries[i].next_due = now;
+			}
+		}
+	}
+
+	if (wait_ms != NULL)
+	{
+		uint64 next = sched->status_next_due;
+		for (i = 0; i < sched->count; i++)
+		{
+			if (sched->entries[i].next_due < next)
+				next = sched->entries[i].next_due;
+		}
+		now = get_tick_count_ms();
+		*wait_ms = next > now ? (uint32)(next - now) : 0;
+	}
+
+	return count;
+}
+
+bool m70_scheduler_changed(m70_scheduler_t* sched, int id)
+{
+	if (sched == NULL || id < 0 || id >= sched->count)
+		return false;
+	return sched->entries[id].changed;
+}
+
+m70_error_code_e m70_scheduler_get_result(m70_scheduler_t* sched, int id)
+{
+	if (sched == NULL || id < 0 || id >= sched->count)
+		return M70_ERROR_CODE_FAILED;
+	return sched->entries[id].result;
+}
+
+uint32 m70_scheduler_get_period(m70_scheduler_t* sched, int id)
+{
+	if (sched == NULL || id < 0 || id >= sched->count)
+		return 0;
+	return sched->entries[id].period_ms;
+}
+
+m70_device_status_e m70_scheduler_get_status(m70_scheduler_t* sched)
+{
+	return sched != NULL ? sched->status : OFFLINE;
+}
+
+uint32 m70_scheduler_get_read_count(m70_scheduler_t* sched)
+{
+	return sched != NULL ? sched->read_count : 0;
+}
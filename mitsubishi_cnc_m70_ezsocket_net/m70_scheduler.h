@@ -0,0 +1,45 @@
+#ifndef __H_M70_SCHEDULER_H__
+#define __H_M70_SCHEDULER_H__
+
+// Adaptive polling of one connection. Every item has a period range: it is read at its
+// minimum period while the value changes, backs off by doubling while the value stays
+// the same, and stays at its maximum period while the machine is in RST or OFFLINE.
+// All items due in a tick are read with one m70_cnc_read_batch call.
+
+#include "typedef.h"
+
+#define M70_SCHED_DEFAULT_STATUS_PERIOD 1000 // Milliseconds between reads of the machine status
+
+typedef struct m70_scheduler m70_scheduler_t;
+
+typedef struct _tag_m70_sched_item
+{
+	int section;			   // Main section
+	int sub_section;		   // Sub-section
+	int system_no;			   // System number
+	int axis_flag;			   // Axis bit mask, 0 when not axis related
+	m70_data_type_e data_type; // Requested type
+	void* value;			   // Caller slot, updated by every successful read
+	int value_size;			   // Bytes of value, compared to detect changes
+	uint32 min_period_ms;	   // Period while the value keeps changing
+	uint32 max_period_ms;	   // Period backed off to while it is static or the machine idles
+} m70_sched_item_t;
+
+m70_scheduler_t* m70_scheduler_create(m70_conn_t* conn, short system_no);
+void m70_scheduler_destroy(m70_scheduler_t* sched);
+void m70_scheduler_set_status_period(m70_scheduler_t* sched, uint32 period_ms);
+
+// Returns the item id, or -1 on invalid parameters
+int m70_scheduler_add(m70_scheduler_t* sched, const m70_sched_item_t* item);
+
+// Reads the items that are due, returns how many were read or -1 when the connection
+// was lost. wait_ms receives the time until the next item is due.
+int m70_scheduler_tick(m70_scheduler_t* sched, uint32* wait_ms);
+
+bool m70_scheduler_changed(m70_scheduler_t* sched, int id); // Value changed by the last read of the item
+m70_error_code_e m70_scheduler_get_result(m70_scheduler_t* sched, int id);
+uint32 m70_scheduler_get_period(m70_scheduler_t* sched, int id);
+m70_device_status_e m70_scheduler_get_status(m70_scheduler_t* sched);
+uint32 m70_scheduler_get_read_count(m70_scheduler_t* sched); // Items read since creation, status included
+
+#endif // __H_M70_SCHEDULER_H__
@@ -0,0 +1,204 @@
+#include "m70_stats.h"
+#include "utill.h"
+#include "m70_log.h"
+#include "m70_error.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define M70_STATS_SUB_BITS 6									  // 64 linear buckets below 64 us
+#define M70_STATS_SUB_COUNT (1 << M70_STATS_SUB_BITS)
+#define M70_STATS_HALF_COUNT (M70_STATS_SUB_COUNT / 2)
+#define M70_STATS_BUCKETS (M70_STATS_SUB_COUNT + (32 - M70_STATS_SUB_BITS) * M70_STATS_HALF_COUNT) // Covers every uint32
+
+typedef struct m70_op_histogram
+{
+	uint32 count;
+	uint32 errors;
+	uint64 total_us;
+	uint32 min_us;
+	uint32 max_us;
+	uint32 buckets[M70_STATS_BUCKETS];
+} m70_op_histogram_t;
+
+typedef struct m70_conn_stats
+{
+	m70_op_histogram_t ops[M70_STATS_OP_COUNT];
+} m70_conn_stats_t;
+
+static const char* g_stats_op_names[M70_STATS_OP_COUNT] = {
+	"mochaGetData",
+	"mochaSetData",
+	"GetCurrentAlarmMsg",
+	"GetCurrentPrgBlock",
+	"FS_OpenFile",
+	"FS_ReadFile",
+	"FS_WriteFile",
+	"FS_CloseFile",
+	"FS_CreateFile",
+	"FS_RemoveFile",
+	"FS_StatFile",
+	"FS_OpenDirectory",
+	"FS_ReadDirectory",
+	"FS_CloseDirectory",
+	"CancelModal2",
+};
+
+static int stats_highest_bit(uint32 value)
+{
+	int bit = 0;
+	while (value >>= 1)
+		bit++;
+	return bit;
+}
+
+static int stats_bucket_index(uint32 value)
+{
+	if (value < M70_STATS_SUB_COUNT)
+		return (int)value;
+
+	// value >> shift falls in [HALF_COUNT, SUB_COUNT)
+	int shift = stats_highest_bit(value) - (M70_STATS_SUB_BITS - 1);
+	return M70_STATS_SUB_COUNT + (shift - 1) * M70_STATS_HALF_COUNT + (int)((value >> shift) - M70_STATS_HALF_COUNT);
+}
+
+// Highest value that lands in the bucket
+static uint32 stats_bucket_upper(int index)
+{
+	if (index < M70_STATS_SUB_COUNT)
+		return (uint32)index;
+
+	int shift = (index - M70_STATS_SUB_COUNT) / M70_STATS_HALF_COUNT + 1;
+	uint64 sub = (uint64)((index - M70_STATS_SUB_COUNT) % M70_STATS_HALF_COUNT + M70_STATS_HALF_COUNT);
+	uint64 upper = ((sub + 1) << shift) - 1;
+	return upper > 0xFFFFFFFFULL ? 0xFFFFFFFFU : (uint32)upper;
+}
+
+static uint32 stats_histogram_percentile(const m70_op_histogram_t* histogram, double percentile)
+{
+	if (histogram->count == 0)
+		return 0;
+	if (percentile < 0)
+		percentile = 0;
+	if (percentile > 100)
+		percentile = 100;
+
+	uint64 target = (uint64)(histogram->count * percentile / 100.0 + 0.5);
+	if (target == 0)
+		target = 1;
+
+	uint64 seen = 0;
+	int i = 0;
+	for (i = 0; i < M70_STATS_BUCKETS; i++)
+	{
+		seen += histogram->buckets[i];
+		if (seen >= target)
+		{
+			uint32 upper = stats_bucket_upper(i);
+			return upper < histogram->max_us ? upper : histogram->max_us;
+		}
+	}
+	return histogram->max_us;
+}
+
+bool m70_stats_enable(m70_conn_t* conn)
+{
+	if (conn == NULL)
+		return false;
+	if (conn->stats != NULL)
+		return true;
+
+	conn->stats = (m70_conn_stats_t*)calloc(1, sizeof(m70_conn_stats_t));
+	if (conn->stats == NULL)
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_SYS_OUT_OF_MEMORY, "Failed to allocate connection statistics");
+		return false;
+	}
+	return true;
+}
+
+void m70_stats_disable(m70_conn_t* conn)
+{
+	if (conn == NULL || conn->stats == NULL)
+		return;
+
+	free(conn->stats);
+	conn->stats = NULL;
+}
+
+void m70_stats_reset(m70_conn_t* conn)
+{
+	if (conn != NULL && conn->stats != NULL)
+		memset((void*)conn->stats, 0, sizeof(m70_conn_stats_t));
+}
+
+uint64 m70_stats_begin(m70_conn_t* conn)
+{
+	return conn != NULL && conn->stats != NULL ? get_tick_count_us() : 0;
+}
+
+void m70_stats_end(m70_conn_t* conn, m70_stats_op_e op, uint64 start, long code)
+{
+	if (start == 0 || conn == NULL || conn->stats == NULL || op < 0 || op >= M70_STATS_OP_COUNT)
+		return;
+
+	uint64 elapsed = get_tick_count_us() - start;
+	uint32 us = elapsed > 0xFFFFFFFFULL ? 0xFFFFFFFFU : (uint32)elapsed;
+	m70_op_histogram_t* histogram = &conn->stats->ops[op];
+	if (histogram->count == 0 || us < histogram->min_us)
+		histogram->min_us = us;
+	if (us > histogram->max_us)
+		histogram->max_us = us;
+	histogram->count++;
+	histogram->total_us += us;
+	if (code != 0)
+		histogram->errors++;
+	histogram->buckets[stats_bucket_index(us)]++;
+}
+
+bool m70_stats_get(m70_conn_t* conn, m70_stats_op_e op, m70_op_stats_t* stats)
+{
+	if (conn == NULL || conn->stats == NULL || stats == NULL || op < 0 || op >= M70_STATS_OP_COUNT)
+		return false;
+
+	const m70_op_histogram_t* histogram = &conn->stats->ops[op];
+	stats->count = histogram->count;
+	stats->errors = histogram->errors;
+	stats->total_us = histogram->total_us;
+	stats->min_us = histogram->min_us;
+	stats->max_us = histogram->max_us;
+	stats->p50_us = stats_histogram_percentile(histogram, 50);
+	stats->p99_us = stats_histogram_percentile(histogram, 99);
+	stats->p999_us = stats_histogram_percentile(histogram, 99.9);
+	return true;
+}
+
+uint32 m70_stats_percentile(m70_conn_t* conn, m70_stats_op_e op, double percentile)
+{
+	if (conn == NULL || conn->stats == NULL || op < 0 || op >= M70_STATS_OP_COUNT)
+		return 0;
+	return stats_histogram_percentile(&conn->stats->ops[op], percentile);
+}
+
+const char* m70_stats_op_name(m70_stats_op_e op)
+{
+	return op >= 0 && op < M70_STATS_OP_COUNT ? g_stats_op_names[op] : "unknown";
+}
+
+void m70_stats_dump(m70_conn_t* conn, FILE* out)
+{
+	if (conn == NULL || conn->stats == NULL || out == NULL)
+		return;
+
+	fprintf(out, "%-20s %10s %8s %10s %10s %10s %10s %10s %10s\n", "operation", "count", "errors", "min_us", "avg_us", "p50_us", "p99_us", "p999_us", "max_us");
+	int op = 0;
+	for (op = 0; op < M70_STATS_OP_COUNT; op++)
+	{
+		m70_op_stats_t stats;
+		if (!m70_stats_get(conn, (m70_stats_op_e)op, &stats) || stats.count == 0)
+			continue;
+
+		fprintf(out, "%-20s %10u %8u %10u %10u %10u %10u %10u %10u\n", g_stats_op_names[op], stats.count, stats.errors, stats.min_us,
+			(uint32)(stats.total_us / stats.count), stats.p50_us, stats.p99_us, stats.p999_us, stats.max_us);
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef __H_M70_STATS_H__
+#define __H_M70_STATS_H__
+
+// Per-connection round-trip statistics of every GIOP operation. Latencies go into
+// log-linear histograms (64 linear microsecond buckets, then 32 per power of two,
+// about 3% resolution), so percentiles come out without keeping samples.
+// Collection is off until m70_stats_enable; m70_cnc_disconnect frees it.
+
+#include <stdio.h>
+#include "typedef.h"
+
+typedef enum _tag_m70_stats_op
+{
+	M70_STATS_OP_GET_DATA = 0, // mochaGetData, sequential and pipelined
+	M70_STATS_OP_SET_DATA,
+	M70_STATS_OP_ALARM_MSG,
+	M70_STATS_OP_PRG_BLOCK,
+	M70_STATS_OP_FS_OPEN,
+	M70_STATS_OP_FS_READ,
+	M70_STATS_OP_FS_WRITE,
+	M70_STATS_OP_FS_CLOSE,
+	M70_STATS_OP_FS_CREATE,
+	M70_STATS_OP_FS_REMOVE,
+	M70_STATS_OP_FS_STAT,
+	M70_STATS_OP_FS_OPEN_DIR,
+	M70_STATS_OP_FS_READ_DIR,
+	M70_STATS_OP_FS_CLOSE_DIR,
+	M70_STATS_OP_CANCEL_MODAL,
+	M70_STATS_OP_COUNT
+} m70_stats_op_e;
+
+typedef struct _tag_m70_op_stats
+{
+	uint32 count;	 // Round trips recorded
+	uint32 errors;	 // Of those, replies with an error code or no reply
+	uint64 total_us; // Sum of all round trips
+	uint32 min_us;
+	uint32 max_us;
+	uint32 p50_us;
+	uint32 p99_us;
+	uint32 p999_us;
+} m70_op_stats_t;
+
+bool m70_stats_enable(m70_conn_t* conn);
+void m70_stats_disable(m70_conn_t* conn); // Frees the histograms
+void m70_stats_reset(m70_conn_t* conn);
+
+// False when statistics are off or op is out of range
+bool m70_stats_get(m70_conn_t* conn, m70_stats_op_e op, m70_op_stats_t* stats);
+uint32 m70_stats_percentile(m70_conn_t* conn, m70_stats_op_e op, double percentile); // percentile in 0..100
+const char* m70_stats_op_name(m70_stats_op_e op);
+
+// One line per operation that has samples
+void m70_stats_dump(m70_conn_t* conn, FILE* out);
+
+// Hooks used around each round trip in m70_giop.c; begin returns 0 while statistics are off
+uint64 m70_stats_begin(m70_conn_t* conn);
+void m70_stats_end(m70_conn_t* conn, m70_stats_op_e op, uint64 start, long code);
+
+#endif // __H_M70_STATS_H__
@@ -0,0 +1,321 @@
+#include "m70_subscribe.h"
+#include "m70_ezsocket.h"
+#include "m70_giop.h"
+#include "m70_log.h"
+#include "m70_error.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// One distinct item read on behalf of all subscribers that share it
+typedef struct m70_sub_source
+{
+	m70_sub_item_t item;
+	int refs;
+	int first_batch; // Index of its first slot in the poll batch, -1 when not read
+	short mode;
+	int64 auto_status;
+	short run_status;
+	uint32 counter;
+	get_data_value position;
+	m70_sub_value_t current;
+	bool valid; // current was read by the last poll
+} m70_sub_source_t;
+
+typedef struct m70_subscription
+{
+	int id;
+	int source;
+	double deadband;
+	m70_sub_callback callback;
+	void* user_data;
+	m70_sub_value_t last; // Last value delivered
+	bool notified;		  // last holds a delivered value
+} m70_subscription_t;
+
+typedef struct m70_subscription_engine
+{
+	m70_sub_source_t* sources;
+	int source_count;
+	m70_subscription_t* subs;
+	int sub_count;
+	int next_id;
+	m70_batch_item_t* batch;
+	int batch_capacity;
+} m70_subscription_engine_t;
+
+// Fields that do not identify the item are cleared so identical items compare equal
+static void sub_normalize_item(m70_sub_item_t* item)
+{
+	if (item->kind != M70_SUB_POSITION)
+	{
+		item->pos_type = POS_WRK;
+		item->axis_index = 0;
+	}
+}
+
+static int sub_find_source(m70_subscription_engine_t* engine, const m70_sub_item_t* item)
+{
+	int i = 0;
+	for (i = 0; i < engine->source_count; i++)
+	{
+		m70_sub_item_t* other = &engine->sources[i].item;
+		if (engine->sources[i].refs > 0 && other->kind == item->kind && other->system_no == item->system_no &&
+			other->pos_type == item->pos_type && other->axis_index == item->axis_index)
+			return i;
+	}
+	return -1;
+}
+
+// A source nobody subscribes to any more is taken over by the next new item
+static int sub_find_free_source(m70_subscription_engine_t* engine)
+{
+	int i = 0;
+	for (i = 0; i < engine->source_count; i++)
+	{
+		if (engine->sources[i].refs <= 0)
+			return i;
+	}
+	return -1;
+}
+
+int m70_subscribe(m70_conn_t* conn, const m70_sub_item_t* item, double deadband, m70_sub_callback callback, void* user_data)
+{
+	if (conn == NULL || item == NULL || callback == NULL || item->kind > M70_SUB_COUNTER ||
+		(item->kind == M70_SUB_POSITION && (item->axis_index < 1 || item->axis_index > M70_MAX_AXIS_COUNT)))
+	{
+		M70_ERROR_SET(M70_ERROR_CODE_EX_CNC_INVALID_PARAM, "Invalid subscription parameters");
+		return -1;
+	}
+
+	m70_subscription_engine_t* engine = conn->subscriptions;
+	if (engine == NULL)
+	{
+		engine = (m70_subscription_engine_t*)calloc(1, sizeof(m70_subscription_engine_t));
+		if (engine == NULL)
+			return -1;
+		engine->next_id = 1;
+		conn->subscriptions = engine;
+	}
+
+	m70_sub_item_t key = *item;
+	sub_normalize_item(&key);
+	int source = sub_find_source(engine, &key);
+	if (source < 0)
+		source = sub_find_free_source(engine);
+	if (source >= 0 && engine->sources[source].refs == 0)
+	{
+		memset((void*)&engine->sources[source], 0, sizeof(m70_sub_source_t));
+		engine->sources[source].item = key;
+	}
+	else if (source < 0)
+	{
+		m70_sub_source_t* sources = (m70_sub_source_t*)realloc(engine->sources, sizeof(m70_sub_source_t) * (engine->source_count + 1));
+		if (sources == NULL)
+			return -1;
+		engine->sources = sources;
+		source = engine->source_count++;
+		memset((void*)&sources[source], 0, sizeof(m70_sub_source_t));
+		sources[source].item = key;
+	}
+
+	m70_subscription_t* subs = (m70_subscription_t*)realloc(engine->subs, sizeof(m70_subscription_t) * (engine->sub_count + 1));
+	if (subs == NULL)
+		return -1;
+	engine->subs = subs;
+
+	m70_subscription_t* sub = &subs[engine->sub_count++];
+	memset((void*)sub, 0, sizeof(*sub));
+	sub->id = engine->next_id++;
+	sub->source = source;
+	sub->deadband = deadband < 0 ? -deadband : deadband;
+	sub->callback = callback;
+	sub->user_data = user_data;
+	engine->sources[source].refs++;
+	M70_LOG_DEBUG("Subscription %d added, kind=%d, source=%d, refs=%d", sub->id, key.kind, source, engine->sources[source].refs);
+	return sub->id;
+}
+
+void m70_unsubscribe(m70_conn_t* conn, int id)
+{
+	if (conn == NULL || conn->subscriptions == NULL)
+		return;
+
+	m70_subscription_engine_t* engine = conn->subscriptions;
+	int i = 0;
+	for (i = 0; i < engine->sub_count; i++)
+	{
+		if (engine->subs[i].id != id)
+			continue;
+
+		engine->sources[engine->subs[i].source].refs--;
+		memmove(&engine->subs[i], &engine->subs[i + 1], sizeof(m70_subscription_t) * (engine->sub_count - i - 1));
+		engine->sub_count--;
+
+		// Unused sources at the end are dropped so that polls do not walk them
+		while (engine->source_count > 0 && engine->sources[engine->source_count - 1].refs <= 0)
+			engine->source_count--;
+		return;
+	}
+}
+
+void m70_unsubscribe_all(m70_conn_t* conn)
+{
+	if (conn == NULL || conn->subscriptions == NULL)
+		return;
+
+	m70_subscription_engine_t* engine = conn->subscriptions;
+	free(engine->sources);
+	free(engine->subs);
+	free(engine->batch);
+	free(engine);
+	conn->subscriptions = NULL;
+}
+
+static void sub_add_read(m70_batch_item_t* batch, int* count, int section, int sub_section, int system_no, int axis_flag, m70_data_type_e data_type, void* value, int value_size)
+{
+	m70_batch_item_t* read = &batch[(*count)++];
+	memset((void*)read, 0, sizeof(*read));
+	read->section = section;
+	read->sub_section = sub_section;
+	read->system_no = system_no;
+	read->axis_flag = axis_flag;
+	read->data_type = data_type;
+	read->value = value;
+	read->value_size = value_size;
+}
+
+// Decodes the batch slots of a source into its current value, false when the read failed
+static bool sub_decode_source(m70_sub_source_t* source, const m70_batch_item_t* batch, uint64 timestamp)
+{
+	const m70_batch_item_t* read = &batch[source->first_batch];
+	m70_sub_value_t* value = &source->current;
+	if (read->result != M70_ERROR_CODE_OK)
+		return false;
+
+	memset((void*)value, 0, sizeof(*value));
+	value->item = source->item;
+	value->timestamp = timestamp;
+	switch (source->item.kind)
+	{
+	case M70_SUB_STATUS:
+		value->mode = (m70_run_mode_e)source->mode;
+		value->run_status = read[2].result == M70_ERROR_CODE_OK ? (m70_run_status_e)source->run_status : RST;
+		value->status = m70_cnc_decode_status(value->mode, read[1].result == M70_ERROR_CODE_OK && source->auto_status == 1, value->run_status);
+		break;
+
+	case M70_SUB_POSITION:
+		value->value = read->data_type == T_FLOATBIN ? source->position.u_float_bin.data : source->position.u_double;
+		break;
+
+	case M70_SUB_COUNTER:
+		value->value = source->counter;
+		break;
+	}
+	return true;
+}
+
+static bool sub_value_moved(const m70_subscription_t* sub, const m70_sub_value_t* value)
+{
+	if (!sub->notified)
+		return true;
+	if (value->item.kind == M70_SUB_STATUS)
+		return value->status != sub->last.status || value->mode != sub->last.mode || value->run_status != sub->last.run_status;
+	if (sub->deadband <= 0)
+		return value->value != sub->last.value;
+	return fabs(value->value - sub->last.value) > sub->deadband;
+}
+
+m70_error_code_e m70_subscription_poll(m70_conn_t* conn, int* notified)
+{
+	if (notified != NULL)
+		*notified = 0;
+	if (!check_conn_is_valid(conn))
+	{
+		M70_CONN_ERROR_SET(conn, M70_ERROR_CODE_EX_CONN_INVALID, "Invalid connection");
+		return M70_ERROR_CODE_FAILED;
+	}
+
+	m70_subscription_engine_t* engine = conn->subscriptions;
+	if (engine == NULL || engine->sub_count == 0)
+		return M70_ERROR_CODE_OK;
+
+	// A status source takes three slots, every other source one
+	if (engine->batch_capacity < engine->source_count * 3)
+	{
+		m70_batch_item_t* batch = (m70_batch_item_t*)realloc(engine->batch, sizeof(m70_batch_item_t) * engine->source_count * 3);
+		if (batch == NULL)
+			return M70_ERROR_CODE_FAILED;
+		engine->batch = batch;
+		engine->batch_capacity = engine->source_count * 3;
+	}
+
+	int count = 0;
+	int i = 0;
+	for (i = 0; i < engine->source_count; i++)
+	{
+		m70_sub_source_t* source = &engine->sources[i];
+		source->first_batch = -1;
+		source->valid = false;
+		if (source->refs <= 0)
+			continue;
+
+		short system_no = source->item.system_no;
+		source->first_batch = count;
+		switch (source->item.kind)
+		{
+		case M70_SUB_STATUS:
+			sub_add_read(engine->batch, &count, 35, 11, system_no, 0, T_SHORT, &source->mode, sizeof(source->mode));
+			sub_add_read(engine->batch, &count, 35, 20, system_no, 0, T_DLONG, &source->auto_status, sizeof(source->auto_status));
+			sub_add_read(engine->batch, &count, 35, 10, system_no, 0, T_SHORT, &source->run_status, sizeof(source->run_status));
+			break;
+
+		case M70_SUB_POSITION:
+			sub_add_read(engine->batch, &count, 37, get_position_sub_section(source->item.pos_type), system_no,
+				get_axis_real_no(source->item.axis_index), T_FLOATBIN, &source->position, sizeof(source->position));
+			break;
+
+		case M70_SUB_COUNTER:
+			sub_add_read(engine->batch, &count, 126, 8002, system_no, 0, T_LONG, &source->counter, sizeof(source->counter));
+			break;
+		}
+	}
+
+	m70_error_code_e ret = m70_cnc_read_batch(conn, engine->batch, count);
+	if (ret == M70_ERROR_CODE_SOCKET_FAILED)
+		return ret;
+
+	uint64 timestamp = get_current_time_ms();
+	for (i = 0; i < engine->source_count; i++)
+	{
+		m70_sub_source_t* source = &engine->sources[i];
+		if (source->first_batch >= 0)
+			source->valid = sub_decode_source(source, engine->batch, timestamp);
+	}
+
+	// Callbacks may subscribe or unsubscribe, so the array is re-read on every step
+	int done = 0;
+	for (i = 0; conn->subscriptions == engine && i < engine->sub_count; i++)
+	{
+		m70_subscription_t* sub = &engine->subs[i];
+		m70_sub_source_t* source = &engine->sources[sub->source];
+		if (!source->valid || !sub_value_moved(sub, &source->current))
+			continue;
+
+		sub->last = source->current;
+		sub->notified = true;
+		m70_sub_value_t value = source->current;
+		int id = sub->id;
+		sub->callback(conn, id, &value, sub->user_data);
+		done++;
+
+		// The callback removed itself or an earlier entry, step back to the same position
+		if (conn->subscriptions == engine && (i >= engine->sub_count || engine->subs[i].id != id))
+			i--;
+	}
+
+	if (notified != NULL)
+		*notified = done;
+	return ret;
+}
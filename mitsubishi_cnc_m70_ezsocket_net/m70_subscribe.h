@@ -0,0 +1,47 @@
+#ifndef __H_M70_SUBSCRIBE_H__
+#define __H_M70_SUBSCRIBE_H__
+
+// Change-detection subscriptions. Every connection owns one engine that reads each distinct
+// item once per m70_subscription_poll, however many subscribers share it, and calls back
+// only the subscribers whose value moved by more than their deadband.
+
+#include "typedef.h"
+
+typedef enum _tag_m70_sub_kind
+{
+	M70_SUB_STATUS = 0, // m70_cnc_read_status: status, mode, run status
+	M70_SUB_POSITION,	// m70_cnc_read_axis_position
+	M70_SUB_COUNTER		// m70_cnc_read_counter
+} m70_sub_kind_e;
+
+typedef struct _tag_m70_sub_item
+{
+	m70_sub_kind_e kind;
+	short system_no;
+	position_type_e pos_type; // POSITION only
+	uint32 axis_index;		  // POSITION only, 1-based
+} m70_sub_item_t;
+
+typedef struct _tag_m70_sub_value
+{
+	m70_sub_item_t item;
+	m70_device_status_e status; // STATUS
+	m70_run_mode_e mode;		// STATUS
+	m70_run_status_e run_status; // STATUS
+	double value;				// POSITION: position, COUNTER: count
+	uint64 timestamp;			// Milliseconds since 1970-01-01 of the read
+} m70_sub_value_t;
+
+// STATUS notifies on any change of status, mode or run status; deadband applies to value.
+// The first successful read is always delivered.
+typedef void (*m70_sub_callback)(m70_conn_t* conn, int id, const m70_sub_value_t* value, void* user_data);
+
+// Returns the subscription id, or -1 on invalid parameters
+int m70_subscribe(m70_conn_t* conn, const m70_sub_item_t* item, double deadband, m70_sub_callback callback, void* user_data);
+void m70_unsubscribe(m70_conn_t* conn, int id);
+void m70_unsubscribe_all(m70_conn_t* conn);
+
+// Reads every subscribed item in one batch and runs the callbacks, notified receives their count
+m70_error_code_e m70_subscription_poll(m70_conn_t* conn, int* notified);
+
+#endif // __H_M70_SUBSCRIBE_H__
@@ -0,0 +1,202 @@
+#include "m70_thread.h"
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <time.h>
+#include <errno.h>
+#include <sys/time.h>
+#endif
+
+typedef struct m70_thread_start
+{
+	m70_thread_fn fn;
+	void* arg;
+} m70_thread_start_t;
+
+#ifdef _WIN32
+static DWORD WINAPI m70_thread_entry(LPVOID param)
+#else
+static void* m70_thread_entry(void* param)
+#endif
+{
+	m70_thread_start_t start = *(m70_thread_start_t*)param;
+	free(param);
+	start.fn(start.arg);
+	return 0;
+}
+
+bool m70_thread_create(m70_thread_t* thread, m70_thread_fn fn, void* arg)
+{
+	m70_thread_start_t* start = (m70_thread_start_t*)malloc(sizeof(m70_thread_start_t));
+	if (start == NULL)
+		return false;
+
+	start->fn = fn;
+	start->arg = arg;
+#ifdef _WIN32
+	*thread = CreateThread(NULL, 0, m70_thread_entry, start, 0, NULL);
+	if (*thread == NULL)
+#else
+	if (pthread_create(thread, NULL, m70_thread_entry, start) != 0)
+#endif
+	{
+		free(start);
+		return false;
+	}
+	return true;
+}
+
+void m70_thread_join(m70_thread_t thread)
+{
+#ifdef _WIN32
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+#else
+	pthread_join(thread, NULL);
+#endif
+}
+
+void m70_thread_detach(m70_thread_t thread)
+{
+#ifdef _WIN32
+	CloseHandle(thread);
+#else
+	pthread_detach(thread);
+#endif
+}
+
+void m70_sleep_ms(uint32 ms)
+{
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (long)(ms % 1000) * 1000000;
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+		;
+#endif
+}
+
+void m70_mutex_init(m70_mutex_t* mutex)
+{
+#ifdef _WIN32
+	InitializeCriticalSection(mutex);
+#else
+	pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void m70_mutex_destroy(m70_mutex_t* mutex)
+{
+#ifdef _WIN32
+	DeleteCriticalSection(mutex);
+#else
+	pthread_mutex_destroy(mutex);
+#endif
+}
+
+void m70_mutex_lock(m70_mutex_t* mutex)
+{
+#ifdef _WIN32
+	EnterCriticalSection(mutex);
+#else
+	pthread_mutex_lock(mutex);
+#endif
+}
+
+void m70_mutex_unlock(m70_mutex_t* mutex)
+{
+#ifdef _WIN32
+	LeaveCriticalSection(mutex);
+#else
+	pthread_mutex_unlock(mutex);
+#endif
+}
+
+void m70_cond_init(m70_cond_t* cond)
+{
+#ifdef _WIN32
+	InitializeConditionVariable(cond);
+#else
+	pthread_cond_init(cond, NULL);
+#endif
+}
+
+void m70_cond_destroy(m70_cond_t* cond)
+{
+#ifndef _WIN32
+	pthread_cond_destroy(cond);
+#endif
+}
+
+// Spurious and timed-out wake-ups both return, callers re-check their predicate
+void m70_cond_wait(m70_cond_t* cond, m70_mutex_t* mutex, uint32 timeout_ms)
+{
+#ifdef _WIN32
+	SleepConditionVariableCS(cond, mutex, timeout_ms);
+#else
+	struct timeval now;
+	struct timespec deadline;
+	gettimeofday(&now, NULL);
+	uint64 nsec = (uint64)now.tv_usec * 1000 + (uint64)(timeout_ms % 1000) * 1000000;
+	deadline.tv_sec = now.tv_sec + timeout_ms / 1000 + (time_t)(nsec / 1000000000);
+	deadline.tv_nsec = (long)(nsec % 1000000000);
+	pthread_cond_timedwait(cond, mutex, &deadline);
+#endif
+}
+
+void m70_cond_signal(m70_cond_t* cond)
+{
+#ifdef _WIN32
+	WakeConditionVariable(cond);
+#else
+	pthread_cond_signal(cond);
+#endif
+}
+
+void m70_cond_broadcast(m70_cond_t* cond)
+{
+#ifdef _WIN32
+	WakeAllConditionVariable(cond);
+#else
+	pthread_cond_broadcast(cond);
+#endif
+}
+
+int32 m70_atomic_add(volatile int32* value, int32 delta)
+{
+#ifdef _WIN32
+	return InterlockedExchangeAdd((volatile LONG*)value, delta) + delta;
+#else
+	return __sync_add_and_fetch(value, delta);
+#endif
+}
+
+int32 m70_atomic_load(volatile int32* value)
+{
+#ifdef _WIN32
+	return InterlockedCompareExchange((volatile LONG*)value, 0, 0);
+#else
+	return __sync_add_and_fetch(value, 0);
+#endif
+}
+
+void m70_atomic_store(volatile int32* value, int32 v)
+{
+#ifdef _WIN32
+	InterlockedExchange((volatile LONG*)value, v);
+#else
+	__sync_lock_test_and_set(value, v);
+	__sync_synchronize();
+#endif
+}
+
+bool m70_atomic_cas(volatile int32* value, int32 expected, int32 desired)
+{
+#ifdef _WIN32
+	return InterlockedCompareExchange((volatile LONG*)value, desired, expected) == expected;
+#else
+	return __sync_bool_compare_and_swap(value, expected, desired);
+#endif
+}
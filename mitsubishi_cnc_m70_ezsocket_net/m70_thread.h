@@ -0,0 +1,45 @@
+#ifndef __H_M70_THREAD_H__
+#define __H_M70_THREAD_H__
+
+// Thin portable wrappers over Win32 threads and pthreads
+
+#include "typedef.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <Windows.h>
+typedef HANDLE m70_thread_t;
+typedef CRITICAL_SECTION m70_mutex_t;
+typedef CONDITION_VARIABLE m70_cond_t;
+#else
+#include <pthread.h>
+typedef pthread_t m70_thread_t;
+typedef pthread_mutex_t m70_mutex_t;
+typedef pthread_cond_t m70_cond_t;
+#endif
+
+typedef void (*m70_thread_fn)(void* arg);
+
+bool m70_thread_create(m70_thread_t* thread, m70_thread_fn fn, void* arg);
+void m70_thread_join(m70_thread_t thread);
+void m70_thread_detach(m70_thread_t thread); // Resources are released when the thread returns
+void m70_sleep_ms(uint32 ms);
+
+void m70_mutex_init(m70_mutex_t* mutex);
+void m70_mutex_destroy(m70_mutex_t* mutex);
+void m70_mutex_lock(m70_mutex_t* mutex);
+void m70_mutex_unlock(m70_mutex_t* mutex);
+
+void m70_cond_init(m70_cond_t* cond);
+void m70_cond_destroy(m70_cond_t* cond);
+void m70_cond_wait(m70_cond_t* cond, m70_mutex_t* mutex, uint32 timeout_ms);
+void m70_cond_signal(m70_cond_t* cond);
+void m70_cond_broadcast(m70_cond_t* cond);
+
+// Full-barrier atomics on 32-bit counters
+int32 m70_atomic_add(volatile int32* value, int32 delta); // Returns the new value
+int32 m70_atomic_load(volatile int32* value);
+void m70_atomic_store(volatile int32* value, int32 v);
+bool m70_atomic_cas(volatile int32* value, int32 expected, int32 desired); // True when value was expected and is now desired
+
+#endif // __H_M70_THREAD_H__
@@ -143,6 +143,7 @@ static m70_error_code_e read_basic_info(m70_conn_t *conn)
     GET_RESULT(ret);
     printf("feed speed: %lf\n", feed_speed);
 
+    // Time counters, read in a single network burst
     uint32 power_on_time = 0;
     uint32 auto_op_time = 0;
     uint32 auto_startup_time = 0;
@@ -150,29 +151,22 @@ static m70_error_code_e read_basic_info(m70_conn_t *conn)
     uint32 cutting_time = 0;
     uint32 sys_date = 0;
     uint32 sys_time = 0;
-
-    ret = m70_cnc_read_power_on_time(conn, &power_on_time);
+    m70_batch_item_t times[] = {
+        {.section = 40, .sub_section = 1, .data_type = T_UINT32, .value = &power_on_time, .value_size = sizeof(power_on_time)},
+        {.section = 40, .sub_section = 2, .data_type = T_UINT32, .value = &auto_op_time, .value_size = sizeof(auto_op_time)},
+        {.section = 40, .sub_section = 3, .data_type = T_UINT32, .value = &auto_startup_time, .value_size = sizeof(auto_startup_time)},
+        {.section = 40, .sub_section = 8, .data_type = T_UINT32, .value = &cycle_time, .value_size = sizeof(cycle_time)},
+        {.section = 40, .sub_section = 100, .data_type = T_UINT32, .value = &cutting_time, .value_size = sizeof(cutting_time)},
+        {.section = 40, .sub_section = 6, .data_type = T_UINT32, .value = &sys_date, .value_size = sizeof(sys_date)},
+        {.section = 40, .sub_section = 7, .data_type = T_UINT32, .value = &sys_time, .value_size = sizeof(sys_time)},
+    };
+    ret = m70_cnc_read_batch(conn, times, sizeof(times) / sizeof(times[0]));
     GET_RESULT(ret);
     printf("power on time: %d\n", power_on_time);
-
-    ret = m70_cnc_read_auto_operation_time(conn, &auto_op_time);
-    GET_RESULT(ret);
     printf("auto op time: %d\n", auto_op_time);
-
-    ret = m70_cnc_read_auto_startup_time(conn, &auto_op_time);
-    GET_RESULT(ret);
     printf("auto startup time: %d\n", auto_startup_time);
-
-    ret = m70_cnc_read_cycle_time(conn, &cycle_time);
-    GET_RESULT(ret);
     printf("cycle time: %d\n", cycle_time);
-
-    ret = m70_cnc_read_cutting_time(conn, &cutting_time);
-    GET_RESULT(ret);
     printf("cutting time: %d\n", cutting_time);
-
-    ret = m70_cnc_read_system_datetime(conn, &sys_date, &sys_time);
-    GET_RESULT(ret);
     printf("system date time: %d, %d\n", sys_date, sys_time);
 
     return ret;
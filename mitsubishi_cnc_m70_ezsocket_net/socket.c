@@ -3,6 +3,7 @@
 #include <string.h>
 #include "m70_log.h"
 #include "m70_error.h"
+#include "m70_thread.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -13,10 +14,36 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
+#include <fcntl.h>
 #endif
 
+static volatile int32 g_send_calls = 0;
+static volatile int32 g_recv_calls = 0;
+
+void socket_count_syscall(bool is_send)
+{
+	m70_atomic_add(is_send ? &g_send_calls : &g_recv_calls, 1);
+}
+
+void socket_get_syscall_counts(uint32* sends, uint32* recvs)
+{
+	if (sends != NULL)
+		*sends = (uint32)m70_atomic_load(&g_send_calls);
+	if (recvs != NULL)
+		*recvs = (uint32)m70_atomic_load(&g_recv_calls);
+}
+
+void socket_reset_syscall_counts()
+{
+	m70_atomic_store(&g_send_calls, 0);
+	m70_atomic_store(&g_recv_calls, 0);
+}
+
 int socket_send_data(int fd, void* buf, int nbytes)
 {
 	int nleft, nwritten;
@@ -31,6 +58,7 @@ int socket_send_data(int fd, void* buf, int nbytes)
 	while (nleft > 0)
 	{
 		nwritten = send(fd, ptr, nleft, 0);
+		socket_count_syscall(true);
 		if (nwritten <= 0)
 		{
 			if (errno == EINTR) {
@@ -53,6 +81,87 @@ int socket_send_data(int fd, void* buf, int nbytes)
 	return (nbytes - nleft);
 }
 
+int socket_send_iov(int fd, const socket_iovec_t* iov, int count)
+{
+	if (fd < 0 || iov == NULL || count <= 0 || count > SOCKET_MAX_IOV) {
+		M70_LOG_ERROR("Send data failed: Invalid socket descriptor %d or %d pieces", fd, count);
+		return -1;
+	}
+
+#ifdef _WIN32
+	WSABUF parts[SOCKET_MAX_IOV];
+#else
+	struct iovec parts[SOCKET_MAX_IOV];
+#endif
+	int nbytes = 0;
+	int i = 0;
+	for (i = 0; i < count; i++)
+	{
+#ifdef _WIN32
+		parts[i].buf = (char*)iov[i].data;
+		parts[i].len = iov[i].length;
+#else
+		parts[i].iov_base = (void*)iov[i].data;
+		parts[i].iov_len = iov[i].length;
+#endif
+		nbytes += iov[i].length;
+	}
+
+	// Partial writes drop the pieces already sent and trim the first remaining one
+	int first = 0;
+	int nleft = nbytes;
+	while (nleft > 0)
+	{
+#ifdef _WIN32
+		DWORD sent = 0;
+		int nwritten = WSASend(fd, parts + first, count - first, &sent, 0, NULL, NULL) == 0 ? (int)sent : -1;
+#else
+		int nwritten = (int)writev(fd, parts + first, count - first);
+#endif
+		socket_count_syscall(true);
+		if (nwritten <= 0)
+		{
+#ifdef _WIN32
+			M70_LOG_ERROR("Send data failed: WSA error %d", WSAGetLastError());
+			return -1;
+#else
+			if (errno == EINTR) {
+				M70_LOG_DEBUG("Send data interrupted, continuing to try");
+				continue;
+			}
+			M70_LOG_ERROR("Send data failed: %s (errno: %d)", strerror(errno), errno);
+			return -1;
+#endif
+		}
+
+		nleft -= nwritten;
+		while (first < count && nwritten > 0)
+		{
+#ifdef _WIN32
+			int length = (int)parts[first].len;
+#else
+			int length = (int)parts[first].iov_len;
+#endif
+			if (nwritten < length)
+			{
+#ifdef _WIN32
+				parts[first].buf += nwritten;
+				parts[first].len -= nwritten;
+#else
+				parts[first].iov_base = (char*)parts[first].iov_base + nwritten;
+				parts[first].iov_len -= nwritten;
+#endif
+				break;
+			}
+			nwritten -= length;
+			first++;
+		}
+	}
+
+	M70_LOG_DEBUG("Successfully sent all %d bytes of data in %d pieces", nbytes, count);
+	return nbytes;
+}
+
 int socket_recv_data(int fd, void* buf, int nbytes)
 {
 	int nleft, nread;
@@ -67,6 +176,7 @@ int socket_recv_data(int fd, void* buf, int nbytes)
 	while (nleft > 0)
 	{
 		nread = recv(fd, ptr, nleft, 0);
+		socket_count_syscall(false);
 		if (nread == 0)
 		{
 			M70_LOG_WARNING("Connection closed, received EOF");
@@ -108,6 +218,7 @@ int socket_recv_data_one_loop(int fd, void* buf, int nbytes)
 	while (nleft > 0)
 	{
 		nread = recv(fd, ptr, nleft, 0);
+		socket_count_syscall(false);
 		if (nread == 0)
 		{
 			M70_LOG_WARNING("Connection closed, received EOF");
@@ -182,6 +293,118 @@ int socket_open_tcp_client_socket(char* dest_ip, short dest_port)
 	return sockFd;
 }
 
+// Non-blocking socket with the connect in progress, completion is signalled by writability
+int socket_open_tcp_client_socket_async(char* dest_ip, short dest_port)
+{
+	struct sockaddr_in server_addr;
+
+	M70_LOG_INFO("Starting non-blocking TCP connection to %s:%d", dest_ip, dest_port);
+	int sockFd = (int)socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sockFd < 0)
+	{
+		M70_LOG_ERROR("Failed to create socket: %s (errno: %d)", strerror(errno), errno);
+		return -1;
+	}
+
+	if (!socket_set_nonblocking(sockFd, true))
+	{
+		socket_close_tcp_socket(sockFd);
+		return -1;
+	}
+
+	memset((char*)&server_addr, 0, sizeof(server_addr));
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_addr.s_addr = inet_addr(dest_ip);
+	server_addr.sin_port = (uint16_t)htons((uint16_t)dest_port);
+
+	int ret = connect(sockFd, (struct sockaddr*)&server_addr, sizeof(server_addr));
+#ifdef _WIN32
+	if (ret != 0 && WSAGetLastError() != WSAEWOULDBLOCK)
+#else
+	if (ret != 0 && errno != EINPROGRESS)
+#endif
+	{
+		M70_LOG_ERROR("Failed to connect to %s:%d: %s (errno: %d)", dest_ip, dest_port, strerror(errno), errno);
+		M70_ERROR_SET(M70_ERROR_CODE_EX_CONN_REFUSED, "Failed to connect to %s:%d: %s", dest_ip, dest_port, strerror(errno));
+		socket_close_tcp_socket(sockFd);
+		return -1;
+	}
+
+	return sockFd;
+}
+
+// Listening socket bound to ip (NULL or "0.0.0.0" for all interfaces)
+int socket_open_tcp_server_socket(char* ip, short port, int backlog)
+{
+	struct sockaddr_in server_addr;
+
+	int sockFd = (int)socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sockFd < 0)
+	{
+		M70_LOG_ERROR("Failed to create socket: %s (errno: %d)", strerror(errno), errno);
+		return -1;
+	}
+
+	int reuse = 1;
+	setsockopt(sockFd, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	memset((char*)&server_addr, 0, sizeof(server_addr));
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_addr.s_addr = ip != NULL ? inet_addr(ip) : htonl(INADDR_ANY);
+	server_addr.sin_port = (uint16_t)htons((uint16_t)port);
+
+	if (bind(sockFd, (struct sockaddr*)&server_addr, sizeof(server_addr)) != 0 || listen(sockFd, backlog) != 0)
+	{
+		M70_LOG_ERROR("Failed to listen on %s:%d: %s (errno: %d)", ip != NULL ? ip : "0.0.0.0", (uint16_t)port, strerror(errno), errno);
+		M70_ERROR_SET(M70_ERROR_CODE_EX_SOCKET_FAILED, "Failed to listen on port %d: %s", (uint16_t)port, strerror(errno));
+		socket_close_tcp_socket(sockFd);
+		return -1;
+	}
+
+	M70_LOG_INFO("Listening on %s:%d", ip != NULL ? ip : "0.0.0.0", (uint16_t)port);
+	return sockFd;
+}
+
+// Blocks until a client connects; the accepted socket sends small replies without Nagle delay
+int socket_accept_tcp_client(int listen_fd)
+{
+	int sockFd = -1;
+	do
+	{
+		sockFd = (int)accept(listen_fd, NULL, NULL);
+	} while (sockFd < 0 && errno == EINTR);
+
+	if (sockFd < 0)
+	{
+		M70_LOG_ERROR("Failed to accept connection: %s (errno: %d)", strerror(errno), errno);
+		return -1;
+	}
+
+	int nodelay = 1;
+	setsockopt(sockFd, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay));
+	return sockFd;
+}
+
+bool socket_set_nonblocking(int fd, bool enable)
+{
+#ifdef _WIN32
+	u_long mode = enable ? 1 : 0;
+	if (ioctlsocket(fd, FIONBIO, &mode) != 0)
+	{
+		M70_LOG_ERROR("Failed to change blocking mode of socket %d", fd);
+		return false;
+	}
+#else
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags < 0 || fcntl(fd, F_SETFL, enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK)) < 0)
+	{
+		M70_LOG_ERROR("Failed to change blocking mode of socket %d: %s", fd, strerror(errno));
+		return false;
+	}
+#endif
+	return true;
+}
+
 void socket_close_tcp_socket(int sockFd)
 {
 	if (sockFd > 0)
@@ -3,10 +3,29 @@
 
 #include "utill.h"
 
+#define SOCKET_MAX_IOV 8 // Pieces accepted by one socket_send_iov
+
+// One piece of a gathered send, the memory stays owned by the caller
+typedef struct _tag_socket_iovec
+{
+	const void* data;
+	int length;
+} socket_iovec_t;
+
 int socket_send_data(int fd, void* ptr, int nbytes);
+int socket_send_iov(int fd, const socket_iovec_t* iov, int count); // Sends all pieces back to back without copying them
 int socket_recv_data(int fd, void* ptr, int nbytes);
 int socket_recv_data_one_loop(int fd, void* ptr, int nbytes);
 int socket_open_tcp_client_socket(char* ip, short port);
+int socket_open_tcp_client_socket_async(char* ip, short port);
+int socket_open_tcp_server_socket(char* ip, short port, int backlog);
+int socket_accept_tcp_client(int listen_fd);
+bool socket_set_nonblocking(int fd, bool enable);
 void socket_close_tcp_socket(int sockFd);
 
+// Process-wide number of send and recv system calls, for benchmarks
+void socket_get_syscall_counts(uint32* sends, uint32* recvs);
+void socket_reset_syscall_counts();
+void socket_count_syscall(bool is_send); // For callers that issue send/recv themselves
+
 #endif //__SOCKET_H_
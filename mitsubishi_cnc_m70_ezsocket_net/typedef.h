@@ -12,6 +12,15 @@ typedef long long int64;
 typedef unsigned long long uint64;
 
 #define BUFFER_SIZE 512
+#define M70_RECV_BUFFER_SIZE 8192 // Per-connection receive buffer, holds several GIOP frames
+#define M70_DEFAULT_PIPELINE_DEPTH 8 // Requests kept in flight by default in pipelined mode
+#define M70_MAX_PIPELINE_DEPTH 64
+#define M70_SEND_BUFFER_SIZE 8192 // Coalesced request packets flushed with a single write
+#define M70_MAX_AXIS_COUNT 8	   // Axes addressable through get_axis_real_no
+#define M70_MAX_SYSTEM_COUNT 4	   // Part systems whose metadata is cached per connection
+#define M70_META_TEXT_SIZE 128	   // Cached axis name lists
+#define M70_META_VERSION_SIZE 513  // Cached version strings: a whole T_string text and a terminator
+#define M70_DEFAULT_OVERRIDE_METHOD_TTL 5000 // Milliseconds an override setting-method bit is trusted
 
 typedef enum _tag_m70_error_code
 {
@@ -21,6 +30,66 @@ typedef enum _tag_m70_error_code
 	M70_ERROR_CODE_UNKOWN = 99,		  // Unknown error
 } m70_error_code_e;
 
+// Extended error code definitions
+typedef enum _tag_m70_error_code_ex
+{
+	// Basic error codes
+	M70_ERROR_CODE_EX_OK = 0,                // Operation successful
+	M70_ERROR_CODE_EX_FAILED = 1,            // Operation failed
+	M70_ERROR_CODE_EX_SOCKET_FAILED = 2,     // Network exception
+	M70_ERROR_CODE_EX_UNKNOWN = 99,          // Unknown error
+
+	// Connection related error codes (100-199)
+	M70_ERROR_CODE_EX_CONN_TIMEOUT = 100,     // Connection timeout
+	M70_ERROR_CODE_EX_CONN_REFUSED = 101,     // Connection refused
+	M70_ERROR_CODE_EX_CONN_CLOSED = 102,      // Connection closed
+	M70_ERROR_CODE_EX_CONN_INVALID = 103,     // Invalid connection
+	M70_ERROR_CODE_EX_CONN_HOST_NOT_FOUND = 104, // Host not found
+	M70_ERROR_CODE_EX_CONN_FAILED = 105,     // Connection failed 
+
+	// Data transmission related error codes (200-299)
+	M70_ERROR_CODE_EX_TRANS_TIMEOUT = 200,    // Data transmission timeout
+	M70_ERROR_CODE_EX_TRANS_INCOMPLETE = 201, // Incomplete data transmission
+	M70_ERROR_CODE_EX_TRANS_INVALID_DATA = 202, // Invalid data
+	M70_ERROR_CODE_EX_TRANS_BUFFER_OVERFLOW = 203, // Buffer overflow
+
+	// Protocol related error codes (300-399)
+	M70_ERROR_CODE_EX_PROTO_INVALID_FORMAT = 300, // Invalid protocol format
+	M70_ERROR_CODE_EX_PROTO_VERSION_MISMATCH = 301, // Protocol version mismatch
+	M70_ERROR_CODE_EX_PROTO_INVALID_COMMAND = 302, // Invalid command
+	M70_ERROR_CODE_EX_PROTO_INVALID_RESPONSE = 303, // Invalid response
+
+	// CNC device related error codes (400-499)
+	M70_ERROR_CODE_EX_CNC_NOT_READY = 400,   // CNC device not ready
+	M70_ERROR_CODE_EX_CNC_BUSY = 401,        // CNC device busy
+	M70_ERROR_CODE_EX_CNC_ALARM = 402,       // CNC device alarm
+	M70_ERROR_CODE_EX_CNC_INVALID_PARAM = 403, // Invalid parameter
+	M70_ERROR_CODE_EX_CNC_INVALID_STATE = 404, // Invalid state
+	M70_ERROR_CODE_EX_CNC_ACCESS_DENIED = 405, // Access denied
+
+	// File operation related error codes (500-599)
+	M70_ERROR_CODE_EX_FILE_NOT_FOUND = 500,   // File not found
+	M70_ERROR_CODE_EX_FILE_ACCESS_DENIED = 501, // File access denied
+	M70_ERROR_CODE_EX_FILE_INVALID_FORMAT = 502, // Invalid file format
+	M70_ERROR_CODE_EX_FILE_IO_ERROR = 503,   // File IO error
+
+	// System related error codes (900-999)
+	M70_ERROR_CODE_EX_SYS_OUT_OF_MEMORY = 900, // Out of memory
+	M70_ERROR_CODE_EX_SYS_RESOURCE_LIMIT = 901, // Resource limit
+	M70_ERROR_CODE_EX_SYS_INTERNAL_ERROR = 999  // Internal error
+} m70_error_code_ex_e;
+
+// Error information structure
+typedef struct _tag_m70_error_info
+{
+	m70_error_code_ex_e error_code;     // Error code
+	int system_error_code;              // System error code
+	char message[256];                  // Error message
+	char file[128];                     // File where error occurred
+	int line;                           // Line number where error occurred
+	char function[64];                  // Function where error occurred
+} m70_error_info_t;
+
 typedef enum _tag_m70_NCType
 {
 	EZNC_SYS_MAGICCARD64 = 0,  // MELDASMAGIC Card64
@@ -188,6 +257,50 @@ typedef enum _tag_alarm_message_type
 	M_ALM_OPE_ALARM = 0x10B
 } alarm_message_type_e;
 
+typedef struct m70_recv_buffer
+{
+	byte data[M70_RECV_BUFFER_SIZE];
+	int start; // Offset of the first unread byte
+	int end;   // Offset one past the last buffered byte
+} m70_recv_buffer_t;
+
+// Valid bits of m70_conn_meta_t
+typedef enum _tag_m70_meta_flag
+{
+	M70_META_DATA_COUNT = 0x01,		 // Shifted by the read_data_count parameter (1..5)
+	M70_META_MACHINE_TYPE = 0x40,
+	M70_META_NC_VERSION = 0x80,
+	M70_META_NC_NAME_VERSION = 0x100,
+	M70_META_PLC_VERSION = 0x200,
+	M70_META_TRANS_SIZE = 0x400,
+	M70_META_AXIS_NAMES = 0x10000 // Shifted by system number - 1
+} m70_meta_flag_e;
+
+// Machine metadata that cannot change while a connection is open.
+// Filled lazily by the readers and cleared on every (re)connect.
+typedef struct m70_conn_meta
+{
+	uint32 valid; // m70_meta_flag_e bits of the fields already read
+	uint32 data_count[6]; // Indexed by read_data_count parameter: system, NC axis, all axis, spindle, PLC axis
+	m70_nc_machine_type_e machine_type;
+	char nc_version[M70_META_VERSION_SIZE];
+	char nc_name_version[M70_META_VERSION_SIZE];
+	char plc_version[M70_META_VERSION_SIZE];
+	int trans_size; // TRANS_SIZE, the controller's preferred transfer size
+	int axis_name_count[M70_MAX_SYSTEM_COUNT];
+	char axis_names[M70_MAX_SYSTEM_COUNT][M70_META_TEXT_SIZE];
+} m70_conn_meta_t;
+
+// Override setting-method bits (Y188F / YC67), indexed by M70_OVERRIDE_* and system number - 1
+#define M70_OVERRIDE_SPINDLE 0
+#define M70_OVERRIDE_FEED 1
+typedef struct m70_override_method
+{
+	uint32 ttl_ms;										 // Revalidation interval, 0 = default
+	byte method[2][M70_MAX_SYSTEM_COUNT];				 // Last method bit read
+	uint64 read_tick[2][M70_MAX_SYSTEM_COUNT];			 // get_tick_count_ms of the read, 0 = never read
+} m70_override_method_t;
+
 typedef struct m70_conn
 {
 	int32 socket;
@@ -195,8 +308,50 @@ typedef struct m70_conn
 	m70_nc_type_e nc_type;
 	uint32 request_id;
 	bool little_endian;
+	uint32 pipeline_depth;		   // Maximum requests in flight, 1 = strictly send-then-wait
+	m70_recv_buffer_t recv_buffer; // Buffered GIOP frames, parsed from memory
+	m70_conn_meta_t meta;		   // Static machine metadata cache
+	m70_override_method_t override_method; // Cached override setting methods
+	struct m70_subscription_engine* subscriptions; // m70_subscribe state, freed by m70_cnc_disconnect
+	m70_error_info_t last_error;   // Last error raised for this connection, see m70_error_get_conn_last
+	struct m70_conn_stats* stats;  // m70_stats histograms, freed by m70_cnc_disconnect
+	uint32 fs_chunk_size;		   // Bytes per request of m70_fs transfers, 0 = M70_FS_DEFAULT_CHUNK
 } m70_conn_t;
 
+// One item of m70_cnc_read_batch
+typedef struct _tag_m70_batch_item
+{
+	int section;			   // Main section
+	int sub_section;		   // Sub-section
+	int system_no;			   // System number
+	int axis_flag;			   // Axis bit mask, 0 when not axis related
+	m70_data_type_e data_type; // Requested type in, returned type out
+	void* value;			   // Output slot, large enough for data_type
+	m70_error_code_e result;   // Per-item result
+	int value_size;			   // Size of value, required for T_STR, 0 = unchecked for fixed types
+} m70_batch_item_t;
+
+// Machine state sampled in one pipelined burst by m70_cnc_read_snapshot
+typedef struct _tag_m70_snapshot
+{
+	uint64 timestamp;	   // Milliseconds since 1970-01-01 when the burst completed
+	uint32 sample_time_ms; // Time between the first request and the last reply
+	m70_device_status_e status;
+	m70_run_mode_e mode;
+	m70_run_status_e run_status;
+	char program_no[64];
+	uint32 sequence_no;
+	uint32 tool_no;
+	short spindle_override;
+	short feed_override;
+	double feed_speed; // Automatic effective feed rate (FC)
+	uint32 spindle_speed;
+	int32 spindle_load;
+	int axis_count;
+	double axis_position[M70_MAX_AXIS_COUNT];
+	bool alarm;
+} m70_snapshot_t;
+
 #pragma pack(push)
 #pragma pack(1)
 
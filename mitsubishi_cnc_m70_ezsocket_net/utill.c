@@ -6,6 +6,8 @@
 #include <Windows.h>
 #else
 #include <unistd.h>
+#include <sys/time.h>
+#include <time.h>
 #endif
 
 #define _WS2_32_WINSOCK_SWAP_LONG(l) \
@@ -391,4 +393,44 @@ bool is_little_endian()
 		is_ok = false;
 
 	return is_ok;
-}
\ No newline at end of file
+}
+
+uint64 get_current_time_ms()
+{
+#ifdef _WIN32
+	FILETIME ft;
+	GetSystemTimeAsFileTime(&ft);
+	uint64 t = ((uint64)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+	return (t - 116444736000000000ULL) / 10000; // 100ns since 1601 -> ms since 1970
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#endif
+}
+
+uint64 get_tick_count_ms()
+{
+#ifdef _WIN32
+	return (uint64)GetTickCount64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+uint64 get_tick_count_us()
+{
+#ifdef _WIN32
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (uint64)(counter.QuadPart / frequency.QuadPart) * 1000000 + (uint64)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
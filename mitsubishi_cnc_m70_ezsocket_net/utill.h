@@ -56,5 +56,8 @@ char* itoa(unsigned long long value, char str[], int radix);
 #endif // !_WIN32
 
 bool is_little_endian();
+uint64 get_current_time_ms(); // Wall clock, milliseconds since 1970-01-01
+uint64 get_tick_count_ms();	  // Monotonic clock in milliseconds, for intervals only
+uint64 get_tick_count_us();	  // Monotonic clock in microseconds, for intervals only
 
 #endif
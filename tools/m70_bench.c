@@ -0,0 +1,487 @@
+// End-to-end benchmark of the client library against m70_sim (or a real controller).
+// Usage: m70_bench [-h host] [-p port] [-c concurrency] [-t seconds] [-s scenario,...] [-d pipeline_depth]
+//                  [-n fs_file_size] [-k fs_chunk] [-f fs_dir] [-o result.json]
+// Every worker thread owns one connection and runs the scenario in a loop. Results go out as JSON:
+// calls and GIOP requests per second, socket system calls per request and call latency percentiles.
+// The simulated round trip time is set on the simulator, see "make -C tools bench".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedef.h"
+#include "m70_ezsocket.h"
+#include "m70_giop.h"
+#include "m70_stats.h"
+#include "m70_thread.h"
+#include "socket.h"
+#include "utill.h"
+
+#ifdef _WIN32
+#pragma warning(disable : 4996)
+#endif
+
+#define BENCH_MAX_WORKERS 256
+#define BENCH_BATCH_ITEMS 16
+
+typedef struct _tag_bench_config
+{
+	char host[64];
+	int port;
+	int concurrency;
+	int seconds;
+	int pipeline_depth; // 0 keeps the library default
+	int fs_file_size;
+	int fs_chunk;
+	char fs_dir[128]; // Prefix of the per-worker benchmark files
+} bench_config_t;
+
+typedef struct _tag_bench_worker
+{
+	int index;
+	m70_conn_t conn;
+	m70_thread_t thread;
+	uint32* samples; // Call latencies in microseconds
+	uint32 sample_count;
+	uint32 sample_capacity;
+	uint32 calls;
+	uint32 errors;
+	uint64 bytes; // File payload moved by the FS scenarios
+	char file_name[160];
+	long fd;	 // Open FS handle, 0 when closed
+	long offset; // Bytes read or written through fd
+	byte* buffer;
+} bench_worker_t;
+
+// One call of a scenario, true on success; setup runs once per worker before timing starts
+typedef bool (*bench_fn)(bench_worker_t* worker);
+
+typedef struct _tag_bench_scenario
+{
+	const char* name;
+	bench_fn setup;
+	bench_fn run;
+} bench_scenario_t;
+
+static bench_config_t g_config;
+static volatile int32 g_stop = 0;
+static const bench_scenario_t* g_scenario = NULL;
+
+static bool run_get_data(bench_worker_t* worker)
+{
+	uint32 counter = 0;
+	m70_data_type_e data_type = T_LONG;
+	return melGetData(&worker->conn, 126, 8002, 1, 0, &data_type, &counter) == 0;
+}
+
+static bool run_read_status(bench_worker_t* worker)
+{
+	m70_device_status_e status;
+	m70_run_mode_e mode;
+	m70_run_status_e run_status;
+	return m70_cnc_read_status(&worker->conn, 1, &status, &mode, &run_status) == M70_ERROR_CODE_OK;
+}
+
+static bool run_read_position(bench_worker_t* worker)
+{
+	double positions[M70_MAX_AXIS_COUNT];
+	int count = 0;
+	return m70_cnc_read_all_axis_position(&worker->conn, 1, positions, &count, POS_MCH) == M70_ERROR_CODE_OK;
+}
+
+static bool run_snapshot(bench_worker_t* worker)
+{
+	m70_snapshot_t snapshot;
+	return m70_cnc_read_snapshot(&worker->conn, 1, POS_MCH, &snapshot) == M70_ERROR_CODE_OK;
+}
+
+static bool run_batch(bench_worker_t* worker)
+{
+	m70_batch_item_t items[BENCH_BATCH_ITEMS];
+	uint32 values[BENCH_BATCH_ITEMS];
+	memset(items, 0, sizeof(items));
+	int i = 0;
+	for (i = 0; i < BENCH_BATCH_ITEMS; i++)
+	{
+		items[i].section = 126;
+		items[i].sub_section = 8002;
+		items[i].system_no = 1;
+		items[i].data_type = T_LONG;
+		items[i].value = &values[i];
+		items[i].value_size = sizeof(values[i]);
+	}
+	return m70_cnc_read_batch(&worker->conn, items, BENCH_BATCH_ITEMS) == M70_ERROR_CODE_OK;
+}
+
+static void close_file(bench_worker_t* worker)
+{
+	if (worker->fd != 0)
+		melFsCloseFile(&worker->conn, worker->fd);
+	worker->fd = 0;
+	worker->offset = 0;
+}
+
+// Writes the next chunk, starting the file over once it reached fs_file_size
+static bool run_fs_write(bench_worker_t* worker)
+{
+	if (worker->fd == 0 && melFsCreateFile(&worker->conn, worker->file_name, 0, &worker->fd) != 0)
+	{
+		worker->fd = 0;
+		return false;
+	}
+
+	long chunk = g_config.fs_chunk;
+	if (chunk > g_config.fs_file_size - worker->offset)
+		chunk = g_config.fs_file_size - worker->offset;
+	long written = 0;
+	bool ok = melFsWriteFile(&worker->conn, worker->fd, worker->buffer, chunk, &written) == 0 && written == chunk;
+	worker->offset += written;
+	worker->bytes += (uint64)written;
+	if (!ok || worker->offset >= g_config.fs_file_size)
+		close_file(worker);
+	return ok;
+}
+
+static bool setup_fs_read(bench_worker_t* worker)
+{
+	while (worker->offset < g_config.fs_file_size || worker->fd != 0)
+	{
+		if (!run_fs_write(worker))
+			return false;
+		if (worker->fd == 0)
+			break;
+	}
+	worker->bytes = 0;
+	return true;
+}
+
+// Reads the next chunk, reopening the file at its end
+static bool run_fs_read(bench_worker_t* worker)
+{
+	if (worker->fd == 0 && melFsOpenFile(&worker->conn, worker->file_name, 0, &worker->fd) != 0)
+	{
+		worker->fd = 0;
+		return false;
+	}
+
+	long count = 0;
+	bool ok = melFsReadFile(&worker->conn, worker->fd, worker->buffer, &count, g_config.fs_chunk) == 0;
+	worker->offset += count;
+	worker->bytes += (uint64)count;
+	if (!ok || count < g_config.fs_chunk)
+		close_file(worker);
+	return ok;
+}
+
+static const bench_scenario_t g_scenarios[] = {
+	{"get_data", NULL, run_get_data},			// One melGetData round trip
+	{"read_status", NULL, run_read_status},		// m70_cnc_read_status, up to three sequential reads
+	{"read_position", NULL, run_read_position}, // m70_cnc_read_all_axis_position, one multi-axis read
+	{"snapshot", NULL, run_snapshot},			// m70_cnc_read_snapshot, one pipelined burst
+	{"batch", NULL, run_batch},					// m70_cnc_read_batch of BENCH_BATCH_ITEMS items
+	{"fs_write", NULL, run_fs_write},			// One melFsWriteFile of fs_chunk bytes
+	{"fs_read", setup_fs_read, run_fs_read},	// One melFsReadFile of fs_chunk bytes
+};
+
+static void add_sample(bench_worker_t* worker, uint32 us)
+{
+	if (worker->sample_count == worker->sample_capacity)
+	{
+		uint32 capacity = worker->sample_capacity > 0 ? worker->sample_capacity * 2 : 4096;
+		uint32* samples = (uint32*)realloc(worker->samples, capacity * sizeof(uint32));
+		if (samples == NULL)
+			return;
+		worker->samples = samples;
+		worker->sample_capacity = capacity;
+	}
+	worker->samples[worker->sample_count++] = us;
+}
+
+static void worker_main(void* arg)
+{
+	bench_worker_t* worker = (bench_worker_t*)arg;
+	while (!m70_atomic_load(&g_stop))
+	{
+		uint64 start = get_tick_count_us();
+		bool ok = g_scenario->run(worker);
+		add_sample(worker, (uint32)(get_tick_count_us() - start));
+		worker->calls++;
+		if (!ok)
+		{
+			worker->errors++;
+			if (!check_conn_is_valid(&worker->conn))
+				break;
+		}
+	}
+}
+
+static int compare_u32(const void* a, const void* b)
+{
+	uint32 x = *(const uint32*)a;
+	uint32 y = *(const uint32*)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static uint32 percentile(const uint32* sorted, uint32 count, double p)
+{
+	if (count == 0)
+		return 0;
+	uint32 index = (uint32)(p / 100.0 * count);
+	return sorted[index < count ? index : count - 1];
+}
+
+// Runs one scenario on fresh connections and appends its JSON object to out
+static bool run_scenario(const bench_scenario_t* scenario, FILE* out, bool first)
+{
+	bench_worker_t* workers = (bench_worker_t*)calloc(g_config.concurrency, sizeof(bench_worker_t));
+	if (workers == NULL)
+		return false;
+
+	bool ok = true;
+	int i = 0;
+	for (i = 0; i < g_config.concurrency && ok; i++)
+	{
+		bench_worker_t* worker = &workers[i];
+		worker->index = i;
+		snprintf(worker->file_name, sizeof(worker->file_name), "%sBENCH%03d.DAT", g_config.fs_dir, i);
+		worker->buffer = (byte*)malloc(g_config.fs_chunk);
+		for (int j = 0; worker->buffer != NULL && j < g_config.fs_chunk; j++)
+			worker->buffer[j] = (byte)('A' + (i + j) % 26);
+
+		ok = worker->buffer != NULL && m70_cnc_connect(g_config.host, g_config.port, EZNC_SYS_MELDAS700M, &worker->conn);
+		if (ok && g_config.pipeline_depth > 0)
+			m70_cnc_set_pipeline_depth(&worker->conn, g_config.pipeline_depth);
+		if (ok && scenario->setup != NULL)
+			ok = scenario->setup(worker);
+		if (ok)
+			ok = m70_stats_enable(&worker->conn);
+		if (!ok)
+			fprintf(stderr, "%s: worker %d failed to connect or set up\n", scenario->name, i);
+	}
+
+	uint32 sends = 0, recvs = 0;
+	uint64 elapsed_us = 0;
+	if (ok)
+	{
+		fprintf(stderr, "%s: %d workers for %d s\n", scenario->name, g_config.concurrency, g_config.seconds);
+		g_scenario = scenario;
+		m70_atomic_store(&g_stop, 0);
+		socket_reset_syscall_counts();
+		uint64 start = get_tick_count_us();
+		int started = 0;
+		for (started = 0; started < g_config.concurrency; started++)
+		{
+			if (!m70_thread_create(&workers[started].thread, worker_main, &workers[started]))
+				break;
+		}
+		m70_sleep_ms((uint32)g_config.seconds * 1000);
+		m70_atomic_store(&g_stop, 1);
+		for (i = 0; i < started; i++)
+			m70_thread_join(workers[i].thread);
+		elapsed_us = get_tick_count_us() - start;
+		socket_get_syscall_counts(&sends, &recvs);
+		ok = started == g_config.concurrency;
+	}
+
+	uint64 calls = 0, errors = 0, bytes = 0, requests = 0, total_us = 0;
+	uint32 sample_count = 0;
+	for (i = 0; i < g_config.concurrency; i++)
+	{
+		bench_worker_t* worker = &workers[i];
+		calls += worker->calls;
+		errors += worker->errors;
+		bytes += worker->bytes;
+		sample_count += worker->sample_count;
+		int op = 0;
+		for (op = 0; op < M70_STATS_OP_COUNT; op++)
+		{
+			m70_op_stats_t stats;
+			if (m70_stats_get(&worker->conn, (m70_stats_op_e)op, &stats))
+				requests += stats.count;
+		}
+	}
+
+	uint32* samples = (uint32*)malloc((sample_count > 0 ? sample_count : 1) * sizeof(uint32));
+	uint32 filled = 0;
+	for (i = 0; i < g_config.concurrency && samples != NULL; i++)
+	{
+		memcpy(samples + filled, workers[i].samples, workers[i].sample_count * sizeof(uint32));
+		filled += workers[i].sample_count;
+	}
+	for (i = 0; i < (int)filled; i++)
+		total_us += samples[i];
+	if (samples != NULL)
+		qsort(samples, filled, sizeof(uint32), compare_u32);
+
+	double seconds = elapsed_us > 0 ? elapsed_us / 1000000.0 : 1;
+	fprintf(out, "%s    {\n", first ? "" : ",\n");
+	fprintf(out, "      \"name\": \"%s\",\n", scenario->name);
+	fprintf(out, "      \"ok\": %s,\n", ok ? "true" : "false");
+	fprintf(out, "      \"seconds\": %.3f,\n", seconds);
+	fprintf(out, "      \"calls\": %llu,\n", calls);
+	fprintf(out, "      \"errors\": %llu,\n", errors);
+	fprintf(out, "      \"calls_per_sec\": %.1f,\n", calls / seconds);
+	fprintf(out, "      \"requests\": %llu,\n", requests);
+	fprintf(out, "      \"requests_per_sec\": %.1f,\n", requests / seconds);
+	fprintf(out, "      \"bytes_per_sec\": %.1f,\n", bytes / seconds);
+	fprintf(out, "      \"send_calls\": %u,\n", sends);
+	fprintf(out, "      \"recv_calls\": %u,\n", recvs);
+	fprintf(out, "      \"syscalls_per_call\": %.3f,\n", calls > 0 ? (double)(sends + recvs) / calls : 0);
+	fprintf(out, "      \"syscalls_per_request\": %.3f,\n", requests > 0 ? (double)(sends + recvs) / requests : 0);
+	fprintf(out, "      \"latency_us\": {\"avg\": %.1f, \"min\": %u, \"p50\": %u, \"p90\": %u, \"p99\": %u, \"p999\": %u, \"max\": %u}\n",
+			filled > 0 ? (double)total_us / filled : 0, filled > 0 ? samples[0] : 0, percentile(samples, filled, 50),
+			percentile(samples, filled, 90), percentile(samples, filled, 99), percentile(samples, filled, 99.9),
+			filled > 0 ? samples[filled - 1] : 0);
+	fprintf(out, "    }");
+	free(samples);
+
+	for (i = 0; i < g_config.concurrency; i++)
+	{
+		bench_worker_t* worker = &workers[i];
+		if (check_conn_is_valid(&worker->conn))
+		{
+			close_file(worker);
+			melRemoveFile(&worker->conn, worker->file_name);
+		}
+		if (worker->conn.socket > 0 || worker->conn.stats != NULL)
+			m70_cnc_disconnect(&worker->conn);
+		free(worker->samples);
+		free(worker->buffer);
+	}
+	free(workers);
+	return ok;
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr,
+			"Usage: %s [-h host] [-p port] [-c concurrency] [-t seconds] [-s scenario,...] [-d pipeline_depth]\n"
+			"          [-n fs_file_size] [-k fs_chunk] [-f fs_dir] [-o result.json]\n"
+			"Scenarios:",
+			name);
+	size_t i = 0;
+	for (i = 0; i < sizeof(g_scenarios) / sizeof(g_scenarios[0]); i++)
+		fprintf(stderr, " %s", g_scenarios[i].name);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char** argv)
+{
+	memset(&g_config, 0, sizeof(g_config));
+	strcpy(g_config.host, "127.0.0.1");
+	strcpy(g_config.fs_dir, "M01:\\");
+	g_config.port = 683;
+	g_config.concurrency = 1;
+	g_config.seconds = 5;
+	g_config.fs_file_size = 256 * 1024;
+	g_config.fs_chunk = 512;
+	const char* scenarios = "get_data,read_status,read_position,snapshot,batch,fs_write,fs_read";
+	const char* output = NULL;
+
+	int i = 0;
+	for (i = 1; i + 1 < argc; i += 2)
+	{
+		const char* value = argv[i + 1];
+		if (argv[i][0] != '-' || strlen(argv[i]) != 2)
+			break;
+		switch (argv[i][1])
+		{
+		case 'h':
+			strncpy(g_config.host, value, sizeof(g_config.host) - 1);
+			break;
+		case 'p':
+			g_config.port = atoi(value);
+			break;
+		case 'c':
+			g_config.concurrency = atoi(value);
+			break;
+		case 't':
+			g_config.seconds = atoi(value);
+			break;
+		case 's':
+			scenarios = value;
+			break;
+		case 'd':
+			g_config.pipeline_depth = atoi(value);
+			break;
+		case 'n':
+			g_config.fs_file_size = atoi(value);
+			break;
+		case 'k':
+			g_config.fs_chunk = atoi(value);
+			break;
+		case 'f':
+			strncpy(g_config.fs_dir, value, sizeof(g_config.fs_dir) - 1);
+			break;
+		case 'o':
+			output = value;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (i < argc || g_config.concurrency < 1 || g_config.concurrency > BENCH_MAX_WORKERS || g_config.seconds < 1 ||
+		g_config.fs_chunk < 1 || g_config.fs_file_size < 1)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		return 1;
+#endif
+
+	FILE* out = output != NULL ? fopen(output, "w") : stdout;
+	if (out == NULL)
+	{
+		fprintf(stderr, "Cannot write %s\n", output);
+		return 1;
+	}
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"host\": \"%s\",\n", g_config.host);
+	fprintf(out, "  \"port\": %d,\n", g_config.port);
+	fprintf(out, "  \"concurrency\": %d,\n", g_config.concurrency);
+	fprintf(out, "  \"seconds\": %d,\n", g_config.seconds);
+	fprintf(out, "  \"pipeline_depth\": %d,\n", g_config.pipeline_depth > 0 ? g_config.pipeline_depth : M70_DEFAULT_PIPELINE_DEPTH);
+	fprintf(out, "  \"fs_file_size\": %d,\n", g_config.fs_file_size);
+	fprintf(out, "  \"fs_chunk\": %d,\n", g_config.fs_chunk);
+	fprintf(out, "  \"scenarios\": [\n");
+
+	int failed = 0;
+	int ran = 0;
+	char list[256];
+	strncpy(list, scenarios, sizeof(list) - 1);
+	list[sizeof(list) - 1] = '\0';
+	char* name = NULL;
+	for (name = strtok(list, ","); name != NULL; name = strtok(NULL, ","))
+	{
+		const bench_scenario_t* scenario = NULL;
+		size_t s = 0;
+		for (s = 0; s < sizeof(g_scenarios) / sizeof(g_scenarios[0]); s++)
+		{
+			if (strcmp(g_scenarios[s].name, name) == 0)
+				scenario = &g_scenarios[s];
+		}
+		if (scenario == NULL)
+		{
+			fprintf(stderr, "Unknown scenario %s\n", name);
+			failed++;
+			continue;
+		}
+		if (!run_scenario(scenario, out, ran == 0))
+			failed++;
+		ran++;
+	}
+
+	fprintf(out, "\n  ]\n}\n");
+	if (out != stdout)
+		fclose(out);
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	return failed > 0 ? 1 : 0;
+}
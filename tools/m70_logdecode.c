@@ -0,0 +1,195 @@
+// Renders binary log files written with binary_mode as text lines.
+// Usage: m70_logdecode file...   Pass rotated files oldest first, e.g. m70.log.2 m70.log.1 m70.log
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "typedef.h"
+#include "m70_log.h"
+
+typedef struct _tag_decode_site
+{
+	char* file;
+	uint32 line;
+	char* format;
+} decode_site_t;
+
+static decode_site_t* g_sites = NULL;
+static uint32 g_site_capacity = 0;
+
+static const char* g_level_names[] = {"DEBUG", "INFO", "WARNING", "ERROR", "FATAL"};
+
+static uint64 get_le(const byte* p, int bytes)
+{
+	uint64 v = 0;
+	while (bytes-- > 0)
+		v = (v << 8) | p[bytes];
+	return v;
+}
+
+static char* copy_text(const byte* p, int length)
+{
+	char* text = (char*)malloc(length + 1);
+	if (text != NULL)
+	{
+		memcpy(text, p, length);
+		text[length] = '\0';
+	}
+	return text;
+}
+
+static void clear_sites()
+{
+	uint32 i = 0;
+	for (i = 0; i < g_site_capacity; i++)
+	{
+		free(g_sites[i].file);
+		free(g_sites[i].format);
+	}
+	memset(g_sites, 0, sizeof(decode_site_t) * g_site_capacity);
+}
+
+static bool add_site(const byte* payload, int length)
+{
+	if (length < 12)
+		return false;
+
+	uint32 id = (uint32)get_le(payload, 4);
+	uint32 line = (uint32)get_le(payload + 4, 4);
+	int file_length = (int)get_le(payload + 8, 2);
+	if (10 + file_length + 2 > length)
+		return false;
+	int format_length = (int)get_le(payload + 10 + file_length, 2);
+	if (12 + file_length + format_length > length)
+		return false;
+
+	if (id >= g_site_capacity)
+	{
+		uint32 capacity = g_site_capacity == 0 ? 1024 : g_site_capacity;
+		while (capacity <= id)
+			capacity *= 2;
+		decode_site_t* sites = (decode_site_t*)realloc(g_sites, sizeof(decode_site_t) * capacity);
+		if (sites == NULL)
+			return false;
+		memset(sites + g_site_capacity, 0, sizeof(decode_site_t) * (capacity - g_site_capacity));
+		g_sites = sites;
+		g_site_capacity = capacity;
+	}
+
+	decode_site_t* site = &g_sites[id];
+	free(site->file);
+	free(site->format);
+	site->file = copy_text(payload + 10, file_length);
+	site->line = line;
+	site->format = copy_text(payload + 12 + file_length, format_length);
+	return true;
+}
+
+static void print_message(const byte* payload, int length)
+{
+	if (length < 13)
+		return;
+
+	uint32 id = (uint32)get_le(payload, 4);
+	uint64 time_ms = get_le(payload + 4, 8);
+	byte level = payload[12];
+	decode_site_t* site = id < g_site_capacity ? &g_sites[id] : NULL;
+
+	char time_text[32] = {0};
+	time_t seconds = (time_t)(time_ms / 1000);
+	struct tm tm_info;
+#ifdef _WIN32
+	localtime_s(&tm_info, &seconds);
+#else
+	localtime_r(&seconds, &tm_info);
+#endif
+	strftime(time_text, sizeof(time_text), "%Y-%m-%d %H:%M:%S", &tm_info);
+
+	if (site == NULL || site->format == NULL)
+	{
+		printf("[%s.%03u] [%s] <unknown format %u>\n", time_text, (uint32)(time_ms % 1000), level < 5 ? g_level_names[level] : "?", id);
+		return;
+	}
+
+	char message[4096];
+	m70_log_format_binary(site->format, payload + 13, length - 13, message, sizeof(message));
+	if (site->file[0] != '\0')
+		printf("[%s.%03u] [%s] [%s:%u] %s\n", time_text, (uint32)(time_ms % 1000), level < 5 ? g_level_names[level] : "?", site->file, site->line, message);
+	else
+		printf("[%s.%03u] [%s] %s\n", time_text, (uint32)(time_ms % 1000), level < 5 ? g_level_names[level] : "?", message);
+}
+
+static int decode_file(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Failed to open %s\n", path);
+		return -1;
+	}
+
+	static byte payload[65536];
+	byte head[3];
+	int records = 0;
+	while (fread(head, 1, sizeof(head), file) == sizeof(head))
+	{
+		int length = (int)get_le(head + 1, 2);
+		if (fread(payload, 1, length, file) != (size_t)length)
+		{
+			fprintf(stderr, "%s: truncated record after %d records\n", path, records);
+			break;
+		}
+
+		switch (head[0])
+		{
+		case M70_LOG_RECORD_HEADER:
+			if (length != (int)strlen(M70_LOG_BINARY_MAGIC) || memcmp(payload, M70_LOG_BINARY_MAGIC, length) != 0)
+			{
+				fprintf(stderr, "%s: not a binary log file\n", path);
+				fclose(file);
+				return -1;
+			}
+			clear_sites();
+			break;
+
+		case M70_LOG_RECORD_FORMAT:
+			if (!add_site(payload, length))
+				fprintf(stderr, "%s: bad format record %d\n", path, records);
+			break;
+
+		case M70_LOG_RECORD_MESSAGE:
+			print_message(payload, length);
+			break;
+
+		default:
+			fprintf(stderr, "%s: unknown record type %d\n", path, head[0]);
+			break;
+		}
+		records++;
+	}
+
+	fclose(file);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s file...\n", argv[0]);
+		return 1;
+	}
+
+	int ret = 0;
+	int i = 0;
+	for (i = 1; i < argc; i++)
+	{
+		if (decode_file(argv[i]) != 0)
+			ret = 1;
+	}
+
+	clear_sites();
+	free(g_sites);
+	return ret;
+}
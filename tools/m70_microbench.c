@@ -0,0 +1,425 @@
+// CPU cost of request encoding and reply decoding, without a controller.
+// Usage: m70_microbench [-t ms_per_case] [-s case,...] [-o result.json]
+// Packets are built into memory and replies are parsed from the connection receive buffer;
+// the "_socket" cases push the same replies through a local socket pair first.
+// Results go out as JSON: iterations, nanoseconds and operations per second for every case.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedef.h"
+#include "m70_giop.h"
+#include "socket.h"
+#include "utill.h"
+
+#ifdef _WIN32
+#pragma warning(disable : 4996)
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#endif
+
+#define MICRO_BATCH 1024	   // Iterations between two clock reads
+#define MICRO_FRAMES 128	   // Replies parsed per refill of the receive buffer
+#define MICRO_FRAME_MAX 64	   // Largest encoded reply
+#define MICRO_PAIR_PORT 16900 // First port tried for the loopback pair on Windows
+
+typedef struct _tag_micro_context
+{
+	m70_conn_t conn; // Encodes requests and parses replies, its socket is one end of a local pair
+	int peer;		 // Other end of the pair
+	byte frames[MICRO_FRAMES * MICRO_FRAME_MAX];
+	int frame_length;
+	int frames_length; // MICRO_FRAMES replies back to back
+} micro_context_t;
+
+typedef void (*micro_fn)(micro_context_t* ctx, uint32 iterations);
+
+typedef struct _tag_micro_case
+{
+	const char* name;
+	micro_fn run;
+} micro_case_t;
+
+static volatile uint32 g_sink; // Keeps results alive so loops are not optimised away
+
+static void run_build_giop_header(micro_context_t* ctx, uint32 iterations)
+{
+	giop_header giop;
+	uint32 i = 0;
+	for (i = 0; i < iterations; i++)
+	{
+		build_giop_header(&ctx->conn, &giop);
+		g_sink += giop.msg_type;
+	}
+}
+
+static void run_build_request_pack_header(micro_context_t* ctx, uint32 iterations)
+{
+	request_pack_header request;
+	uint32 i = 0;
+	for (i = 0; i < iterations; i++)
+	{
+		build_request_pack_header(&ctx->conn, &request, 0x0D);
+		g_sink += request.request_id;
+	}
+}
+
+static void run_build_get_data_pack(micro_context_t* ctx, uint32 iterations)
+{
+	get_data_pack pack;
+	uint32 i = 0;
+	for (i = 0; i < iterations; i++)
+		g_sink += build_get_data_pack(&ctx->conn, &pack, 126, 8002, 1, (int)(i & 0x0F), T_LONG);
+}
+
+static void run_build_set_data_pack(micro_context_t* ctx, uint32 iterations)
+{
+	set_data_pack pack;
+	double value = 12.5;
+	uint32 i = 0;
+	for (i = 0; i < iterations; i++)
+		g_sink += build_set_data_pack(&ctx->conn, &pack, 122, 50, 1, 0, T_DOUBLE, &value);
+}
+
+static void run_build_set_data_pack_str(micro_context_t* ctx, uint32 iterations)
+{
+	set_data_pack pack;
+	T_string text;
+	memset(&text, 0, sizeof(text));
+	strcpy(text.text, "MICROBENCH COMMON VARIABLE COMMENT");
+	text.msg_length = (int)strlen(text.text);
+	uint32 i = 0;
+	for (i = 0; i < iterations; i++)
+		g_sink += build_set_data_pack(&ctx->conn, &pack, 122, 50, 1, 0, T_STR, &text);
+}
+
+static void run_get_data_type_length(micro_context_t* ctx, uint32 iterations)
+{
+	static const int types[] = {T_CHAR, T_SHORT, T_LONG, T_DLONG, T_DOUBLE, T_FLOATBIN, T_STR, 0x100};
+	uint32 i = 0;
+	(void)ctx;
+	for (i = 0; i < iterations; i++)
+		g_sink += get_data_type_length(types[i & 7]);
+}
+
+static void run_is_mutiple_axis(micro_context_t* ctx, uint32 iterations)
+{
+	static const int flags[] = {0x0, 0x1, 0x4, 0x3, 0x80, 0xFF, 0x40000000, 0x80000001};
+	uint32 i = 0;
+	(void)ctx;
+	for (i = 0; i < iterations; i++)
+		g_sink += is_mutiple_axis(flags[i & 7]);
+}
+
+static void run_int32_bytes(micro_context_t* ctx, uint32 iterations)
+{
+	byte bytes[4];
+	uint32 i = 0;
+	(void)ctx;
+	for (i = 0; i < iterations; i++)
+	{
+		int32_to_bytes((int32)i, bytes);
+		g_sink += (uint32)bytes_to_int32(bytes);
+	}
+}
+
+static void run_double_bytes(micro_context_t* ctx, uint32 iterations)
+{
+	byte bytes[8];
+	uint32 i = 0;
+	(void)ctx;
+	for (i = 0; i < iterations; i++)
+	{
+		double_to_bytes((double)i * 0.5, bytes);
+		g_sink += (uint32)bytes_to_double(bytes);
+	}
+}
+
+static void run_htond(micro_context_t* ctx, uint32 iterations)
+{
+	uint32 i = 0;
+	(void)ctx;
+	for (i = 0; i < iterations; i++)
+		g_sink += (uint32)ntohd_(htond_((double)i * 0.5));
+}
+
+static void run_htonf(micro_context_t* ctx, uint32 iterations)
+{
+	uint32 i = 0;
+	(void)ctx;
+	for (i = 0; i < iterations; i++)
+		g_sink += (uint32)ntohf_(htonf_((float)i * 0.5f));
+}
+
+static void run_htonll(micro_context_t* ctx, uint32 iterations)
+{
+	uint32 i = 0;
+	(void)ctx;
+	for (i = 0; i < iterations; i++)
+		g_sink += (uint32)ntohll_(htonll_((uint64)i << 20));
+}
+
+// One melGetData reply carrying a T_LONG, or an error reply when is_error is set
+static int encode_reply(byte* out, uint32 request_id, bool is_error)
+{
+	static const char exception[] = "IDL:M70Micro/Error:1.0";
+	int length = sizeof(giop_header) + sizeof(response_pack_header);
+	response_pack_header response = {0, request_id, is_error ? 1 : 0};
+	memcpy(out + sizeof(giop_header), &response, sizeof(response));
+	if (is_error)
+	{
+		uint32 exception_length = sizeof(exception);
+		mel_error_code error;
+		memset(&error, 0, sizeof(error));
+		error.error_code = 0x80000001;
+		memcpy(out + length, &exception_length, 4);
+		memcpy(out + length + 4, exception, sizeof(exception));
+		length += 4 + sizeof(exception);
+		memcpy(out + length, &error, sizeof(error));
+		length += sizeof(error);
+	}
+	else
+	{
+		get_data_response_header header = {0, T_LONG, 4};
+		uint32 value = 1234;
+		memcpy(out + length, &header, sizeof(header));
+		memcpy(out + length + sizeof(header), &value, sizeof(value));
+		length += sizeof(header) + sizeof(value);
+	}
+
+	giop_header giop;
+	memcpy(giop.magic_number, "GIOP", 4);
+	giop.version = 1;
+	giop.byte_order = 1;
+	giop.msg_type = MSG_TYPES_Reply;
+	giop.data_length = length - sizeof(giop_header);
+	memcpy(out, &giop, sizeof(giop));
+	return length;
+}
+
+static void prepare_frames(micro_context_t* ctx, bool is_error)
+{
+	int i = 0;
+	ctx->frames_length = 0;
+	for (i = 0; i < MICRO_FRAMES; i++)
+	{
+		ctx->frame_length = encode_reply(ctx->frames + ctx->frames_length, (uint32)i, is_error);
+		ctx->frames_length += ctx->frame_length;
+	}
+}
+
+// Parses one reply the way melGetData does
+static void parse_reply(micro_context_t* ctx)
+{
+	giop_header giop;
+	int msg_length = 0;
+	uint32 value = 0;
+	m70_data_type_e data_type = T_LONG;
+	long code = mel_receive_response(&ctx->conn, &giop, &msg_length);
+	if (code == 0)
+		msg_length -= receive_get_data_response(&ctx->conn, msg_length, &data_type, 0, &value, sizeof(value));
+	receive_remain_info_response(&ctx->conn, &msg_length);
+	g_sink += (uint32)code + value;
+}
+
+static void parse_from_memory(micro_context_t* ctx, uint32 iterations, bool is_error)
+{
+	prepare_frames(ctx, is_error);
+	uint32 done = 0;
+	while (done < iterations)
+	{
+		memcpy(ctx->conn.recv_buffer.data, ctx->frames, ctx->frames_length);
+		ctx->conn.recv_buffer.start = 0;
+		ctx->conn.recv_buffer.end = ctx->frames_length;
+		uint32 i = 0;
+		for (i = 0; i < MICRO_FRAMES && done < iterations; i++, done++)
+			parse_reply(ctx);
+	}
+	ctx->conn.recv_buffer.start = 0;
+	ctx->conn.recv_buffer.end = 0;
+}
+
+static void run_parse_get_data_reply(micro_context_t* ctx, uint32 iterations)
+{
+	parse_from_memory(ctx, iterations, false);
+}
+
+static void run_parse_error_reply(micro_context_t* ctx, uint32 iterations)
+{
+	parse_from_memory(ctx, iterations, true);
+}
+
+// Every batch of replies is written by the peer in one call and read back through the socket
+static void run_parse_get_data_reply_socket(micro_context_t* ctx, uint32 iterations)
+{
+	prepare_frames(ctx, false);
+	uint32 done = 0;
+	while (done < iterations && ctx->conn.connected)
+	{
+		uint32 count = iterations - done < MICRO_FRAMES ? iterations - done : MICRO_FRAMES;
+		if (socket_send_data(ctx->peer, ctx->frames, (int)count * ctx->frame_length) < 0)
+			break;
+		uint32 i = 0;
+		for (i = 0; i < count; i++)
+			parse_reply(ctx);
+		done += count;
+	}
+}
+
+static const micro_case_t g_cases[] = {
+	{"build_giop_header", run_build_giop_header},
+	{"build_request_pack_header", run_build_request_pack_header},
+	{"build_get_data_pack", run_build_get_data_pack},
+	{"build_set_data_pack", run_build_set_data_pack},
+	{"build_set_data_pack_str", run_build_set_data_pack_str},
+	{"get_data_type_length", run_get_data_type_length},
+	{"is_mutiple_axis", run_is_mutiple_axis},
+	{"int32_bytes", run_int32_bytes},
+	{"double_bytes", run_double_bytes},
+	{"htond_ntohd", run_htond},
+	{"htonf_ntohf", run_htonf},
+	{"htonll_ntohll", run_htonll},
+	{"parse_get_data_reply", run_parse_get_data_reply},
+	{"parse_error_reply", run_parse_error_reply},
+	{"parse_get_data_reply_socket", run_parse_get_data_reply_socket},
+};
+
+// Two connected stream sockets; a loopback TCP connection where socketpair is missing
+static bool open_pair(int* a, int* b)
+{
+#ifdef _WIN32
+	int port = 0;
+	for (port = MICRO_PAIR_PORT; port < MICRO_PAIR_PORT + 100; port++)
+	{
+		int listen_fd = socket_open_tcp_server_socket("127.0.0.1", (short)port, 1);
+		if (listen_fd <= 0)
+			continue;
+		*a = socket_open_tcp_client_socket("127.0.0.1", (short)port);
+		*b = *a > 0 ? socket_accept_tcp_client(listen_fd) : -1;
+		socket_close_tcp_socket(listen_fd);
+		return *a > 0 && *b > 0;
+	}
+	return false;
+#else
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		return false;
+	*a = fds[0];
+	*b = fds[1];
+	return true;
+#endif
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [-t ms_per_case] [-s case,...] [-o result.json]\nCases:", name);
+	size_t i = 0;
+	for (i = 0; i < sizeof(g_cases) / sizeof(g_cases[0]); i++)
+		fprintf(stderr, " %s", g_cases[i].name);
+	fprintf(stderr, "\n");
+}
+
+static bool selected(const char* list, const char* name)
+{
+	if (list == NULL)
+		return true;
+	size_t length = strlen(name);
+	const char* p = list;
+	while ((p = strstr(p, name)) != NULL)
+	{
+		if ((p == list || p[-1] == ',') && (p[length] == ',' || p[length] == '\0'))
+			return true;
+		p += length;
+	}
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	int ms_per_case = 200;
+	const char* cases = NULL;
+	const char* output = NULL;
+
+	int i = 0;
+	for (i = 1; i + 1 < argc; i += 2)
+	{
+		if (argv[i][0] != '-' || strlen(argv[i]) != 2)
+			break;
+		if (argv[i][1] == 't')
+			ms_per_case = atoi(argv[i + 1]);
+		else if (argv[i][1] == 's')
+			cases = argv[i + 1];
+		else if (argv[i][1] == 'o')
+			output = argv[i + 1];
+		else
+			break;
+	}
+	if (i < argc || ms_per_case < 1)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		return 1;
+#endif
+
+	micro_context_t* ctx = (micro_context_t*)calloc(1, sizeof(micro_context_t));
+	int socket = -1;
+	if (ctx == NULL || !open_pair(&socket, &ctx->peer))
+	{
+		fprintf(stderr, "Cannot open a local socket pair\n");
+		return 1;
+	}
+	giop_init_conn(&ctx->conn, EZNC_SYS_MELDAS700M);
+	ctx->conn.socket = socket;
+	ctx->conn.connected = true;
+
+	FILE* out = output != NULL ? fopen(output, "w") : stdout;
+	if (out == NULL)
+	{
+		fprintf(stderr, "Cannot write %s\n", output);
+		return 1;
+	}
+
+	fprintf(out, "{\n  \"ms_per_case\": %d,\n  \"cases\": [\n", ms_per_case);
+	bool first = true;
+	size_t c = 0;
+	for (c = 0; c < sizeof(g_cases) / sizeof(g_cases[0]); c++)
+	{
+		if (!selected(cases, g_cases[c].name))
+			continue;
+
+		g_cases[c].run(ctx, MICRO_BATCH); // Warm up caches and branch predictors
+		uint64 iterations = 0;
+		uint64 budget = (uint64)ms_per_case * 1000;
+		uint64 start = get_tick_count_us();
+		uint64 elapsed = 0;
+		while (elapsed < budget)
+		{
+			g_cases[c].run(ctx, MICRO_BATCH);
+			iterations += MICRO_BATCH;
+			elapsed = get_tick_count_us() - start;
+		}
+
+		double ns = elapsed * 1000.0 / iterations;
+		fprintf(out, "%s    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f}",
+				first ? "" : ",\n", g_cases[c].name, iterations, ns, ns > 0 ? 1e9 / ns : 0);
+		first = false;
+	}
+	fprintf(out, "\n  ]\n}\n");
+	if (out != stdout)
+		fclose(out);
+
+	socket_close_tcp_socket(ctx->peer);
+	giop_disconnect(&ctx->conn);
+	free(ctx);
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	return 0;
+}
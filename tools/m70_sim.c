@@ -0,0 +1,1418 @@
+// Local CNC simulator answering the GIOP requests of m70_giop.c from an in-memory device model.
+// Usage: m70_sim [-p port] [-b address] [-c config] [-r fs_root] [-l latency_ms] [-j jitter_ms]
+//                [-e error_rate] [-E error_code] [-d drop_rate] [-v]
+// Every client is served by its own thread; m70_sim.conf describes the config file syntax.
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "typedef.h"
+#include "m70_ezsocket_private.h"
+#include "m70_thread.h"
+#include "socket.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <io.h>
+#pragma warning(disable : 4996)
+#else
+#include <dirent.h>
+#include <sys/select.h>
+#endif
+
+#define M70_SIM_DEFAULT_PORT 683
+#define M70_SIM_MAX_FRAME (1 << 20)		  // Largest request accepted, a bigger one closes the connection
+#define M70_SIM_MAX_HANDLES 64			  // Open files and directories per client
+#define M70_SIM_MAX_ARRIVALS 64			  // Receives remembered per client to date buffered requests
+#define M70_SIM_MAX_TEXTS 16			  // Configured alarm and program block lines
+#define M70_SIM_DEFAULT_FS_CHUNK 65536	  // Most bytes returned by one mochaFSReadFile
+#define M70_SIM_ATTR_DIRECTORY 0x10		  // file_FS_stat.mode of a directory
+#define M70_SIM_EXCEPTION "IDL:M70Sim/Error:1.0" // Exception id carried by error replies
+
+// Error codes of the simulator itself, a real controller reports its own values
+#define M70_SIM_ERROR_INJECTED 0x80000001  // Default code of injected errors
+#define M70_SIM_ERROR_ARGUMENT 0x80000002  // Malformed request arguments
+#define M70_SIM_ERROR_OPERATION 0x80000003 // Unknown operation name
+#define M70_SIM_ERROR_FILE 0x80000004	   // File system call failed
+#define M70_SIM_ERROR_HANDLE 0x80000005	   // Unknown handle or no handle left
+
+typedef struct _tag_sim_item
+{
+	uint32 section;
+	uint32 sub_section;
+	uint32 system_no;
+	uint32 axis_flag;
+	double value;
+	double step; // Added after every read, so counters and positions move
+	char* text;	 // String value, NULL for numbers
+} sim_item_t;
+
+typedef struct _tag_sim_text
+{
+	uint32 system_no;
+	int32 number; // Alarm number, unused for program blocks
+	char text[256];
+} sim_text_t;
+
+typedef struct _tag_sim_config
+{
+	char bind_ip[64];
+	int port;
+	char fs_root[260];
+	uint32 fs_chunk;
+	uint32 latency_ms; // Least time between a request arriving and its reply, like a round trip
+	uint32 jitter_ms;  // Uniform random extra delay, 0..jitter_ms
+	double error_rate; // Share of requests answered with error_code instead of being executed
+	uint32 error_code;
+	double drop_rate; // Share of requests that close the connection without a reply
+	bool verbose;
+} sim_config_t;
+
+typedef struct _tag_sim_dir
+{
+	char path[520];
+#ifdef _WIN32
+	intptr_t find;
+	struct _finddata_t data;
+	bool pending; // data holds an entry not returned yet
+#else
+	DIR* dir;
+#endif
+} sim_dir_t;
+
+typedef struct _tag_sim_handle
+{
+	FILE* file;
+	sim_dir_t* dir;
+} sim_handle_t;
+
+typedef struct _tag_sim_request
+{
+	uint32 request_id;
+	char op[64];
+	const byte* args; // Arguments after the principal
+	int args_length;
+} sim_request_t;
+
+typedef struct _tag_sim_client
+{
+	int socket;
+	int id;
+	byte* in;
+	int in_start;
+	int in_end;
+	int in_capacity;
+	byte* out;
+	int out_length;
+	int out_capacity;
+	sim_handle_t handles[M70_SIM_MAX_HANDLES];
+	uint32 random;
+	int arrival_end[M70_SIM_MAX_ARRIVALS]; // in_end after each receive, oldest first
+	uint64 arrival_us[M70_SIM_MAX_ARRIVALS]; // get_tick_count_us of those receives
+	int arrival_count;
+	uint32 requests;
+	uint32 injected;
+} sim_client_t;
+
+typedef uint32 (*sim_handler)(sim_client_t* client, const sim_request_t* request);
+
+static sim_config_t g_config;
+static m70_mutex_t g_model_lock; // Items change on reads with a step and on mochaSetData
+static sim_item_t* g_items = NULL;
+static int g_item_count = 0;
+static int g_item_capacity = 0;
+static sim_text_t g_alarms[M70_SIM_MAX_TEXTS];
+static int g_alarm_count = 0;
+static sim_text_t g_blocks[M70_SIM_MAX_TEXTS];
+static int g_block_count = 0;
+static volatile int32 g_client_count = 0;
+
+// Loaded before the config file, so every m70_cnc_read_* call has a plausible answer
+static const char* g_default_model[] = {
+	"data 2 1 0 0 1", // System count
+	"data 2 2 0 0 3", // NC axis count
+	"data 2 3 0 0 4", // All axis count
+	"data 2 4 0 0 1", // Spindle count
+	"data 2 5 0 0 0", // PLC axis count
+	"data 2 100 0 0 0", // Machine type, 0 = machining center
+	"text 67 1 0 0 BND-1040W000-A0", // NC version
+	"text 68 1 0 0 M70V", // NC name version
+	"text 67 2 0 0 PLC-SIM", // PLC version
+	"data 35 11 1 0 0", // Running mode MEM
+	"data 35 20 1 0 1", // Automatic operation running
+	"data 35 10 1 0 3", // Run status AUT
+	"data 126 8002 1 0 0 1", // Parts counter
+	"text 45 100 1 0 M01:/PRG/USER/O100", // Main program path
+	"text 45 101 1 0 O100", // Main program number
+	"data 45 102 1 0 10 10", // Sequence number
+	"data 45 103 1 0 1 1", // Block number
+	"text 127 1 1 1 X", // Axis names
+	"text 127 1 1 2 Y",
+	"text 127 1 1 4 Z",
+	"data 37 1 1 1 10.000 0.001", // Workpiece positions
+	"data 37 1 1 2 20.000 0.002",
+	"data 37 1 1 4 -5.000 -0.001",
+	"data 37 2 1 1 110.000 0.001", // Machine positions
+	"data 37 2 1 2 220.000 0.002",
+	"data 37 2 1 4 -50.000 -0.001",
+	"data 34 1 1 1 1200", // Spindle speed
+	"data 63 4 1 1 35", // Spindle load
+	"data 33 1 1 0 1500.0", // Automatic effective feed rate
+	"data 55 100536 1 0 7", // Tool number (R536)
+	"data 40 1 0 0 360000 1", // Power on time
+	"data 40 2 0 0 120000 1", // Auto operation time
+	"data 40 3 0 0 90000 1", // Auto start-up time
+	"data 40 8 0 0 30000 1", // Cutting time
+	"data 25 10 1 0 8192", // Transfer size (TRANS_SIZE)
+	"alarm 1 0", // No alarm
+	"block 1 N10 G01 X10. Y20. F1500",
+	NULL};
+
+static uint32 get_u32(const byte* p)
+{
+	uint32 v = 0;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// xorshift32, one generator per client thread
+static double sim_random(sim_client_t* client)
+{
+	uint32 x = client->random;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	client->random = x;
+	return (double)x / 4294967296.0;
+}
+
+static sim_item_t* find_item(uint32 section, uint32 sub_section, uint32 system_no, uint32 axis_flag)
+{
+	int i = 0;
+	for (i = 0; i < g_item_count; i++)
+	{
+		sim_item_t* item = &g_items[i];
+		if (item->section == section && item->sub_section == sub_section && item->system_no == system_no && item->axis_flag == axis_flag)
+			return item;
+	}
+	return NULL;
+}
+
+// Existing item with the address, or a new zero item; called with g_model_lock held
+static sim_item_t* add_item(uint32 section, uint32 sub_section, uint32 system_no, uint32 axis_flag)
+{
+	sim_item_t* item = find_item(section, sub_section, system_no, axis_flag);
+	if (item != NULL)
+		return item;
+
+	if (g_item_count == g_item_capacity)
+	{
+		int capacity = g_item_capacity > 0 ? g_item_capacity * 2 : 64;
+		sim_item_t* items = (sim_item_t*)realloc(g_items, capacity * sizeof(sim_item_t));
+		if (items == NULL)
+			return NULL;
+		g_items = items;
+		g_item_capacity = capacity;
+	}
+
+	item = &g_items[g_item_count++];
+	memset(item, 0, sizeof(*item));
+	item->section = section;
+	item->sub_section = sub_section;
+	item->system_no = system_no;
+	item->axis_flag = axis_flag;
+	return item;
+}
+
+static void set_item_text(sim_item_t* item, const char* text, int length)
+{
+	free(item->text);
+	item->text = (char*)malloc(length + 1);
+	if (item->text != NULL)
+	{
+		memcpy(item->text, text, length);
+		item->text[length] = '\0';
+	}
+	item->value = atof(item->text != NULL ? item->text : "0");
+}
+
+static sim_text_t* set_text_line(sim_text_t* lines, int* count, uint32 system_no)
+{
+	int i = 0;
+	for (i = 0; i < *count; i++)
+	{
+		if (lines[i].system_no == system_no)
+			return &lines[i];
+	}
+	if (*count == M70_SIM_MAX_TEXTS)
+		return NULL;
+
+	memset(&lines[*count], 0, sizeof(sim_text_t));
+	lines[*count].system_no = system_no;
+	return &lines[(*count)++];
+}
+
+static const sim_text_t* get_text_line(const sim_text_t* lines, int count, uint32 system_no)
+{
+	int i = 0;
+	for (i = 0; i < count; i++)
+	{
+		if (lines[i].system_no == system_no)
+			return &lines[i];
+	}
+	return NULL;
+}
+
+// Skips spaces and returns the rest of the line without the trailing newline
+static char* rest_of_line(char* p)
+{
+	while (*p == ' ' || *p == '\t')
+		p++;
+	size_t length = strlen(p);
+	while (length > 0 && (p[length - 1] == '\n' || p[length - 1] == '\r'))
+		p[--length] = '\0';
+	return p;
+}
+
+static bool load_config_line(const char* source, int line_no, const char* text)
+{
+	char line[512];
+	strncpy(line, text, sizeof(line) - 1);
+	line[sizeof(line) - 1] = '\0';
+
+	char* p = line;
+	while (*p == ' ' || *p == '\t')
+		p++;
+	if (*p == '\0' || *p == '#' || *p == '\n' || *p == '\r')
+		return true;
+
+	char key[32] = {0};
+	int used = 0;
+	if (sscanf(p, "%31s%n", key, &used) != 1)
+		return true;
+	p += used;
+
+	bool ok = true;
+	uint32 section = 0, sub_section = 0, system_no = 0, axis_flag = 0;
+	double value = 0, step = 0;
+	if (strcmp(key, "data") == 0)
+	{
+		int fields = sscanf(p, "%u %u %u %u %lf %lf", &section, &sub_section, &system_no, &axis_flag, &value, &step);
+		ok = fields >= 5;
+		if (ok)
+		{
+			m70_mutex_lock(&g_model_lock);
+			sim_item_t* item = add_item(section, sub_section, system_no, axis_flag);
+			if (item != NULL)
+			{
+				free(item->text);
+				item->text = NULL;
+				item->value = value;
+				item->step = fields == 6 ? step : 0;
+			}
+			m70_mutex_unlock(&g_model_lock);
+		}
+	}
+	else if (strcmp(key, "text") == 0)
+	{
+		ok = sscanf(p, "%u %u %u %u%n", &section, &sub_section, &system_no, &axis_flag, &used) == 4;
+		if (ok)
+		{
+			char* rest = rest_of_line(p + used);
+			m70_mutex_lock(&g_model_lock);
+			sim_item_t* item = add_item(section, sub_section, system_no, axis_flag);
+			if (item != NULL)
+			{
+				set_item_text(item, rest, (int)strlen(rest));
+				item->step = 0;
+			}
+			m70_mutex_unlock(&g_model_lock);
+		}
+	}
+	else if (strcmp(key, "alarm") == 0 || strcmp(key, "block") == 0)
+	{
+		bool alarm = key[0] == 'a';
+		int32 number = 0;
+		ok = alarm ? sscanf(p, "%u %d%n", &system_no, &number, &used) == 2 : sscanf(p, "%u%n", &system_no, &used) == 1;
+		sim_text_t* entry = NULL;
+		if (ok)
+			entry = alarm ? set_text_line(g_alarms, &g_alarm_count, system_no) : set_text_line(g_blocks, &g_block_count, system_no);
+		if (entry != NULL)
+		{
+			entry->number = number;
+			strncpy(entry->text, rest_of_line(p + used), sizeof(entry->text) - 1);
+		}
+	}
+	else if (strcmp(key, "latency") == 0)
+		ok = sscanf(p, "%u", &g_config.latency_ms) == 1;
+	else if (strcmp(key, "jitter") == 0)
+		ok = sscanf(p, "%u", &g_config.jitter_ms) == 1;
+	else if (strcmp(key, "error_rate") == 0)
+		ok = sscanf(p, "%lf", &g_config.error_rate) == 1;
+	else if (strcmp(key, "error_code") == 0)
+		ok = sscanf(p, "%i", (int*)&g_config.error_code) == 1;
+	else if (strcmp(key, "drop_rate") == 0)
+		ok = sscanf(p, "%lf", &g_config.drop_rate) == 1;
+	else if (strcmp(key, "fs_chunk") == 0)
+		ok = sscanf(p, "%u", &g_config.fs_chunk) == 1 && g_config.fs_chunk > 0;
+	else if (strcmp(key, "fs_root") == 0)
+		strncpy(g_config.fs_root, rest_of_line(p), sizeof(g_config.fs_root) - 1);
+	else if (strcmp(key, "port") == 0)
+		ok = sscanf(p, "%d", &g_config.port) == 1;
+	else if (strcmp(key, "bind") == 0)
+		ok = sscanf(p, "%63s", g_config.bind_ip) == 1;
+	else
+		ok = false;
+
+	if (!ok)
+		fprintf(stderr, "%s:%d: invalid line: %s", source, line_no, text);
+	return ok;
+}
+
+static bool load_config(const char* path)
+{
+	FILE* file = fopen(path, "r");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Cannot open config %s\n", path);
+		return false;
+	}
+
+	char line[512];
+	int line_no = 0;
+	bool ok = true;
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		if (!load_config_line(path, ++line_no, line))
+			ok = false;
+	}
+	fclose(file);
+	return ok;
+}
+
+// Maps a CNC path such as "M01:\PRG\USER\O100" below the file system root, rejecting ".."
+static bool map_path(const byte* name, uint32 length, char* path, size_t size)
+{
+	char local[260];
+	if (length >= sizeof(local))
+		return false;
+	memcpy(local, name, length);
+	local[length] = '\0';
+
+	char* p = strchr(local, ':');
+	p = p != NULL ? p + 1 : local;
+	char* c = NULL;
+	for (c = p; *c != '\0'; c++)
+	{
+		if (*c == '\\')
+			*c = '/';
+	}
+	while (*p == '/')
+		p++;
+
+	const char* segment = p;
+	while (segment != NULL && *segment != '\0')
+	{
+		if (strncmp(segment, "..", 2) == 0 && (segment[2] == '/' || segment[2] == '\0'))
+			return false;
+		segment = strchr(segment, '/');
+		if (segment != NULL)
+			segment++;
+	}
+
+	size_t length_p = strlen(p);
+	while (length_p > 0 && p[length_p - 1] == '/')
+		p[--length_p] = '\0';
+	return snprintf(path, size, "%s/%s", g_config.fs_root, p) < (int)size;
+}
+
+static sim_dir_t* sim_dir_open(const char* path)
+{
+	sim_dir_t* dir = (sim_dir_t*)calloc(1, sizeof(sim_dir_t));
+	if (dir == NULL)
+		return NULL;
+	strncpy(dir->path, path, sizeof(dir->path) - 1);
+
+#ifdef _WIN32
+	char pattern[530];
+	snprintf(pattern, sizeof(pattern), "%s/*", path);
+	dir->find = _findfirst(pattern, &dir->data);
+	dir->pending = dir->find != -1;
+	if (dir->find == -1)
+#else
+	dir->dir = opendir(path);
+	if (dir->dir == NULL)
+#endif
+	{
+		free(dir);
+		return NULL;
+	}
+	return dir;
+}
+
+// Next entry name, skipping "." and ".."; false at the end
+static bool sim_dir_next(sim_dir_t* dir, char* name, size_t size)
+{
+	for (;;)
+	{
+#ifdef _WIN32
+		if (!dir->pending)
+			return false;
+		strncpy(name, dir->data.name, size - 1);
+		dir->pending = _findnext(dir->find, &dir->data) == 0;
+#else
+		struct dirent* entry = readdir(dir->dir);
+		if (entry == NULL)
+			return false;
+		strncpy(name, entry->d_name, size - 1);
+#endif
+		name[size - 1] = '\0';
+		if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0)
+			return true;
+	}
+}
+
+static void sim_dir_close(sim_dir_t* dir)
+{
+#ifdef _WIN32
+	_findclose(dir->find);
+#else
+	closedir(dir->dir);
+#endif
+	free(dir);
+}
+
+static bool out_reserve(sim_client_t* client, int bytes)
+{
+	if (client->out_length + bytes <= client->out_capacity)
+		return true;
+
+	int capacity = client->out_capacity > 0 ? client->out_capacity : 4096;
+	while (capacity < client->out_length + bytes)
+		capacity *= 2;
+	byte* out = (byte*)realloc(client->out, capacity);
+	if (out == NULL)
+		return false;
+	client->out = out;
+	client->out_capacity = capacity;
+	return true;
+}
+
+static void out_put(sim_client_t* client, const void* data, int bytes)
+{
+	if (bytes <= 0 || !out_reserve(client, bytes))
+		return;
+	memcpy(client->out + client->out_length, data, bytes);
+	client->out_length += bytes;
+}
+
+static void out_u32(sim_client_t* client, uint32 value)
+{
+	out_put(client, &value, sizeof(value));
+}
+
+static void reply_begin(sim_client_t* client, uint32 request_id, uint32 is_error)
+{
+	giop_header giop;
+	memcpy(giop.magic_number, "GIOP", 4);
+	giop.version = 1;
+	giop.byte_order = 1;
+	giop.msg_type = MSG_TYPES_Reply;
+	giop.data_length = 0;
+	out_put(client, &giop, sizeof(giop));
+
+	response_pack_header response;
+	response.sc_list = 0;
+	response.request_id = request_id;
+	response.is_error = is_error;
+	out_put(client, &response, sizeof(response));
+}
+
+// Layout read by receive_error_data_response: exception id, then mel_error_code
+static void reply_error(sim_client_t* client, uint32 request_id, uint32 code)
+{
+	reply_begin(client, request_id, 1);
+	out_u32(client, sizeof(M70_SIM_EXCEPTION));
+	out_put(client, M70_SIM_EXCEPTION, sizeof(M70_SIM_EXCEPTION));
+
+	mel_error_code error;
+	memset(&error, 0, sizeof(error));
+	error.error_code = code;
+	out_put(client, &error, sizeof(error));
+}
+
+static void reply_end(sim_client_t* client, int start)
+{
+	uint32 length = (uint32)(client->out_length - start - sizeof(giop_header));
+	memcpy(client->out + start + offsetof(giop_header, data_length), &length, sizeof(length));
+}
+
+static bool parse_request(const byte* body, int length, sim_request_t* request)
+{
+	// request_pack_header up to the object key, then the operation name padded to 4 bytes
+	if (length < 16)
+		return false;
+	request->request_id = get_u32(body + 4);
+	uint32 key_length = get_u32(body + 12);
+	int offset = 16 + (int)((key_length + 3) & ~3u);
+	if (key_length > (uint32)length || offset + 4 > length)
+		return false;
+
+	uint32 op_length = get_u32(body + offset);
+	offset += 4;
+	if (op_length > (uint32)(length - offset))
+		return false;
+	uint32 copy = op_length < sizeof(request->op) ? op_length : (uint32)sizeof(request->op) - 1;
+	memcpy(request->op, body + offset, copy);
+	request->op[copy] = '\0';
+
+	offset += (int)((op_length + 3) & ~3u) + 4; // Operation name and principal
+	if (offset > length)
+		return false;
+	request->args = body + offset;
+	request->args_length = length - offset;
+	return true;
+}
+
+static int data_type_size(uint32 data_type)
+{
+	switch (data_type)
+	{
+	case T_CHAR:
+	case T_UCHAR:
+		return 1;
+	case T_SHORT:
+	case T_USHORT:
+		return 2;
+	case T_DLONG:
+	case T_DOUBLE:
+		return 8;
+	case T_FLOATBIN:
+		return sizeof(float_bin_data);
+	default:
+		return 4;
+	}
+}
+
+static bool is_string_type(uint32 data_type)
+{
+	return data_type >= T_STR && data_type <= T_FloatWStr;
+}
+
+// Current value of an address in the requested type, advancing items with a step
+static void read_value(uint32 section, uint32 sub_section, uint32 system_no, uint32 axis_flag, double* value, char* text, size_t size)
+{
+	m70_mutex_lock(&g_model_lock);
+	sim_item_t* item = find_item(section, sub_section, system_no, axis_flag);
+	*value = 0;
+	text[0] = '\0';
+	if (item != NULL)
+	{
+		*value = item->value;
+		if (item->text != NULL)
+			strncpy(text, item->text, size - 1);
+		else
+			snprintf(text, size, "%.15g", item->value);
+		item->value += item->step;
+	}
+	text[size - 1] = '\0';
+	m70_mutex_unlock(&g_model_lock);
+}
+
+static void out_value(sim_client_t* client, uint32 data_type, double value)
+{
+	int64 integer = (int64)value;
+	switch (data_type)
+	{
+	case T_DOUBLE:
+		out_put(client, &value, sizeof(value));
+		break;
+	case T_FLOATBIN:
+	{
+		float_bin_data data;
+		memset(&data, 0, sizeof(data));
+		data.int_data_nos = 6;
+		data.dec_data_nos = 3;
+		data.data = value;
+		out_put(client, &data, sizeof(data));
+		break;
+	}
+	default:
+		out_put(client, &integer, data_type_size(data_type)); // Little-endian low bytes
+		break;
+	}
+}
+
+static uint32 handle_get_data(sim_client_t* client, const sim_request_t* request)
+{
+	if (request->args_length < 24)
+		return M70_SIM_ERROR_ARGUMENT;
+
+	const byte* args = request->args;
+	uint32 section = get_u32(args);
+	uint32 sub_section = get_u32(args + 4);
+	uint32 system_no = get_u32(args + 8);
+	uint32 axis_flag = get_u32(args + 12);
+	uint32 data_type = get_u32(args + 20);
+	double value = 0;
+	char text[512];
+
+	// Several axis bits: one FLOATBIN record per axis, lowest bit first
+	if (data_type == T_FLOATBIN && (axis_flag & (axis_flag - 1)) != 0)
+	{
+		uint32 count = 0;
+		uint32 bit = 0;
+		for (bit = 1; bit != 0; bit <<= 1)
+		{
+			if (axis_flag & bit)
+				count++;
+		}
+
+		get_data_float_bin_response_header header;
+		memset(&header, 0, sizeof(header));
+		header.data_length = 8 + count * sizeof(float_bin_data);
+		header.data_type = T_FLOATBIN;
+		header.data_count = count;
+		out_put(client, &header, sizeof(header));
+		for (bit = 1; bit != 0; bit <<= 1)
+		{
+			if (axis_flag & bit)
+			{
+				read_value(section, sub_section, system_no, bit, &value, text, sizeof(text));
+				out_value(client, T_FLOATBIN, value);
+			}
+		}
+		return 0;
+	}
+
+	read_value(section, sub_section, system_no, axis_flag, &value, text, sizeof(text));
+	get_data_response_header header;
+	memset(&header, 0, sizeof(header));
+	header.data_type = data_type;
+	if (is_string_type(data_type))
+	{
+		// T_string: length, then the characters
+		int32 length = (int32)strlen(text);
+		header.data_length = 4 + length;
+		out_put(client, &header, sizeof(header));
+		out_put(client, &length, sizeof(length));
+		out_put(client, text, length);
+		return 0;
+	}
+
+	header.data_length = data_type_size(data_type);
+	out_put(client, &header, sizeof(header));
+	out_value(client, data_type, value);
+	return 0;
+}
+
+static uint32 handle_set_data(sim_client_t* client, const sim_request_t* request)
+{
+	if (request->args_length < 28)
+		return M70_SIM_ERROR_ARGUMENT;
+
+	const byte* args = request->args;
+	uint32 data_type = get_u32(args + 20);
+	uint32 byte_numbers = get_u32(args + 24);
+	const byte* data = args + 28;
+	if (byte_numbers > (uint32)(request->args_length - 28))
+		return M70_SIM_ERROR_ARGUMENT;
+
+	m70_mutex_lock(&g_model_lock);
+	sim_item_t* item = add_item(get_u32(args), get_u32(args + 4), get_u32(args + 8), get_u32(args + 12));
+	if (item == NULL)
+	{
+		m70_mutex_unlock(&g_model_lock);
+		return M70_SIM_ERROR_ARGUMENT;
+	}
+
+	item->step = 0;
+	if (is_string_type(data_type))
+	{
+		int32 length = byte_numbers >= 4 ? (int32)get_u32(data) : 0;
+		if (length < 0 || length > (int32)byte_numbers - 4)
+			length = byte_numbers >= 4 ? (int32)byte_numbers - 4 : 0;
+		set_item_text(item, (const char*)data + 4, length);
+	}
+	else
+	{
+		free(item->text);
+		item->text = NULL;
+		if (data_type == T_DOUBLE && byte_numbers >= 8)
+			memcpy(&item->value, data, sizeof(double));
+		else if (data_type == T_FLOATBIN && byte_numbers >= sizeof(float_bin_data))
+			item->value = ((const float_bin_data*)data)->data;
+		else
+		{
+			int64 integer = 0;
+			memcpy(&integer, data, byte_numbers < sizeof(integer) ? byte_numbers : sizeof(integer));
+			int size = data_type_size(data_type);
+			if (size < 8 && (integer & ((int64)1 << (size * 8 - 1))))
+				integer |= -((int64)1 << (size * 8)); // Sign-extend CHAR, SHORT and LONG
+			item->value = (double)integer;
+		}
+	}
+	m70_mutex_unlock(&g_model_lock);
+	(void)client;
+	return 0;
+}
+
+static uint32 handle_alarm_msg(sim_client_t* client, const sim_request_t* request)
+{
+	if (request->args_length < 12)
+		return M70_SIM_ERROR_ARGUMENT;
+
+	// alarm_string: number, length, text
+	const sim_text_t* alarm = get_text_line(g_alarms, g_alarm_count, get_u32(request->args));
+	int32 number = 0;
+	int32 length = 0;
+	if (alarm != NULL && get_u32(request->args + 4) > 0)
+	{
+		number = alarm->number;
+		length = (int32)strlen(alarm->text);
+	}
+	out_put(client, &number, sizeof(number));
+	out_put(client, &length, sizeof(length));
+	if (length > 0)
+		out_put(client, alarm->text, length + 1);
+	return 0;
+}
+
+static uint32 handle_prg_block(sim_client_t* client, const sim_request_t* request)
+{
+	if (request->args_length < 8)
+		return M70_SIM_ERROR_ARGUMENT;
+
+	// prog_block: block, row, unused, length, text
+	const sim_text_t* block = get_text_line(g_blocks, g_block_count, get_u32(request->args));
+	int32 length = block != NULL ? (int32)strlen(block->text) : 0;
+	out_u32(client, 1);
+	out_u32(client, 1);
+	out_u32(client, 0);
+	out_put(client, &length, sizeof(length));
+	if (length > 0)
+		out_put(client, block->text, length + 1);
+	return 0;
+}
+
+static int add_handle(sim_client_t* client, FILE* file, sim_dir_t* dir)
+{
+	int i = 0;
+	for (i = 0; i < M70_SIM_MAX_HANDLES; i++)
+	{
+		if (client->handles[i].file == NULL && client->handles[i].dir == NULL)
+		{
+			client->handles[i].file = file;
+			client->handles[i].dir = dir;
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+static sim_handle_t* get_handle(sim_client_t* client, const byte* p)
+{
+	uint32 handle = get_u32(p);
+	if (handle < 1 || handle > M70_SIM_MAX_HANDLES)
+		return NULL;
+	return &client->handles[handle - 1];
+}
+
+// Path argument: length, then the name
+static bool get_path_arg(const sim_request_t* request, int offset, char* path, size_t size)
+{
+	if (request->args_length < offset + 4)
+		return false;
+	uint32 length = get_u32(request->args + offset);
+	if (length > (uint32)(request->args_length - offset - 4))
+		return false;
+	return map_path(request->args + offset + 4, length, path, size);
+}
+
+static uint32 open_file_reply(sim_client_t* client, const char* path, const char* mode)
+{
+	FILE* file = fopen(path, mode);
+	if (file == NULL)
+		return M70_SIM_ERROR_FILE;
+
+	int handle = add_handle(client, file, NULL);
+	if (handle == 0)
+	{
+		fclose(file);
+		return M70_SIM_ERROR_HANDLE;
+	}
+	out_u32(client, 0);
+	out_u32(client, (uint32)handle);
+	return 0;
+}
+
+static uint32 handle_fs_open(sim_client_t* client, const sim_request_t* request)
+{
+	char path[600];
+	if (request->args_length < 8 || !get_path_arg(request, 8, path, sizeof(path)))
+		return M70_SIM_ERROR_ARGUMENT;
+	return open_file_reply(client, path, get_u32(request->args) == 0 ? "rb" : "r+b");
+}
+
+static uint32 handle_fs_create(sim_client_t* client, const sim_request_t* request)
+{
+	char path[600];
+	if (!get_path_arg(request, 4, path, sizeof(path)))
+		return M70_SIM_ERROR_ARGUMENT;
+	return open_file_reply(client, path, "w+b");
+}
+
+static uint32 handle_fs_read(sim_client_t* client, const sim_request_t* request)
+{
+	if (request->args_length < 8)
+		return M70_SIM_ERROR_ARGUMENT;
+	sim_handle_t* handle = get_handle(client, request->args);
+	if (handle == NULL || handle->file == NULL)
+		return M70_SIM_ERROR_HANDLE;
+
+	uint32 size = get_u32(request->args + 4);
+	if (size > g_config.fs_chunk)
+		size = g_config.fs_chunk;
+
+	// ret and size, then the bytes read straight into the reply
+	int start = client->out_length;
+	out_u32(client, 0);
+	out_u32(client, 0);
+	if (!out_reserve(client, (int)size))
+		return M70_SIM_ERROR_FILE;
+	uint32 count = (uint32)fread(client->out + client->out_length, 1, size, handle->file);
+	client->out_length += (int)count;
+	memcpy(client->out + start + 4, &count, sizeof(count));
+	return 0;
+}
+
+static uint32 handle_fs_write(sim_client_t* client, const sim_request_t* request)
+{
+	if (request->args_length < 8)
+		return M70_SIM_ERROR_ARGUMENT;
+	sim_handle_t* handle = get_handle(client, request->args);
+	if (handle == NULL || handle->file == NULL)
+		return M70_SIM_ERROR_HANDLE;
+
+	uint32 size = get_u32(request->args + 4);
+	if (size > (uint32)(request->args_length - 8))
+		return M70_SIM_ERROR_ARGUMENT;
+
+	uint32 count = (uint32)fwrite(request->args + 8, 1, size, handle->file);
+	if (count != size)
+		return M70_SIM_ERROR_FILE;
+	out_u32(client, 0);
+	out_u32(client, count);
+	return 0;
+}
+
+static uint32 handle_fs_close(sim_client_t* client, const sim_request_t* request)
+{
+	if (request->args_length < 4)
+		return M70_SIM_ERROR_ARGUMENT;
+	sim_handle_t* handle = get_handle(client, request->args);
+	if (handle == NULL || handle->file == NULL)
+		return M70_SIM_ERROR_HANDLE;
+
+	bool ok = fclose(handle->file) == 0;
+	handle->file = NULL;
+	return ok ? 0 : M70_SIM_ERROR_FILE;
+}
+
+static uint32 handle_fs_remove(sim_client_t* client, const sim_request_t* request)
+{
+	char path[600];
+	if (!get_path_arg(request, 0, path, sizeof(path)))
+		return M70_SIM_ERROR_ARGUMENT;
+	(void)client;
+	return remove(path) == 0 ? 0 : M70_SIM_ERROR_FILE;
+}
+
+static uint32 handle_fs_stat(sim_client_t* client, const sim_request_t* request)
+{
+	char path[600];
+	if (!get_path_arg(request, 0, path, sizeof(path)))
+		return M70_SIM_ERROR_ARGUMENT;
+
+	struct stat info;
+	if (stat(path, &info) != 0)
+		return M70_SIM_ERROR_FILE;
+
+	time_t mtime = info.st_mtime;
+	struct tm* tm = localtime(&mtime);
+	file_FS_stat stat_data;
+	memset(&stat_data, 0, sizeof(stat_data));
+	stat_data.mode = (info.st_mode & S_IFMT) == S_IFDIR ? M70_SIM_ATTR_DIRECTORY : 0;
+	stat_data.file_size = (uint32)info.st_size;
+	if (tm != NULL)
+	{
+		stat_data.year = tm->tm_year + 1900 - 1950;
+		stat_data.month = tm->tm_mon + 1;
+		stat_data.day = tm->tm_mday;
+		stat_data.hour = tm->tm_hour;
+		stat_data.minute = tm->tm_min;
+		stat_data.second = tm->tm_sec;
+	}
+
+	FS_stat_file_response_header header;
+	memset(&header, 0, sizeof(header));
+	header.data_length = sizeof(stat_data);
+	out_put(client, &header, sizeof(header));
+	out_put(client, &stat_data, sizeof(stat_data));
+	return 0;
+}
+
+static uint32 handle_fs_open_dir(sim_client_t* client, const sim_request_t* request)
+{
+	char path[600];
+	if (!get_path_arg(request, 0, path, sizeof(path)))
+		return M70_SIM_ERROR_ARGUMENT;
+
+	sim_dir_t* dir = sim_dir_open(path);
+	if (dir == NULL)
+		return M70_SIM_ERROR_FILE;
+
+	int handle = add_handle(client, NULL, dir);
+	if (handle == 0)
+	{
+		sim_dir_close(dir);
+		return M70_SIM_ERROR_HANDLE;
+	}
+	out_u32(client, 0);
+	out_u32(client, (uint32)handle);
+	return 0;
+}
+
+// One entry name per call, sizes and times are read with mochaFSStatFile; an empty reply
+// (data size 0) ends the listing
+static uint32 handle_fs_read_dir(sim_client_t* client, const sim_request_t* request)
+{
+	if (request->args_length < 4)
+		return M70_SIM_ERROR_ARGUMENT;
+	sim_handle_t* handle = get_handle(client, request->args);
+	if (handle == NULL || handle->dir == NULL)
+		return M70_SIM_ERROR_HANDLE;
+
+	char entry[256];
+	int length = 0;
+	if (sim_dir_next(handle->dir, entry, sizeof(entry)))
+		length = (int)strlen(entry) + 1;
+
+	out_u32(client, 0);
+	if (length == 0)
+	{
+		out_u32(client, 0);
+		return 0;
+	}
+	out_u32(client, (uint32)(8 + length));
+	out_u32(client, 0);
+	out_u32(client, (uint32)length);
+	out_put(client, entry, length);
+	return 0;
+}
+
+static uint32 handle_fs_close_dir(sim_client_t* client, const sim_request_t* request)
+{
+	if (request->args_length < 4)
+		return M70_SIM_ERROR_ARGUMENT;
+	sim_handle_t* handle = get_handle(client, request->args);
+	if (handle == NULL || handle->dir == NULL)
+		return M70_SIM_ERROR_HANDLE;
+
+	sim_dir_close(handle->dir);
+	handle->dir = NULL;
+	return 0;
+}
+
+static uint32 handle_cancel_modal(sim_client_t* client, const sim_request_t* request)
+{
+	(void)client;
+	(void)request;
+	return 0;
+}
+
+static const struct
+{
+	const char* op;
+	sim_handler handler;
+} g_handlers[] = {
+	{"mochaGetData", handle_get_data},
+	{"mochaSetData", handle_set_data},
+	{"mochaGetCurrentAlarmMsgFirst", handle_alarm_msg},
+	{"mochaGetCurrentPrgBlockFirst", handle_prg_block},
+	{"mochaFSOpenFile", handle_fs_open},
+	{"mochaFSReadFile", handle_fs_read},
+	{"mochaFSCloseFile", handle_fs_close},
+	{"mochaFSCreateFile", handle_fs_create},
+	{"mochaFSRemoveFile", handle_fs_remove},
+	{"mochaFSWriteFile", handle_fs_write},
+	{"mochaFSStatFile", handle_fs_stat},
+	{"mochaFSOpenDirectory", handle_fs_open_dir},
+	{"mochaFSReadDirectory", handle_fs_read_dir},
+	{"mochaFSCloseDirectory", handle_fs_close_dir},
+	{"mochaCancelModal2", handle_cancel_modal},
+};
+
+static void dispatch(sim_client_t* client, const sim_request_t* request)
+{
+	sim_handler handler = NULL;
+	size_t i = 0;
+	for (i = 0; i < sizeof(g_handlers) / sizeof(g_handlers[0]); i++)
+	{
+		if (strcmp(g_handlers[i].op, request->op) == 0)
+		{
+			handler = g_handlers[i].handler;
+			break;
+		}
+	}
+
+	int start = client->out_length;
+	uint32 code = M70_SIM_ERROR_OPERATION;
+	if (g_config.error_rate > 0 && sim_random(client) < g_config.error_rate)
+	{
+		code = g_config.error_code;
+		client->injected++;
+	}
+	else if (handler != NULL)
+	{
+		reply_begin(client, request->request_id, 0);
+		code = handler(client, request);
+	}
+
+	if (code != 0)
+	{
+		client->out_length = start;
+		reply_error(client, request->request_id, code);
+	}
+	reply_end(client, start);
+
+	if (g_config.verbose)
+		printf("[%d] #%u %s -> 0x%x\n", client->id, request->request_id, request->op, code);
+}
+
+// Size of the complete request frame at the head of the input, 0 while it is incomplete.
+// Bytes before a "GIOP" magic are dropped: FS packets are sent with trailing padding.
+static int next_frame(sim_client_t* client)
+{
+	while (client->in_end - client->in_start >= (int)sizeof(giop_header))
+	{
+		const byte* p = client->in + client->in_start;
+		if (memcmp(p, "GIOP", 4) != 0)
+		{
+			client->in_start++;
+			continue;
+		}
+
+		uint32 length = get_u32(p + offsetof(giop_header, data_length));
+		if (length > M70_SIM_MAX_FRAME)
+			return -1;
+		int frame = (int)(sizeof(giop_header) + length);
+		return client->in_end - client->in_start >= frame ? frame : 0;
+	}
+	return 0;
+}
+
+static bool receive_more(sim_client_t* client)
+{
+	if (client->in_start > 0)
+	{
+		memmove(client->in, client->in + client->in_start, client->in_end - client->in_start);
+		client->in_end -= client->in_start;
+		int i = 0;
+		int kept = 0;
+		for (i = 0; i < client->arrival_count; i++)
+		{
+			if (client->arrival_end[i] - client->in_start <= 0)
+				continue;
+			client->arrival_end[kept] = client->arrival_end[i] - client->in_start;
+			client->arrival_us[kept++] = client->arrival_us[i];
+		}
+		client->arrival_count = kept;
+		client->in_start = 0;
+	}
+
+	if (client->in_end == client->in_capacity)
+	{
+		int capacity = client->in_capacity * 2;
+		if (capacity > (int)(M70_SIM_MAX_FRAME + sizeof(giop_header)) * 2)
+			return false;
+		byte* in = (byte*)realloc(client->in, capacity);
+		if (in == NULL)
+			return false;
+		client->in = in;
+		client->in_capacity = capacity;
+	}
+
+	int count = socket_recv_data_one_loop(client->socket, client->in + client->in_end, client->in_capacity - client->in_end);
+	if (count <= 0)
+		return false;
+	client->in_end += count;
+	if (client->arrival_count == M70_SIM_MAX_ARRIVALS)
+	{
+		// Dropping the oldest makes its bytes look later than they were, never earlier
+		memmove(client->arrival_end, client->arrival_end + 1, sizeof(int) * (M70_SIM_MAX_ARRIVALS - 1));
+		memmove(client->arrival_us, client->arrival_us + 1, sizeof(uint64) * (M70_SIM_MAX_ARRIVALS - 1));
+		client->arrival_count--;
+	}
+	client->arrival_end[client->arrival_count] = client->in_end;
+	client->arrival_us[client->arrival_count++] = get_tick_count_us();
+	return true;
+}
+
+// When the last byte before end was received
+static uint64 arrival_of(const sim_client_t* client, int end)
+{
+	int i = 0;
+	for (i = 0; i < client->arrival_count; i++)
+	{
+		if (client->arrival_end[i] >= end)
+			return client->arrival_us[i];
+	}
+	return get_tick_count_us();
+}
+
+// Sleeps until due while still taking in requests, so those sent meanwhile keep their arrival time
+static bool wait_until(sim_client_t* client, uint64 due)
+{
+	uint64 now = get_tick_count_us();
+	while (now < due)
+	{
+		if (client->in_end - client->in_start >= M70_SIM_MAX_FRAME)
+		{
+			m70_sleep_ms((uint32)((due - now + 999) / 1000));
+			break;
+		}
+
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(client->socket, &readable);
+		struct timeval timeout;
+		timeout.tv_sec = (long)((due - now) / 1000000);
+		timeout.tv_usec = (long)((due - now) % 1000000);
+		int ready = select(client->socket + 1, &readable, NULL, NULL, &timeout);
+		if (ready > 0 && !receive_more(client))
+			return false;
+		if (ready < 0)
+			m70_sleep_ms(1);
+		now = get_tick_count_us();
+	}
+	return true;
+}
+
+static bool flush_replies(sim_client_t* client)
+{
+	if (client->out_length == 0)
+		return true;
+	int length = client->out_length;
+	client->out_length = 0;
+	return socket_send_data(client->socket, client->out, length) == length;
+}
+
+static void client_main(void* arg)
+{
+	sim_client_t* client = (sim_client_t*)arg;
+	bool running = true;
+	while (running)
+	{
+		int frame = next_frame(client);
+		if (frame < 0)
+			break;
+		if (frame == 0)
+		{
+			running = flush_replies(client) && receive_more(client);
+			continue;
+		}
+
+		client->requests++;
+		if (((const giop_header*)(client->in + client->in_start))->msg_type != MSG_TYPES_Request)
+		{
+			client->in_start += frame;
+			continue;
+		}
+
+		// Counted from the arrival, so requests pipelined together wait once and not one after another
+		uint32 delay = g_config.latency_ms;
+		if (g_config.jitter_ms > 0)
+			delay += (uint32)(sim_random(client) * (g_config.jitter_ms + 1));
+		if (delay > 0 && !wait_until(client, arrival_of(client, client->in_start + frame) + (uint64)delay * 1000))
+			break;
+
+		// Waiting may have moved the input
+		const byte* p = client->in + client->in_start;
+		client->in_start += frame;
+
+		if (g_config.drop_rate > 0 && sim_random(client) < g_config.drop_rate)
+		{
+			client->injected++;
+			break;
+		}
+
+		sim_request_t request;
+		memset(&request, 0, sizeof(request));
+		if (!parse_request(p + sizeof(giop_header), frame - (int)sizeof(giop_header), &request))
+			break;
+		dispatch(client, &request);
+
+		// Replies to pipelined requests already buffered go out together
+		if (next_frame(client) == 0 && !flush_replies(client))
+			break;
+	}
+
+	int i = 0;
+	for (i = 0; i < M70_SIM_MAX_HANDLES; i++)
+	{
+		if (client->handles[i].file != NULL)
+			fclose(client->handles[i].file);
+		if (client->handles[i].dir != NULL)
+			sim_dir_close(client->handles[i].dir);
+	}
+	printf("Client %d disconnected: %u requests, %u injected faults\n", client->id, client->requests, client->injected);
+	fflush(stdout);
+	socket_close_tcp_socket(client->socket);
+	m70_atomic_add(&g_client_count, -1);
+	free(client->in);
+	free(client->out);
+	free(client);
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr,
+			"Usage: %s [-p port] [-b address] [-c config] [-r fs_root] [-l latency_ms] [-j jitter_ms]\n"
+			"          [-e error_rate] [-E error_code] [-d drop_rate] [-v]\n",
+			name);
+}
+
+int main(int argc, char** argv)
+{
+	memset(&g_config, 0, sizeof(g_config));
+	strcpy(g_config.bind_ip, "0.0.0.0");
+	strcpy(g_config.fs_root, ".");
+	g_config.port = M70_SIM_DEFAULT_PORT;
+	g_config.fs_chunk = M70_SIM_DEFAULT_FS_CHUNK;
+	g_config.error_code = M70_SIM_ERROR_INJECTED;
+	m70_mutex_init(&g_model_lock);
+
+	int i = 0;
+	for (i = 0; g_default_model[i] != NULL; i++)
+		load_config_line("default", i + 1, g_default_model[i]);
+
+	// The config file is read first so command line options override it
+	for (i = 1; i < argc - 1; i++)
+	{
+		if (strcmp(argv[i], "-c") == 0 && !load_config(argv[i + 1]))
+			return 1;
+	}
+
+	for (i = 1; i < argc; i++)
+	{
+		const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (strcmp(argv[i], "-v") == 0)
+		{
+			g_config.verbose = true;
+			continue;
+		}
+		if (value == NULL || argv[i][0] != '-' || strlen(argv[i]) != 2)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+
+		switch (argv[i][1])
+		{
+		case 'p':
+			g_config.port = atoi(value);
+			break;
+		case 'b':
+			strncpy(g_config.bind_ip, value, sizeof(g_config.bind_ip) - 1);
+			break;
+		case 'c':
+			break;
+		case 'r':
+			strncpy(g_config.fs_root, value, sizeof(g_config.fs_root) - 1);
+			break;
+		case 'l':
+			g_config.latency_ms = (uint32)atoi(value);
+			break;
+		case 'j':
+			g_config.jitter_ms = (uint32)atoi(value);
+			break;
+		case 'e':
+			g_config.error_rate = atof(value);
+			break;
+		case 'E':
+			g_config.error_code = (uint32)strtoul(value, NULL, 0);
+			break;
+		case 'd':
+			g_config.drop_rate = atof(value);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+		i++;
+	}
+
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		return 1;
+#endif
+
+	int listen_fd = socket_open_tcp_server_socket(g_config.bind_ip, (short)g_config.port, 16);
+	if (listen_fd < 0)
+	{
+		fprintf(stderr, "Cannot listen on %s:%d\n", g_config.bind_ip, g_config.port);
+		return 1;
+	}
+
+	printf("m70_sim listening on %s:%d, %d items, fs root %s, latency %u+%u ms, error rate %g, drop rate %g\n",
+		   g_config.bind_ip, g_config.port, g_item_count, g_config.fs_root, g_config.latency_ms, g_config.jitter_ms,
+		   g_config.error_rate, g_config.drop_rate);
+	fflush(stdout);
+
+	int next_id = 0;
+	for (;;)
+	{
+		int fd = socket_accept_tcp_client(listen_fd);
+		if (fd < 0)
+			continue;
+
+		sim_client_t* client = (sim_client_t*)calloc(1, sizeof(sim_client_t));
+		byte* in = (byte*)malloc(M70_RECV_BUFFER_SIZE);
+		if (client == NULL || in == NULL)
+		{
+			free(client);
+			free(in);
+			socket_close_tcp_socket(fd);
+			continue;
+		}
+
+		client->socket = fd;
+		client->id = ++next_id;
+		client->in = in;
+		client->in_capacity = M70_RECV_BUFFER_SIZE;
+		client->random = (uint32)time(NULL) ^ ((uint32)client->id * 2654435761u);
+		if (client->random == 0)
+			client->random = 1;
+
+		// The client frees itself when it disconnects
+		int id = client->id;
+		m70_thread_t thread;
+		m70_atomic_add(&g_client_count, 1);
+		if (!m70_thread_create(&thread, client_main, client))
+		{
+			m70_atomic_add(&g_client_count, -1);
+			socket_close_tcp_socket(fd);
+			free(in);
+			free(client);
+			continue;
+		}
+		m70_thread_detach(thread);
+		printf("Client %d connected, %d active\n", id, m70_atomic_load(&g_client_count));
+		fflush(stdout);
+	}
+}
@@ -0,0 +1,385 @@
+// Regression tests of the client library against a running m70_sim.
+// Usage: m70_simtest [-h host] [-p port] -r sim_fs_root -w work_dir
+// sim_fs_root is the -r directory of the simulator, the tests put controller files there directly
+// and compare them with what the library sent. work_dir holds the local side of transfers.
+// Prints one line per test and exits with the number of failed tests, see "make -C tools test".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "typedef.h"
+#include "m70_ezsocket.h"
+#include "m70_ezsocket_private.h"
+#include "m70_error.h"
+#include "m70_fs.h"
+#include "m70_fs_tree.h"
+#include "m70_fs_sync.h"
+#include "m70_thread.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#pragma warning(disable : 4996)
+#endif
+
+#define TEST_FILE_SIZE 100003 // Several transfer chunks and a short last one
+#define TEST_SYNC_FILES 10
+
+typedef struct _tag_test_config
+{
+	char host[64];
+	int port;
+	char fs_root[200]; // Controller "M01:\" as seen by the simulator
+	char work_dir[200];
+} test_config_t;
+
+typedef bool (*test_fn)(m70_conn_t* conn);
+
+typedef struct _tag_test_case
+{
+	const char* name;
+	test_fn run;
+} test_case_t;
+
+static test_config_t g_config;
+static const char* g_test_name = NULL;
+
+#define TEST_CHECK(cond)                                                        \
+	do                                                                          \
+	{                                                                           \
+		if (!(cond))                                                            \
+		{                                                                       \
+			printf("FAIL %s: line %d: %s\n", g_test_name, __LINE__, #cond);   \
+			return false;                                                       \
+		}                                                                       \
+	} while (0)
+
+static void test_path(char* path, size_t size, const char* dir, const char* name)
+{
+	snprintf(path, size, "%s/%s", dir, name);
+}
+
+static bool write_file(const char* path, const byte* data, size_t size)
+{
+	FILE* file = fopen(path, "wb");
+	if (file == NULL)
+		return false;
+	bool ok = fwrite(data, 1, size, file) == size;
+	return fclose(file) == 0 && ok;
+}
+
+// Reads at most size bytes, returns the count or -1 when the file cannot be opened
+static long read_file(const char* path, byte* data, size_t size)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+		return -1;
+	long count = (long)fread(data, 1, size, file);
+	fclose(file);
+	return count;
+}
+
+static bool write_text(const char* dir, const char* name, const char* text)
+{
+	char path[512];
+	test_path(path, sizeof(path), dir, name);
+	return write_file(path, (const byte*)text, strlen(text));
+}
+
+static void fill_pattern(byte* data, size_t size, uint32 seed)
+{
+	size_t i = 0;
+	for (i = 0; i < size; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		data[i] = (byte)(seed >> 16);
+	}
+}
+
+static bool make_dir(const char* dir, const char* name)
+{
+	char path[512];
+	test_path(path, sizeof(path), dir, name);
+	mkdir(path, 0755);
+	struct stat info;
+	return stat(path, &info) == 0 && (info.st_mode & S_IFMT) == S_IFDIR;
+}
+
+static bool test_batch_read(m70_conn_t* conn)
+{
+	long counter = 0;
+	uint32 power_on_time = 0;
+	T_string version;
+	memset((void*)&version, 0, sizeof(version));
+	m70_batch_item_t items[] = {
+		{.section = 126, .sub_section = 8002, .system_no = 1, .data_type = T_LONG, .value = &counter, .value_size = sizeof(counter)},
+		{.section = 40, .sub_section = 1, .data_type = T_UINT32, .value = &power_on_time, .value_size = sizeof(power_on_time)},
+		{.section = 67, .sub_section = 1, .data_type = T_STR, .value = &version, .value_size = sizeof(version)},
+	};
+	TEST_CHECK(m70_cnc_read_batch(conn, items, 3) == M70_ERROR_CODE_OK);
+	TEST_CHECK(items[0].result == M70_ERROR_CODE_OK && items[1].result == M70_ERROR_CODE_OK && items[2].result == M70_ERROR_CODE_OK);
+	TEST_CHECK(power_on_time >= 360000);
+	TEST_CHECK(strcmp(version.text, "BND-1040W000-A0") == 0);
+
+	// A string slot without a size is refused before anything is sent
+	items[2].value_size = 0;
+	TEST_CHECK(m70_cnc_read_batch(conn, items, 3) == M70_ERROR_CODE_FAILED);
+	return true;
+}
+
+static bool test_snapshot(m70_conn_t* conn)
+{
+	m70_snapshot_t snapshot;
+	TEST_CHECK(m70_cnc_read_snapshot(conn, 1, POS_MCH, &snapshot) == M70_ERROR_CODE_OK);
+	TEST_CHECK(snapshot.axis_count == 3);
+	TEST_CHECK(snapshot.spindle_speed == 1200);
+	TEST_CHECK(snapshot.tool_no == 7);
+	TEST_CHECK(snapshot.feed_speed == 1500.0);
+	TEST_CHECK(snapshot.axis_position[0] >= 110.0 && snapshot.axis_position[0] < 111.0);
+	return true;
+}
+
+static bool test_transfer(m70_conn_t* conn)
+{
+	byte* data = (byte*)malloc(TEST_FILE_SIZE);
+	byte* back = (byte*)malloc(TEST_FILE_SIZE + 1);
+	TEST_CHECK(data != NULL && back != NULL);
+	fill_pattern(data, TEST_FILE_SIZE, 17);
+
+	char remote_copy[512];
+	char local[512];
+	test_path(remote_copy, sizeof(remote_copy), g_config.fs_root, "TRANSFER.NC");
+	test_path(local, sizeof(local), g_config.work_dir, "transfer.nc");
+
+	// Memory to controller and back, then controller to a local file
+	TEST_CHECK(m70_cnc_upload_program_from_memory(conn, "M01:\\TRANSFER.NC", data, TEST_FILE_SIZE, NULL) == M70_ERROR_CODE_OK);
+	TEST_CHECK(read_file(remote_copy, back, TEST_FILE_SIZE + 1) == TEST_FILE_SIZE && memcmp(back, data, TEST_FILE_SIZE) == 0);
+	uint64 length = 0;
+	memset(back, 0, TEST_FILE_SIZE);
+	TEST_CHECK(m70_cnc_download_program_to_memory(conn, "M01:\\TRANSFER.NC", back, TEST_FILE_SIZE, &length, NULL) == M70_ERROR_CODE_OK);
+	TEST_CHECK(length == TEST_FILE_SIZE && memcmp(back, data, TEST_FILE_SIZE) == 0);
+	TEST_CHECK(m70_cnc_download_program_to_file(conn, "M01:\\TRANSFER.NC", local, NULL) == M70_ERROR_CODE_OK);
+	TEST_CHECK(read_file(local, back, TEST_FILE_SIZE + 1) == TEST_FILE_SIZE && memcmp(back, data, TEST_FILE_SIZE) == 0);
+
+	// A local file goes up through its mapping
+	fill_pattern(data, TEST_FILE_SIZE, 29);
+	TEST_CHECK(write_file(local, data, TEST_FILE_SIZE));
+	TEST_CHECK(m70_cnc_upload_program_from_file(conn, "M01:\\TRANSFER.NC", local, NULL) == M70_ERROR_CODE_OK);
+	TEST_CHECK(read_file(remote_copy, back, TEST_FILE_SIZE + 1) == TEST_FILE_SIZE && memcmp(back, data, TEST_FILE_SIZE) == 0);
+
+	// A file larger than the buffer is reported, not cut short
+	length = 0;
+	TEST_CHECK(m70_cnc_download_program_to_memory(conn, "M01:\\TRANSFER.NC", back, TEST_FILE_SIZE - 1, &length, NULL) == M70_ERROR_CODE_FAILED);
+	TEST_CHECK(length <= TEST_FILE_SIZE - 1);
+
+	free(data);
+	free(back);
+	return true;
+}
+
+static bool test_transfer_missing(m70_conn_t* conn)
+{
+	char local[512];
+	byte back[64];
+	test_path(local, sizeof(local), g_config.work_dir, "keep.nc");
+	TEST_CHECK(write_text(g_config.work_dir, "keep.nc", "KEEP ME"));
+
+	// Neither a missing remote file nor a missing local source may touch the other side
+	TEST_CHECK(m70_cnc_download_program_to_file(conn, "M01:\\NO_SUCH.NC", local, NULL) == M70_ERROR_CODE_FAILED);
+	TEST_CHECK(read_file(local, back, sizeof(back)) == 7 && memcmp(back, "KEEP ME", 7) == 0);
+	strcat(local, M70_FS_PART_SUFFIX);
+	TEST_CHECK(read_file(local, back, sizeof(back)) == -1);
+
+	char missing[512];
+	test_path(missing, sizeof(missing), g_config.work_dir, "no_such.nc");
+	TEST_CHECK(m70_cnc_upload_program_from_file(conn, "M01:\\UNTOUCHED.NC", missing, NULL) == M70_ERROR_CODE_FAILED);
+	char remote_copy[512];
+	test_path(remote_copy, sizeof(remote_copy), g_config.fs_root, "UNTOUCHED.NC");
+	TEST_CHECK(read_file(remote_copy, back, sizeof(back)) == -1);
+	TEST_CHECK(m70_cnc_upload_program_from_memory(conn, "M01:\\NO_DIR\\X.NC", back, 4, NULL) == M70_ERROR_CODE_FAILED);
+	return true;
+}
+
+static bool test_tree(m70_conn_t* conn)
+{
+	char dir[512];
+	test_path(dir, sizeof(dir), g_config.fs_root, "TREE");
+	TEST_CHECK(make_dir(g_config.fs_root, "TREE") && make_dir(dir, "A"));
+	TEST_CHECK(write_text(dir, "ONE.NC", "G00 X0") && write_text(dir, "A/TWO.NC", "G01 X10. Y20."));
+
+	m70_fs_tree_t* tree = m70_fs_tree_create("M01:\\TREE");
+	TEST_CHECK(tree != NULL);
+	TEST_CHECK(m70_fs_tree_build(conn, tree) == M70_ERROR_CODE_OK);
+	TEST_CHECK(tree->count == 2 && tree->listed == 2);
+	const m70_fs_entry_t* entry = m70_fs_tree_find(tree, "M01:\\TREE\\A\\TWO.NC");
+	TEST_CHECK(entry != NULL && !entry->is_dir && entry->size == 13 && entry->mtime > 20000101000000ULL);
+	entry = m70_fs_tree_find(tree, "M01:\\TREE\\A");
+	TEST_CHECK(entry != NULL && entry->is_dir);
+
+	// Nothing changed, so nothing is listed again
+	TEST_CHECK(m70_fs_tree_refresh(conn, tree) == M70_ERROR_CODE_OK);
+	TEST_CHECK(tree->listed == 0);
+
+	// Directory times have a resolution of one second
+	m70_sleep_ms(1100);
+	char sub[512];
+	test_path(sub, sizeof(sub), dir, "A");
+	TEST_CHECK(make_dir(sub, "B") && write_text(sub, "B/THREE.NC", "M30"));
+	TEST_CHECK(m70_fs_tree_refresh(conn, tree) == M70_ERROR_CODE_OK);
+	TEST_CHECK(tree->count == 3);
+	entry = m70_fs_tree_find(tree, "M01:\\TREE\\A\\B\\THREE.NC");
+	TEST_CHECK(entry != NULL && entry->size == 3);
+
+	m70_fs_tree_destroy(tree);
+	return true;
+}
+
+static bool sync_once(m70_conn_t* conn, const char* local_dir, m70_fs_tree_t* tree, m70_fs_sync_result_t* result)
+{
+	m70_fs_sync_options_t options;
+	memset((void*)&options, 0, sizeof(options));
+	options.delete_extra = true;
+	options.tree = tree;
+	return m70_cnc_sync_programs(conn, local_dir, "M01:\\SYNC", &options, result) == M70_ERROR_CODE_OK;
+}
+
+static bool test_sync(m70_conn_t* conn)
+{
+	char local_dir[512];
+	test_path(local_dir, sizeof(local_dir), g_config.work_dir, "sync");
+	TEST_CHECK(make_dir(g_config.work_dir, "sync") && make_dir(g_config.fs_root, "SYNC"));
+	int i = 0;
+	for (i = 0; i < TEST_SYNC_FILES; i++)
+	{
+		char name[32];
+		char text[64];
+		snprintf(name, sizeof(name), "P%d.NC", i + 1);
+		snprintf(text, sizeof(text), "N%d G01 X%d.\n", i + 1, i * 10);
+		TEST_CHECK(write_text(local_dir, name, text));
+	}
+	byte* big = (byte*)malloc(TEST_FILE_SIZE);
+	TEST_CHECK(big != NULL);
+	fill_pattern(big, TEST_FILE_SIZE, 41);
+	char path[512];
+	test_path(path, sizeof(path), local_dir, "BIG.NC");
+	TEST_CHECK(write_file(path, big, TEST_FILE_SIZE));
+	free(big);
+
+	m70_fs_tree_t* tree = m70_fs_tree_create("M01:\\SYNC");
+	TEST_CHECK(tree != NULL);
+	m70_fs_sync_result_t result;
+	TEST_CHECK(sync_once(conn, local_dir, tree, &result));
+	TEST_CHECK(result.uploaded == TEST_SYNC_FILES + 1 && result.failed == 0);
+
+	// The cached index must know what was just sent
+	TEST_CHECK(sync_once(conn, local_dir, tree, &result));
+	TEST_CHECK(result.uploaded == 0 && result.skipped == TEST_SYNC_FILES + 1);
+
+	// One change goes out once; later syncs leave it alone
+	m70_sleep_ms(1100);
+	TEST_CHECK(write_text(local_dir, "P3.NC", "N3 G01 X25. Y5.\n"));
+	TEST_CHECK(sync_once(conn, local_dir, tree, &result));
+	TEST_CHECK(result.uploaded == 1);
+	TEST_CHECK(sync_once(conn, local_dir, tree, &result));
+	TEST_CHECK(result.uploaded == 0);
+	byte back[64];
+	test_path(path, sizeof(path), g_config.fs_root, "SYNC/P3.NC");
+	TEST_CHECK(read_file(path, back, sizeof(back)) == 16 && memcmp(back, "N3 G01 X25. Y5.\n", 16) == 0);
+
+	// A file deleted locally is removed once
+	test_path(path, sizeof(path), local_dir, "P5.NC");
+	TEST_CHECK(remove(path) == 0);
+	TEST_CHECK(sync_once(conn, local_dir, tree, &result));
+	TEST_CHECK(result.removed == 1 && result.failed == 0);
+	TEST_CHECK(sync_once(conn, local_dir, tree, &result));
+	TEST_CHECK(result.removed == 0 && result.uploaded == 0 && result.failed == 0);
+	test_path(path, sizeof(path), g_config.fs_root, "SYNC/P5.NC");
+	TEST_CHECK(read_file(path, back, sizeof(back)) == -1);
+
+	m70_fs_tree_destroy(tree);
+	return true;
+}
+
+static const test_case_t g_tests[] = {
+	{"batch_read", test_batch_read},
+	{"snapshot", test_snapshot},
+	{"transfer", test_transfer},
+	{"transfer_missing", test_transfer_missing},
+	{"tree", test_tree},
+	{"sync", test_sync},
+};
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [-h host] [-p port] -r sim_fs_root -w work_dir\n", name);
+}
+
+int main(int argc, char** argv)
+{
+	memset(&g_config, 0, sizeof(g_config));
+	strcpy(g_config.host, "127.0.0.1");
+	g_config.port = 683;
+
+	int i = 0;
+	for (i = 1; i + 1 < argc; i += 2)
+	{
+		const char* value = argv[i + 1];
+		if (argv[i][0] != '-' || strlen(argv[i]) != 2)
+			break;
+		switch (argv[i][1])
+		{
+		case 'h':
+			strncpy(g_config.host, value, sizeof(g_config.host) - 1);
+			break;
+		case 'p':
+			g_config.port = atoi(value);
+			break;
+		case 'r':
+			strncpy(g_config.fs_root, value, sizeof(g_config.fs_root) - 1);
+			break;
+		case 'w':
+			strncpy(g_config.work_dir, value, sizeof(g_config.work_dir) - 1);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (i < argc || g_config.fs_root[0] == '\0' || g_config.work_dir[0] == '\0')
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		return 1;
+#endif
+
+	// Every test gets a fresh connection, so one that fails midway cannot break the next
+	int failed = 0;
+	size_t t = 0;
+	for (t = 0; t < sizeof(g_tests) / sizeof(g_tests[0]); t++)
+	{
+		m70_conn_t conn;
+		memset((void*)&conn, 0, sizeof(conn));
+		g_test_name = g_tests[t].name;
+		if (!m70_cnc_connect(g_config.host, g_config.port, EZNC_SYS_MELDAS700M, &conn))
+		{
+			printf("FAIL %s: cannot connect to %s:%d\n", g_test_name, g_config.host, g_config.port);
+			failed++;
+			continue;
+		}
+		if (g_tests[t].run(&conn))
+			printf("ok   %s\n", g_test_name);
+		else
+			failed++;
+		m70_cnc_disconnect(&conn);
+	}
+
+	printf("%d of %d tests failed\n", failed, (int)(sizeof(g_tests) / sizeof(g_tests[0])));
+	return failed;
+}